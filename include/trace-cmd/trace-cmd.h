@@ -91,6 +91,7 @@ enum {
 	TRACECMD_FL_BUFFER_INSTANCE	= (1 << 1),
 	TRACECMD_FL_LATENCY		= (1 << 2),
 	TRACECMD_FL_IN_USECS		= (1 << 3),
+	TRACECMD_FL_QUIET		= (1 << 4),
 };
 
 struct tracecmd_ftrace {
@@ -122,6 +123,10 @@ int tracecmd_get_parsing_failures(struct tracecmd_input *handle);
 int tracecmd_long_size(struct tracecmd_input *handle);
 int tracecmd_page_size(struct tracecmd_input *handle);
 int tracecmd_cpus(struct tracecmd_input *handle);
+unsigned long long tracecmd_cpu_data_offset(struct tracecmd_input *handle,
+					    int cpu);
+unsigned long long tracecmd_cpu_data_size(struct tracecmd_input *handle,
+					  int cpu);
 int tracecmd_copy_headers(struct tracecmd_input *handle, int fd);
 void tracecmd_set_flag(struct tracecmd_input *handle, int flag);
 void tracecmd_clear_flag(struct tracecmd_input *handle, int flag);
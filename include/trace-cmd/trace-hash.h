@@ -6,16 +6,32 @@
 #ifndef _TRACE_HASH_H
 #define _TRACE_HASH_H
 
+struct trace_hash;
+
 struct trace_hash_item {
 	struct trace_hash_item	*next;
 	struct trace_hash_item	*prev;
 	unsigned long long	key;
+	struct trace_hash	*hash;
 };
 
+/*
+ * The number of buckets is doubled when there are more items than
+ * buckets. The items are moved to the new buckets a few buckets at a
+ * time by the following additions, hence while resizing, some of the
+ * items are still in the old buckets.
+ */
 struct trace_hash {
 	struct trace_hash_item	**buckets;
 	int			nr_buckets;
-	int			power;
+	int			bits;
+	unsigned long long	nr_items;
+
+	/* The buckets that are being moved, if resizing */
+	struct trace_hash_item	**old_buckets;
+	int			nr_old_buckets;
+	int			old_bits;
+	int			migrate;
 };
 
 int trace_hash_init(struct trace_hash *hash, int buckets);
@@ -30,11 +46,39 @@ static inline void trace_hash_del(struct trace_hash_item *item)
 	prev->next = item->next;
 	if (item->next)
 		item->next->prev = prev;
+
+	if (item->hash)
+		item->hash->nr_items--;
+	item->hash = NULL;
+}
+
+static inline struct trace_hash_item **
+trace_hash_first_bucket(struct trace_hash *hash)
+{
+	return hash->buckets;
+}
+
+/* Walk the new buckets first, then the old ones that were not moved yet */
+static inline struct trace_hash_item **
+trace_hash_next_bucket(struct trace_hash *hash, struct trace_hash_item **bucket)
+{
+	bucket++;
+	if (bucket == hash->buckets + hash->nr_buckets) {
+		if (!hash->old_buckets)
+			return NULL;
+		bucket = hash->old_buckets + hash->migrate;
+	}
+	if (hash->old_buckets &&
+	    bucket == hash->old_buckets + hash->nr_old_buckets)
+		return NULL;
+
+	return bucket;
 }
 
+/* Do not add items to the hash while walking it */
 #define trace_hash_for_each_bucket(bucket, hash)			\
-	for (bucket = (hash)->buckets;					\
-	     (bucket) < (hash)->buckets + (hash)->nr_buckets; (bucket)++)
+	for (bucket = trace_hash_first_bucket(hash); bucket;		\
+	     bucket = trace_hash_next_bucket(hash, bucket))
 
 #define trace_hash_for_each_item(item, bucket)				\
 	for ((item = *(bucket)); item; item = (item)->next)
@@ -140,11 +140,18 @@ struct tep_format_field {
 	unsigned long		flags;
 };
 
+struct tep_field_hash {
+	struct tep_format_field	**fields;
+	unsigned int		mask;
+};
+
 struct tep_format {
 	int			nr_common;
 	int			nr_fields;
 	struct tep_format_field	*common_fields;
 	struct tep_format_field	*fields;
+	struct tep_field_hash	common_hash;
+	struct tep_field_hash	fields_hash;
 };
 
 struct tep_print_arg_atom {
@@ -273,6 +280,9 @@ struct tep_event {
 	char			*system;
 	tep_event_handler_func	handler;
 	void			*context;
+	/* The rest of the format, until it is parsed (see tep_parse_event_lazy()) */
+	char			*lazy_format;
+	unsigned long		lazy_size;
 };
 
 enum {
@@ -321,6 +331,7 @@ enum tep_flag {
 	TEP_NSEC_OUTPUT		= 1,	/* output in NSECS */
 	TEP_DISABLE_SYS_PLUGINS	= 1 << 1,
 	TEP_DISABLE_PLUGINS	= 1 << 2,
+	TEP_QUIET		= 1 << 3,	/* no warnings while parsing */
 };
 
 #define TEP_ERRORS 							      \
@@ -457,6 +468,9 @@ enum tep_errno tep_parse_format(struct tep_handle *tep,
 				struct tep_event **eventp,
 				const char *buf,
 				unsigned long size, const char *sys);
+enum tep_errno tep_parse_event_lazy(struct tep_handle *tep, const char *buf,
+				    unsigned long size, const char *sys);
+void tep_parse_lazy_events(struct tep_handle *tep);
 
 void *tep_get_field_raw(struct trace_seq *s, struct tep_event *event,
 			const char *name, struct tep_record *record,
@@ -524,6 +538,7 @@ int tep_data_pid(struct tep_handle *tep, struct tep_record *rec);
 int tep_data_preempt_count(struct tep_handle *tep, struct tep_record *rec);
 int tep_data_flags(struct tep_handle *tep, struct tep_record *rec);
 const char *tep_data_comm_from_pid(struct tep_handle *tep, int pid);
+const char *tep_data_comm_history(struct tep_handle *tep, int pid, int idx);
 struct tep_cmdline;
 struct tep_cmdline *tep_data_pid_from_comm(struct tep_handle *tep, const char *comm,
 					   struct tep_cmdline *next);
@@ -579,6 +594,7 @@ unsigned long long tep_get_input_buf_ptr(void);
 /* for debugging */
 void tep_print_funcs(struct tep_handle *tep);
 void tep_print_printk(struct tep_handle *tep);
+int tep_init_lookup_maps(struct tep_handle *tep);
 
 /* ----------------------- filtering ----------------------- */
 
@@ -125,10 +125,12 @@ void play()
 		/* Clear the screen. */
 		glClear(GL_COLOR_BUFFER_BIT);
 
-		/* Draw all graphs. */
+		/* Draw all graphs, using a single batch. */
+		ksplot_batch_begin();
 		for (auto &g: graphs)
 			g->draw();
 
+		ksplot_batch_flush();
 		glFlush();
 
 		if (!(i % 250))
@@ -84,6 +84,7 @@ bool KsGraphMark::set(const KsDataStore &data,
 	_isSet = true;
 	_pos = pos;
 	_ts = data.rows()[_pos]->ts;
+	_offset = data.rows()[_pos]->offset;
 	visFlags = data.rows()[_pos]->visible;
 
 	if ((visFlags & KS_TEXT_VIEW_FILTER_MASK) &&
@@ -119,9 +120,42 @@ bool KsGraphMark::update(const KsDataStore &data, kshark_trace_histo *histo)
 	if (!_isSet)
 		return false;
 
+	if (data.chunks() && !remap(data)) {
+		/* The entry is outside of the current time-window. */
+		_bin = -1;
+		_mark._visible = false;
+		return false;
+	}
+
 	return set(data, histo, this->_pos, this->_cpu, this->_task);
 }
 
+/**
+ * @brief In out-of-core mode the data array changes together with the
+ *	  time-window of the model. Use this function to find the new index
+ *	  of the entry this marker points to.
+ *
+ * @param data: Input location for the Data Store object.
+ *
+ * @returns True if the entry is inside the current data array. Otherwise
+ *	    False.
+ */
+bool KsGraphMark::remap(const KsDataStore &data)
+{
+	ssize_t row;
+
+	if (!_isSet)
+		return false;
+
+	row = data.findRow(_ts, _offset);
+	if (row < 0)
+		return false;
+
+	_pos = row;
+
+	return true;
+}
+
 /** Unset the Marker and make it invisible. */
 void KsGraphMark::remove()
 {
@@ -72,6 +72,8 @@ public:
 
 	bool update(const KsDataStore &data, kshark_trace_histo *histo);
 
+	bool remap(const KsDataStore &data);
+
 	/** Is this marker visible. */
 	bool isVisible() const {return _mark._visible;}
 
@@ -102,6 +104,9 @@ public:
 	/** The timestamp of the marker. */
 	uint64_t	_ts;
 
+	/** The offset into the trace file of the entry this marker points to. */
+	uint64_t	_offset;
+
 	/** The RGB color of the marker. */
 	QColor		_color;
 
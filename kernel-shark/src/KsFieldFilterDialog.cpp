@@ -0,0 +1,251 @@
+// SPDX-License-Identifier: LGPL-2.1
+
+/*
+ * Copyright (C) 2017 VMware Inc, Yordan Karadzhov <ykaradzhov@vmware.com>
+ */
+
+/**
+ *  @file    KsFieldFilterDialog.cpp
+ *  @brief   GUI Dialog for filtering by the value of a numeric event field.
+ */
+
+// C++
+#include <limits>
+
+// KernelShark
+#include "KsFieldFilterDialog.hpp"
+#include "libkshark.h"
+#include "KsUtils.hpp"
+
+/** Create dialog for filtering by the value of a numeric event field. */
+KsFieldFilterDialog::KsFieldFilterDialog(QWidget *parent)
+: QDialog(parent),
+  _eventToolBar(this),
+  _fieldToolBar(this),
+  _rangeToolBar(this),
+  _sysEvLabel("System/Event: ", &_eventToolBar),
+  _fieldLabel("Field: ", &_fieldToolBar),
+  _minLabel("Min: ", &_rangeToolBar),
+  _maxLabel("  Max: ", &_rangeToolBar),
+  _systemComboBox(&_eventToolBar),
+  _eventComboBox(&_eventToolBar),
+  _fieldComboBox(&_fieldToolBar),
+  _minEdit(&_rangeToolBar),
+  _maxEdit(&_rangeToolBar),
+  _applyButton("Apply", this),
+  _cancelButton("Cancel", this)
+{
+	struct kshark_context *kshark_ctx(NULL);
+	int buttonWidth;
+
+	if (!kshark_instance(&kshark_ctx))
+		return;
+
+	setMinimumWidth(FONT_WIDTH * 60);
+
+	_eventToolBar.addWidget(&_sysEvLabel);
+	_eventToolBar.addWidget(&_systemComboBox);
+	_eventToolBar.addWidget(&_eventComboBox);
+	_topLayout.addWidget(&_eventToolBar);
+
+	_fieldToolBar.addWidget(&_fieldLabel);
+	_fieldToolBar.addWidget(&_fieldComboBox);
+	_topLayout.addWidget(&_fieldToolBar);
+
+	/*
+	 * Using the old Signal-Slot syntax because QComboBox::currentIndexChanged
+	 * has overloads.
+	 */
+	connect(&_systemComboBox,	SIGNAL(currentIndexChanged(const QString&)),
+		this,			SLOT(_systemChanged(const QString&)));
+
+	connect(&_eventComboBox,	SIGNAL(currentIndexChanged(const QString&)),
+		this,			SLOT(_eventChanged(const QString&)));
+
+	_setSystemCombo(kshark_ctx);
+
+	/* An empty bound means that the range is not limited from this side. */
+	_minEdit.setPlaceholderText("no limit");
+	_maxEdit.setPlaceholderText("no limit");
+	_minEdit.setMinimumWidth(20 * FONT_WIDTH);
+	_maxEdit.setMinimumWidth(20 * FONT_WIDTH);
+
+	_rangeToolBar.addWidget(&_minLabel);
+	_rangeToolBar.addWidget(&_minEdit);
+	_rangeToolBar.addWidget(&_maxLabel);
+	_rangeToolBar.addWidget(&_maxEdit);
+	_topLayout.addWidget(&_rangeToolBar);
+
+	this->setLayout(&_topLayout);
+
+	buttonWidth = STRING_WIDTH("--Cancel--");
+	_applyButton.setFixedWidth(buttonWidth);
+	_applyButton.setDefault(true);
+	_cancelButton.setFixedWidth(buttonWidth);
+	_buttonLayout.addWidget(&_applyButton);
+	_buttonLayout.addWidget(&_cancelButton);
+	_buttonLayout.setAlignment(Qt::AlignLeft);
+	_topLayout.addLayout(&_buttonLayout);
+
+	connect(&_applyButton,		&QPushButton::pressed,
+		this,			&KsFieldFilterDialog::_applyPress);
+
+	connect(&_cancelButton,		&QPushButton::pressed,
+		this,			&QWidget::close);
+}
+
+void KsFieldFilterDialog::_setSystemCombo(struct kshark_context *kshark_ctx)
+{
+	QStringList sysList;
+	tep_event **events;
+	int i(0), nEvts(0);
+
+	if (kshark_ctx->pevent) {
+		nEvts = tep_get_events_count(kshark_ctx->pevent);
+		events = tep_list_events(kshark_ctx->pevent,
+					 TEP_EVENT_SORT_SYSTEM);
+	}
+
+	while (i < nEvts) {
+		QString sysName(events[i]->system);
+		sysList << sysName;
+		while (sysName == events[i]->system) {
+			if (++i == nEvts)
+				break;
+		}
+	}
+
+	qSort(sysList);
+	_systemComboBox.addItems(sysList);
+
+	i = _systemComboBox.findText("sched");
+	if (i >= 0)
+		_systemComboBox.setCurrentIndex(i);
+}
+
+void KsFieldFilterDialog::_systemChanged(const QString &sysName)
+{
+	kshark_context *kshark_ctx(NULL);
+	QStringList evtsList;
+	tep_event **events;
+	int i, nEvts;
+
+	_eventComboBox.clear();
+	if (!kshark_instance(&kshark_ctx) || !kshark_ctx->pevent)
+		return;
+
+	nEvts = tep_get_events_count(kshark_ctx->pevent);
+	events = tep_list_events(kshark_ctx->pevent, TEP_EVENT_SORT_SYSTEM);
+
+	for (i = 0; i < nEvts; ++i) {
+		if (sysName == events[i]->system)
+			evtsList << events[i]->name;
+	}
+
+	qSort(evtsList);
+	_eventComboBox.addItems(evtsList);
+}
+
+/*
+ * Only the integer fields can be filtered. These are the fields,
+ * kshark_get_field_column() is able to extract.
+ */
+QStringList
+KsFieldFilterDialog::_getNumericFields(struct tep_event *event)
+{
+	tep_format_field *field, **fields = tep_event_fields(event);
+	QStringList fieldList;
+
+	for (field = *fields; field; field = field->next) {
+		if (field->flags & (TEP_FIELD_IS_ARRAY |
+				    TEP_FIELD_IS_STRING |
+				    TEP_FIELD_IS_DYNAMIC) ||
+		    field->size > 8)
+			continue;
+
+		fieldList << field->name;
+	}
+
+	free(fields);
+
+	qSort(fieldList);
+	return fieldList;
+}
+
+struct tep_event *KsFieldFilterDialog::_currentEvent()
+{
+	kshark_context *kshark_ctx(NULL);
+
+	if (!kshark_instance(&kshark_ctx) || !kshark_ctx->pevent)
+		return nullptr;
+
+	return tep_find_event_by_name(kshark_ctx->pevent,
+				      _systemComboBox.currentText().toStdString().c_str(),
+				      _eventComboBox.currentText().toStdString().c_str());
+}
+
+void KsFieldFilterDialog::_eventChanged(const QString &evtName)
+{
+	struct tep_event *event;
+
+	_fieldComboBox.clear();
+	if (evtName.isEmpty())
+		return;
+
+	event = _currentEvent();
+	if (event)
+		_fieldComboBox.addItems(_getNumericFields(event));
+}
+
+void KsFieldFilterDialog::_applyPress()
+{
+	QString field = _fieldComboBox.currentText();
+	tep_format_field *format;
+	struct tep_event *event;
+	bool okMin(true), okMax(true);
+	qint64 min, max;
+
+	event = _currentEvent();
+	if (!event || field.isEmpty())
+		return;
+
+	format = tep_find_any_field(event, field.toStdString().c_str());
+	if (!format)
+		return;
+
+	/*
+	 * The bounds of an unsigned field are passed as the bits of an
+	 * unsigned value.
+	 */
+	if (format->flags & TEP_FIELD_IS_SIGNED) {
+		min = _minEdit.text().isEmpty() ?
+		      std::numeric_limits<qint64>::min() :
+		      _minEdit.text().toLongLong(&okMin, 0);
+
+		max = _maxEdit.text().isEmpty() ?
+		      std::numeric_limits<qint64>::max() :
+		      _maxEdit.text().toLongLong(&okMax, 0);
+	} else {
+		min = _minEdit.text().isEmpty() ? 0 :
+		      _minEdit.text().toULongLong(&okMin, 0);
+
+		max = _maxEdit.text().isEmpty() ?
+		      std::numeric_limits<quint64>::max() :
+		      _maxEdit.text().toULongLong(&okMax, 0);
+	}
+
+	if (!okMin || !okMax) {
+		QErrorMessage *em = new QErrorMessage(this);
+		QString text("Invalid range of the field ");
+
+		text += field;
+		em->showMessage(text, "fieldFilter");
+		qCritical() << "ERROR: " << text;
+
+		return;
+	}
+
+	emit apply(event->id, field, min, max);
+
+	close();
+}
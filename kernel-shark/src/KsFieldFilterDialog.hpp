@@ -0,0 +1,64 @@
+/* SPDX-License-Identifier: LGPL-2.1 */
+
+/*
+ * Copyright (C) 2017 VMware Inc, Yordan Karadzhov <ykaradzhov@vmware.com>
+ */
+
+/**
+ *  @file    KsFieldFilterDialog.hpp
+ *  @brief   GUI Dialog for filtering by the value of a numeric event field.
+ */
+
+#ifndef _KS_FIELD_FILTER_DIALOG_H
+#define _KS_FIELD_FILTER_DIALOG_H
+
+// Qt
+#include <QtWidgets>
+
+// KernelShark
+#include "KsWidgetsLib.hpp"
+
+/**
+ * The KsFieldFilterDialog class provides a dialog for filtering the entries
+ * of a trace event by the range of values of one of its numeric fields.
+ */
+class KsFieldFilterDialog : public QDialog
+{
+	Q_OBJECT
+public:
+	explicit KsFieldFilterDialog(QWidget *parent = nullptr);
+
+signals:
+	/** Signal emitted when the _apply button of the dialog is pressed. */
+	void apply(int eventId, const QString &field, qint64 min, qint64 max);
+
+private:
+	QVBoxLayout	_topLayout;
+
+	QHBoxLayout	_buttonLayout;
+
+	QToolBar	_eventToolBar, _fieldToolBar, _rangeToolBar;
+
+	QLabel		_sysEvLabel, _fieldLabel, _minLabel, _maxLabel;
+
+	QComboBox	_systemComboBox, _eventComboBox, _fieldComboBox;
+
+	QLineEdit	_minEdit, _maxEdit;
+
+	QPushButton	_applyButton, _cancelButton;
+
+	void _applyPress();
+
+	struct tep_event *_currentEvent();
+
+	QStringList _getNumericFields(struct tep_event *event);
+
+	void _setSystemCombo(struct kshark_context *kshark_ctx);
+
+private slots:
+	void _systemChanged(const QString&);
+
+	void _eventChanged(const QString&);
+};
+
+#endif // _KS_FIELD_FILTER_DIALOG_H
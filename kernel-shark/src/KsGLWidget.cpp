@@ -19,6 +19,9 @@
 #include "KsPlugins.hpp"
 #include "KsDualMarker.hpp"
 
+/** The size of the margin data of the Task collections. */
+#define KS_TASK_COLLECTION_MARGIN	25
+
 /** Create a default (empty) OpenGL widget. */
 KsGLWidget::KsGLWidget(QWidget *parent)
 : QOpenGLWidget(parent),
@@ -29,10 +32,18 @@ KsGLWidget::KsGLWidget(QWidget *parent)
   _data(nullptr),
   _rubberBand(QRubberBand::Rectangle, this),
   _rubberBandOrigin(0, 0),
-  _dpr(1)
+  _dpr(1),
+  _sceneValid(false)
 {
 	setMouseTracking(true);
 
+	/*
+	 * Any change of the model invalidates the cached graphs and plugin
+	 * shapes.
+	 */
+	connect(&_model,	&QAbstractItemModel::modelReset,
+		this,		[this] () {_sceneValid = false;});
+
 	/*
 	 * Using the old Signal-Slot syntax because QWidget::update has
 	 * overloads.
@@ -44,6 +55,8 @@ KsGLWidget::~KsGLWidget()
 {
 	for (auto &g: _graphs)
 		delete g;
+
+	_freeShapes();
 }
 
 /** Reimplemented function used to set up all required OpenGL resources. */
@@ -60,6 +73,7 @@ void KsGLWidget::initializeGL()
 void KsGLWidget::resizeGL(int w, int h)
 {
 	ksplot_resize_opengl(w, h);
+	_sceneValid = false;
 	if(!_data)
 		return;
 
@@ -91,26 +105,45 @@ void KsGLWidget::paintGL()
 	if (isEmpty())
 		return;
 
+	/*
+	 * Collect the primitives of the frame and draw them with a few
+	 * batched calls. The batch groups the primitives by type and color,
+	 * hence each layer that has to be drawn on top of the previous one
+	 * is a separate batch.
+	 */
+	ksplot_batch_begin();
+
 	/* Draw the time axis. */
 	_drawAxisX(size);
 
-	/* Process and draw all graphs by using the built-in logic. */
-	_makeGraphs(_cpuList, _taskList);
+	/*
+	 * Reprocess the graphs and the plugin-specific shapes only if the
+	 * model or the lists of plots have changed since the last time.
+	 * Otherwise (for example when only the markers have been moved) just
+	 * redraw the cached scene.
+	 */
+	if (!_sceneValid ||
+	    _sceneCPUList != _cpuList ||
+	    _sceneTaskList != _taskList)
+		_makeScene();
+
+	/* Draw all graphs. */
 	for (auto const &g: _graphs)
 		g->draw(size);
 
-	/* Process and draw all plugin-specific shapes. */
-	_makePluginShapes(_cpuList, _taskList);
-	while (!_shapes.empty()) {
-		auto s = _shapes.front();
-		_shapes.pop_front();
+	ksplot_batch_flush();
+	ksplot_batch_begin();
 
+	/* Draw all plugin-specific shapes. */
+	for (auto const &s: _shapes) {
 		s->_size = size;
 		s->draw();
-
-		delete s;
 	}
 
+	_shapeBuffer.draw(size);
+
+	ksplot_batch_flush();
+
 	/*
 	 * Update and draw the markers. Make sure that the active marker
 	 * is drawn on top.
@@ -361,8 +394,12 @@ void KsGLWidget::loadData(KsDataStore *data)
 	nCPUs = tep_get_cpus(_data->tep());
 
 	_model.reset();
+	_model.setDataStore(_data);
 
-	/* Now load the entire set of trace data. */
+	/*
+	 * Now load the entire set of trace data. In out-of-core mode this is
+	 * the data of the first time-window only.
+	 */
 	tMin = _data->rows()[0]->ts;
 	tMax = _data->rows()[_data->size() - 1]->ts;
 	ksmodel_set_bining(_model.histo(), nBins, tMin, tMax);
@@ -377,7 +414,7 @@ void KsGLWidget::loadData(KsDataStore *data)
 	_taskList = {};
 
 	loadColors();
-	_makeGraphs(_cpuList, _taskList);
+	_makeScene();
 }
 
 /**
@@ -390,6 +427,7 @@ void KsGLWidget::loadColors()
 	_pidColors = KsPlot::getTaskColorTable();
 	_cpuColors.clear();
 	_cpuColors = KsPlot::getCPUColorTable();
+	_sceneValid = false;
 }
 
 /**
@@ -488,6 +526,31 @@ void KsGLWidget::_drawAxisX(float size)
 	KsPlot::drawLine(a0, c0, {}, size);
 }
 
+/*
+ * Process all graphs and all plugin-specific shapes and keep them, until the
+ * model or the lists of plots change.
+ */
+void KsGLWidget::_makeScene()
+{
+	_freeShapes();
+	_makeGraphs(_cpuList, _taskList);
+	_makePluginShapes(_cpuList, _taskList);
+
+	_sceneCPUList = _cpuList;
+	_sceneTaskList = _taskList;
+	_sceneValid = true;
+}
+
+void KsGLWidget::_freeShapes()
+{
+	while (!_shapes.empty()) {
+		delete _shapes.front();
+		_shapes.pop_front();
+	}
+
+	_shapeBuffer.clear();
+}
+
 void KsGLWidget::_makeGraphs(QVector<int> cpuList, QVector<int> taskList)
 {
 	/* The very first thing to do is to clean up. */
@@ -498,7 +561,9 @@ void KsGLWidget::_makeGraphs(QVector<int> cpuList, QVector<int> taskList)
 	if (!_data || !_data->size())
 		return;
 
-	auto lamAddGraph = [&](KsPlot::Graph *graph) {
+	std::vector<KsPlot::GraphFillJob> jobs;
+
+	auto lamAddGraph = [&](KsPlot::Graph *graph, int id, bool task) {
 		/*
 		* Calculate the base level of the CPU graph inside the widget.
 		* Remember that the "Y" coordinate is inverted.
@@ -512,15 +577,35 @@ void KsGLWidget::_makeGraphs(QVector<int> cpuList, QVector<int> taskList)
 
 		graph->setBase(base);
 		_graphs.append(graph);
+		jobs.push_back({graph, id, task});
 	};
 
 	/* Create CPU graphs according to the cpuList. */
 	for (auto const &cpu: cpuList)
-		lamAddGraph(_newCPUGraph(cpu));
+		lamAddGraph(_newCPUGraph(cpu), cpu, false);
+
+	/*
+	 * Process in parallel the data collections of all tasks, which do not
+	 * have a collection yet.
+	 */
+	kshark_context *kshark_ctx(nullptr);
+	if (kshark_instance(&kshark_ctx))
+		kshark_register_data_collections(kshark_ctx,
+						 _data->rows(), _data->size(),
+						 kshark_match_pid,
+						 taskList.constData(),
+						 taskList.count(),
+						 KS_TASK_COLLECTION_MARGIN);
 
 	/* Create Task graphs taskList to the taskList. */
 	for (auto const &pid: taskList)
-		lamAddGraph(_newTaskGraph(pid));
+		lamAddGraph(_newTaskGraph(pid), pid, true);
+
+	/*
+	 * Fill all graphs in parallel. The graphs get drawn later, by the
+	 * GUI thread.
+	 */
+	KsPlot::fillGraphs(&jobs);
 }
 
 void KsGLWidget::_makePluginShapes(QVector<int> cpuList, QVector<int> taskList)
@@ -529,19 +614,26 @@ void KsGLWidget::_makePluginShapes(QVector<int> cpuList, QVector<int> taskList)
 	kshark_event_handler *evt_handlers;
 	KsCppArgV cppArgv;
 
-	if (!kshark_instance(&kshark_ctx))
+	/*
+	 * In out-of-core mode the model can be filled by using the summary
+	 * of the pages, without loading the entries. There is nothing for
+	 * the plugins to draw in this case.
+	 */
+	if (!kshark_instance(&kshark_ctx) || !_model.histo()->data)
 		return;
 
 	cppArgv._histo = _model.histo();
 	cppArgv._shapes = &_shapes;
+	cppArgv._shapeBuffer = &_shapeBuffer;
 
 	for (int g = 0; g < cpuList.count(); ++g) {
 		cppArgv._graph = _graphs[g];
 		evt_handlers = kshark_ctx->event_handlers;
 		while (evt_handlers) {
-			evt_handlers->draw_func(cppArgv.toC(),
-						cpuList[g],
-						KSHARK_PLUGIN_CPU_DRAW);
+			if (evt_handlers->draw_func)
+				evt_handlers->draw_func(cppArgv.toC(),
+							cpuList[g],
+							KSHARK_PLUGIN_CPU_DRAW);
 
 			evt_handlers = evt_handlers->next;
 		}
@@ -551,9 +643,10 @@ void KsGLWidget::_makePluginShapes(QVector<int> cpuList, QVector<int> taskList)
 		cppArgv._graph = _graphs[cpuList.count() + g];
 		evt_handlers = kshark_ctx->event_handlers;
 		while (evt_handlers) {
-			evt_handlers->draw_func(cppArgv.toC(),
-						taskList[g],
-						KSHARK_PLUGIN_TASK_DRAW);
+			if (evt_handlers->draw_func)
+				evt_handlers->draw_func(cppArgv.toC(),
+							taskList[g],
+							KSHARK_PLUGIN_TASK_DRAW);
 
 			evt_handlers = evt_handlers->next;
 		}
@@ -582,7 +675,6 @@ KsPlot::Graph *KsGLWidget::_newCPUGraph(int cpu)
 					  cpu);
 
 	graph->setDataCollectionPtr(col);
-	graph->fillCPUGraph(cpu);
 
 	return graph;
 }
@@ -616,7 +708,7 @@ KsPlot::Graph *KsGLWidget::_newTaskGraph(int pid)
 						      _data->rows(),
 						      _data->size(),
 						      kshark_match_pid, pid,
-						      25);
+						      KS_TASK_COLLECTION_MARGIN);
 	}
 
 	/*
@@ -638,7 +730,6 @@ KsPlot::Graph *KsGLWidget::_newTaskGraph(int pid)
 	}
 
 	graph->setDataCollectionPtr(col);
-	graph->fillTaskGraph(pid);
 
 	return graph;
 }
@@ -168,6 +168,8 @@ private:
 
 	KsPlot::PlotObjList	_shapes;
 
+	KsPlot::ShapeBuffer	_shapeBuffer;
+
 	KsPlot::ColorTable	_pidColors;
 
 	KsPlot::ColorTable	_cpuColors;
@@ -192,8 +194,16 @@ private:
 
 	int 		_dpr;
 
+	bool		_sceneValid;
+
+	QVector<int>	_sceneCPUList, _sceneTaskList;
+
 	void _drawAxisX(float size);
 
+	void _makeScene();
+
+	void _freeShapes();
+
 	void _makeGraphs(QVector<int> cpuMask, QVector<int> taskMask);
 
 	KsPlot::Graph *_newCPUGraph(int cpu);
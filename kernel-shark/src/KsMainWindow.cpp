@@ -16,6 +16,8 @@
 
 // C++11
 #include <thread>
+#include <mutex>
+#include <condition_variable>
 
 // Qt
 #include <QMenu>
@@ -30,6 +32,7 @@
 #include "KsMainWindow.hpp"
 #include "KsCaptureDialog.hpp"
 #include "KsAdvFilteringDialog.hpp"
+#include "KsFieldFilterDialog.hpp"
 
 /** Create KernelShark Main window. */
 KsMainWindow::KsMainWindow(QWidget *parent)
@@ -55,6 +58,7 @@ KsMainWindow::KsMainWindow(QWidget *parent)
   _showTasksAction("Show tasks", this),
   _showCPUsAction("Show CPUs", this),
   _advanceFilterAction("Advance Filtering", this),
+  _fieldFilterAction("Field range filter", this),
   _clearAllFilters("Clear all filters", this),
   _cpuSelectAction("CPUs", this),
   _taskSelectAction("Tasks", this),
@@ -118,6 +122,9 @@ KsMainWindow::KsMainWindow(QWidget *parent)
 	connect(&_data,		&KsDataStore::updateWidgets,
 		&_graph,	&KsTraceGraph::update);
 
+	connect(&_data,		&KsDataStore::windowChanged,
+		&_view,		&KsTraceViewer::update);
+
 	connect(&_plugins,	&KsPluginManager::dataReload,
 		&_data,		&KsDataStore::reload);
 
@@ -242,6 +249,9 @@ void KsMainWindow::_createActions()
 	connect(&_advanceFilterAction,	&QAction::triggered,
 		this,			&KsMainWindow::_advancedFiltering);
 
+	connect(&_fieldFilterAction,	&QAction::triggered,
+		this,			&KsMainWindow::_fieldFiltering);
+
 	connect(&_clearAllFilters,	&QAction::triggered,
 		this,			&KsMainWindow::_clearFilters);
 
@@ -362,6 +372,7 @@ void KsMainWindow::_createMenus()
 	filter->addAction(&_showTasksAction);
 	filter->addAction(&_showCPUsAction);
 	filter->addAction(&_advanceFilterAction);
+	filter->addAction(&_fieldFilterAction);
 	filter->addAction(&_clearAllFilters);
 
 	/* Plot menu */
@@ -422,17 +433,10 @@ QString KsMainWindow::_getCacheDir()
 		QDir().mkpath(dir);
 	};
 
-	dir = getenv("KS_USER_CACHE_DIR");
-	if (!dir.isEmpty()) {
-		if (!QDir(dir).exists())
-			lamMakePath(true);
-	} else {
-		auto appCachePath = QStandardPaths::GenericCacheLocation;
-		dir = QStandardPaths::writableLocation(appCachePath);
-		dir += "/kernelshark";
-
-		if (!QDir(dir).exists())
-			lamMakePath(false);
+	dir = KsUtils::getCacheDir();
+	if (!QDir(dir).exists()) {
+		/* Ask before creating a directory, set by the user. */
+		lamMakePath(!QString(getenv("KS_USER_CACHE_DIR")).isEmpty());
 	}
 
 	return dir;
@@ -785,6 +789,29 @@ void KsMainWindow::_advancedFiltering()
 	dialog->show();
 }
 
+void KsMainWindow::_fieldFiltering()
+{
+	KsFieldFilterDialog *dialog;
+
+	if (!_data.tep()) {
+		QErrorMessage *em = new QErrorMessage(this);
+		QString text("Unable to open Field filtering dialog.");
+
+		text += " Tracing data has to be loaded first.";
+
+		em->showMessage(text, "fieldFiltering");
+		qCritical() << "ERROR: " << text;
+
+		return;
+	}
+
+	dialog = new KsFieldFilterDialog(this);
+	connect(dialog,		&KsFieldFilterDialog::apply,
+		&_data,		&KsDataStore::applyFieldFilter);
+
+	dialog->show();
+}
+
 void KsMainWindow::_clearFilters()
 {
 	_data.clearAllFilters();
@@ -953,12 +980,84 @@ void KsMainWindow::_bugReport()
 	QDesktopServices::openUrl(bugs);
 }
 
+void KsMainWindow::_loadProgress(kshark_context *kshark_ctx,
+				 const kshark_load_progress *progress,
+				 void *data)
+{
+	KsLoadState *state = static_cast<KsLoadState *>(data);
+
+	/* This is called by the loading thread. */
+	state->_phase = progress->phase;
+	state->_done = progress->done;
+	state->_total = progress->total;
+}
+
+void KsMainWindow::_showLoadProgress(KsProgressBar *pb,
+				     const KsLoadState &state,
+				     std::chrono::steady_clock::time_point start)
+{
+	/* The part of the progress bar, used by each loading phase. */
+	static const int phaseBegin[] = {0, 0, 140, 150, 160};
+	static const int phaseEnd[] = {160, 140, 150, 160, 160};
+	uint64_t done(state._done), total(state._total);
+	int phase(state._phase);
+	double seconds, rate;
+	QString info;
+	int value;
+
+	if (phase < 0) {
+		pb->setInfo("Opening ...");
+		pb->setValue(1);
+		return;
+	}
+
+	value = phaseBegin[phase];
+	if (total)
+		value += (phaseEnd[phase] - phaseBegin[phase]) * done / total;
+
+	switch (phase) {
+	case KS_LOAD_DECODE:
+		seconds = std::chrono::duration<double>(
+				std::chrono::steady_clock::now() - start).count();
+
+		rate = seconds > 0. ? done / seconds : 0.;
+		info = QString("Decoded %1 of %2 MB").arg(done / 1e6, 0, 'f', 1)
+						     .arg(total / 1e6, 0, 'f', 1);
+
+		if (rate > 0.) {
+			info += QString(", %1 MB/s, ETA %2 s")
+				.arg(rate / 1e6, 0, 'f', 1)
+				.arg((total - done) / rate, 0, 'f', 0);
+		}
+
+		break;
+
+	case KS_LOAD_CACHE:
+		info = "Loading cached data ...";
+		break;
+
+	case KS_LOAD_MERGE:
+		info = "Sorting ...";
+		break;
+
+	default:
+		info = "Indexing ...";
+		break;
+	}
+
+	pb->setInfo(info);
+	pb->setValue(value);
+}
+
 /** Load trace data for file. */
 void KsMainWindow::loadDataFile(const QString& fileName)
 {
+	kshark_context *kshark_ctx(nullptr);
+	std::condition_variable loadCond;
 	char buff[FILENAME_MAX];
 	QString pbLabel("Loading    ");
 	bool loadDone = false;
+	std::mutex mutex;
 	struct stat st;
 	int ret;
 
@@ -988,27 +1087,50 @@ void KsMainWindow::loadDataFile(const QString& fileName)
 
 	setWindowTitle("Kernel Shark");
 	KsProgressBar pb(pbLabel);
-	QApplication::processEvents();
+	pb.enableCancel();
+
+	if (!kshark_instance(&kshark_ctx))
+		return;
+
+	KsLoadState state;
+	kshark_set_load_progress(kshark_ctx, _loadProgress, &state);
 
 	auto lamLoadJob = [&](KsDataStore *d) {
 		d->loadDataFile(fileName);
+
+		std::lock_guard<std::mutex> lock(mutex);
 		loadDone = true;
+		loadCond.notify_one();
 	};
+
+	auto start = std::chrono::steady_clock::now();
 	std::thread tload(lamLoadJob, &_data);
 
-	for (int i = 0; i < 160; ++i) {
-		/*
-		 * TODO: The way this progress bar gets updated here is a pure
-		 * cheat. See if this can be implemented better.
-		*/
-		if (loadDone)
+	while (true) {
+		std::unique_lock<std::mutex> lock(mutex);
+		if (loadCond.wait_for(lock, std::chrono::milliseconds(100),
+				      [&] {return loadDone;}))
 			break;
 
-		pb.setValue(i);
-		usleep(150000);
+		lock.unlock();
+
+		if (pb.canceled())
+			kshark_cancel_loading(kshark_ctx);
+
+		_showLoadProgress(&pb, state, start);
 	}
 
 	tload.join();
+	kshark_set_load_progress(kshark_ctx, nullptr, nullptr);
+
+	if (pb.canceled()) {
+		qInfo() << "Loading of " << fileName << " canceled";
+		_data.clear();
+		_resizeEmpty();
+		_plugins.unloadAll();
+
+		return;
+	}
 
 	if (_data.size() < 1) {
 		QString text("No data was loaded from file ");
@@ -12,6 +12,10 @@
 #ifndef _KS_MAINWINDOW_H
 #define _KS_MAINWINDOW_H
 
+// C++11
+#include <atomic>
+#include <chrono>
+
 // Qt
 #include <QMainWindow>
 #include <QLocalServer>
@@ -21,6 +25,7 @@
 #include "KsTraceGraph.hpp"
 #include "KsSession.hpp"
 #include "KsUtils.hpp"
+#include "KsWidgetsLib.hpp"
 
 /**
  * The KsMainWindow class provides Main window for the KernelShark GUI.
@@ -124,6 +129,8 @@ private:
 
 	QAction		_advanceFilterAction;
 
+	QAction		_fieldFilterAction;
+
 	QAction		_clearAllFilters;
 
 	// Plots menu.
@@ -189,6 +196,8 @@ private:
 
 	void _advancedFiltering();
 
+	void _fieldFiltering();
+
 	void _clearFilters();
 
 	void _cpuSelect();
@@ -248,6 +257,29 @@ private:
 
 	QString _getCacheDir();
 
+	/**
+	 * Progress of the loading of the data, shared between the loading
+	 * thread and the GUI thread.
+	 */
+	struct KsLoadState {
+		/** The current loading phase. Negative before the start. */
+		std::atomic<int>	_phase{-1};
+
+		/** The work done in the current phase. */
+		std::atomic<uint64_t>	_done{0};
+
+		/** The total amount of work in the current phase. */
+		std::atomic<uint64_t>	_total{0};
+	};
+
+	static void _loadProgress(kshark_context *kshark_ctx,
+				  const kshark_load_progress *progress,
+				  void *data);
+
+	static void _showLoadProgress(KsProgressBar *pb,
+				      const KsLoadState &state,
+				      std::chrono::steady_clock::time_point start);
+
 private slots:
 	void _captureFinished(int, QProcess::ExitStatus);
 };
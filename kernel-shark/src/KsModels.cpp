@@ -18,9 +18,18 @@
 KsFilterProxyModel::KsFilterProxyModel(QObject *parent)
 : QSortFilterProxyModel(parent),
   _searchStop(false),
-  _source(nullptr)
+  _data(nullptr),
+  _source(nullptr),
+  _infoIndex(nullptr),
+  _infoIndexCancel(0)
 {}
 
+/** Destroy the KsFilterProxyModel object. */
+KsFilterProxyModel::~KsFilterProxyModel()
+{
+	stopInfoIndex();
+}
+
 /**
  * Returns False if the item in the row indicated by the sourceRow and
  * sourceParentshould be filtered out. Otherwise returns True.
@@ -38,9 +47,162 @@ KsFilterProxyModel::filterAcceptsRow(int sourceRow,
 /** Provide the Proxy model with data. */
 void KsFilterProxyModel::fill(KsDataStore *data)
 {
+	if (_data != data->rows())
+		_startInfoIndex(data);
+
 	_data = data->rows();
 }
 
+void KsFilterProxyModel::_startInfoIndex(KsDataStore *data)
+{
+	kshark_entry **rows = data->rows();
+	size_t nRows = data->size();
+
+	stopInfoIndex();
+	if (!rows || data->size() <= 0)
+		return;
+
+	/*
+	 * The building has to stop before the data gets freed. This may
+	 * happen in a thread, different from the GUI thread.
+	 */
+	connect(data,	&KsDataStore::aboutToFreeData,
+		this,	&KsFilterProxyModel::stopInfoIndex,
+		static_cast<Qt::ConnectionType>(Qt::DirectConnection |
+						Qt::UniqueConnection));
+
+	/*
+	 * In out-of-core mode the index describes only the current
+	 * time-window, hence it is not saved. Saving the index can also be
+	 * disabled by setting the environment variable KS_NO_INFO_INDEX_FILE.
+	 */
+	bool saved = !data->chunks() && !getenv("KS_NO_INFO_INDEX_FILE");
+	QString cacheDir = KsUtils::getCacheDir();
+
+	auto lamBuild = [this, rows, nRows, saved, cacheDir] () {
+		std::string dir = cacheDir.toStdString();
+		kshark_context *kshark_ctx(nullptr);
+		kshark_info_index *index(nullptr);
+		const char *file;
+
+		if (!kshark_instance(&kshark_ctx) || !kshark_ctx->file)
+			return;
+
+		/*
+		 * The index is saved next to the trace data file. If this is
+		 * not possible (read-only directory), the index is saved in
+		 * the cache directory of the user.
+		 */
+		file = kshark_ctx->file;
+		if (saved) {
+			index = kshark_load_info_index(kshark_ctx, file,
+						       nullptr, nRows);
+			if (!index)
+				index = kshark_load_info_index(kshark_ctx, file,
+							       dir.c_str(),
+							       nRows);
+		}
+
+		if (!index) {
+			index = kshark_info_index_build(kshark_ctx, rows, nRows,
+							&_infoIndexCancel);
+			if (index && saved &&
+			    !kshark_save_info_index(kshark_ctx, file, nullptr,
+						    index) &&
+			    QDir().mkpath(cacheDir))
+				kshark_save_info_index(kshark_ctx, file,
+						       dir.c_str(), index);
+		}
+
+		std::lock_guard<std::mutex> lock(_infoIndexMutex);
+		_infoIndex = index;
+	};
+
+	_infoIndexThread = std::thread(lamBuild);
+}
+
+/**
+ * Stop the building of the full-text index of the info strings and free the
+ * index. The function is thread-safe.
+ */
+void KsFilterProxyModel::stopInfoIndex()
+{
+	__atomic_store_n(&_infoIndexCancel, 1, __ATOMIC_RELAXED);
+	if (_infoIndexThread.joinable())
+		_infoIndexThread.join();
+
+	__atomic_store_n(&_infoIndexCancel, 0, __ATOMIC_RELAXED);
+
+	std::lock_guard<std::mutex> lock(_infoIndexMutex);
+	kshark_info_index_free(_infoIndex);
+	_infoIndex = nullptr;
+}
+
+/**
+ * @brief Search the Info column by using the full-text index of the info
+ *	  strings. Only the rows which may contain the search text get
+ *	  checked.
+ *
+ * @param column: The number of the column to search in.
+ * @param searchText: The text to search for.
+ * @param cond: Matching condition function.
+ * @param matchList: Output location for a list containing the row indexes of
+ *		     the cells satisfying matching condition.
+ *
+ * @returns True if the index has been used. False if the index is not ready
+ *	    or it cannot be used for this search. In this case the matchList
+ *	    is not modified. The search runs in the calling thread, hence the
+ *	    index is used only if it leaves a small number of rows to check.
+ */
+bool KsFilterProxyModel::searchIndexed(int column,
+				       const QString &searchText,
+				       search_condition_func cond,
+				       QList<int> *matchList)
+{
+	size_t *rows;
+	ssize_t n;
+
+	if (column != KsViewModel::TRACE_VIEW_COL_INFO || !_source)
+		return false;
+
+	std::lock_guard<std::mutex> lock(_infoIndexMutex);
+	if (!_infoIndex)
+		return false;
+
+	/*
+	 * The info strings of the rows, not found in the index, do not
+	 * contain the search text. For all those rows the outcome of the
+	 * matching condition is the same as for an empty string. If this
+	 * outcome is positive, all rows have to be visited and the index
+	 * does not help.
+	 */
+	if (cond(searchText, QString()))
+		return false;
+
+	n = kshark_info_index_find(_infoIndex,
+				   searchText.toStdString().c_str(),
+				   &rows);
+	if (n < 0)
+		return false;
+
+	if (n > KS_SEARCH_INDEXED_MAX) {
+		/* Too many candidates. Let the parallel search do the job. */
+		free(rows);
+		return false;
+	}
+
+	/* Only the candidate rows can match. They are sorted. */
+	for (ssize_t j = 0; j < n; ++j) {
+		if (filterAcceptsRow(rows[j], {}) &&
+		    cond(searchText, _source->getValueStr(column, rows[j])))
+			matchList->append(rows[j]);
+	}
+
+	free(rows);
+
+	return true;
+}
+
 /** Set the source model for this Proxy model. */
 void KsFilterProxyModel::setSource(KsViewModel *s)
 {
@@ -148,6 +310,11 @@ size_t KsFilterProxyModel::search(KsSearchFSM *sm, QList<int> *matchList)
 {
 	int nRows = rowCount({});
 
+	if ((sm->column() == KsViewModel::TRACE_VIEW_COL_INFO ||
+	     sm->column() == KsViewModel::TRACE_VIEW_COL_LAT) &&
+	    _searchParallel(sm, matchList, sm->_lastRowSearched + 1, nRows - 1))
+		return matchList->count();
+
 	sm->_lastRowSearched =
 		_search(sm->column(),
 			sm->searchText(),
@@ -162,6 +329,139 @@ size_t KsFilterProxyModel::search(KsSearchFSM *sm, QList<int> *matchList)
 	return matchList->count();
 }
 
+/*
+ * Get the value of the Info or Latency column of the entry, by using an
+ * additional reader of the trace data file.
+ */
+static QString readerValueStr(kshark_reader *reader, int column,
+			      const kshark_entry *e)
+{
+	if (column == KsViewModel::TRACE_VIEW_COL_LAT)
+		return kshark_reader_get_latency(reader, e);
+
+	return kshark_reader_get_info(reader, e);
+}
+
+/*
+ * Search the Info or Latency column in parallel. Each thread formats the
+ * records by using its own reader of the trace data file, hence the threads
+ * do not compete for the input mutex of the session. The table is processed
+ * in chunks, distributed dynamically between the threads. The results are
+ * merged in the order of the chunks, so that the search can be paused and
+ * resumed from the first row which has not been searched yet. Returns false
+ * if the parallel search is not possible.
+ */
+bool KsFilterProxyModel::_searchParallel(KsSearchFSM *sm,
+					 QList<int> *matchList,
+					 int first, int last)
+{
+	int nThreads = std::thread::hardware_concurrency();
+	int nChunks, nextChunk(0), ready(0), running, pbStart;
+	search_condition_func cond = sm->condition();
+	QString searchText = sm->searchText();
+	kshark_context *kshark_ctx(nullptr);
+	std::vector<std::thread> threads;
+	int column = sm->column();
+	int nRows = last - first + 1;
+	ssize_t lastRow(first);
+
+	if (nThreads < 2 || nRows < 2 * KS_SEARCH_CHUNK_SIZE)
+		return false;
+
+	if (!kshark_instance(&kshark_ctx) || !kshark_ctx->file)
+		return false;
+
+	nChunks = (nRows + KS_SEARCH_CHUNK_SIZE - 1) / KS_SEARCH_CHUNK_SIZE;
+	if (nThreads > nChunks)
+		nThreads = nChunks;
+
+	std::vector<QList<int>> results(nChunks);
+	std::vector<char> done(nChunks, 0);
+
+	auto lamSearch = [&] () {
+		kshark_reader *reader = kshark_reader_open(kshark_ctx);
+		int chunk, index, row, chunkLast;
+		QString item;
+
+		while (!_searchStop) {
+			chunk = __atomic_fetch_add(&nextChunk, 1,
+						   __ATOMIC_RELAXED);
+			if (chunk >= nChunks)
+				break;
+
+			index = first + chunk * KS_SEARCH_CHUNK_SIZE;
+			chunkLast = std::min(index + KS_SEARCH_CHUNK_SIZE - 1,
+					     last);
+
+			for (; index <= chunkLast; ++index) {
+				row = mapRowFromSource(index);
+
+				/*
+				 * Fall back to the (serialized) access via
+				 * the session, if no reader is available.
+				 */
+				if (reader)
+					item = readerValueStr(reader, column,
+							      _data[row]);
+				else
+					item = _source->getValueStr(column, row);
+
+				if (cond(searchText, item))
+					results[chunk].append(row);
+			}
+
+			std::lock_guard<std::mutex> lk(_mutex);
+			done[chunk] = 1;
+			_pbCond.notify_one();
+		}
+
+		kshark_reader_close(reader);
+
+		std::lock_guard<std::mutex> lk(_mutex);
+		--running;
+		_pbCond.notify_one();
+	};
+
+	running = nThreads;
+	for (int t = 0; t < nThreads; ++t)
+		threads.push_back(std::thread(lamSearch));
+
+	/*
+	 * Merge the results of the chunks in order, while updating the
+	 * progress of the search. The user can pause the search at any time.
+	 */
+	pbStart = _searchProgress;
+	for (bool finished = false; !finished;) {
+		{
+			std::unique_lock<std::mutex> lk(_mutex);
+			_pbCond.wait_for(lk, std::chrono::milliseconds(100));
+			finished = (running == 0);
+
+			for (; ready < nChunks && done[ready]; ++ready)
+				*matchList << results[ready];
+		}
+
+		lastRow = std::min(first + ready * KS_SEARCH_CHUNK_SIZE, last + 1);
+		_searchProgress = pbStart + (KS_PROGRESS_BAR_MAX - pbStart) *
+					    (lastRow - first) / nRows;
+
+		sm->setProgress(_searchProgress);
+		sm->_searchCountLabel.setText(QString(" %1").arg(matchList->count()));
+		QApplication::processEvents();
+	}
+
+	for (auto &t: threads)
+		t.join();
+
+	/*
+	 * If the search has been paused, the chunks searched after the first
+	 * unfinished one are discarded. The search will be resumed from there.
+	 */
+	sm->_lastRowSearched = (lastRow > last) ? lastRow : lastRow - 1;
+
+	return true;
+}
+
 /** @brief Search the content of the table for a data satisfying an abstract
  *	   condition.
  *
@@ -192,6 +492,249 @@ QList<int> KsFilterProxyModel::searchMap(int column,
 	return matchList;
 }
 
+/** Create a KsRowFormatter object and start its formatting thread. */
+KsRowFormatter::KsRowFormatter(QObject *parent)
+: QObject(parent),
+  _cache(KS_FORMAT_CACHE_SIZE),
+  _data(nullptr),
+  _nRows(0),
+  _request(-1),
+  _lastRequest(0),
+  _forward(true),
+  _jobFirst(-1),
+  _jobLast(-1),
+  _generation(0),
+  _stop(false),
+  _reader(nullptr),
+  _readerGeneration(0)
+{
+	for (auto &r: _cache)
+		r._row = -1;
+
+	_thread = std::thread(&KsRowFormatter::_run, this);
+}
+
+/** Stop the formatting thread and destroy the KsRowFormatter object. */
+KsRowFormatter::~KsRowFormatter()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stop = true;
+	}
+
+	_cond.notify_one();
+	_thread.join();
+}
+
+/**
+ * @brief Provide the formatter with data. The cache is emptied. Call this
+ *	  function with NULL before freeing the data, currently in use. The
+ *	  function returns only when the formatting thread no longer accesses
+ *	  the old data.
+ *
+ * @param data: Input location for the trace data.
+ * @param n: The size of the data array.
+ */
+void KsRowFormatter::setData(kshark_entry **data, size_t n)
+{
+	std::lock_guard<std::mutex> dataLock(_dataMutex);
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	_data = data;
+	_nRows = n;
+	++_generation;
+	_request = _jobFirst = _jobLast = -1;
+	_lastRequest = 0;
+
+	for (auto &r: _cache) {
+		r._row = -1;
+		r._latency.clear();
+		r._info.clear();
+	}
+}
+
+/**
+ * @brief Get the formatted Latency and Info columns of a row. If the row is
+ *	  not in the cache, a background formatting of the row and of the rows
+ *	  following it in the direction of the scrolling is requested. The
+ *	  signal rowsReady() is emitted when these rows are formatted.
+ *
+ * @param row: Row index.
+ * @param latency: Output location for the content of the Latency column.
+ * @param info: Output location for the content of the Info column.
+ *
+ * @returns True if the row is in the cache. Otherwise False.
+ */
+bool KsRowFormatter::get(int row, QString *latency, QString *info)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	const Row &r = _cache[row % KS_FORMAT_CACHE_SIZE];
+
+	if (r._row == row) {
+		*latency = r._latency;
+		*info = r._info;
+		return true;
+	}
+
+	/* Check if this row is about to be formatted. */
+	if (row >= _jobFirst && row <= _jobLast && _request < 0)
+		return false;
+
+	if (row != _lastRequest)
+		_forward = row > _lastRequest;
+
+	_lastRequest = _request = row;
+	_cond.notify_one();
+
+	return false;
+}
+
+/*
+ * (Re)open the reader of the formatting thread for the current data. The
+ * function is called by the formatting thread, holding "_dataMutex".
+ */
+void KsRowFormatter::_openReader(unsigned int generation)
+{
+	kshark_context *kshark_ctx(nullptr);
+
+	kshark_reader_close(_reader);
+	_reader = nullptr;
+	_readerGeneration = generation;
+
+	if (_data && kshark_instance(&kshark_ctx))
+		_reader = kshark_reader_open(kshark_ctx);
+}
+
+/*
+ * Format a row and put it in the cache. The function is called by the
+ * formatting thread, without holding "_mutex". The records are read by the
+ * own reader of the thread, hence the formatting does not compete with the
+ * GUI thread for the input mutex of the session. Returns False if the data
+ * has changed.
+ */
+bool KsRowFormatter::_format(int row, unsigned int generation)
+{
+	QString latency, info;
+
+	{
+		std::lock_guard<std::mutex> dataLock(_dataMutex);
+
+		if (generation != _generation)
+			return false;
+
+		if (_readerGeneration != generation)
+			_openReader(generation);
+
+		/*
+		 * Fall back to the (serialized) access via the session, if no
+		 * reader is available.
+		 */
+		if (_reader) {
+			latency = kshark_reader_get_latency(_reader,
+							    _data[row]);
+			info = kshark_reader_get_info(_reader, _data[row]);
+		} else {
+			latency = kshark_get_latency_easy(_data[row]);
+			info = kshark_get_info_easy(_data[row]);
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(_mutex);
+	if (generation != _generation)
+		return false;
+
+	Row &r = _cache[row % KS_FORMAT_CACHE_SIZE];
+	r._row = row;
+	r._latency = latency;
+	r._info = info;
+
+	return true;
+}
+
+void KsRowFormatter::_run()
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+	int first, last, row, step, batchFirst, batchLast;
+	unsigned int generation;
+	QVector<int> rows;
+
+	while (true) {
+		_cond.wait(lock, [this] {return _stop || _request >= 0;});
+		if (_stop)
+			break;
+
+		/*
+		 * Format first the requested row and the rows after it, which
+		 * are visible together with it. Then continue with the rows
+		 * in the direction of the scrolling.
+		 */
+		rows.clear();
+		first = _request;
+		last = std::min<int>(first + (_forward ? KS_FORMAT_PREFETCH :
+							 KS_FORMAT_VISIBLE),
+				     static_cast<int>(_nRows) - 1);
+
+		for (row = first; row <= last; ++row)
+			rows.append(row);
+
+		if (!_forward) {
+			last = std::max(first - KS_FORMAT_PREFETCH, 0);
+			for (row = first - 1; row >= last; --row)
+				rows.append(row);
+		}
+
+		_jobFirst = rows.isEmpty() ? -1 :
+			    std::min(rows.first(), rows.last());
+		_jobLast = rows.isEmpty() ? -1 :
+			   std::max(rows.first(), rows.last());
+		_request = -1;
+		generation = _generation;
+
+		batchFirst = batchLast = -1;
+		for (int i = 0; i < rows.count(); ++i) {
+			/* A new request has priority over the current one. */
+			if (_stop || _request >= 0 || generation != _generation)
+				break;
+
+			row = rows[i];
+			if (_cache[row % KS_FORMAT_CACHE_SIZE]._row == row)
+				continue;
+
+			lock.unlock();
+			if (!_format(row, generation)) {
+				lock.lock();
+				break;
+			}
+
+			if (batchFirst < 0 || row < batchFirst)
+				batchFirst = row;
+
+			if (row > batchLast)
+				batchLast = row;
+
+			step = (batchLast - batchFirst) + 1;
+			if (step >= KS_FORMAT_BATCH) {
+				emit rowsReady(batchFirst, batchLast);
+				batchFirst = batchLast = -1;
+			}
+
+			lock.lock();
+		}
+
+		if (batchFirst >= 0 && generation == _generation) {
+			lock.unlock();
+			emit rowsReady(batchFirst, batchLast);
+			lock.lock();
+		}
+
+		if (generation == _generation)
+			_jobFirst = _jobLast = -1;
+	}
+
+	kshark_reader_close(_reader);
+	_reader = nullptr;
+}
+
 /** Create default (empty) KsViewModel object. */
 KsViewModel::KsViewModel(QObject *parent)
 : QAbstractTableModel(parent),
@@ -201,7 +744,22 @@ KsViewModel::KsViewModel(QObject *parent)
 	   "Latency", "Event", "Info"}),
   _markA(KS_NO_ROW_SELECTED),
   _markB(KS_NO_ROW_SELECTED)
-{}
+{
+	/*
+	 * The formatter emits its signal from the formatting thread. The
+	 * connection is queued, hence the views get updated by the GUI
+	 * thread.
+	 */
+	connect(&_formatter,	&KsRowFormatter::rowsReady,
+		this,		[this] (int first, int last) {
+			if (last >= static_cast<int>(_nRows))
+				return;
+
+			emit dataChanged(index(first, TRACE_VIEW_COL_LAT),
+					 index(last, TRACE_VIEW_COL_INFO));
+		},
+		Qt::QueuedConnection);
+}
 
 /**
  * Get the data stored under the given role for the item referred to by
@@ -226,8 +784,29 @@ QVariant KsViewModel::data(const QModelIndex &index, int role) const
 			return QVariant::fromValue(QColor(_colorMarkB));
 	}
 
-	if (role == Qt::DisplayRole)
-		return this->getValue(index.column(), index.row());
+	if (role == Qt::DisplayRole) {
+		QString latency, info;
+
+		/*
+		 * Formatting the Latency and the Info columns requires reading
+		 * the trace data file. This is done in the background. Show a
+		 * placeholder until the row is formatted.
+		 */
+		switch (index.column()) {
+		case TRACE_VIEW_COL_LAT:
+		case TRACE_VIEW_COL_INFO:
+			if (!_formatter.get(index.row(), &latency, &info))
+				return QString("...");
+
+			if (index.column() == TRACE_VIEW_COL_LAT)
+				return latency;
+
+			return info;
+
+		default:
+			return this->getValue(index.column(), index.row());
+		}
+	}
 
 	return {};
 }
@@ -298,6 +877,16 @@ void KsViewModel::fill(KsDataStore *data)
 
 	_data = data->rows();
 	_nRows = data->size();
+	_formatter.setData(_data, _nRows);
+
+	/*
+	 * The formatting has to stop before the data gets freed. This may
+	 * happen in a thread, different from the GUI thread.
+	 */
+	connect(data,	&KsDataStore::aboutToFreeData,
+		this,	&KsViewModel::stopFormatting,
+		static_cast<Qt::ConnectionType>(Qt::DirectConnection |
+						Qt::UniqueConnection));
 
 	endInsertRows();
 }
@@ -318,6 +907,15 @@ void KsViewModel::selectRow(DualMarkerState state, int row)
 	}
 }
 
+/**
+ * Stop the background formatting of the rows of the table. The function is
+ * thread-safe.
+ */
+void KsViewModel::stopFormatting()
+{
+	_formatter.setData(nullptr, 0);
+}
+
 /** Reset the model. */
 void KsViewModel::reset()
 {
@@ -325,6 +923,7 @@ void KsViewModel::reset()
 
 	_data = nullptr;
 	_nRows = 0;
+	stopFormatting();
 
 	endResetModel();
 }
@@ -371,7 +970,8 @@ size_t KsViewModel::search(int column,
 
 /** Create a default (empty) KsFilterProxyModel object. */
 KsGraphModel::KsGraphModel(QObject *parent)
-: QAbstractTableModel(parent)
+: QAbstractTableModel(parent),
+  _data(nullptr)
 {
 	ksmodel_init(&_histo);
 }
@@ -404,6 +1004,7 @@ void KsGraphModel::fill(kshark_entry **entries, size_t n)
 
 	ksmodel_fill(&_histo, entries, n);
 
+	_syncWindow();
 	endResetModel();
 }
 
@@ -417,6 +1018,7 @@ void KsGraphModel::shiftForward(size_t n)
 {
 	beginResetModel();
 	ksmodel_shift_forward(&_histo, n);
+	_syncWindow();
 	endResetModel();
 }
 
@@ -430,6 +1032,7 @@ void KsGraphModel::shiftBackward(size_t n)
 {
 	beginResetModel();
 	ksmodel_shift_backward(&_histo, n);
+	_syncWindow();
 	endResetModel();
 }
 
@@ -443,6 +1046,7 @@ void KsGraphModel::jumpTo(size_t ts)
 {
 	beginResetModel();
 	ksmodel_jump_to(&_histo, ts);
+	_syncWindow();
 	endResetModel();
 }
 
@@ -457,6 +1061,7 @@ void KsGraphModel::zoomOut(double r, int mark)
 {
 	beginResetModel();
 	ksmodel_zoom_out(&_histo, r, mark);
+	_syncWindow();
 	endResetModel();
 }
 
@@ -471,6 +1076,7 @@ void KsGraphModel::zoomIn(double r, int mark)
 {
 	beginResetModel();
 	ksmodel_zoom_in(&_histo, r, mark);
+	_syncWindow();
 	endResetModel();
 }
 
@@ -479,13 +1085,20 @@ void KsGraphModel::quickZoomOut()
 {
 	beginResetModel();
 
-	ksmodel_set_bining(&_histo,
-			   _histo.n_bins,
-			   _histo.data[0]->ts,
-			   _histo.data[_histo.data_size - 1]->ts);
+	if (_histo.chunks)
+		ksmodel_set_bining(&_histo,
+				   _histo.n_bins,
+				   _histo.chunks->ts_min,
+				   _histo.chunks->ts_max);
+	else
+		ksmodel_set_bining(&_histo,
+				   _histo.n_bins,
+				   _histo.data[0]->ts,
+				   _histo.data[_histo.data_size - 1]->ts);
 
 	ksmodel_fill(&_histo, _histo.data, _histo.data_size);
 
+	_syncWindow();
 	endResetModel();
 }
 
@@ -510,6 +1123,7 @@ void KsGraphModel::reset()
 {
 	beginResetModel();
 	ksmodel_clear(&_histo);
+	_data = nullptr;
 	endResetModel();
 }
 
@@ -519,5 +1133,30 @@ void KsGraphModel::update(KsDataStore *data)
 	beginResetModel();
 	if (data)
 		ksmodel_fill(&_histo, data->rows(), data->size());
+	_syncWindow();
 	endResetModel();
 }
+
+/**
+ * @brief Set the Data Store of the model. If the Data Store works in
+ *	  out-of-core mode, the model takes its data from the cache of data
+ *	  chunks and the Data Store follows the time-window of the model.
+ *
+ * @param data: Input location for the Data Store object.
+ */
+void KsGraphModel::setDataStore(KsDataStore *data)
+{
+	_data = data;
+	ksmodel_set_chunk_cache(&_histo, data ? data->chunks() : nullptr);
+}
+
+/*
+ * In out-of-core mode, give the Data Store the entries of the new time-window
+ * of the model.
+ */
+void KsGraphModel::_syncWindow()
+{
+	if (_data && _histo.chunks && _histo.data &&
+	    _histo.data != _data->rows())
+		_data->setWindow(_histo.data, _histo.data_size);
+}
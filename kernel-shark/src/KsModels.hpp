@@ -14,6 +14,8 @@
 
 // C++11
 #include <mutex>
+#include <thread>
+#include <vector>
 #include <condition_variable>
 
 // Qt
@@ -35,6 +37,135 @@ enum class DualMarkerState;
 
 class KsDataStore;
 
+/** The number of formatted rows, kept in the cache of KsRowFormatter. */
+#define KS_FORMAT_CACHE_SIZE	4096
+
+/**
+ * The number of rows, formatted in the direction of the scrolling after a row
+ * missing in the cache of KsRowFormatter has been requested.
+ */
+#define KS_FORMAT_PREFETCH	512
+
+/**
+ * The number of rows, formatted in the forward direction after a row missing
+ * in the cache has been requested, when scrolling backward. These are the
+ * rows of the table, visible together with the requested row.
+ */
+#define KS_FORMAT_VISIBLE	128
+
+/** The number of formatted rows, reported together. */
+#define KS_FORMAT_BATCH		64
+
+/**
+ * The number of rows, processed together by one thread during the parallel
+ * search of the Info and Latency columns.
+ */
+#define KS_SEARCH_CHUNK_SIZE	4096
+
+/**
+ * The maximum number of rows, checked by the indexed search. If the index
+ * returns more candidates, the parallel search is used instead.
+ */
+#define KS_SEARCH_INDEXED_MAX	(8 * KS_SEARCH_CHUNK_SIZE)
+
+/**
+ * Class KsRowFormatter provides a background formatting of the table columns
+ * which require reading the trace data file (Latency and Info). The formatted
+ * rows are kept in a bounded cache.
+ */
+class KsRowFormatter : public QObject
+{
+	Q_OBJECT
+public:
+	explicit KsRowFormatter(QObject *parent = nullptr);
+
+	~KsRowFormatter();
+
+	void setData(kshark_entry **data, size_t n);
+
+	bool get(int row, QString *latency, QString *info);
+
+signals:
+	/**
+	 * This signal is emitted by the formatting thread when a range of
+	 * rows has been formatted.
+	 */
+	void rowsReady(int first, int last);
+
+private:
+	/** Formatted row of the table. */
+	struct Row {
+		/** Row index. Negative if the cache slot is empty. */
+		int	_row;
+
+		/** The content of the Latency column. */
+		QString	_latency;
+
+		/** The content of the Info column. */
+		QString	_info;
+	};
+
+	/** Cache of formatted rows. A row is kept in slot (row % size). */
+	std::vector<Row>	_cache;
+
+	/** Trace data array. */
+	kshark_entry		**_data;
+
+	/** The size of the data array. */
+	size_t			_nRows;
+
+	/** Requested row, missing in the cache. Negative if none. */
+	int			_request;
+
+	/** The last requested row. */
+	int			_lastRequest;
+
+	/** The direction of the scrolling. */
+	bool			_forward;
+
+	/** The first row of the range, being formatted at the moment. */
+	int			_jobFirst;
+
+	/** The last row of the range, being formatted at the moment. */
+	int			_jobLast;
+
+	/** Incremented each time the data changes. */
+	unsigned int		_generation;
+
+	/** If set, the formatting thread exits. */
+	bool			_stop;
+
+	/** Mutex protecting the cache and the state of the requests. */
+	std::mutex		_mutex;
+
+	/**
+	 * Mutex, held by the formatting thread while accessing the trace
+	 * data. Changing the data requires holding this mutex as well.
+	 */
+	std::mutex		_dataMutex;
+
+	/** Condition variable used to wake up the formatting thread. */
+	std::condition_variable	_cond;
+
+	/** The formatting thread. */
+	std::thread		_thread;
+
+	/**
+	 * Reader of the trace data file, used only by the formatting thread.
+	 * NULL if no reader could be opened for the current data.
+	 */
+	kshark_reader		*_reader;
+
+	/** The data generation, the reader has been opened for. */
+	unsigned int		_readerGeneration;
+
+	void _run();
+
+	void _openReader(unsigned int generation);
+
+	bool _format(int row, unsigned int generation);
+};
+
 /**
  * Class KsViewModel provides models for trace data representation in a
  * table view.
@@ -86,6 +217,8 @@ public:
 
 	QVariant getValue(int column, int row) const;
 
+	void stopFormatting();
+
 	size_t search(int column,
 		      const QString &searchText,
 		      search_condition_func cond,
@@ -142,6 +275,9 @@ private:
 
 	/** The color of the row selected by marker B. */
 	QColor	_colorMarkB;
+
+	/** Background formatting of the Latency and Info columns. */
+	mutable KsRowFormatter	_formatter;
 };
 
 /**
@@ -154,6 +290,8 @@ class KsFilterProxyModel : public QSortFilterProxyModel
 public:
 	explicit KsFilterProxyModel(QObject *parent = nullptr);
 
+	~KsFilterProxyModel();
+
 	bool filterAcceptsRow(int sourceRow,
 			      const QModelIndex &sourceParent) const override;
 
@@ -170,6 +308,13 @@ public:
 
 	size_t search(KsSearchFSM *sm, QList<int> *matchList);
 
+	bool searchIndexed(int column,
+			   const QString &searchText,
+			   search_condition_func cond,
+			   QList<int> *matchList);
+
+	void stopInfoIndex();
+
 	QList<int> searchMap(int column,
 			     const QString  &searchText,
 			     search_condition_func  cond,
@@ -219,6 +364,23 @@ private:
 
 	KsViewModel	 	*_source;
 
+	/** Full-text index of the info strings. NULL if not ready. */
+	kshark_info_index	*_infoIndex;
+
+	/** Mutex protecting the full-text index. */
+	std::mutex		_infoIndexMutex;
+
+	/** Thread building the full-text index in the background. */
+	std::thread		_infoIndexThread;
+
+	/** If set, the building of the full-text index is aborted. */
+	int			_infoIndexCancel;
+
+	void _startInfoIndex(KsDataStore *data);
+
+	bool _searchParallel(KsSearchFSM *sm, QList<int> *matchList,
+			     int first, int last);
+
 	size_t _search(int column,
 		       const QString &searchText,
 		       search_condition_func cond,
@@ -288,8 +450,15 @@ public:
 
 	void update(KsDataStore *data = nullptr);
 
+	void setDataStore(KsDataStore *data);
+
 private:
 	kshark_trace_histo	_histo;
+
+	/** The Data Store, following the time-window in out-of-core mode. */
+	KsDataStore		*_data;
+
+	void _syncWindow();
 };
 
 /** Defines a default number of bins to be used by the visualization model. */
@@ -15,6 +15,9 @@
 // C++
 #include <algorithm>
 #include <vector>
+#include <thread>
+#include <atomic>
+#include <system_error>
 
 // OpenGL
 #include <GL/freeglut.h>
@@ -452,6 +455,91 @@ void Polygon::_draw(const Color &col, float size) const
 					    size);
 }
 
+/** @brief Remove all shapes. The allocated memory is kept for reuse. */
+void ShapeBuffer::clear()
+{
+	_items.clear();
+}
+
+/**
+ * @brief Add a point.
+ *
+ * @param x: X coordinate of the point in pixels.
+ * @param y: Y coordinate of the point in pixels.
+ * @param col: The color of the point.
+ */
+void ShapeBuffer::addPoint(int x, int y, const Color &col)
+{
+	_items.push_back({ItemType::Point, {{x, y}}, col});
+}
+
+/**
+ * @brief Add a line between point "A" and point "B".
+ *
+ * @param xA: X coordinate of the point "A" in pixels.
+ * @param yA: Y coordinate of the point "A" in pixels.
+ * @param xB: X coordinate of the point "B" in pixels.
+ * @param yB: Y coordinate of the point "B" in pixels.
+ * @param col: The color of the line.
+ */
+void ShapeBuffer::addLine(int xA, int yA, int xB, int yB, const Color &col)
+{
+	_items.push_back({ItemType::Line, {{xA, yA}, {xB, yB}}, col});
+}
+
+/**
+ * @brief Add a rectangle, defined by two opposite corners.
+ *
+ * @param x0: X coordinate of the first corner in pixels.
+ * @param y0: Y coordinate of the first corner in pixels.
+ * @param x1: X coordinate of the opposite corner in pixels.
+ * @param y1: Y coordinate of the opposite corner in pixels.
+ * @param col: The color of the rectangle.
+ * @param fill: If True, the area of the rectangle will be colored.
+ *	  Otherwise only the contour of the rectangle will be plotted.
+ */
+void ShapeBuffer::addRectangle(int x0, int y0, int x1, int y1,
+			       const Color &col, bool fill)
+{
+	_items.push_back({fill ? ItemType::FilledRectangle :
+				 ItemType::Rectangle,
+			  {{x0, y0}, {x0, y1}, {x1, y1}, {x1, y0}},
+			  col});
+}
+
+/**
+ * @brief Draw all shapes, in the order they have been added.
+ *
+ * @param size: The size of the points and lines.
+ */
+void ShapeBuffer::draw(float size) const
+{
+	for (auto const &i: _items) {
+		switch (i._type) {
+		case ItemType::Point:
+			ksplot_draw_point(&i._points[0],
+					  i._color.color_c_ptr(), size);
+			break;
+
+		case ItemType::Line:
+			ksplot_draw_line(&i._points[0], &i._points[1],
+					 i._color.color_c_ptr(), size);
+			break;
+
+		case ItemType::FilledRectangle:
+			ksplot_draw_polygon(i._points, 4,
+					    i._color.color_c_ptr(), size);
+			break;
+
+		case ItemType::Rectangle:
+			ksplot_draw_polygon_contour(i._points, 4,
+						    i._color.color_c_ptr(),
+						    size);
+			break;
+		}
+	}
+}
+
 /**
  * @brief Create a default Mark.
  */
@@ -1101,6 +1189,54 @@ void Graph::fillTaskGraph(int pid)
 	}
 }
 
+/**
+ * @brief Fill a set of Graphs in parallel. The Graphs only read the model
+ *	  and the data collections, hence they can be filled concurrently.
+ *	  The jobs are distributed dynamically between a pool of worker
+ *	  threads, one per available core. The calling thread is one of the
+ *	  workers. The drawing of the Graphs has to be done afterwards, by the
+ *	  thread owning the OpenGL context.
+ *
+ * @param jobs: Input location for the Graphs to be filled.
+ */
+void fillGraphs(std::vector<GraphFillJob> *jobs)
+{
+	std::atomic<size_t> next(0);
+	std::vector<std::thread> pool;
+	size_t nThreads;
+
+	auto lamWorker = [&] () {
+		size_t i;
+
+		while ((i = next++) < jobs->size()) {
+			GraphFillJob &job = (*jobs)[i];
+
+			if (job._task)
+				job._graph->fillTaskGraph(job._id);
+			else
+				job._graph->fillCPUGraph(job._id);
+		}
+	};
+
+	nThreads = std::min<size_t>(std::thread::hardware_concurrency(),
+				    jobs->size());
+
+	/* The calling thread is one of the workers. */
+	for (size_t t = 1; t < nThreads; ++t) {
+		try {
+			pool.emplace_back(lamWorker);
+		} catch (const std::system_error &) {
+			/* Continue with the threads created so far. */
+			break;
+		}
+	}
+
+	lamWorker();
+
+	for (auto &t: pool)
+		t.join();
+}
+
 /**
  * @brief Draw the Graph
  *
@@ -15,6 +15,7 @@
 // C++
 #include <forward_list>
 #include <unordered_map>
+#include <vector>
 
 // KernelShark
 #include "libkshark.h"
@@ -303,6 +304,63 @@ public:
 	virtual ~Rectangle() {}
 };
 
+/**
+ * Buffer of simple shapes (points, lines and rectangles), stored by value in
+ * a contiguous array. Clearing the buffer keeps the allocated memory, hence
+ * shapes can be added to the buffer repeatedly, without allocating memory
+ * for each individual shape. The shapes are drawn in the order they have been
+ * added, unless a batch of libkshark-plot groups them by type and color.
+ */
+class ShapeBuffer {
+public:
+	void clear();
+
+	/** @brief Check if the buffer contains no shapes. */
+	bool empty() const {return _items.empty();}
+
+	void addPoint(int x, int y, const Color &col);
+
+	void addLine(int xA, int yA, int xB, int yB, const Color &col);
+
+	void addRectangle(int x0, int y0, int x1, int y1,
+			  const Color &col, bool fill);
+
+	void draw(float size) const;
+
+private:
+	/** Types of the shapes, stored in the buffer. */
+	enum class ItemType {
+		/** A single point. */
+		Point,
+
+		/** A line between two points. */
+		Line,
+
+		/** A rectangle, with its area colored. */
+		FilledRectangle,
+
+		/** Only the contour of a rectangle. */
+		Rectangle,
+	};
+
+	/** A shape, stored in the buffer. */
+	struct Item {
+		/** The type of the shape. */
+		ItemType	_type;
+
+		/**
+		 * The points of the shape. Only the first one, two or four
+		 * points are used, depending on the type of the shape.
+		 */
+		ksplot_point	_points[4];
+
+		/** The color of the shape. */
+		Color		_color;
+	};
+
+	std::vector<Item>	_items;
+};
+
 /**
  * This class represents the graphical element of the KernelShark GUI marker.
  */
@@ -510,6 +568,20 @@ private:
 	void _initBins();
 };
 
+/** A Graph, together with the CPU or the Task it has to be filled with. */
+struct GraphFillJob {
+	/** The Graph to be filled. */
+	Graph	*_graph;
+
+	/** CPU Id or Process Id. */
+	int	_id;
+
+	/** If true, this is a Task Graph. Else this is a CPU Graph. */
+	bool	_task;
+};
+
+void fillGraphs(std::vector<GraphFillJob> *jobs);
+
 }; // KsPlot
 
 #endif  /* _KS_PLOT_TOOLS_H */
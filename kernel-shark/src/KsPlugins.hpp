@@ -33,6 +33,13 @@ struct KsCppArgV {
 	 */
 	KsPlot::PlotObjList	*_shapes;
 
+	/**
+	 * Pointer to the buffers of simple shapes. Plugins should prefer
+	 * adding their lines and rectangles here, because this requires no
+	 * memory allocation per shape.
+	 */
+	KsPlot::ShapeBuffer	*_shapeBuffer;
+
 	/**
 	 * Convert the "this" pointer of the C++ argument vector into a
 	 * C pointer.
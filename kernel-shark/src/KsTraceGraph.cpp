@@ -363,8 +363,19 @@ void KsTraceGraph::_setPointerInfo(size_t i)
 void KsTraceGraph::markEntry(size_t row)
 {
 	int graph, cpuGrId, taskGrId;
+	uint64_t ts, offset;
+	ssize_t newRow;
+
+	/*
+	 * In out-of-core mode the row can be recorded (in a session) for
+	 * another time-window of the data.
+	 */
+	if (_data->chunks() && row >= (size_t) _data->size())
+		return;
 
 	_glWindow.findGraphIds(*_data->rows()[row], &cpuGrId, &taskGrId);
+	ts = _data->rows()[row]->ts;
+	offset = _data->rows()[row]->offset;
 
 	/*
 	 * If a Task graph has been found, this Task graph will be
@@ -384,7 +395,17 @@ void KsTraceGraph::markEntry(size_t row)
 				  50,
 				  KS_GRAPH_HEIGHT / 2 + _glWindow.vSpacing() / 2);
 
-	_glWindow.model()->jumpTo(_data->rows()[row]->ts);
+	_glWindow.model()->jumpTo(ts);
+
+	if (_data->chunks()) {
+		/* In out-of-core mode the jump can change the data. */
+		newRow = _data->findRow(ts, offset);
+		if (newRow < 0)
+			return;
+
+		row = newRow;
+	}
+
 	_mState->activeMarker().set(*_data,
 				    _glWindow.model()->histo(),
 				    row, cpuGrId, taskGrId);
@@ -397,7 +418,9 @@ void KsTraceGraph::_markerReDraw()
 	int cpuGrId, taskGrId;
 	size_t row;
 
-	if (_mState->markerA()._isSet) {
+	/* In out-of-core mode the markers can be outside of the data. */
+	if (_mState->markerA()._isSet &&
+	    (!_data->chunks() || _mState->markerA().remap(*_data))) {
 		row = _mState->markerA()._pos;
 		_glWindow.findGraphIds(*_data->rows()[row], &cpuGrId, &taskGrId);
 		_mState->markerA().set(*_data,
@@ -405,7 +428,8 @@ void KsTraceGraph::_markerReDraw()
 				       row, cpuGrId, taskGrId);
 	}
 
-	if (_mState->markerB()._isSet) {
+	if (_mState->markerB()._isSet &&
+	    (!_data->chunks() || _mState->markerB().remap(*_data))) {
 		row = _mState->markerB()._pos;
 		_glWindow.findGraphIds(*_data->rows()[row], &cpuGrId, &taskGrId);
 		_mState->markerB().set(*_data,
@@ -231,7 +231,8 @@ void KsTraceViewer::update(KsDataStore *data)
 	_proxyModel.fill(data);
 	_model.update(data);
 	_data = data;
-	if (_mState->activeMarker()._isSet)
+
+	if (_markerInData(_mState->activeMarker()))
 		showRow(_mState->activeMarker()._pos, true);
 }
 
@@ -455,6 +456,18 @@ void KsTraceViewer::clearSelection()
 	_view.clearSelection();
 }
 
+/*
+ * In out-of-core mode the marker can be outside of the loaded time-window
+ * of the data.
+ */
+bool KsTraceViewer::_markerInData(KsGraphMark &mark)
+{
+	if (!mark._isSet)
+		return false;
+
+	return !_data->chunks() || mark.remap(*_data);
+}
+
 /** Switch the Dual marker. */
 void KsTraceViewer::markSwitch()
 {
@@ -464,7 +477,7 @@ void KsTraceViewer::markSwitch()
 	DualMarkerState state = _mState->getState();
 
 	/* First deal with the passive marker. */
-	if (_mState->getMarker(!state)._isSet) {
+	if (_markerInData(_mState->getMarker(!state))) {
 		/*
 		 * The passive marker is set. Use the model to color the row of
 		 * the passive marker.
@@ -483,7 +496,7 @@ void KsTraceViewer::markSwitch()
 	 * Now deal with the active marker. This has to be done after dealing
 	 *  with the model, because changing the model clears the selection.
 	 */
-	if (_mState->getMarker(state)._isSet) {
+	if (_markerInData(_mState->getMarker(state))) {
 		/*
 		 * The active marker is set. Use QTableView to select its row.
 		 * The index in the source model is used to retrieve the value
@@ -597,6 +610,7 @@ size_t KsTraceViewer::_searchItems()
 {
 	int column = _searchFSM._columnComboBox.currentIndex();
 	QString searchText = _searchFSM._searchLineEdit.text();
+	bool indexed(false);
 	int count, dataRow;
 
 	if (searchText.isEmpty()) {
@@ -606,7 +620,21 @@ size_t KsTraceViewer::_searchItems()
 		return 0;
 	}
 
-	if (_proxyModel.rowCount({}) < KS_SEARCH_SHOW_PROGRESS_MIN) {
+	if (_searchFSM.getState() != search_state_t::Paused_s) {
+		/*
+		 * Try to use the full-text index of the info strings. A
+		 * paused search is always continued by scanning the table,
+		 * because part of the matches are already in the list.
+		 */
+		_searchFSM.updateCondition();
+		indexed = _proxyModel.searchIndexed(column, searchText,
+						    _searchFSM.condition(),
+						    &_matchList);
+	}
+
+	if (indexed) {
+		/* The search is done. */
+	} else if (_proxyModel.rowCount({}) < KS_SEARCH_SHOW_PROGRESS_MIN) {
 		/*
 		 * This is a small data-set. Do a single-threaded search
 		 * without showing the progress. We will bypass the state
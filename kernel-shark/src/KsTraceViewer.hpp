@@ -159,6 +159,8 @@ private:
 
 	void _setSearchIterator(int row);
 
+	bool _markerInData(KsGraphMark &mark);
+
 	bool _searchDone()
 	{
 		return _searchFSM.getState() == search_state_t::Done_s ||
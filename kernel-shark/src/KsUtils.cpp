@@ -151,6 +151,25 @@ bool isInstalled()
 	return appPath == installPath;
 }
 
+/**
+ * @brief Get the KernelShark cache directory of the user. This is the
+ *	  directory set by the environment variable KS_USER_CACHE_DIR, or
+ *	  the "kernelshark" subdirectory of the generic cache location. The
+ *	  directory may not exist yet.
+ */
+QString getCacheDir()
+{
+	QString dir = getenv("KS_USER_CACHE_DIR");
+
+	if (dir.isEmpty()) {
+		auto appCachePath = QStandardPaths::GenericCacheLocation;
+		dir = QStandardPaths::writableLocation(appCachePath);
+		dir += "/kernelshark";
+	}
+
+	return dir;
+}
+
 static QString getFileDialog(QWidget *parent,
 			     const QString &windowName,
 			     const QString &filter,
@@ -313,17 +332,21 @@ KsDataStore::KsDataStore(QWidget *parent)
 : QObject(parent),
   _tep(nullptr),
   _rows(nullptr),
-  _dataSize(0)
+  _dataSize(0),
+  _chunks(nullptr)
 {}
 
 /** Destroy the KsDataStore object. */
 KsDataStore::~KsDataStore()
-{}
+{
+	_waitCache();
+}
 
 /** Load trace data for file. */
 void KsDataStore::loadDataFile(const QString &file)
 {
 	kshark_context *kshark_ctx(nullptr);
+	uint64_t dataSize(0);
 
 	if (!kshark_instance(&kshark_ctx))
 		return;
@@ -342,22 +365,209 @@ void KsDataStore::loadDataFile(const QString &file)
 	else
 		kshark_handle_plugins(kshark_ctx, KSHARK_PLUGIN_UPDATE);
 
-	_dataSize = kshark_load_data_entries(kshark_ctx, &_rows);
+	for (int cpu = 0; cpu < tracecmd_cpus(kshark_ctx->handle); ++cpu)
+		dataSize += tracecmd_cpu_data_size(kshark_ctx->handle, cpu);
+
+	if (dataSize > KS_OUT_OF_CORE_DATA_SIZE) {
+		/*
+		 * The trace data is too big to be loaded in memory. Open the
+		 * file in out-of-core mode and start with the first chunk of
+		 * data.
+		 */
+		qInfo() << "Opening " << file << " in out-of-core mode";
+		_chunks = kshark_chunk_cache_alloc(kshark_ctx,
+						   KS_OUT_OF_CORE_CHUNK_SIZE,
+						   KS_OUT_OF_CORE_MAX_CHUNKS);
+		if (_chunks)
+			_loadWindow(_chunks->ts_min, _chunks->ts_min);
+
+		return;
+	}
+
+	_dataSize = kshark_load_data_entries_cached(kshark_ctx,
+						    file.toStdString().c_str(),
+						    &_rows);
+}
+
+/*
+ * Make the entries of a given time-window the data of the Data Store. Used
+ * in out-of-core mode only.
+ */
+bool KsDataStore::_loadWindow(uint64_t min, uint64_t max)
+{
+	kshark_entry **rows;
+	ssize_t n;
+
+	n = kshark_chunk_cache_get(_chunks, min, max, &rows);
+	if (n < 0)
+		return false;
+
+	_setWindow(rows, n);
+
+	return true;
+}
+
+/*
+ * Decode again the entries of the current time-window. Used in out-of-core
+ * mode only, when the plugins or the filters have changed.
+ */
+void KsDataStore::_reloadWindow()
+{
+	kshark_entry **rows;
+	ssize_t n;
+
+	emit aboutToFreeData();
+
+	/* The reloading frees the entries of the current time-window. */
+	_rows = nullptr;
+	_dataSize = 0;
+
+	n = kshark_chunk_cache_reload(_chunks, &rows);
+	if (n < 0)
+		return;
+
+	_setWindow(rows, n);
+}
+
+void KsDataStore::_setWindow(kshark_entry **rows, ssize_t size)
+{
+	kshark_context *kshark_ctx(nullptr);
+
+	if (!kshark_instance(&kshark_ctx))
+		return;
+
+	if (_dataSize > 0)
+		emit aboutToFreeData();
+
+	/*
+	 * All Data collections and indexes refer to the entries of the old
+	 * time-window.
+	 */
+	kshark_free_collection_list(kshark_ctx->collections);
+	kshark_ctx->collections = nullptr;
+	kshark_clear_field_columns(kshark_ctx);
+
+	_rows = rows;
+	_dataSize = size;
+
+	kshark_index_entries(kshark_ctx, _rows, _dataSize);
+
+	/*
+	 * The entries of the chunks, which stayed in memory, may have been
+	 * filtered with different filters.
+	 */
+	if (!kshark_ctx->advanced_event_filter->filters)
+		kshark_filter_entries(kshark_ctx, _rows, _dataSize);
+
+	registerCPUCollections();
+}
+
+/**
+ * @brief In out-of-core mode, replace the trace data by the entries of
+ *	  another time-window, obtained by using kshark_chunk_cache_get().
+ *
+ * @param rows: Input location for the trace data of the new time-window.
+ * @param size: The size of the trace data.
+ */
+void KsDataStore::setWindow(kshark_entry **rows, ssize_t size)
+{
+	if (!_chunks || rows == _rows)
+		return;
+
+	_setWindow(rows, size);
+
+	emit windowChanged(this);
+}
+
+/**
+ * @brief Find the index of an entry inside the data array. In out-of-core
+ *	  mode use this function to find an entry again, after the time-window
+ *	  has changed.
+ *
+ * @param ts: The timestamp of the entry.
+ * @param offset: The offset into the trace file of the entry.
+ *
+ * @returns The index of the entry, or a negative value if the entry is not
+ *	    in the data array.
+ */
+ssize_t KsDataStore::findRow(uint64_t ts, uint64_t offset) const
+{
+	ssize_t row;
+
+	if (_dataSize <= 0)
+		return -ENOENT;
+
+	row = kshark_find_entry_by_time(ts, _rows, 0, _dataSize - 1);
+	if (row < 0)
+		return -ENOENT;
+
+	while (row > 0 && _rows[row - 1]->ts == ts)
+		--row;
+
+	for (; row < _dataSize && _rows[row]->ts == ts; ++row)
+		if (_rows[row]->offset == offset)
+			return row;
+
+	return -ENOENT;
 }
 
-void KsDataStore::_freeData()
+void KsDataStore::_freeData(bool saveCache)
 {
-	if (_dataSize > 0) {
-		for (ssize_t r = 0; r < _dataSize; ++r)
-			free(_rows[r]);
+	kshark_context *kshark_ctx(nullptr);
 
-		free(_rows);
+	if (_dataSize > 0)
+		emit aboutToFreeData();
+
+	if (_chunks) {
+		/* Out-of-core mode. The entries belong to the cache. */
+		kshark_chunk_cache_free(_chunks);
+		_chunks = nullptr;
+	} else if (_dataSize > 0 && kshark_instance(&kshark_ctx)) {
+		if (saveCache && kshark_ctx->file &&
+		    kshark_entry_cache_outdated(kshark_ctx))
+			_saveCache(kshark_ctx);
+		else
+			kshark_free_data_entries(kshark_ctx, _rows, _dataSize);
 	}
 
 	_rows = nullptr;
 	_dataSize = 0;
 }
 
+/*
+ * Write the cache file of the trace data file and free the data. By now the
+ * data collections of the session are registered, so they get cached too.
+ * The file is written by a background thread, hence neither the closing
+ * nor the loading of the next file have to wait for it.
+ */
+void KsDataStore::_saveCache(kshark_context *kshark_ctx)
+{
+	kshark_cache_image *image;
+
+	image = kshark_entry_cache_detach(kshark_ctx, kshark_ctx->file,
+					  _rows, _dataSize);
+	if (!image) {
+		kshark_free_data_entries(kshark_ctx, _rows, _dataSize);
+		return;
+	}
+
+	_waitCache();
+
+	auto lamSave = [image] () {
+		kshark_entry_cache_image_save(image);
+		kshark_entry_cache_image_free(image);
+	};
+
+	_cacheThread = std::thread(lamSave);
+}
+
+/* Wait for the writing of the cache file to finish. */
+void KsDataStore::_waitCache()
+{
+	if (_cacheThread.joinable())
+		_cacheThread.join();
+}
+
 /** Reload the trace data. */
 void KsDataStore::reload()
 {
@@ -366,10 +576,19 @@ void KsDataStore::reload()
 	if (!kshark_instance(&kshark_ctx))
 		return;
 
-	_freeData();
+	_tep = kshark_ctx->pevent;
+
+	if (_chunks) {
+		_reloadWindow();
+		emit updateWidgets(this);
+
+		return;
+	}
+
+	/* The plugins have changed, so the data does not match the cache. */
+	_freeData(false);
 
 	_dataSize = kshark_load_data_entries(kshark_ctx, &_rows);
-	_tep = kshark_ctx->pevent;
 
 	emit updateWidgets(this);
 }
@@ -379,7 +598,7 @@ void KsDataStore::clear()
 {
 	kshark_context *kshark_ctx(nullptr);
 
-	_freeData();
+	_freeData(true);
 	_tep = nullptr;
 
 	if (kshark_instance(&kshark_ctx) && kshark_ctx->handle)
@@ -414,13 +633,15 @@ void KsDataStore::registerCPUCollections()
 		return;
 
 	int nCPUs = tep_get_cpus(_tep);
-	for (int cpu = 0; cpu < nCPUs; ++cpu) {
-		kshark_register_data_collection(kshark_ctx,
-						_rows, _dataSize,
-						KsUtils::matchCPUVisible,
-						cpu,
-						0);
-	}
+	QVector<int> cpus(nCPUs);
+	for (int cpu = 0; cpu < nCPUs; ++cpu)
+		cpus[cpu] = cpu;
+
+	kshark_register_data_collections(kshark_ctx,
+					 _rows, _dataSize,
+					 KsUtils::matchCPUVisible,
+					 cpus.constData(), nCPUs,
+					 0);
 }
 
 void KsDataStore::_unregisterCPUCollections()
@@ -523,6 +744,43 @@ void KsDataStore::applyNegCPUFilter(QVector<int> vec)
 	_applyIdFilter(KS_HIDE_CPU_FILTER, vec);
 }
 
+/**
+ * @brief Apply a filter of the values of a numeric event field.
+ *
+ * @param eventId: The Id of the trace event.
+ * @param field: The name of the field.
+ * @param min: The lower bound of the range (included).
+ * @param max: The upper bound of the range (included).
+ */
+void KsDataStore::applyFieldFilter(int eventId, const QString &field,
+				   qint64 min, qint64 max)
+{
+	kshark_context *kshark_ctx(nullptr);
+
+	if (!kshark_instance(&kshark_ctx) || !_tep)
+		return;
+
+	if (!kshark_filter_field_add(kshark_ctx, eventId,
+				     field.toStdString().c_str(),
+				     min, max))
+		return;
+
+	_unregisterCPUCollections();
+
+	/*
+	 * If the advanced event filter is set, the data has to be reloaded,
+	 * because the advanced filter uses tep_records.
+	 */
+	if (kshark_ctx->advanced_event_filter->filters)
+		reload();
+	else
+		kshark_filter_entries(kshark_ctx, _rows, _dataSize);
+
+	registerCPUCollections();
+
+	emit updateWidgets(this);
+}
+
 /** Disable all filters. */
 void KsDataStore::clearAllFilters()
 {
@@ -539,9 +797,18 @@ void KsDataStore::clearAllFilters()
 	kshark_filter_clear(kshark_ctx, KS_HIDE_EVENT_FILTER);
 	kshark_filter_clear(kshark_ctx, KS_SHOW_CPU_FILTER);
 	kshark_filter_clear(kshark_ctx, KS_HIDE_CPU_FILTER);
+	kshark_filter_field_clear(kshark_ctx);
 
 	tep_filter_reset(kshark_ctx->advanced_event_filter);
-	kshark_clear_all_filters(kshark_ctx, _rows, _dataSize);
+
+	/*
+	 * In out-of-core mode the filters have been applied to chunks of
+	 * data which are not visible now. Decode the data again.
+	 */
+	if (_chunks)
+		_reloadWindow();
+	else
+		kshark_clear_all_filters(kshark_ctx, _rows, _dataSize);
 
 	emit updateWidgets(this);
 }
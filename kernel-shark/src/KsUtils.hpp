@@ -14,6 +14,7 @@
 
 // C++ 11
 #include <chrono>
+#include <thread>
 
 // Qt
 #include <QtWidgets>
@@ -62,6 +63,19 @@ auto stringWidth = [](QString s)
 /** Macro providing the height of the KernelShark graphs in pixels. */
 #define KS_GRAPH_HEIGHT	(FONT_HEIGHT*2)
 
+/**
+ * Trace data files, having more trace data (in bytes) than this, are opened
+ * in out-of-core mode. Only the entries around the visible time-window are
+ * kept in memory.
+ */
+#define KS_OUT_OF_CORE_DATA_SIZE	(4ULL << 30)
+
+/** Approximate number of entries in one chunk of data in out-of-core mode. */
+#define KS_OUT_OF_CORE_CHUNK_SIZE	(1 << 20)
+
+/** Maximum number of chunks of data kept in memory in out-of-core mode. */
+#define KS_OUT_OF_CORE_MAX_CHUNKS	32
+
 //! @cond Doxygen_Suppress
 
 #define KS_JSON_CAST(doc) \
@@ -114,6 +128,8 @@ bool matchCPUVisible(struct kshark_context *kshark_ctx,
 
 bool isInstalled();
 
+QString getCacheDir();
+
 QString getFile(QWidget *parent,
 		const QString &windowName,
 		const QString &filter,
@@ -165,6 +181,16 @@ public:
 	/** Get the size of the data array. */
 	ssize_t size() const {return _dataSize;}
 
+	/**
+	 * Get the cache of data chunks. The cache is used only if the trace
+	 * data file is opened in out-of-core mode, otherwise this is NULL.
+	 */
+	kshark_chunk_cache *chunks() const {return _chunks;}
+
+	void setWindow(struct kshark_entry **rows, ssize_t size);
+
+	ssize_t findRow(uint64_t ts, uint64_t offset) const;
+
 	void reload();
 
 	void update();
@@ -183,6 +209,9 @@ public:
 
 	void applyNegCPUFilter(QVector<int>);
 
+	void applyFieldFilter(int eventId, const QString &field,
+			      qint64 min, qint64 max);
+
 	void clearAllFilters();
 
 signals:
@@ -192,6 +221,18 @@ signals:
 	 */
 	void updateWidgets(KsDataStore *);
 
+	/**
+	 * This signal is emitted before the trace data gets freed. The
+	 * signal may be emitted by a thread, different from the GUI thread.
+	 */
+	void aboutToFreeData();
+
+	/**
+	 * This signal is emitted when in out-of-core mode the data array
+	 * has been replaced by the entries of another time-window.
+	 */
+	void windowChanged(KsDataStore *);
+
 private:
 	/** Page event used to parse the page. */
 	tep_handle		*_tep;
@@ -202,7 +243,24 @@ private:
 	/** The size of the data array. */
 	ssize_t			_dataSize;
 
-	void _freeData();
+	/** Cache of data chunks, used in out-of-core mode. */
+	kshark_chunk_cache	*_chunks;
+
+	/** Thread writing the cache file of the closed trace data. */
+	std::thread		_cacheThread;
+
+	void _freeData(bool saveCache);
+
+	void _saveCache(kshark_context *kshark_ctx);
+
+	void _waitCache();
+
+	bool _loadWindow(uint64_t min, uint64_t max);
+
+	void _reloadWindow();
+
+	void _setWindow(struct kshark_entry **rows, ssize_t size);
+
 	void _unregisterCPUCollections();
 	void _applyIdFilter(int filterId, QVector<int> vec);
 };
@@ -25,7 +25,9 @@
 KsProgressBar::KsProgressBar(QString message, QWidget *parent)
 : QWidget(parent),
   _sb(this),
-  _pb(&_sb) {
+  _pb(&_sb),
+  _cancelButton("Cancel", this),
+  _canceled(false) {
 	resize(KS_BROGBAR_WIDTH, KS_BROGBAR_HEIGHT);
 	setWindowTitle("KernelShark");
 	setLayout(new QVBoxLayout);
@@ -39,6 +41,17 @@ KsProgressBar::KsProgressBar(QString message, QWidget *parent)
 
 	layout()->addWidget(new QLabel(message));
 	layout()->addWidget(&_sb);
+	layout()->addWidget(&_info);
+	_info.hide();
+
+	layout()->addWidget(&_cancelButton);
+	_cancelButton.hide();
+
+	connect(&_cancelButton,	&QPushButton::pressed,
+		[this] () {
+			_canceled = true;
+			_cancelButton.setEnabled(false);
+		});
 
 	setWindowFlags(Qt::WindowStaysOnTopHint);
 
@@ -54,6 +67,24 @@ void KsProgressBar::setValue(int i) {
 	QApplication::processEvents();
 }
 
+/** @brief Show additional information about the progress of the job.
+ *
+ * @param info: Text to be shown below the progressbar.
+ */
+void KsProgressBar::setInfo(const QString &info) {
+	_info.setText(info);
+	_info.show();
+}
+
+/**
+ * @brief Show a "Cancel" button. Use canceled() to check if the button was
+ *	  pressed.
+ */
+void KsProgressBar::enableCancel() {
+	_cancelButton.show();
+	QApplication::processEvents();
+}
+
 /**
  * @brief Create KsMessageDialog.
  *
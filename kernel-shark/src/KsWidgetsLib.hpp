@@ -27,10 +27,23 @@ class KsProgressBar : public QWidget
 
 	QProgressBar	_pb;
 
+	QLabel		_info;
+
+	QPushButton	_cancelButton;
+
+	bool		_canceled;
+
 public:
 	KsProgressBar(QString message, QWidget *parent = nullptr);
 
 	void setValue(int i);
+
+	void setInfo(const QString &info);
+
+	void enableCancel();
+
+	/** Check if the user has requested the job to be canceled. */
+	bool canceled() const {return _canceled;}
 };
 
 /** Defines the progress bar's maximum value. */
@@ -0,0 +1,1209 @@
+// SPDX-License-Identifier: LGPL-2.1
+
+/*
+ * Copyright (C) 2019 VMware Inc, Yordan Karadzhov <y.karadz@gmail.com>
+ */
+
+ /**
+  *  @file    libkshark-cache.c
+  *  @brief   Persistent (sidecar file) cache of the loaded trace data.
+  */
+
+// C
+#ifndef _GNU_SOURCE
+/** Use GNU C Library. */
+#define _GNU_SOURCE
+
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dlfcn.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// KernelShark
+#include "libkshark.h"
+
+/** Magic string, identifying a KernelShark entry cache file. */
+#define KS_CACHE_MAGIC		"KSCACHE"
+
+/** Version of the layout of the cache file. */
+#define KS_CACHE_VERSION	1
+
+/** Suffix, appended to the name of the trace data file. */
+#define KS_CACHE_SUFFIX		".kscache"
+
+/** Magic string, identifying a KernelShark info index file. */
+#define KS_INFO_INDEX_MAGIC	"KSINFO"
+
+/** Suffix of the info index file, appended to the name of the data file. */
+#define KS_INFO_INDEX_SUFFIX	".ksinfo"
+
+/** Maximum length of the name of a Matching condition function. */
+#define KS_CACHE_FUNC_NAME_MAX	128
+
+/** Maximum length of a task's command name (same as TASK_COMM_LEN). */
+#define KS_CACHE_COMM_LEN	16
+
+/**
+ * Header of the cache file. The header is followed by the array of entries,
+ * the array of tasks and the data collections. All sections start at an
+ * offset, aligned to 8 bytes.
+ */
+struct kshark_cache_header {
+	/** Magic string. */
+	char		magic[8];
+
+	/** Version of the layout. */
+	uint32_t	version;
+
+	/** Size of one entry, used to detect ABI changes. */
+	uint32_t	entry_size;
+
+	/** Size of the trace data file. */
+	uint64_t	trace_size;
+
+	/** Modification time (seconds) of the trace data file. */
+	int64_t		trace_mtime_sec;
+
+	/** Modification time (nanoseconds) of the trace data file. */
+	int64_t		trace_mtime_nsec;
+
+	/** Hash of the names of all registered plugins. */
+	uint64_t	plugin_hash;
+
+	/** Number of entries. */
+	uint64_t	n_entries;
+
+	/** Number of tasks. */
+	uint64_t	n_tasks;
+
+	/** Number of data collections. */
+	uint64_t	n_collections;
+
+	/** Offset of the array of entries. */
+	uint64_t	entries_offset;
+
+	/** Offset of the array of tasks. */
+	uint64_t	tasks_offset;
+
+	/** Offset of the data collections. */
+	uint64_t	collections_offset;
+};
+
+/**
+ * Header of the info index file. The header is followed by the array of
+ * offsets of the hash buckets and by the compressed lists of the buckets.
+ */
+struct kshark_info_index_header {
+	/** Identification of the trace data file. */
+	struct kshark_cache_header	cache;
+
+	/** Number of indexed rows. */
+	uint64_t			n_rows;
+
+	/** Number of rows per block. */
+	uint64_t			block;
+
+	/** Number of hash buckets. */
+	uint64_t			n_buckets;
+
+	/** The size of the compressed lists in bytes. */
+	uint64_t			data_size;
+};
+
+/** Task record of the cache file. */
+struct kshark_cache_task {
+	/** PID of the task. */
+	int32_t	pid;
+
+	/** Command name of the task. */
+	char	comm[KS_CACHE_COMM_LEN];
+
+	/** Padding. */
+	char	pad[4];
+};
+
+/**
+ * Data collection record of the cache file. The record is followed by the
+ * arrays of Resume and Break points ("size" 64-bit values each).
+ */
+struct kshark_cache_collection {
+	/** Symbol name of the Matching condition function. */
+	char		cond[KS_CACHE_FUNC_NAME_MAX];
+
+	/** Matching condition value. */
+	int64_t		val;
+
+	/** Number of data intervals. */
+	uint64_t	size;
+};
+
+static inline uint64_t cache_align(uint64_t offset)
+{
+	return (offset + 7) & ~7ULL;
+}
+
+static char *cache_file_name(const char *file, const char *suffix)
+{
+	char *name;
+
+	if (asprintf(&name, "%s%s", file, suffix) < 0)
+		return NULL;
+
+	return name;
+}
+
+/*
+ * The info index of a trace data file, kept in a directory different from
+ * the one of the data file. The absolute path of the data file is encoded in
+ * the name of the index file, so that the indexes of different data files
+ * do not collide.
+ */
+static char *info_index_file_name(const char *file, const char *dir)
+{
+	char *path, *name, *c;
+
+	if (!dir)
+		return cache_file_name(file, KS_INFO_INDEX_SUFFIX);
+
+	path = realpath(file, NULL);
+	if (!path)
+		return NULL;
+
+	for (c = path; *c; ++c)
+		if (*c == '/')
+			*c = '%';
+
+	if (asprintf(&name, "%s/%s%s", dir, path, KS_INFO_INDEX_SUFFIX) < 0)
+		name = NULL;
+
+	free(path);
+
+	return name;
+}
+
+static uint64_t cache_plugin_hash(struct kshark_context *kshark_ctx)
+{
+	struct kshark_plugin_list *plugin;
+	uint64_t hash = 0, h;
+	const char *c;
+
+	/*
+	 * The order in which the plugins are registered does not change the
+	 * result of the loading, hence the hashes of the individual names are
+	 * combined in an order-independent way.
+	 */
+	for (plugin = kshark_ctx->plugins; plugin; plugin = plugin->next) {
+		h = 14695981039346656037ULL;
+		for (c = plugin->file; *c; ++c) {
+			h ^= (unsigned char) *c;
+			h *= 1099511628211ULL;
+		}
+
+		hash += h;
+	}
+
+	return hash;
+}
+
+static bool cache_header_init(struct kshark_context *kshark_ctx,
+			      const char *file,
+			      struct kshark_cache_header *header)
+{
+	struct stat st;
+
+	if (stat(file, &st) < 0)
+		return false;
+
+	memset(header, 0, sizeof(*header));
+	memcpy(header->magic, KS_CACHE_MAGIC, sizeof(KS_CACHE_MAGIC));
+	header->version = KS_CACHE_VERSION;
+	header->entry_size = sizeof(struct kshark_entry);
+	header->trace_size = st.st_size;
+	header->trace_mtime_sec = st.st_mtim.tv_sec;
+	header->trace_mtime_nsec = st.st_mtim.tv_nsec;
+	header->plugin_hash = cache_plugin_hash(kshark_ctx);
+
+	return true;
+}
+
+static bool cache_header_match(const struct kshark_cache_header *a,
+			       const struct kshark_cache_header *b)
+{
+	return memcmp(a->magic, b->magic, sizeof(a->magic)) == 0 &&
+	       a->version == b->version &&
+	       a->entry_size == b->entry_size &&
+	       a->trace_size == b->trace_size &&
+	       a->trace_mtime_sec == b->trace_mtime_sec &&
+	       a->trace_mtime_nsec == b->trace_mtime_nsec &&
+	       a->plugin_hash == b->plugin_hash;
+}
+
+static bool cache_write(FILE *fp, const void *buf, size_t size, uint64_t *pos)
+{
+	static const char zeros[8];
+	uint64_t aligned;
+
+	if (size && fwrite(buf, size, 1, fp) != 1)
+		return false;
+
+	*pos += size;
+	aligned = cache_align(*pos);
+	if (aligned != *pos) {
+		if (fwrite(zeros, aligned - *pos, 1, fp) != 1)
+			return false;
+
+		*pos = aligned;
+	}
+
+	return true;
+}
+
+static bool cache_func_name(matching_condition_func *cond, char *name)
+{
+	Dl_info info;
+
+	/*
+	 * The address of the function is not persistent, hence the function
+	 * is stored by its symbol name.
+	 */
+	if (!dladdr((void *) cond, &info) || !info.dli_sname ||
+	    info.dli_saddr != (void *) cond ||
+	    strlen(info.dli_sname) >= KS_CACHE_FUNC_NAME_MAX)
+		return false;
+
+	strcpy(name, info.dli_sname);
+	return true;
+}
+
+/**
+ * The trace data and the state of the session, which go into a cache file.
+ * The image can be written without accessing the session.
+ */
+struct kshark_cache_image {
+	/** Header of the cache file. */
+	struct kshark_cache_header	header;
+
+	/** The name of the cache file. */
+	char				*cache_file;
+
+	/** The trace data. */
+	struct kshark_entry		**rows;
+
+	/** The size of the trace data. */
+	size_t				n_rows;
+
+	/** Number of CPUs of the trace data. */
+	int				n_cpus;
+
+	/** Array of task records ("header.n_tasks" elements). */
+	struct kshark_cache_task	*tasks;
+
+	/** Array of collection records ("header.n_collections" elements). */
+	struct kshark_cache_collection	*collections;
+
+	/** Resume and Break points of each collection. */
+	uint64_t			**points;
+
+	/** If true, the trace data is freed together with the image. */
+	bool				owns_data;
+
+	/** Memory mapping of the entry cache file, holding the data (if any). */
+	void				*map;
+
+	/** The size of the memory mapping. */
+	size_t				map_size;
+};
+
+static uint64_t cache_hash(uint64_t hash, const void *data, size_t size)
+{
+	const unsigned char *c = data;
+	size_t i;
+
+	for (i = 0; i < size; ++i) {
+		hash ^= c[i];
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+/* Hash of all data collections, which can be stored in a cache file. */
+static uint64_t cache_collections_hash(struct kshark_context *kshark_ctx)
+{
+	char name[KS_CACHE_FUNC_NAME_MAX];
+	struct kshark_entry_collection *col;
+	uint64_t hash = 14695981039346656037ULL;
+
+	for (col = kshark_ctx->collections; col; col = col->next) {
+		if (!cache_func_name(col->cond, name))
+			continue;
+
+		hash = cache_hash(hash, name, strlen(name) + 1);
+		hash = cache_hash(hash, &col->val, sizeof(col->val));
+		hash = cache_hash(hash, &col->size, sizeof(col->size));
+		hash = cache_hash(hash, col->resume_points,
+				  col->size * sizeof(*col->resume_points));
+		hash = cache_hash(hash, col->break_points,
+				  col->size * sizeof(*col->break_points));
+	}
+
+	return hash;
+}
+
+/**
+ * @brief Check if the cache file of the loaded trace data has to be
+ *	  (re)written. This is the case if the data has not been loaded from
+ *	  the cache, or if the data collections have changed since.
+ *
+ * @param kshark_ctx: Input location for the session context pointer.
+ */
+bool kshark_entry_cache_outdated(struct kshark_context *kshark_ctx)
+{
+	return !kshark_ctx->entry_cache ||
+	       kshark_ctx->entry_cache_hash != cache_collections_hash(kshark_ctx);
+}
+
+static bool cache_image_tasks(struct kshark_context *kshark_ctx,
+			      struct kshark_cache_image *image)
+{
+	ssize_t n_tasks, i;
+	int *pids = NULL;
+
+	n_tasks = kshark_get_task_pids(kshark_ctx, &pids);
+	if (n_tasks < 0)
+		return false;
+
+	image->tasks = calloc(n_tasks ? n_tasks : 1, sizeof(*image->tasks));
+	if (!image->tasks) {
+		free(pids);
+		return false;
+	}
+
+	for (i = 0; i < n_tasks; ++i) {
+		image->tasks[i].pid = pids[i];
+		if (tep_is_pid_registered(kshark_ctx->pevent, pids[i]))
+			strncpy(image->tasks[i].comm,
+				tep_data_comm_from_pid(kshark_ctx->pevent, pids[i]),
+				KS_CACHE_COMM_LEN - 1);
+	}
+
+	image->header.n_tasks = n_tasks;
+	free(pids);
+
+	return true;
+}
+
+static bool cache_image_collections(struct kshark_context *kshark_ctx,
+				    struct kshark_cache_image *image)
+{
+	struct kshark_cache_collection *rec;
+	struct kshark_entry_collection *col;
+	size_t n = 0, i;
+
+	for (col = kshark_ctx->collections; col; col = col->next)
+		++n;
+
+	image->collections = calloc(n ? n : 1, sizeof(*image->collections));
+	image->points = calloc(n ? n : 1, sizeof(*image->points));
+	if (!image->collections || !image->points)
+		return false;
+
+	/*
+	 * The collections are copied, because the session may change them
+	 * (or get closed) while the image is being written.
+	 */
+	for (col = kshark_ctx->collections; col; col = col->next) {
+		rec = &image->collections[image->header.n_collections];
+		if (!cache_func_name(col->cond, rec->cond))
+			continue;
+
+		rec->val = col->val;
+		rec->size = col->size;
+
+		image->points[image->header.n_collections] =
+			malloc((col->size ? 2 * col->size : 1) *
+			       sizeof(**image->points));
+		if (!image->points[image->header.n_collections])
+			return false;
+
+		for (i = 0; i < col->size; ++i) {
+			image->points[image->header.n_collections][i] =
+				col->resume_points[i];
+			image->points[image->header.n_collections][col->size + i] =
+				col->break_points[i];
+		}
+
+		image->header.n_collections++;
+	}
+
+	return true;
+}
+
+static struct kshark_cache_image *
+cache_image_alloc(struct kshark_context *kshark_ctx, const char *file,
+		  struct kshark_entry **data_rows, size_t n_rows)
+{
+	struct kshark_cache_image *image;
+
+	image = calloc(1, sizeof(*image));
+	if (!image)
+		return NULL;
+
+	if (!cache_header_init(kshark_ctx, file, &image->header))
+		goto fail;
+
+	image->cache_file = cache_file_name(file, KS_CACHE_SUFFIX);
+	if (!image->cache_file ||
+	    !cache_image_tasks(kshark_ctx, image) ||
+	    !cache_image_collections(kshark_ctx, image))
+		goto fail;
+
+	image->rows = data_rows;
+	image->n_rows = n_rows;
+	image->n_cpus = tracecmd_cpus(kshark_ctx->handle);
+
+	return image;
+
+ fail:
+	kshark_entry_cache_image_free(image);
+	return NULL;
+}
+
+/**
+ * @brief Detach the trace data, loaded by kshark_load_data_entries() or by
+ *	  kshark_load_data_entries_cached(), from the session and make an
+ *	  image of the cache file of the trace data file. The image holds the
+ *	  data, the tasks and the data collections, hence it can be written by
+ *	  kshark_entry_cache_image_save() in any thread, even after the session
+ *	  has been closed. On success, the data is owned by the image and is
+ *	  freed by kshark_entry_cache_image_free().
+ *
+ * @param kshark_ctx: Input location for the session context pointer.
+ * @param file: The trace data file.
+ * @param data_rows: Input location for the trace data.
+ * @param n_rows: The size of the inputted data.
+ *
+ * @returns The image on success, or NULL on failure. On failure, the data
+ *	    still belongs to the session.
+ */
+struct kshark_cache_image *
+kshark_entry_cache_detach(struct kshark_context *kshark_ctx, const char *file,
+			  struct kshark_entry **data_rows, size_t n_rows)
+{
+	struct kshark_cache_image *image;
+	const char *map;
+
+	if (!kshark_ctx || !file || !data_rows)
+		return NULL;
+
+	image = cache_image_alloc(kshark_ctx, file, data_rows, n_rows);
+	if (!image)
+		return NULL;
+
+	if (data_rows == kshark_ctx->index_data)
+		kshark_index_clear(kshark_ctx);
+
+	if (data_rows == kshark_ctx->field_data)
+		kshark_clear_field_columns(kshark_ctx);
+
+	/* The entries may point into the mapping of the old cache file. */
+	map = kshark_ctx->entry_cache;
+	if (map && n_rows &&
+	    (const char *) data_rows[0] >= map &&
+	    (const char *) data_rows[0] < map + kshark_ctx->entry_cache_size) {
+		image->map = kshark_ctx->entry_cache;
+		image->map_size = kshark_ctx->entry_cache_size;
+		kshark_ctx->entry_cache = NULL;
+		kshark_ctx->entry_cache_size = 0;
+	}
+
+	image->owns_data = true;
+
+	return image;
+}
+
+/**
+ * @brief Write an image into its cache file.
+ *
+ * @param image: Input location for the image.
+ *
+ * @returns True on success, or false on failure.
+ */
+bool kshark_entry_cache_image_save(struct kshark_cache_image *image)
+{
+	struct kshark_cache_header header = image->header;
+	struct kshark_entry **data_rows = image->rows;
+	struct kshark_cache_collection *col_rec;
+	uint64_t pos = 0, *next = NULL;
+	struct kshark_entry entry;
+	char *tmp_file = NULL;
+	ssize_t i, *last = NULL;
+	int n_cpus = image->n_cpus;
+	FILE *fp = NULL;
+	bool ret = false;
+	uint64_t k;
+	int cpu;
+
+	if (asprintf(&tmp_file, "%s.%i", image->cache_file, getpid()) < 0) {
+		tmp_file = NULL;
+		goto out;
+	}
+
+	fp = fopen(tmp_file, "w");
+	if (!fp)
+		goto out;
+
+	/* Write a placeholder header. It will be rewritten at the end. */
+	if (!cache_write(fp, &header, sizeof(header), &pos))
+		goto out;
+
+	/*
+	 * The "next" pointers are stored as indexes (shifted by one, so that
+	 * zero means NULL). The entries of one CPU are linked in time, hence
+	 * the next entry is the following entry having the same CPU.
+	 */
+	last = malloc((n_cpus > 0 ? n_cpus : 1) * sizeof(*last));
+	next = calloc(image->n_rows ? image->n_rows : 1, sizeof(*next));
+	if (!last || !next)
+		goto out;
+
+	for (cpu = 0; cpu < n_cpus; ++cpu)
+		last[cpu] = -1;
+
+	for (i = 0; i < image->n_rows; ++i) {
+		cpu = data_rows[i]->cpu;
+		if (cpu < 0 || cpu >= n_cpus)
+			continue;
+
+		if (last[cpu] >= 0 && data_rows[last[cpu]]->next == data_rows[i])
+			next[last[cpu]] = i + 1;
+
+		last[cpu] = i;
+	}
+
+	header.entries_offset = pos;
+	header.n_entries = image->n_rows;
+	for (i = 0; i < image->n_rows; ++i) {
+		entry = *data_rows[i];
+		entry.next = (struct kshark_entry *) (uintptr_t) next[i];
+
+		/* Only the information about the plugins is persistent. */
+		entry.visible |= 0xFF & ~KS_PLUGIN_UNTOUCHED_MASK;
+
+		if (!cache_write(fp, &entry, sizeof(entry), &pos))
+			goto out;
+	}
+
+	header.tasks_offset = pos;
+	if (!cache_write(fp, image->tasks,
+			 header.n_tasks * sizeof(*image->tasks), &pos))
+		goto out;
+
+	header.collections_offset = pos;
+	for (k = 0; k < header.n_collections; ++k) {
+		col_rec = &image->collections[k];
+		if (!cache_write(fp, col_rec, sizeof(*col_rec), &pos) ||
+		    !cache_write(fp, image->points[k],
+				 2 * col_rec->size * sizeof(**image->points),
+				 &pos))
+			goto out;
+	}
+
+	if (fseek(fp, 0, SEEK_SET) < 0 ||
+	    fwrite(&header, sizeof(header), 1, fp) != 1)
+		goto out;
+
+	if (fclose(fp) == 0)
+		ret = rename(tmp_file, image->cache_file) == 0;
+
+	fp = NULL;
+
+ out:
+	if (fp)
+		fclose(fp);
+
+	if (!ret && tmp_file)
+		unlink(tmp_file);
+
+	free(next);
+	free(last);
+	free(tmp_file);
+
+	return ret;
+}
+
+/**
+ * @brief Free an image of a cache file. If the image owns the trace data,
+ *	  the data is freed too.
+ *
+ * @param image: Input location for the image.
+ */
+void kshark_entry_cache_image_free(struct kshark_cache_image *image)
+{
+	uint64_t k;
+	size_t i;
+
+	if (!image)
+		return;
+
+	if (image->owns_data) {
+		if (image->map) {
+			munmap(image->map, image->map_size);
+		} else {
+			for (i = 0; i < image->n_rows; ++i)
+				free(image->rows[i]);
+		}
+
+		free(image->rows);
+	}
+
+	if (image->points)
+		for (k = 0; k < image->header.n_collections; ++k)
+			free(image->points[k]);
+
+	free(image->points);
+	free(image->collections);
+	free(image->tasks);
+	free(image->cache_file);
+	free(image);
+}
+
+/**
+ * @brief Save the trace data, loaded by kshark_load_data_entries(), into a
+ *	  cache file next to the trace data file. The cache contains the
+ *	  entries, the tasks and all data collections, having a Matching
+ *	  condition function which can be found by its symbol name. The
+ *	  cache is only valid for the same trace data file (size and
+ *	  modification time) and the same set of registered plugins.
+ *
+ * @param kshark_ctx: Input location for the session context pointer.
+ * @param file: The trace data file.
+ * @param data_rows: Input location for the trace data.
+ * @param n_rows: The size of the inputted data.
+ *
+ * @returns True on success, or false on failure.
+ */
+bool kshark_save_entry_cache(struct kshark_context *kshark_ctx,
+			     const char *file,
+			     struct kshark_entry **data_rows,
+			     size_t n_rows)
+{
+	struct kshark_cache_image *image;
+	bool ret;
+
+	if (!kshark_ctx || !file || !data_rows)
+		return false;
+
+	image = cache_image_alloc(kshark_ctx, file, data_rows, n_rows);
+	if (!image)
+		return false;
+
+	ret = kshark_entry_cache_image_save(image);
+	kshark_entry_cache_image_free(image);
+
+	return ret;
+}
+
+static bool cache_load_collections(struct kshark_context *kshark_ctx,
+				   const struct kshark_cache_header *header,
+				   const char *map, size_t map_size)
+{
+	const struct kshark_cache_collection *col_rec;
+	struct kshark_entry_collection *col;
+	matching_condition_func *cond;
+	const uint64_t *points;
+	uint64_t pos, i, k;
+
+	pos = header->collections_offset;
+	for (k = 0; k < header->n_collections; ++k) {
+		if (pos + sizeof(*col_rec) > map_size)
+			return false;
+
+		col_rec = (const struct kshark_cache_collection *) (map + pos);
+		pos += sizeof(*col_rec);
+		if (col_rec->size > map_size / sizeof(*points) ||
+		    pos + 2 * col_rec->size * sizeof(*points) > map_size)
+			return false;
+
+		points = (const uint64_t *) (map + pos);
+		pos += 2 * col_rec->size * sizeof(*points);
+
+		cond = dlsym(RTLD_DEFAULT, col_rec->cond);
+		if (!cond ||
+		    kshark_find_data_collection(kshark_ctx->collections,
+						cond, col_rec->val))
+			continue;
+
+		col = calloc(1, sizeof(*col));
+		if (!col)
+			return false;
+
+		if (!kshark_collection_points_alloc(col, col_rec->size)) {
+			free(col);
+			return false;
+		}
+
+		for (i = 0; i < col_rec->size; ++i) {
+			col->resume_points[i] = points[i];
+			col->break_points[i] = points[col_rec->size + i];
+		}
+
+		col->cond = cond;
+		col->val = col_rec->val;
+
+		col->next = kshark_ctx->collections;
+		kshark_ctx->collections = col;
+	}
+
+	return true;
+}
+
+static void cache_progress_report(struct kshark_context *kshark_ctx,
+				  enum kshark_load_phase phase,
+				  uint64_t done, uint64_t total)
+{
+	struct kshark_load_progress progress;
+
+	if (!kshark_ctx->load_progress_func)
+		return;
+
+	memset(&progress, 0, sizeof(progress));
+	progress.phase = phase;
+	progress.done = done;
+	progress.total = total;
+	progress.n_entries = done;
+
+	kshark_ctx->load_progress_func(kshark_ctx, &progress,
+				       kshark_ctx->load_progress_data);
+}
+
+/*
+ * The plugin actions are not executed for the entries restored from the
+ * cache. The changes they made to the entries are stored in the cache, but
+ * the actions may also collect information from the records. Pass them the
+ * records of the events they handle now, before the data is used. The
+ * restored entries are not changed.
+ */
+static void cache_replay_plugin_actions(struct kshark_context *kshark_ctx,
+					struct kshark_entry **rows, size_t n)
+{
+	struct kshark_event_handler *evt_handler;
+	struct kshark_entry entry;
+	struct tep_record *rec;
+	size_t i;
+
+	if (!kshark_ctx->event_handlers)
+		return;
+
+	pthread_mutex_lock(&kshark_ctx->input_mutex);
+
+	for (i = 0; i < n; ++i) {
+		/* Entries without a record, like the "missed_events" ones. */
+		if (rows[i]->event_id < 0)
+			continue;
+
+		evt_handler = kshark_find_event_handler(kshark_ctx->event_handlers,
+							rows[i]->event_id);
+		if (!evt_handler)
+			continue;
+
+		rec = tracecmd_read_at(kshark_ctx->handle, rows[i]->offset,
+				       NULL);
+		if (!rec)
+			continue;
+
+		for (; evt_handler;
+		     evt_handler = kshark_find_event_handler(evt_handler->next,
+							     rows[i]->event_id)) {
+			entry = *rows[i];
+			evt_handler->event_func(kshark_ctx, rec, &entry);
+		}
+
+		free_record(rec);
+	}
+
+	pthread_mutex_unlock(&kshark_ctx->input_mutex);
+}
+
+/**
+ * @brief Load the trace data from the cache file of the trace data file.
+ *	  The cache file is mapped in memory and the outputted entries point
+ *	  directly into the mapping. Use kshark_free_data_entries() to free
+ *	  the data.
+ *
+ * @param kshark_ctx: Input location for the session context pointer.
+ * @param file: The trace data file.
+ * @param data_rows: Output location for the trace data.
+ *
+ * @returns The size of the outputted data in the case of success, or a
+ *	    negative error code on failure. -ENOENT is returned if no valid
+ *	    cache exists.
+ */
+ssize_t kshark_load_entry_cache(struct kshark_context *kshark_ctx,
+				const char *file,
+				struct kshark_entry ***data_rows)
+{
+	const struct kshark_cache_header *header;
+	const struct kshark_cache_task *tasks;
+	struct kshark_cache_header expected;
+	struct kshark_entry *entries, **rows;
+	char *cache_file, comm[KS_CACHE_COMM_LEN];
+	uint64_t i, next;
+	struct stat st;
+	void *map;
+	int fd;
+
+	if (!kshark_ctx || !file || kshark_ctx->entry_cache)
+		return -EINVAL;
+
+	/* The Advanced filter needs the records. */
+	if (kshark_ctx->advanced_event_filter &&
+	    kshark_ctx->advanced_event_filter->filters)
+		return -ENOENT;
+
+	if (!cache_header_init(kshark_ctx, file, &expected))
+		return -ENOENT;
+
+	cache_file = cache_file_name(file, KS_CACHE_SUFFIX);
+	if (!cache_file)
+		return -ENOMEM;
+
+	fd = open(cache_file, O_RDONLY);
+	free(cache_file);
+	if (fd < 0)
+		return -ENOENT;
+
+	if (fstat(fd, &st) < 0 || st.st_size < sizeof(*header)) {
+		close(fd);
+		return -ENOENT;
+	}
+
+	/*
+	 * The mapping is private, because the "next" pointers have to be
+	 * restored in place. Only the pages of the entries get copied. The
+	 * rest of the file is paged in on demand.
+	 */
+	map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return -ENOENT;
+
+	header = map;
+	if (!cache_header_match(header, &expected) ||
+	    header->n_entries > st.st_size / sizeof(*entries) ||
+	    header->n_tasks > st.st_size / sizeof(*tasks) ||
+	    header->entries_offset +
+	    header->n_entries * sizeof(*entries) > st.st_size ||
+	    header->tasks_offset +
+	    header->n_tasks * sizeof(*tasks) > st.st_size)
+		goto fail_unmap;
+
+	rows = calloc(header->n_entries ? header->n_entries : 1, sizeof(*rows));
+	if (!rows)
+		goto fail_unmap;
+
+	__atomic_store_n(&kshark_ctx->load_cancel, 0, __ATOMIC_RELAXED);
+	cache_progress_report(kshark_ctx, KS_LOAD_CACHE, 0, header->n_entries);
+
+	entries = (struct kshark_entry *) ((char *) map + header->entries_offset);
+	for (i = 0; i < header->n_entries; ++i) {
+		next = (uintptr_t) entries[i].next;
+		if (next > header->n_entries) {
+			free(rows);
+			goto fail_unmap;
+		}
+
+		entries[i].next = next ? &entries[next - 1] : NULL;
+		rows[i] = &entries[i];
+	}
+
+	/*
+	 * Restore the tasks. The names of the tasks may have been registered
+	 * by a plugin during the original loading.
+	 */
+	tasks = (const struct kshark_cache_task *) ((char *) map +
+						    header->tasks_offset);
+	for (i = 0; i < header->n_tasks; ++i) {
+		if (!kshark_add_task(kshark_ctx, tasks[i].pid))
+			goto fail_free;
+
+		memcpy(comm, tasks[i].comm, KS_CACHE_COMM_LEN);
+		comm[KS_CACHE_COMM_LEN - 1] = '\0';
+		if (*comm && !tep_is_pid_registered(kshark_ctx->pevent,
+						    tasks[i].pid))
+			tep_register_comm(kshark_ctx->pevent, comm,
+					  tasks[i].pid);
+	}
+
+	if (!cache_load_collections(kshark_ctx, header, map, st.st_size))
+		goto fail_free;
+
+	cache_replay_plugin_actions(kshark_ctx, rows, header->n_entries);
+
+	kshark_filter_entries(kshark_ctx, rows, header->n_entries);
+
+	kshark_ctx->entry_cache = map;
+	kshark_ctx->entry_cache_size = st.st_size;
+	kshark_ctx->entry_cache_hash = cache_collections_hash(kshark_ctx);
+
+	free(*data_rows);
+	*data_rows = rows;
+
+	cache_progress_report(kshark_ctx, KS_LOAD_INDEX, 0, header->n_entries);
+	kshark_index_entries(kshark_ctx, rows, header->n_entries);
+
+	cache_progress_report(kshark_ctx, KS_LOAD_DONE,
+			      header->n_entries, header->n_entries);
+
+	return header->n_entries;
+
+ fail_free:
+	free(rows);
+	fprintf(stderr, "Failed to allocate memory during data loading.\n");
+	munmap(map, st.st_size);
+	return -ENOMEM;
+
+ fail_unmap:
+	munmap(map, st.st_size);
+	return -ENOENT;
+}
+
+/**
+ * @brief Load the content of the trace data file into an array of
+ *	  kshark_entries, using the cache file of the trace data file if a
+ *	  valid one exists. If no valid cache exists, the data is loaded
+ *	  using kshark_load_data_entries(). The cache file is not written
+ *	  here, because the data collections are registered later. Use
+ *	  kshark_entry_cache_outdated() and kshark_entry_cache_detach() when
+ *	  closing the data, or kshark_free_data_entries() to free the data.
+ *
+ * @param kshark_ctx: Input location for the session context pointer.
+ * @param file: The trace data file, opened by kshark_open().
+ * @param data_rows: Output location for the trace data.
+ *
+ * @returns The size of the outputted data in the case of success, or a
+ *	    negative error code on failure.
+ */
+ssize_t kshark_load_data_entries_cached(struct kshark_context *kshark_ctx,
+					const char *file,
+					struct kshark_entry ***data_rows)
+{
+	ssize_t n_rows;
+
+	n_rows = kshark_load_entry_cache(kshark_ctx, file, data_rows);
+	if (n_rows != -ENOENT)
+		return n_rows;
+
+	return kshark_load_data_entries(kshark_ctx, data_rows);
+}
+
+/**
+ * @brief Free an array of entries, loaded by kshark_load_data_entries() or
+ *	  by kshark_load_data_entries_cached().
+ *
+ * @param kshark_ctx: Input location for the session context pointer.
+ * @param data_rows: Input location for the trace data.
+ * @param n_rows: The size of the inputted data.
+ */
+void kshark_free_data_entries(struct kshark_context *kshark_ctx,
+			      struct kshark_entry **data_rows,
+			      size_t n_rows)
+{
+	const char *map = kshark_ctx ? kshark_ctx->entry_cache : NULL;
+	size_t i;
+
+	if (!data_rows)
+		return;
+
+	if (kshark_ctx && data_rows == kshark_ctx->index_data)
+		kshark_index_clear(kshark_ctx);
+
+	if (kshark_ctx && data_rows == kshark_ctx->field_data)
+		kshark_clear_field_columns(kshark_ctx);
+
+	if (map && n_rows &&
+	    (const char *) data_rows[0] >= map &&
+	    (const char *) data_rows[0] < map + kshark_ctx->entry_cache_size) {
+		munmap(kshark_ctx->entry_cache, kshark_ctx->entry_cache_size);
+		kshark_ctx->entry_cache = NULL;
+		kshark_ctx->entry_cache_size = 0;
+	} else {
+		for (i = 0; i < n_rows; ++i)
+			free(data_rows[i]);
+	}
+
+	free(data_rows);
+}
+
+static bool info_index_header_init(struct kshark_context *kshark_ctx,
+				   const char *file,
+				   struct kshark_info_index_header *header)
+{
+	memset(header, 0, sizeof(*header));
+	if (!cache_header_init(kshark_ctx, file, &header->cache))
+		return false;
+
+	memset(header->cache.magic, 0, sizeof(header->cache.magic));
+	memcpy(header->cache.magic, KS_INFO_INDEX_MAGIC,
+	       sizeof(KS_INFO_INDEX_MAGIC));
+	header->block = KS_INFO_INDEX_BLOCK;
+	header->n_buckets = KS_INFO_INDEX_BUCKETS;
+
+	return true;
+}
+
+/**
+ * @brief Save a full-text index of the info strings into a file next to the
+ *	  trace data file, or into a given directory. The saved index is only
+ *	  valid for the same trace data file (size and modification time) and
+ *	  the same set of registered plugins.
+ *
+ * @param kshark_ctx: Input location for the session context pointer.
+ * @param file: The trace data file.
+ * @param dir: The directory of the index file. If NULL, the index file is
+ *	       saved next to the trace data file.
+ * @param index: Input location for the index.
+ *
+ * @returns True on success, or false on failure.
+ */
+bool kshark_save_info_index(struct kshark_context *kshark_ctx,
+			    const char *file, const char *dir,
+			    const struct kshark_info_index *index)
+{
+	struct kshark_info_index_header header;
+	char *index_file, *tmp_file = NULL;
+	uint64_t pos = 0;
+	bool ret = false;
+	FILE *fp = NULL;
+
+	if (!kshark_ctx || !file || !index)
+		return false;
+
+	if (!info_index_header_init(kshark_ctx, file, &header))
+		return false;
+
+	header.n_rows = index->n_rows;
+	header.data_size = index->offsets[KS_INFO_INDEX_BUCKETS];
+
+	index_file = info_index_file_name(file, dir);
+	if (!index_file ||
+	    asprintf(&tmp_file, "%s.%i", index_file, getpid()) < 0) {
+		tmp_file = NULL;
+		goto out;
+	}
+
+	fp = fopen(tmp_file, "w");
+	if (!fp)
+		goto out;
+
+	if (!cache_write(fp, &header, sizeof(header), &pos) ||
+	    !cache_write(fp, index->offsets,
+			 (KS_INFO_INDEX_BUCKETS + 1) * sizeof(*index->offsets),
+			 &pos) ||
+	    !cache_write(fp, index->data, header.data_size, &pos))
+		goto out;
+
+	if (fclose(fp) == 0)
+		ret = rename(tmp_file, index_file) == 0;
+
+	fp = NULL;
+
+ out:
+	if (fp)
+		fclose(fp);
+
+	if (!ret && tmp_file)
+		unlink(tmp_file);
+
+	free(tmp_file);
+	free(index_file);
+
+	return ret;
+}
+
+/**
+ * @brief Load the full-text index of the info strings, saved by
+ *	  kshark_save_info_index(). Use kshark_info_index_free() to free the
+ *	  index.
+ *
+ * @param kshark_ctx: Input location for the session context pointer.
+ * @param file: The trace data file.
+ * @param dir: The directory of the index file. If NULL, the index file is
+ *	       looked for next to the trace data file.
+ * @param n_rows: The size of the loaded trace data.
+ *
+ * @returns The index on success, or NULL if no valid index exists.
+ */
+struct kshark_info_index *
+kshark_load_info_index(struct kshark_context *kshark_ctx,
+		       const char *file, const char *dir, size_t n_rows)
+{
+	struct kshark_info_index_header header, expected;
+	struct kshark_info_index *index = NULL;
+	char *index_file;
+	FILE *fp;
+	size_t i;
+
+	if (!kshark_ctx || !file ||
+	    !info_index_header_init(kshark_ctx, file, &expected))
+		return NULL;
+
+	index_file = info_index_file_name(file, dir);
+	if (!index_file)
+		return NULL;
+
+	fp = fopen(index_file, "r");
+	free(index_file);
+	if (!fp)
+		return NULL;
+
+	if (fread(&header, sizeof(header), 1, fp) != 1 ||
+	    !cache_header_match(&header.cache, &expected.cache) ||
+	    header.n_rows != n_rows ||
+	    header.block != KS_INFO_INDEX_BLOCK ||
+	    header.n_buckets != KS_INFO_INDEX_BUCKETS)
+		goto fail;
+
+	index = calloc(1, sizeof(*index));
+	if (!index)
+		goto fail;
+
+	index->n_rows = n_rows;
+	index->offsets = malloc((KS_INFO_INDEX_BUCKETS + 1) *
+				sizeof(*index->offsets));
+	index->data = malloc(header.data_size ? header.data_size : 1);
+	if (!index->offsets || !index->data)
+		goto fail;
+
+	if (fseek(fp, cache_align(sizeof(header)), SEEK_SET) < 0 ||
+	    fread(index->offsets, sizeof(*index->offsets),
+		  KS_INFO_INDEX_BUCKETS + 1, fp) != KS_INFO_INDEX_BUCKETS + 1 ||
+	    (header.data_size &&
+	     fread(index->data, header.data_size, 1, fp) != 1))
+		goto fail;
+
+	/* The offsets must not point outside of the compressed lists. */
+	for (i = 0; i < KS_INFO_INDEX_BUCKETS; ++i)
+		if (index->offsets[i] > index->offsets[i + 1])
+			goto fail;
+
+	if (index->offsets[0] != 0 ||
+	    index->offsets[KS_INFO_INDEX_BUCKETS] != header.data_size)
+		goto fail;
+
+	fclose(fp);
+
+	return index;
+
+ fail:
+	kshark_info_index_free(index);
+	fclose(fp);
+
+	return NULL;
+}
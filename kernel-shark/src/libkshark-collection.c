@@ -12,6 +12,8 @@
 // C
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include <assert.h>
 #include <errno.h>
 
@@ -29,12 +31,17 @@ enum collection_point_type {
 
 #define LAST_BIN	-3
 
-struct entry_list {
-	struct entry_list	*next;
+struct entry_point {
 	size_t			index;
 	uint8_t			type;
 };
 
+struct entry_list {
+	struct entry_point	*points;
+	size_t			count;
+	size_t			size;
+};
+
 
 enum map_flags {
 	COLLECTION_BEFORE = -1,
@@ -42,46 +49,137 @@ enum map_flags {
 	COLLECTION_AFTER = 1,
 };
 
+struct collection_job {
+	struct kshark_context		*kshark_ctx;
+	struct kshark_entry		**data;
+	size_t				n_rows;
+	matching_condition_func		*cond;
+	int				*vals;
+	struct kshark_entry_collection	**cols;
+	const struct kshark_posting_list **lists;
+	size_t				n_vals;
+	size_t				margin;
+	size_t				next;
+};
+
+struct collection_sweep {
+	struct collection_job		*job;
+	size_t				*vals;
+	size_t				n_vals;
+	struct kshark_posting_list	*lists;
+	size_t				*sizes;
+	size_t				n_chunks;
+	size_t				next;
+	bool				failed;
+};
+
 //! @endcond
 
 /*
  * If the type of the last added entry is COLLECTION_IGNORE, overwrite this
  * entry (ignore the old entry values). Else add a new entry to the list.
  */
-static bool collection_add_entry(struct entry_list **list,
+static bool collection_add_entry(struct entry_list *list,
 				 size_t i, uint8_t type)
 {
-	struct entry_list *entry = *list;
+	struct entry_point *points;
+
+	if (!list->count ||
+	    list->points[list->count - 1].type != COLLECTION_IGNORE) {
+		if (list->count == list->size) {
+			list->size = list->size ? list->size * 2 : 64;
+			points = realloc(list->points,
+					 list->size * sizeof(*points));
+			if (!points)
+				return false;
+
+			list->points = points;
+		}
 
-	if (entry->type != COLLECTION_IGNORE) {
-		entry->next = malloc(sizeof(*entry));
-		if (!entry->next)
-			return false;
+		++list->count;
+	}
+
+	list->points[list->count - 1].index = i;
+	list->points[list->count - 1].type = type;
+
+	return true;
+}
 
-		entry = entry->next;
-		*list = entry;
+/* Change the type of the last added entry. */
+static void collection_set_last_type(struct entry_list *list, uint8_t type)
+{
+	list->points[list->count - 1].type = type;
+}
+
+/**
+ * @brief Allocate the arrays of Resume and Break points of a Data collection.
+ *	  Both arrays are stored in one contiguous block of memory, owned by
+ *	  "resume_points".
+ *
+ * @param col: Input location for the Data collection.
+ * @param size: Number of data intervals.
+ *
+ * @returns True on success, or false on failure.
+ */
+bool kshark_collection_points_alloc(struct kshark_entry_collection *col,
+				    size_t size)
+{
+	col->resume_points = calloc(2 * size + 1, sizeof(*col->resume_points));
+	if (!col->resume_points) {
+		col->break_points = NULL;
+		col->size = 0;
+		return false;
 	}
 
-	entry->index = i;
-	entry->type = type;
+	col->break_points = col->resume_points + size;
+	col->size = size;
 
 	return true;
 }
 
+/*
+ * Get the index of the entry, following the entry "i" on the same CPU (this
+ * is its "next" entry). If the data has no CPU index, i + 1 is returned and
+ * the "next" entry has to be searched for.
+ */
+static size_t next_on_cpu(struct kshark_context *kshark_ctx,
+			  struct kshark_entry **data,
+			  size_t i, ssize_t end)
+{
+	const struct kshark_posting_list *list;
+	size_t pos;
+
+	list = kshark_index_lookup(kshark_ctx, data, kshark_match_cpu,
+				   data[i]->cpu);
+	if (!list)
+		return i + 1;
+
+	pos = kshark_posting_list_find(list, i) + 1;
+	if (pos >= list->count || list->rows[pos] >= (size_t) end)
+		return end;
+
+	return list->rows[pos];
+}
+
+/*
+ * Process the collection. If "list" is not NULL, it holds the indexes of all
+ * entries satisfying the Matching condition and only those are visited.
+ */
 static struct kshark_entry_collection *
-kshark_data_collection_alloc(struct kshark_context *kshark_ctx,
-			     struct kshark_entry **data,
-			     ssize_t first,
-			     size_t n_rows,
-			     matching_condition_func cond,
-			     int val,
-			     size_t margin)
+collection_alloc_list(struct kshark_context *kshark_ctx,
+		      struct kshark_entry **data,
+		      ssize_t first,
+		      size_t n_rows,
+		      matching_condition_func cond,
+		      int val,
+		      size_t margin,
+		      const struct kshark_posting_list *list)
 {
 	struct kshark_entry_collection *col_ptr = NULL;
 	struct kshark_entry *last_vis_entry = NULL;
-	struct entry_list *col_list, *temp;
+	struct entry_list col_list = {NULL, 0, 0};
 	size_t resume_count = 0, break_count = 0;
-	size_t i, j, last_added = 0;
+	size_t i, j, pos, last_added = 0;
 	ssize_t end;
 	bool good_data = false;
 
@@ -94,30 +192,34 @@ kshark_data_collection_alloc(struct kshark_context *kshark_ctx,
 	if (first >= end)
 		return col_ptr;
 
-	col_list = malloc(sizeof(*col_list));
-	if (!col_list)
-		goto fail;
-
-	temp = col_list;
-
 	if (margin != 0) {
 		/*
 		 * If this collection includes margin data, add a margin data
 		 * interval at the very beginning of the data-set.
 		 */
-		temp->index = first;
-		temp->type = COLLECTION_RESUME;
+		if (!collection_add_entry(&col_list, first, COLLECTION_RESUME))
+			goto fail;
 		++resume_count;
 
-		collection_add_entry(&temp, first + margin - 1,
-				     COLLECTION_BREAK);
+		if (!collection_add_entry(&col_list, first + margin - 1,
+					  COLLECTION_BREAK))
+			goto fail;
 		++break_count;
-	} else {
-		temp->type = COLLECTION_IGNORE;
 	}
 
+	/* Jump directly to the entries satisfying the Matching condition. */
+	pos = list ? kshark_posting_list_find(list, first + margin) : 0;
+
 	for (i = first + margin; i < end; ++i) {
-		if (!cond(kshark_ctx, data[i], val)) {
+		if (list) {
+			while (pos < list->count && list->rows[pos] < i)
+				++pos;
+
+			if (pos == list->count || list->rows[pos] >= (size_t) end)
+				break;
+
+			i = list->rows[pos];
+		} else if (!cond(kshark_ctx, data[i], val)) {
 			/*
 			 * The entry is irrelevant for this collection.
 			 * Do nothing.
@@ -133,8 +235,9 @@ kshark_data_collection_alloc(struct kshark_context *kshark_ctx,
 			 */
 			good_data = true;
 			if (last_added == 0 || last_added < i - margin) {
-				collection_add_entry(&temp, i - margin,
-						 COLLECTION_RESUME);
+				if (!collection_add_entry(&col_list, i - margin,
+							  COLLECTION_RESUME))
+					goto fail;
 				++resume_count;
 			} else {
 				/*
@@ -142,7 +245,8 @@ kshark_data_collection_alloc(struct kshark_context *kshark_ctx,
 				 * Continue extending the previous data
 				 * interval.
 				 */
-				temp->type = COLLECTION_IGNORE;
+				collection_set_last_type(&col_list,
+							 COLLECTION_IGNORE);
 				--break_count;
 			}
 		} else if (good_data &&
@@ -156,7 +260,8 @@ kshark_data_collection_alloc(struct kshark_context *kshark_ctx,
 			last_vis_entry = data[i];
 
 			/* Keep adding entries until the "next" record. */
-			for (j = i + 1;
+			j = next_on_cpu(kshark_ctx, data, i, end);
+			for (;
 			     j != end && last_vis_entry->next != data[j];
 			     j++)
 				;
@@ -182,14 +287,17 @@ kshark_data_collection_alloc(struct kshark_context *kshark_ctx,
 
 			last_added = i = j;
 			if (!good_data) {
-				collection_add_entry(&temp, i, COLLECTION_BREAK);
+				if (!collection_add_entry(&col_list, i,
+							  COLLECTION_BREAK))
+					goto fail;
 				++break_count;
 			}
 		}
 	}
 
 	if (good_data) {
-		collection_add_entry(&temp, end - 1, COLLECTION_BREAK);
+		if (!collection_add_entry(&col_list, end - 1, COLLECTION_BREAK))
+			goto fail;
 		++break_count;
 	}
 
@@ -198,12 +306,14 @@ kshark_data_collection_alloc(struct kshark_context *kshark_ctx,
 		 * If this collection includes margin data, add a margin data
 		 * interval at the very end of the data-set.
 		 */
-		collection_add_entry(&temp, first + n_rows - margin,
-				 COLLECTION_RESUME);
+		if (!collection_add_entry(&col_list, first + n_rows - margin,
+					  COLLECTION_RESUME))
+			goto fail;
 		++resume_count;
 
-		collection_add_entry(&temp, first + n_rows - 1,
-				 COLLECTION_BREAK);
+		if (!collection_add_entry(&col_list, first + n_rows - 1,
+					  COLLECTION_BREAK))
+			goto fail;
 		++break_count;
 	}
 
@@ -214,52 +324,51 @@ kshark_data_collection_alloc(struct kshark_context *kshark_ctx,
 	assert(break_count == resume_count);
 
 	col_ptr->next = NULL;
-
-	col_ptr->resume_points = calloc(resume_count,
-					sizeof(*col_ptr->resume_points));
-	if (!col_ptr->resume_points)
-		goto fail;
-
-	col_ptr->break_points = calloc(break_count,
-				       sizeof(*col_ptr->break_points));
-	if (!col_ptr->break_points) {
-		free(col_ptr->resume_points);
-		goto fail;
-	}
-
 	col_ptr->cond = cond;
 	col_ptr->val = val;
 
-	col_ptr->size = resume_count;
+	if (!kshark_collection_points_alloc(col_ptr, resume_count))
+		goto fail;
+
 	for (i = 0; i < col_ptr->size; ++i) {
-		assert(col_list->type == COLLECTION_RESUME);
-		col_ptr->resume_points[i] = col_list->index;
-		temp = col_list;
-		col_list = col_list->next;
-		free(temp);
+		assert(col_list.points[2 * i].type == COLLECTION_RESUME);
+		col_ptr->resume_points[i] = col_list.points[2 * i].index;
 
-		assert(col_list->type == COLLECTION_BREAK);
-		col_ptr->break_points[i] = col_list->index;
-		temp = col_list;
-		col_list = col_list->next;
-		free(temp);
+		assert(col_list.points[2 * i + 1].type == COLLECTION_BREAK);
+		col_ptr->break_points[i] = col_list.points[2 * i + 1].index;
 	}
 
+	free(col_list.points);
+
 	return col_ptr;
 
 fail:
 	fprintf(stderr, "Failed to allocate memory for Data collection.\n");
 
 	free(col_ptr);
-	for (i = 0; i < resume_count + break_count; ++i) {
-		temp = col_list;
-		col_list = col_list->next;
-		free(temp);
-	}
+	free(col_list.points);
 
 	return NULL;
 }
 
+static struct kshark_entry_collection *
+kshark_data_collection_alloc(struct kshark_context *kshark_ctx,
+			     struct kshark_entry **data,
+			     ssize_t first,
+			     size_t n_rows,
+			     matching_condition_func cond,
+			     int val,
+			     size_t margin)
+{
+	const struct kshark_posting_list *list;
+
+	/* If the data is indexed, use the index of the Matching condition. */
+	list = kshark_index_lookup(kshark_ctx, data, cond, val);
+
+	return collection_alloc_list(kshark_ctx, data, first, n_rows,
+				     cond, val, margin, list);
+}
+
 /*
  * This function provides mapping between the index inside the data-set and
  * the index of the collection interval. Additional output flag is used to
@@ -739,10 +848,9 @@ kshark_find_data_collection(struct kshark_entry_collection *col,
  */
 void kshark_reset_data_collection(struct kshark_entry_collection *col)
 {
+	/* The Break points are stored in the same block of memory. */
 	free(col->resume_points);
 	col->resume_points = NULL;
-
-	free(col->break_points);
 	col->break_points = NULL;
 
 	col->size = 0;
@@ -751,7 +859,6 @@ void kshark_reset_data_collection(struct kshark_entry_collection *col)
 static void kshark_free_data_collection(struct kshark_entry_collection *col)
 {
 	free(col->resume_points);
-	free(col->break_points);
 	free(col);
 }
 
@@ -794,6 +901,295 @@ kshark_register_data_collection(struct kshark_context *kshark_ctx,
 	return col;
 }
 
+static void *collection_worker(void *arg)
+{
+	struct collection_job *job = arg;
+	size_t i;
+
+	while ((i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) <
+	       job->n_vals) {
+		job->cols[i] = collection_alloc_list(job->kshark_ctx,
+						     job->data,
+						     0, job->n_rows,
+						     job->cond,
+						     job->vals[i],
+						     job->margin,
+						     job->lists[i]);
+	}
+
+	return NULL;
+}
+
+static bool sweep_add_row(struct kshark_posting_list *list, size_t *size,
+			  size_t row)
+{
+	size_t *rows;
+
+	if (list->count == *size) {
+		*size = *size ? *size * 2 : 64;
+		rows = realloc(list->rows, *size * sizeof(*rows));
+		if (!rows)
+			return false;
+
+		list->rows = rows;
+	}
+
+	list->rows[list->count++] = row;
+
+	return true;
+}
+
+/*
+ * Each chunk of rows is checked against all values and the matching rows are
+ * added to the posting lists of the chunk (one list per value).
+ */
+static void *sweep_worker(void *arg)
+{
+	struct collection_sweep *sweep = arg;
+	struct collection_job *job = sweep->job;
+	struct kshark_posting_list *lists;
+	size_t c, row, last, v, *sizes;
+
+	while ((c = __atomic_fetch_add(&sweep->next, 1, __ATOMIC_RELAXED)) <
+	       sweep->n_chunks) {
+		lists = &sweep->lists[c * sweep->n_vals];
+		sizes = &sweep->sizes[c * sweep->n_vals];
+		row = job->n_rows * c / sweep->n_chunks;
+		last = job->n_rows * (c + 1) / sweep->n_chunks;
+
+		for (; row < last; ++row) {
+			for (v = 0; v < sweep->n_vals; ++v) {
+				if (!job->cond(job->kshark_ctx, job->data[row],
+					       job->vals[sweep->vals[v]]))
+					continue;
+
+				if (!sweep_add_row(&lists[v], &sizes[v], row)) {
+					sweep->failed = true;
+					return NULL;
+				}
+			}
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Run "func" in "n_jobs" parallel workers at most. The calling thread is one
+ * of the workers.
+ */
+static void collection_run_workers(void *(*func)(void *), void *arg,
+				   size_t n_jobs)
+{
+	size_t i, n_threads = 0;
+	pthread_t *threads = NULL;
+	long n_cpus;
+
+	n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (n_cpus > 1 && n_jobs > 1) {
+		n_threads = (size_t) n_cpus < n_jobs ? n_cpus : n_jobs;
+
+		--n_threads;
+		threads = calloc(n_threads, sizeof(*threads));
+		if (!threads)
+			n_threads = 0;
+	}
+
+	for (i = 0; i < n_threads; ++i) {
+		if (pthread_create(&threads[i], NULL, func, arg) != 0) {
+			n_threads = i;
+			break;
+		}
+	}
+
+	func(arg);
+
+	for (i = 0; i < n_threads; ++i)
+		pthread_join(threads[i], NULL);
+
+	free(threads);
+}
+
+/*
+ * Find the entries, satisfying the Matching condition for each value which is
+ * not indexed already. The data is swept only once. The outputted lists
+ * (one per value of "sweep->vals") are merged in "lists".
+ */
+static bool collection_sweep_data(struct collection_sweep *sweep,
+				  struct kshark_posting_list *lists)
+{
+	struct kshark_posting_list *chunk;
+	size_t c, v, count;
+	long n_cpus;
+	bool ret = false;
+
+	n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	/* Use more chunks than threads, to balance the load. */
+	sweep->n_chunks = n_cpus > 1 ? 4 * n_cpus : 1;
+	if (sweep->n_chunks > sweep->job->n_rows)
+		sweep->n_chunks = 1;
+
+	sweep->lists = calloc(sweep->n_chunks * sweep->n_vals,
+			      sizeof(*sweep->lists));
+	sweep->sizes = calloc(sweep->n_chunks * sweep->n_vals,
+			      sizeof(*sweep->sizes));
+	if (!sweep->lists || !sweep->sizes)
+		goto out;
+
+	collection_run_workers(sweep_worker, sweep, sweep->n_chunks);
+	if (sweep->failed)
+		goto out;
+
+	for (v = 0; v < sweep->n_vals; ++v) {
+		count = 0;
+		for (c = 0; c < sweep->n_chunks; ++c)
+			count += sweep->lists[c * sweep->n_vals + v].count;
+
+		lists[v].key = sweep->job->vals[sweep->vals[v]];
+		lists[v].count = 0;
+		lists[v].rows = malloc((count ? count : 1) *
+				       sizeof(*lists[v].rows));
+		if (!lists[v].rows)
+			goto out;
+
+		/* The chunks are in order, hence the merged list is sorted. */
+		for (c = 0; c < sweep->n_chunks; ++c) {
+			chunk = &sweep->lists[c * sweep->n_vals + v];
+			if (chunk->count)
+				memcpy(lists[v].rows + lists[v].count,
+				       chunk->rows,
+				       chunk->count * sizeof(*chunk->rows));
+
+			lists[v].count += chunk->count;
+		}
+	}
+
+	ret = true;
+
+ out:
+	if (sweep->lists) {
+		for (c = 0; c < sweep->n_chunks * sweep->n_vals; ++c)
+			free(sweep->lists[c].rows);
+	}
+
+	free(sweep->lists);
+	free(sweep->sizes);
+
+	return ret;
+}
+
+/**
+ * @brief Allocate and process data collections, defined with a given Matching
+ *	  condition function and a set of values. The data is swept only
+ *	  once (in parallel) for all values and the collections are added to
+ *	  the list of collections used by the session. Values, for which a
+ *	  collection is registered already, are skipped. The Matching
+ *	  condition function must be safe to be called from multiple threads
+ *	  at the same time.
+ *
+ * @param kshark_ctx: Input location for the session context pointer.
+ * @param data: Input location for the trace data.
+ * @param n_rows: The size of the inputted data.
+ * @param cond: Matching condition function for the collections to be
+ *	        registered.
+ * @param vals: Array of Matching condition values.
+ * @param n_vals: The size of the array of values.
+ * @param margin: The size of the additional (margin) data, added to each
+ *		  interval of the collections. See
+ *		  kshark_register_data_collection().
+ *
+ * @returns The number of newly registered Data collections on success, or a
+ *	    negative error code on failure.
+ */
+ssize_t kshark_register_data_collections(struct kshark_context *kshark_ctx,
+					 struct kshark_entry **data,
+					 size_t n_rows,
+					 matching_condition_func cond,
+					 const int *vals, size_t n_vals,
+					 size_t margin)
+{
+	struct collection_job job = {kshark_ctx, data, n_rows, cond};
+	struct collection_sweep sweep = {&job};
+	struct kshark_posting_list *swept = NULL;
+	ssize_t ret = 0;
+	size_t i, j;
+
+	job.vals = calloc(n_vals + 1, sizeof(*job.vals));
+	job.cols = calloc(n_vals + 1, sizeof(*job.cols));
+	job.lists = calloc(n_vals + 1, sizeof(*job.lists));
+	sweep.vals = calloc(n_vals + 1, sizeof(*sweep.vals));
+	swept = calloc(n_vals + 1, sizeof(*swept));
+	if (!job.vals || !job.cols || !job.lists || !sweep.vals || !swept) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	/* Skip the values which have a collection already. */
+	for (i = 0; i < n_vals; ++i) {
+		if (kshark_find_data_collection(kshark_ctx->collections,
+						cond, vals[i]))
+			continue;
+
+		for (j = 0; j < job.n_vals; ++j)
+			if (job.vals[j] == vals[i])
+				break;
+
+		if (j == job.n_vals)
+			job.vals[job.n_vals++] = vals[i];
+	}
+
+	job.margin = margin;
+	if (!job.n_vals)
+		goto out;
+
+	/* The values which are not indexed need a sweep through the data. */
+	for (i = 0; i < job.n_vals; ++i) {
+		job.lists[i] = kshark_index_lookup(kshark_ctx, data,
+						   cond, job.vals[i]);
+		if (!job.lists[i])
+			sweep.vals[sweep.n_vals++] = i;
+	}
+
+	if (sweep.n_vals) {
+		if (!collection_sweep_data(&sweep, swept)) {
+			ret = -ENOMEM;
+			goto out;
+		}
+
+		for (i = 0; i < sweep.n_vals; ++i)
+			job.lists[sweep.vals[i]] = &swept[i];
+	}
+
+	collection_run_workers(collection_worker, &job, job.n_vals);
+
+	for (i = 0; i < job.n_vals; ++i) {
+		if (!job.cols[i]) {
+			ret = -ENOMEM;
+			continue;
+		}
+
+		job.cols[i]->next = kshark_ctx->collections;
+		kshark_ctx->collections = job.cols[i];
+		if (ret >= 0)
+			++ret;
+	}
+
+ out:
+	if (swept) {
+		for (i = 0; i < sweep.n_vals; ++i)
+			free(swept[i].rows);
+	}
+
+	free(swept);
+	free(sweep.vals);
+	free(job.vals);
+	free(job.cols);
+	free(job.lists);
+
+	return ret;
+}
+
 /**
  * @brief Allocate and process data collection, defined with a given Matching
  *	  condition function and value. Add this collection to a given list of
@@ -1209,6 +1209,183 @@ bool kshark_import_adv_filters(struct kshark_context *kshark_ctx,
 	}
 }
 
+static bool kshark_field_filters_to_json(struct kshark_context *kshark_ctx,
+					 struct json_object *jobj)
+{
+	json_object *jfilter_data, *jfilter, *jsystem, *jname, *jfield;
+	json_object *jmin, *jmax;
+	struct kshark_field_filter *filter;
+	struct tep_event *event;
+
+	jfilter = jsystem = jname = jfield = jmin = jmax = NULL;
+
+	/*
+	 * If this Json document already contains a description of the field
+	 * filters, delete this description.
+	 */
+	json_del_if_exist(jobj, KS_FIELD_FILTER_NAME);
+
+	if (!kshark_ctx->field_filters)
+		return true;
+
+	/* Create a Json array and fill the filters into it. */
+	jfilter_data = json_object_new_array();
+	if (!jfilter_data)
+		goto fail;
+
+	for (filter = kshark_ctx->field_filters; filter; filter = filter->next) {
+		event = tep_find_event(kshark_ctx->pevent, filter->event_id);
+		if (!event)
+			continue;
+
+		jfilter = json_object_new_object();
+		jsystem = json_object_new_string(event->system);
+		jname = json_object_new_string(event->name);
+		jfield = json_object_new_string(filter->field);
+		jmin = json_object_new_int64(filter->min);
+		jmax = json_object_new_int64(filter->max);
+		if (!jfilter || !jsystem || !jname || !jfield || !jmin || !jmax)
+			goto fail;
+
+		json_object_object_add(jfilter, "system", jsystem);
+		json_object_object_add(jfilter, "name", jname);
+		json_object_object_add(jfilter, "field", jfield);
+		json_object_object_add(jfilter, "min", jmin);
+		json_object_object_add(jfilter, "max", jmax);
+
+		json_object_array_add(jfilter_data, jfilter);
+		jfilter = jsystem = jname = jfield = jmin = jmax = NULL;
+	}
+
+	/* Add the array of field filters to the filter config document. */
+	json_object_object_add(jobj, KS_FIELD_FILTER_NAME, jfilter_data);
+
+	return true;
+
+ fail:
+	fprintf(stderr, "Failed to allocate memory for json_object.\n");
+	json_object_put(jfilter_data);
+	json_object_put(jfilter);
+	json_object_put(jsystem);
+	json_object_put(jname);
+	json_object_put(jfield);
+	json_object_put(jmin);
+	json_object_put(jmax);
+
+	return false;
+}
+
+/**
+ * @brief Record the current configuration of the filters of the values of
+ *	  numeric event fields into a Configuration document.
+ *
+ * @param kshark_ctx: Input location for session context pointer.
+ * @param conf: Input location for the kshark_config_doc instance. Currently
+ *		only Json format is supported. If NULL, a new Filter
+ *		Configuration document will be created.
+ *
+ * @returns True on success, otherwise False.
+ */
+bool kshark_export_field_filters(struct kshark_context *kshark_ctx,
+				 struct kshark_config_doc **conf)
+{
+	if (!*conf)
+		*conf = kshark_filter_config_new(KS_CONFIG_JSON);
+
+	if (!*conf)
+		return false;
+
+	switch ((*conf)->format) {
+	case KS_CONFIG_JSON:
+		return kshark_field_filters_to_json(kshark_ctx,
+						    (*conf)->conf_doc);
+
+	default:
+		fprintf(stderr, "Document format %d not supported\n",
+			(*conf)->format);
+		return false;
+	}
+}
+
+static bool kshark_field_filters_from_json(struct kshark_context *kshark_ctx,
+					   struct json_object *jobj)
+{
+	json_object *jfilter_data, *jfilter, *jsystem, *jname, *jfield;
+	json_object *jmin, *jmax;
+	struct tep_event *event;
+	int i, length;
+
+	/*
+	 * Use the name of the filter to find the array of field filters.
+	 * Notice that the filter config document may contain no data for
+	 * this particular filter.
+	 */
+	if (!json_object_object_get_ex(jobj, KS_FIELD_FILTER_NAME,
+				       &jfilter_data))
+		return false;
+
+	if (!kshark_json_type_check(jobj, "kshark.config.filter") ||
+	    json_object_get_type(jfilter_data) != json_type_array)
+		goto fail;
+
+	length = json_object_array_length(jfilter_data);
+	for (i = 0; i < length; ++i) {
+		jfilter = json_object_array_get_idx(jfilter_data, i);
+
+		if (!json_object_object_get_ex(jfilter, "system", &jsystem) ||
+		    !json_object_object_get_ex(jfilter, "name", &jname) ||
+		    !json_object_object_get_ex(jfilter, "field", &jfield) ||
+		    !json_object_object_get_ex(jfilter, "min", &jmin) ||
+		    !json_object_object_get_ex(jfilter, "max", &jmax))
+			goto fail;
+
+		event = tep_find_event_by_name(kshark_ctx->pevent,
+					       json_object_get_string(jsystem),
+					       json_object_get_string(jname));
+		if (!event)
+			continue;
+
+		if (!kshark_filter_field_add(kshark_ctx, event->id,
+					     json_object_get_string(jfield),
+					     json_object_get_int64(jmin),
+					     json_object_get_int64(jmax)))
+			goto fail;
+	}
+
+	return true;
+
+ fail:
+	fprintf(stderr, "Failed to load the field filters.\n");
+	return false;
+}
+
+/**
+ * @brief Load from Configuration document the configuration of the filters
+ *	  of the values of numeric event fields.
+ *
+ * @param kshark_ctx: Input location for session context pointer.
+ * @param conf: Input location for the kshark_config_doc instance. Currently
+ *		only Json format is supported.
+ *
+ * @returns True, if a filter has been loaded. If the filter configuration
+ *	    document contains no data for the field filters or in a case of
+ *	    an error, the function returns False.
+ */
+bool kshark_import_field_filters(struct kshark_context *kshark_ctx,
+				 struct kshark_config_doc *conf)
+{
+	switch (conf->format) {
+	case KS_CONFIG_JSON:
+		return kshark_field_filters_from_json(kshark_ctx,
+						      conf->conf_doc);
+
+	default:
+		fprintf(stderr, "Document format %d not supported\n",
+			conf->format);
+		return false;
+	}
+}
+
 static bool kshark_user_mask_to_json(struct kshark_context *kshark_ctx,
 				     struct json_object *jobj)
 {
@@ -1536,7 +1713,8 @@ kshark_export_all_filters(struct kshark_context *kshark_ctx,
 	    !kshark_export_all_task_filters(kshark_ctx, &conf) ||
 	    !kshark_export_all_cpu_filters(kshark_ctx, &conf) ||
 	    !kshark_export_user_mask(kshark_ctx, &conf) ||
-	    !kshark_export_adv_filters(kshark_ctx, &conf)) {
+	    !kshark_export_adv_filters(kshark_ctx, &conf) ||
+	    !kshark_export_field_filters(kshark_ctx, &conf)) {
 		kshark_free_config_doc(conf);
 		return NULL;
 	}
@@ -1564,6 +1742,7 @@ bool kshark_import_all_filters(struct kshark_context *kshark_ctx,
 	ret |= kshark_import_all_event_filters(kshark_ctx, conf);
 	ret |= kshark_import_user_mask(kshark_ctx, conf);
 	ret |= kshark_import_adv_filters(kshark_ctx, conf);
+	ret |= kshark_import_field_filters(kshark_ctx, conf);
 
 	return ret;
 }
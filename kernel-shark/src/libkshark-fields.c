@@ -0,0 +1,443 @@
+// SPDX-License-Identifier: LGPL-2.1
+
+/*
+ * Copyright (C) 2019 VMware Inc, Yordan Karadzhov <y.karadz@gmail.com>
+ */
+
+ /**
+  *  @file    libkshark-fields.c
+  *  @brief   Columns of the values of numeric event fields.
+  */
+
+// C
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+// KernelShark
+#include "libkshark.h"
+
+/** Minimum number of entries, processed by one extraction thread. */
+#define KS_FIELD_MIN_ROWS_PER_THREAD	(1 << 14)
+
+/** Extraction job, shared between all extraction threads. */
+struct field_job {
+	/** Input location for the session context pointer. */
+	struct kshark_context		*kshark_ctx;
+
+	/** Input location for the trace data. */
+	struct kshark_entry		**data;
+
+	/** The columns to fill. */
+	struct kshark_field_column	**columns;
+
+	/** The format of the field of each column. */
+	struct tep_format_field		**formats;
+
+	/** Number of columns. */
+	int				n_columns;
+};
+
+/** The part of the data, processed by one extraction thread. */
+struct field_shard {
+	/** Shared extraction job. */
+	struct field_job	*job;
+
+	/** The index of the first entry of the shard. */
+	size_t			first;
+
+	/** The index of the last entry of the shard (not included). */
+	size_t			last;
+};
+
+static bool job_has_event(const struct field_job *job, int event_id)
+{
+	int c;
+
+	for (c = 0; c < job->n_columns; ++c)
+		if (job->columns[c]->event_id == event_id)
+			return true;
+
+	return false;
+}
+
+static int64_t read_field(struct tep_handle *pevent,
+			  const struct tep_format_field *format,
+			  const struct kshark_field_column *col,
+			  const void *data)
+{
+	uint64_t val;
+	int shift;
+
+	val = tep_read_number(pevent, (const char *) data + format->offset,
+			      format->size);
+
+	if (col->is_signed && format->size < 8) {
+		shift = 64 - 8 * format->size;
+		return (int64_t) (val << shift) >> shift;
+	}
+
+	return val;
+}
+
+static void extract_record(struct field_job *job, struct tep_handle *pevent,
+			   struct tep_record *record, int event_id, size_t row)
+{
+	struct kshark_field_column *col;
+	int c;
+
+	for (c = 0; c < job->n_columns; ++c) {
+		col = job->columns[c];
+		if (col->event_id != event_id)
+			continue;
+
+		col->values[row] = read_field(pevent, job->formats[c], col,
+					      record->data);
+		col->valid[row] = 1;
+	}
+}
+
+static void *field_worker(void *arg)
+{
+	struct field_shard *shard = arg;
+	struct field_job *job = shard->job;
+	struct kshark_context *kshark_ctx = job->kshark_ctx;
+	struct tracecmd_input *handle = kshark_ctx->handle;
+	struct tep_handle *pevent = kshark_ctx->pevent;
+	struct kshark_reader *reader;
+	struct tep_record *record;
+	struct kshark_entry *e;
+	bool untouched;
+	int event_id;
+	size_t i;
+
+	/*
+	 * Each thread reads the records by using its own reader of the
+	 * trace data file. If the reader cannot be opened, fall back to
+	 * the (serialized) access via the session.
+	 */
+	reader = kshark_reader_open(kshark_ctx);
+	if (reader) {
+		handle = reader->handle;
+		pevent = reader->pevent;
+	}
+
+	for (i = shard->first; i < shard->last; ++i) {
+		e = job->data[i];
+		if (e->event_id < 0)
+			continue;
+
+		/*
+		 * The value of "entry->event_id" cannot be trusted if the
+		 * entry has been touched by a plugin callback function.
+		 */
+		untouched = e->visible & KS_PLUGIN_UNTOUCHED_MASK;
+		if (untouched && !job_has_event(job, e->event_id))
+			continue;
+
+		if (!reader)
+			pthread_mutex_lock(&kshark_ctx->input_mutex);
+
+		record = tracecmd_read_at(handle, e->offset, NULL);
+		if (record) {
+			event_id = untouched ? e->event_id :
+					       tep_data_type(pevent, record);
+
+			extract_record(job, pevent, record, event_id, i);
+			free_record(record);
+		}
+
+		if (!reader)
+			pthread_mutex_unlock(&kshark_ctx->input_mutex);
+	}
+
+	kshark_reader_close(reader);
+
+	return NULL;
+}
+
+static void run_field_job(struct field_shard *shards, size_t n_shards)
+{
+	pthread_t *threads;
+	size_t i, n_threads = n_shards - 1;
+
+	threads = calloc(n_threads ? n_threads : 1, sizeof(*threads));
+	if (!threads)
+		n_threads = 0;
+
+	for (i = 0; i < n_threads; ++i) {
+		if (pthread_create(&threads[i], NULL,
+				   field_worker, &shards[i + 1]) != 0) {
+			n_threads = i;
+			break;
+		}
+	}
+
+	/* The calling thread processes the first shard. */
+	field_worker(&shards[0]);
+
+	/* Process the shards which failed to get their own thread. */
+	for (i = n_threads + 1; i < n_shards; ++i)
+		field_worker(&shards[i]);
+
+	for (i = 0; i < n_threads; ++i)
+		pthread_join(threads[i], NULL);
+
+	free(threads);
+}
+
+static size_t get_n_shards(size_t n_rows)
+{
+	size_t n_shards;
+	long n_cpus;
+
+	n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	n_shards = n_rows / KS_FIELD_MIN_ROWS_PER_THREAD;
+	if (n_cpus > 0 && n_shards > (size_t) n_cpus)
+		n_shards = n_cpus;
+
+	return n_shards ? n_shards : 1;
+}
+
+static void free_column(struct kshark_field_column *col)
+{
+	if (!col)
+		return;
+
+	free(col->field);
+	free(col->values);
+	free(col->valid);
+	free(col);
+}
+
+static struct kshark_field_column *
+find_column(struct kshark_field_column *list, int event_id, const char *field)
+{
+	for (; list; list = list->next)
+		if (list->event_id == event_id && strcmp(list->field, field) == 0)
+			return list;
+
+	return NULL;
+}
+
+static struct tep_format_field *
+get_field_format(struct kshark_context *kshark_ctx, int event_id,
+		 const char *field)
+{
+	struct tep_format_field *format;
+	struct tep_event *event;
+
+	event = tep_find_event(kshark_ctx->pevent, event_id);
+	if (!event)
+		return NULL;
+
+	format = tep_find_any_field(event, field);
+	if (!format)
+		return NULL;
+
+	/* Only integer fields can be extracted. */
+	if (format->flags & (TEP_FIELD_IS_ARRAY | TEP_FIELD_IS_STRING |
+			     TEP_FIELD_IS_DYNAMIC) ||
+	    format->size > 8)
+		return NULL;
+
+	return format;
+}
+
+static struct kshark_field_column *
+alloc_column(int event_id, const char *field,
+	     const struct tep_format_field *format, size_t n_rows)
+{
+	struct kshark_field_column *col;
+
+	col = calloc(1, sizeof(*col));
+	if (!col)
+		return NULL;
+
+	col->event_id = event_id;
+	col->field = strdup(field);
+	col->is_signed = format->flags & TEP_FIELD_IS_SIGNED;
+	col->n_rows = n_rows;
+	col->values = calloc(n_rows ? n_rows : 1, sizeof(*col->values));
+	col->valid = calloc(n_rows ? n_rows : 1, sizeof(*col->valid));
+	if (!col->field || !col->values || !col->valid) {
+		free_column(col);
+		return NULL;
+	}
+
+	return col;
+}
+
+static bool job_has_column(const struct field_job *job, int event_id,
+			   const char *field)
+{
+	int c;
+
+	for (c = 0; c < job->n_columns; ++c)
+		if (job->columns[c]->event_id == event_id &&
+		    strcmp(job->columns[c]->field, field) == 0)
+			return true;
+
+	return false;
+}
+
+/**
+ * @brief Extract the values of several numeric event fields from the trace
+ *	  data. All fields are decoded in a single pass over the data, done
+ *	  in parallel. Only the records of the requested events are read.
+ *	  The resulting columns are cached in the session and can be
+ *	  retrieved by using kshark_get_field_column(). The cache is freed
+ *	  when the trace data is freed.
+ *
+ * @param kshark_ctx: Input location for the session context pointer.
+ * @param data: Input location for the trace data.
+ * @param n_rows: The size of the inputted data.
+ * @param event_ids: Array of the Ids of the events.
+ * @param fields: Array of the names of the fields. The field "fields[i]"
+ *		  belongs to the event "event_ids[i]".
+ * @param n_columns: The number of (event, field) pairs.
+ *
+ * @returns Zero on success. -EINVAL is returned if one of the fields does not
+ *	    exist or is not an integer. -ENOMEM is returned on failure to
+ *	    allocate memory.
+ */
+int kshark_load_field_columns(struct kshark_context *kshark_ctx,
+			      struct kshark_entry **data, size_t n_rows,
+			      const int *event_ids, const char * const *fields,
+			      int n_columns)
+{
+	struct field_job job = {kshark_ctx, data};
+	struct field_shard *shards = NULL;
+	struct tep_format_field *format;
+	struct kshark_field_column *col;
+	size_t i, n_shards;
+	int c, ret = -ENOMEM;
+
+	if (!kshark_ctx->pevent)
+		return -ENODEV;
+
+	if (data != kshark_ctx->field_data)
+		kshark_clear_field_columns(kshark_ctx);
+
+	job.columns = calloc(n_columns ? n_columns : 1, sizeof(*job.columns));
+	job.formats = calloc(n_columns ? n_columns : 1, sizeof(*job.formats));
+	if (!job.columns || !job.formats)
+		goto out;
+
+	for (c = 0; c < n_columns; ++c) {
+		/* Skip the columns, which are already available. */
+		if (find_column(kshark_ctx->field_columns,
+				event_ids[c], fields[c]) ||
+		    job_has_column(&job, event_ids[c], fields[c]))
+			continue;
+
+		format = get_field_format(kshark_ctx, event_ids[c], fields[c]);
+		if (!format) {
+			ret = -EINVAL;
+			goto out;
+		}
+
+		col = alloc_column(event_ids[c], fields[c], format, n_rows);
+		if (!col)
+			goto out;
+
+		job.formats[job.n_columns] = format;
+		job.columns[job.n_columns++] = col;
+	}
+
+	if (!job.n_columns) {
+		ret = 0;
+		goto out;
+	}
+
+	n_shards = get_n_shards(n_rows);
+	shards = calloc(n_shards, sizeof(*shards));
+	if (!shards)
+		goto out;
+
+	for (i = 0; i < n_shards; ++i) {
+		shards[i].job = &job;
+		shards[i].first = n_rows * i / n_shards;
+		shards[i].last = n_rows * (i + 1) / n_shards;
+	}
+
+	run_field_job(shards, n_shards);
+
+	/* Add the new columns to the cache. */
+	for (c = 0; c < job.n_columns; ++c) {
+		col = job.columns[c];
+		for (i = 0; i < n_rows; ++i)
+			col->n_valid += col->valid[i];
+
+		col->next = kshark_ctx->field_columns;
+		kshark_ctx->field_columns = col;
+	}
+
+	job.n_columns = 0;
+	kshark_ctx->field_data = data;
+	ret = 0;
+
+ out:
+	if (ret == -ENOMEM)
+		fprintf(stderr, "Failed to allocate memory for the field columns.\n");
+
+	for (c = 0; c < job.n_columns; ++c)
+		free_column(job.columns[c]);
+
+	free(shards);
+	free(job.columns);
+	free(job.formats);
+
+	return ret;
+}
+
+/**
+ * @brief Get the column of the values of a numeric event field. If the
+ *	  column is not cached yet, the values are extracted from the trace
+ *	  data.
+ *
+ * @param kshark_ctx: Input location for the session context pointer.
+ * @param data: Input location for the trace data.
+ * @param n_rows: The size of the inputted data.
+ * @param event_id: The Id of the event.
+ * @param field: The name of the field.
+ *
+ * @returns The field column on success, or NULL on failure. The column is
+ *	    owned by the session and is valid until the trace data is freed.
+ */
+const struct kshark_field_column *
+kshark_get_field_column(struct kshark_context *kshark_ctx,
+			struct kshark_entry **data, size_t n_rows,
+			int event_id, const char *field)
+{
+	if (data != kshark_ctx->field_data ||
+	    !find_column(kshark_ctx->field_columns, event_id, field)) {
+		if (kshark_load_field_columns(kshark_ctx, data, n_rows,
+					      &event_id, &field, 1) < 0)
+			return NULL;
+	}
+
+	return find_column(kshark_ctx->field_columns, event_id, field);
+}
+
+/**
+ * @brief Free all field columns, cached in the session.
+ *
+ * @param kshark_ctx: Input location for the session context pointer.
+ */
+void kshark_clear_field_columns(struct kshark_context *kshark_ctx)
+{
+	struct kshark_field_column *col;
+
+	if (!kshark_ctx)
+		return;
+
+	while (kshark_ctx->field_columns) {
+		col = kshark_ctx->field_columns;
+		kshark_ctx->field_columns = col->next;
+		free_column(col);
+	}
+
+	kshark_ctx->field_data = NULL;
+}
@@ -0,0 +1,682 @@
+// SPDX-License-Identifier: LGPL-2.1
+
+/*
+ * Copyright (C) 2019 VMware Inc, Yordan Karadzhov <y.karadz@gmail.com>
+ */
+
+ /**
+  *  @file    libkshark-index.c
+  *  @brief   Per-task and per-CPU posting lists of the loaded entries.
+  */
+
+// C
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+// KernelShark
+#include "libkshark.h"
+
+/** Minimum number of entries, processed by one indexing thread. */
+#define KS_INDEX_MIN_ROWS_PER_THREAD	(1 << 16)
+
+/** Posting list returned when the indexed data has no entries for a key. */
+static const struct kshark_posting_list empty_list = {0, 0, NULL};
+
+/** The part of the data, processed by one indexing thread. */
+struct index_shard {
+	/** Shared indexing job. */
+	struct index_job	*job;
+
+	/** The index of the first entry of the shard. */
+	size_t			first;
+
+	/** The index of the last entry of the shard (not included). */
+	size_t			last;
+
+	/**
+	 * Number of entries per Pid / CPU, found in the shard. During the
+	 * filling of the lists these are the positions to write at.
+	 */
+	size_t			*pid_pos, *cpu_pos;
+
+	/** Number of entries having Pid or CPU, missing from the keys. */
+	size_t			n_unknown_pids, n_unknown_cpus;
+};
+
+/** Indexing job, shared between all indexing threads. */
+struct index_job {
+	/** Input location for the trace data. */
+	struct kshark_entry	**data;
+
+	/** Sorted array of Pids. */
+	int			*pids;
+
+	/** Number of Pids. */
+	size_t			n_pids;
+
+	/** Number of CPUs. */
+	int			n_cpus;
+
+	/** Posting lists, sorted by Pid. */
+	struct kshark_posting_list	*pid_lists;
+
+	/** Posting lists, indexed by CPU. */
+	struct kshark_posting_list	*cpu_lists;
+
+	/** If true, fill the lists. Else only count the entries. */
+	bool			fill;
+};
+
+static ssize_t find_pid(const int *pids, size_t n_pids, int pid)
+{
+	size_t l = 0, h = n_pids, mid;
+
+	while (l < h) {
+		mid = (l + h) / 2;
+		if (pids[mid] < pid)
+			l = mid + 1;
+		else
+			h = mid;
+	}
+
+	if (l < n_pids && pids[l] == pid)
+		return l;
+
+	return -1;
+}
+
+static void *index_worker(void *arg)
+{
+	struct index_shard *shard = arg;
+	struct index_job *job = shard->job;
+	struct kshark_entry *e;
+	ssize_t k;
+	size_t i;
+
+	for (i = shard->first; i < shard->last; ++i) {
+		e = job->data[i];
+
+		k = find_pid(job->pids, job->n_pids, e->pid);
+		if (k < 0)
+			++shard->n_unknown_pids;
+		else if (job->fill)
+			job->pid_lists[k].rows[shard->pid_pos[k]++] = i;
+		else
+			++shard->pid_pos[k];
+
+		if (e->cpu < 0 || e->cpu >= job->n_cpus)
+			++shard->n_unknown_cpus;
+		else if (job->fill)
+			job->cpu_lists[e->cpu].rows[shard->cpu_pos[e->cpu]++] = i;
+		else
+			++shard->cpu_pos[e->cpu];
+	}
+
+	return NULL;
+}
+
+static void run_index_job(struct index_shard *shards, size_t n_shards)
+{
+	pthread_t *threads;
+	size_t i, n_threads = n_shards - 1;
+
+	threads = calloc(n_threads ? n_threads : 1, sizeof(*threads));
+	if (!threads)
+		n_threads = 0;
+
+	for (i = 0; i < n_threads; ++i) {
+		if (pthread_create(&threads[i], NULL,
+				   index_worker, &shards[i + 1]) != 0) {
+			n_threads = i;
+			break;
+		}
+	}
+
+	/* The calling thread processes the first shard. */
+	index_worker(&shards[0]);
+
+	/* Process the shards which failed to get their own thread. */
+	for (i = n_threads + 1; i < n_shards; ++i)
+		index_worker(&shards[i]);
+
+	for (i = 0; i < n_threads; ++i)
+		pthread_join(threads[i], NULL);
+
+	free(threads);
+}
+
+static int compare_pids(const void *a, const void *b)
+{
+	int pid_a = *(const int *) a;
+	int pid_b = *(const int *) b;
+
+	return (pid_a > pid_b) - (pid_a < pid_b);
+}
+
+static ssize_t add_unknown_pids(struct index_job *job,
+				struct kshark_entry **data, size_t n_rows)
+{
+	size_t i, j, size = job->n_pids;
+	int *pids;
+
+	/* Collect the Pids of all entries, which have no task registered. */
+	for (i = 0; i < n_rows; ++i) {
+		if (find_pid(job->pids, job->n_pids, data[i]->pid) >= 0)
+			continue;
+
+		pids = realloc(job->pids, (size + 1) * sizeof(*pids));
+		if (!pids)
+			return -ENOMEM;
+
+		job->pids = pids;
+		job->pids[size++] = data[i]->pid;
+	}
+
+	qsort(job->pids, size, sizeof(*job->pids), compare_pids);
+	for (i = j = 0; i < size; ++i)
+		if (!j || job->pids[j - 1] != job->pids[i])
+			job->pids[j++] = job->pids[i];
+
+	job->n_pids = j;
+
+	return j;
+}
+
+static void free_lists(struct kshark_posting_list *lists, size_t n)
+{
+	size_t i;
+
+	if (!lists)
+		return;
+
+	for (i = 0; i < n; ++i)
+		free(lists[i].rows);
+
+	free(lists);
+}
+
+static struct kshark_posting_list *
+alloc_lists(struct index_shard *shards, size_t n_shards,
+	    size_t n_lists, bool cpu)
+{
+	struct kshark_posting_list *lists;
+	size_t i, k, count, *pos;
+
+	lists = calloc(n_lists ? n_lists : 1, sizeof(*lists));
+	if (!lists)
+		return NULL;
+
+	for (k = 0; k < n_lists; ++k) {
+		/*
+		 * Turn the per-shard counts into the positions, where each
+		 * shard starts writing inside the list.
+		 */
+		for (count = i = 0; i < n_shards; ++i) {
+			pos = cpu ? shards[i].cpu_pos : shards[i].pid_pos;
+			count += pos[k];
+			pos[k] = count - pos[k];
+		}
+
+		lists[k].count = count;
+		if (!count)
+			continue;
+
+		lists[k].rows = malloc(count * sizeof(*lists[k].rows));
+		if (!lists[k].rows) {
+			free_lists(lists, n_lists);
+			return NULL;
+		}
+	}
+
+	return lists;
+}
+
+static size_t get_n_shards(size_t n_rows)
+{
+	size_t n_shards;
+	long n_cpus;
+
+	n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	n_shards = n_rows / KS_INDEX_MIN_ROWS_PER_THREAD;
+	if (n_cpus > 0 && n_shards > (size_t) n_cpus)
+		n_shards = n_cpus;
+
+	return n_shards ? n_shards : 1;
+}
+
+/**
+ * @brief Build per-task and per-CPU posting lists of the entries of a given
+ *	  array of trace data. The lists are built in parallel and replace
+ *	  the index of any previously indexed data. Pid and CPU queries on
+ *	  the indexed array (data requests, collections, model queries) use
+ *	  the lists instead of scanning the data.
+ *
+ * @param kshark_ctx: Input location for the session context pointer.
+ * @param data: Input location for the trace data.
+ * @param n_rows: The size of the inputted data.
+ *
+ * @returns Zero on success, or a negative error code on failure.
+ */
+int kshark_index_entries(struct kshark_context *kshark_ctx,
+			 struct kshark_entry **data,
+			 size_t n_rows)
+{
+	struct index_job job = {data};
+	struct index_shard *shards;
+	size_t i, n_shards, n_unknown_pids, n_unknown_cpus;
+	ssize_t n_pids;
+	int ret = -ENOMEM;
+
+	kshark_index_clear(kshark_ctx);
+	if (!data || !n_rows)
+		return 0;
+
+	n_pids = kshark_get_task_pids(kshark_ctx, &job.pids);
+	if (n_pids < 0)
+		return n_pids;
+
+	job.n_pids = n_pids;
+	if (job.n_pids)
+		qsort(job.pids, job.n_pids, sizeof(*job.pids), compare_pids);
+
+	job.n_cpus = kshark_ctx->handle ?
+		     tracecmd_cpus(kshark_ctx->handle) : 0;
+
+	n_shards = get_n_shards(n_rows);
+	shards = calloc(n_shards, sizeof(*shards));
+	if (!shards)
+		goto out;
+
+	for (i = 0; i < n_shards; ++i) {
+		shards[i].job = &job;
+		shards[i].first = n_rows * i / n_shards;
+		shards[i].last = n_rows * (i + 1) / n_shards;
+	}
+
+ count:
+	for (i = 0; i < n_shards; ++i) {
+		free(shards[i].pid_pos);
+		free(shards[i].cpu_pos);
+		shards[i].pid_pos = calloc(job.n_pids + 1,
+					   sizeof(*shards[i].pid_pos));
+		shards[i].cpu_pos = calloc(job.n_cpus + 1,
+					   sizeof(*shards[i].cpu_pos));
+		if (!shards[i].pid_pos || !shards[i].cpu_pos)
+			goto out;
+
+		shards[i].n_unknown_pids = shards[i].n_unknown_cpus = 0;
+	}
+
+	run_index_job(shards, n_shards);
+
+	n_unknown_pids = n_unknown_cpus = 0;
+	for (i = 0; i < n_shards; ++i) {
+		n_unknown_pids += shards[i].n_unknown_pids;
+		n_unknown_cpus += shards[i].n_unknown_cpus;
+	}
+
+	if (n_unknown_pids) {
+		/*
+		 * Some entries (for example the "missed_events" entries) may
+		 * have Pids without a task registered. Add those Pids to the
+		 * keys and count again.
+		 */
+		if (add_unknown_pids(&job, data, n_rows) < 0)
+			goto out;
+
+		goto count;
+	}
+
+	job.pid_lists = alloc_lists(shards, n_shards, job.n_pids, false);
+	if (!job.pid_lists)
+		goto out;
+
+	for (i = 0; i < job.n_pids; ++i)
+		job.pid_lists[i].key = job.pids[i];
+
+	/*
+	 * The CPU index is only usable if it covers all entries. Otherwise
+	 * the CPU queries will keep scanning the data.
+	 */
+	if (n_unknown_cpus)
+		job.n_cpus = 0;
+
+	job.cpu_lists = alloc_lists(shards, n_shards, job.n_cpus, true);
+	if (!job.cpu_lists)
+		goto out;
+
+	for (i = 0; i < (size_t) job.n_cpus; ++i)
+		job.cpu_lists[i].key = i;
+
+	job.fill = true;
+	run_index_job(shards, n_shards);
+
+	kshark_ctx->index_data = data;
+	kshark_ctx->index_size = n_rows;
+	kshark_ctx->pid_index = job.pid_lists;
+	kshark_ctx->n_pid_index = job.n_pids;
+	job.pid_lists = NULL;
+
+	if (job.n_cpus) {
+		kshark_ctx->cpu_index = job.cpu_lists;
+		kshark_ctx->n_cpu_index = job.n_cpus;
+		job.cpu_lists = NULL;
+	}
+
+	ret = 0;
+
+ out:
+	if (ret < 0)
+		fprintf(stderr, "Failed to allocate memory for the entry index.\n");
+
+	if (shards) {
+		for (i = 0; i < n_shards; ++i) {
+			free(shards[i].pid_pos);
+			free(shards[i].cpu_pos);
+		}
+	}
+
+	free_lists(job.pid_lists, job.n_pids);
+	free_lists(job.cpu_lists, job.n_cpus);
+	free(shards);
+	free(job.pids);
+
+	return ret;
+}
+
+/**
+ * @brief Free the posting lists of the indexed trace data.
+ *
+ * @param kshark_ctx: Input location for the session context pointer.
+ */
+void kshark_index_clear(struct kshark_context *kshark_ctx)
+{
+	if (!kshark_ctx)
+		return;
+
+	free_lists(kshark_ctx->pid_index, kshark_ctx->n_pid_index);
+	free_lists(kshark_ctx->cpu_index, kshark_ctx->n_cpu_index);
+
+	kshark_ctx->pid_index = kshark_ctx->cpu_index = NULL;
+	kshark_ctx->n_pid_index = kshark_ctx->n_cpu_index = 0;
+	kshark_ctx->index_data = NULL;
+	kshark_ctx->index_size = 0;
+}
+
+static struct kshark_posting_list *
+find_pid_list(struct kshark_context *kshark_ctx, int pid)
+{
+	size_t l = 0, h = kshark_ctx->n_pid_index, mid;
+
+	while (l < h) {
+		mid = (l + h) / 2;
+		if (kshark_ctx->pid_index[mid].key < pid)
+			l = mid + 1;
+		else
+			h = mid;
+	}
+
+	if (l < kshark_ctx->n_pid_index && kshark_ctx->pid_index[l].key == pid)
+		return &kshark_ctx->pid_index[l];
+
+	return NULL;
+}
+
+/**
+ * @brief Get the posting list of the entries satisfying a given Matching
+ *	  condition.
+ *
+ * @param kshark_ctx: Input location for the session context pointer.
+ * @param data: Input location for the trace data.
+ * @param cond: Matching condition function.
+ * @param val: Matching condition value, used by the Matching condition
+ *	       function.
+ *
+ * @returns Pointer to the posting list, or NULL if the data is not indexed or
+ *	    the Matching condition function is neither kshark_match_pid() nor
+ *	    kshark_match_cpu(). In this case the data has to be scanned.
+ */
+const struct kshark_posting_list *
+kshark_index_lookup(struct kshark_context *kshark_ctx,
+		    struct kshark_entry **data,
+		    matching_condition_func cond, int val)
+{
+	const struct kshark_posting_list *list;
+
+	if (!kshark_ctx || !data || data != kshark_ctx->index_data)
+		return NULL;
+
+	if (cond == kshark_match_pid) {
+		list = find_pid_list(kshark_ctx, val);
+		return list ? list : &empty_list;
+	}
+
+	if (cond == kshark_match_cpu && kshark_ctx->cpu_index) {
+		if (val < 0 || val >= kshark_ctx->n_cpu_index)
+			return &empty_list;
+
+		return &kshark_ctx->cpu_index[val];
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Binary search inside a posting list.
+ *
+ * @param list: Input location for the posting list.
+ * @param row: Index of an entry inside the array of trace data.
+ *
+ * @returns The position inside the list of the first entry having index
+ *	    greater or equal to "row". If no such entry exists, the size of
+ *	    the list is returned.
+ */
+size_t kshark_posting_list_find(const struct kshark_posting_list *list,
+				size_t row)
+{
+	size_t l = 0, h = list->count, mid;
+
+	while (l < h) {
+		mid = (l + h) / 2;
+		if (list->rows[mid] < row)
+			l = mid + 1;
+		else
+			h = mid;
+	}
+
+	return l;
+}
+
+/* Marks a row, removed from a posting list. */
+#define KS_INDEX_REMOVED	((size_t) -1)
+
+static int compare_rows(const void *a, const void *b)
+{
+	size_t row_a = *(const size_t *) a;
+	size_t row_b = *(const size_t *) b;
+
+	return (row_a > row_b) - (row_a < row_b);
+}
+
+/* Find the position of an entry inside a Pid list, using its timestamp. */
+static ssize_t find_entry_pos(struct kshark_entry **data,
+			      const struct kshark_posting_list *list,
+			      const struct kshark_entry *e)
+{
+	size_t l = 0, h = list->count, mid, pos;
+
+	while (l < h) {
+		mid = (l + h) / 2;
+		if (data[list->rows[mid]]->ts < e->ts)
+			l = mid + 1;
+		else
+			h = mid;
+	}
+
+	for (pos = l; pos < list->count; ++pos)
+		if (data[list->rows[pos]] == e ||
+		    data[list->rows[pos]]->ts != e->ts)
+			break;
+
+	if (pos == list->count || data[list->rows[pos]] != e)
+		return -1;
+
+	return pos;
+}
+
+static bool add_pid_list(struct kshark_context *kshark_ctx, int pid)
+{
+	struct kshark_posting_list *lists;
+	size_t l;
+
+	lists = realloc(kshark_ctx->pid_index,
+			(kshark_ctx->n_pid_index + 1) * sizeof(*lists));
+	if (!lists)
+		return false;
+
+	kshark_ctx->pid_index = lists;
+	for (l = 0; l < kshark_ctx->n_pid_index; ++l)
+		if (lists[l].key > pid)
+			break;
+
+	memmove(&lists[l + 1], &lists[l],
+		(kshark_ctx->n_pid_index - l) * sizeof(*lists));
+	++kshark_ctx->n_pid_index;
+
+	lists[l].key = pid;
+	lists[l].count = 0;
+	lists[l].rows = NULL;
+
+	return true;
+}
+
+/**
+ * @brief Update the index after the Pids of a set of indexed entries have
+ *	  been changed (for example by a plugin). Each posting list, affected
+ *	  by the change, is rebuilt only once.
+ *
+ * @param kshark_ctx: Input location for the session context pointer.
+ * @param entries: Array of entries. Their "pid" fields hold the new Pids.
+ * @param old_pids: The Pids of the entries before the change.
+ * @param n: The size of the arrays.
+ *
+ * @returns Zero on success, or a negative error code on failure. On failure
+ *	    the index gets cleared.
+ */
+int kshark_index_update_pids(struct kshark_context *kshark_ctx,
+			     struct kshark_entry **entries,
+			     const int *old_pids, size_t n)
+{
+	size_t *n_added = NULL, *rows = NULL, *old_list = NULL;
+	struct kshark_posting_list *list;
+	size_t i, j, k, *tmp;
+	int ret = -ENOMEM;
+	ssize_t pos;
+
+	if (!kshark_ctx || !kshark_ctx->index_data || !n)
+		return 0;
+
+	/* Add the lists of the new Pids first. This moves the lists. */
+	for (i = 0; i < n; ++i) {
+		if (entries[i]->pid != old_pids[i] &&
+		    !find_pid_list(kshark_ctx, entries[i]->pid) &&
+		    !add_pid_list(kshark_ctx, entries[i]->pid))
+			goto fail;
+	}
+
+	n_added = calloc(kshark_ctx->n_pid_index, sizeof(*n_added));
+	rows = calloc(n, sizeof(*rows));
+	old_list = calloc(n, sizeof(*old_list));
+	if (!n_added || !rows || !old_list)
+		goto fail;
+
+	/* Find all entries, before any list gets modified. */
+	ret = -EINVAL;
+	for (i = 0; i < n; ++i) {
+		rows[i] = KS_INDEX_REMOVED;
+		if (entries[i]->pid == old_pids[i])
+			continue;
+
+		list = find_pid_list(kshark_ctx, old_pids[i]);
+		if (!list)
+			goto fail;
+
+		pos = find_entry_pos(kshark_ctx->index_data, list, entries[i]);
+		if (pos < 0)
+			goto fail;
+
+		old_list[i] = list - kshark_ctx->pid_index;
+		rows[i] = pos;
+	}
+
+	/* Mark the entries as removed from the old lists. */
+	for (i = 0; i < n; ++i) {
+		if (rows[i] == KS_INDEX_REMOVED)
+			continue;
+
+		list = &kshark_ctx->pid_index[old_list[i]];
+
+		/* The same entry cannot be moved twice. */
+		if (list->rows[rows[i]] == KS_INDEX_REMOVED)
+			goto fail;
+
+		pos = rows[i];
+		rows[i] = list->rows[pos];
+		list->rows[pos] = KS_INDEX_REMOVED;
+
+		list = find_pid_list(kshark_ctx, entries[i]->pid);
+		++n_added[list - kshark_ctx->pid_index];
+	}
+
+	/* Compact the old lists and make room in the new lists. */
+	ret = -ENOMEM;
+	for (k = 0; k < kshark_ctx->n_pid_index; ++k) {
+		list = &kshark_ctx->pid_index[k];
+		for (i = j = 0; i < list->count; ++i)
+			if (list->rows[i] != KS_INDEX_REMOVED)
+				list->rows[j++] = list->rows[i];
+
+		list->count = j;
+		if (!n_added[k])
+			continue;
+
+		tmp = realloc(list->rows,
+			      (list->count + n_added[k]) * sizeof(*tmp));
+		if (!tmp)
+			goto fail;
+
+		list->rows = tmp;
+	}
+
+	for (i = 0; i < n; ++i) {
+		if (rows[i] == KS_INDEX_REMOVED)
+			continue;
+
+		list = find_pid_list(kshark_ctx, entries[i]->pid);
+		list->rows[list->count++] = rows[i];
+	}
+
+	for (k = 0; k < kshark_ctx->n_pid_index; ++k) {
+		list = &kshark_ctx->pid_index[k];
+		if (n_added[k])
+			qsort(list->rows, list->count, sizeof(*list->rows),
+			      compare_rows);
+	}
+
+	free(n_added);
+	free(rows);
+	free(old_list);
+
+	return 0;
+
+ fail:
+	free(n_added);
+	free(rows);
+	free(old_list);
+
+	/* Better no index than an index that lies. */
+	kshark_index_clear(kshark_ctx);
+	return ret;
+}
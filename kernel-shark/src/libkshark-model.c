@@ -25,6 +25,24 @@
 /** For all bins. */
 # define ALLB(histo) LOB(histo)
 
+/* The timestamp of the first entry of the dataset. */
+static uint64_t ksmodel_data_min(struct kshark_trace_histo *histo)
+{
+	if (histo->chunks)
+		return histo->chunks->ts_min;
+
+	return histo->data[0]->ts;
+}
+
+/* The timestamp of the last entry of the dataset. */
+static uint64_t ksmodel_data_max(struct kshark_trace_histo *histo)
+{
+	if (histo->chunks)
+		return histo->chunks->ts_max;
+
+	return histo->data[histo->data_size - 1]->ts;
+}
+
 /**
  * @brief Initialize the Visualization model.
  *
@@ -93,7 +111,6 @@ static void ksmodel_set_in_range_bining(struct kshark_trace_histo *histo,
 					bool force_in_range)
 {
 	uint64_t corrected_range, delta_range, range = max - min;
-	struct kshark_entry *last;
 
 	/* The size of the bin must be >= 1, hence the range must be >= n. */
 	if (n == 0 || range < n) {
@@ -141,12 +158,11 @@ static void ksmodel_set_in_range_bining(struct kshark_trace_histo *histo,
 		 * Make sure that the new range doesn't go outside of the time
 		 * interval of the dataset.
 		 */
-		last = histo->data[histo->data_size - 1];
-		if (histo->min < histo->data[0]->ts) {
-			histo->min = histo->data[0]->ts;
+		if (histo->min < ksmodel_data_min(histo)) {
+			histo->min = ksmodel_data_min(histo);
 			histo->max = histo->min + corrected_range;
-		} else if (histo->max > last->ts) {
-			histo->max = last->ts;
+		} else if (histo->max > ksmodel_data_max(histo)) {
+			histo->max = ksmodel_data_max(histo);
 			histo->min = histo->max - corrected_range;
 		}
 	}
@@ -368,16 +384,38 @@ static void ksmodel_set_bin_counts(struct kshark_trace_histo *histo)
 	histo->tot_count += histo->bin_count[prev_not_empty] = count_tmp;
 }
 
-/**
- * @brief Provide the Visualization model with data. Calculate the current
- *	  state of the model.
- *
- * @param histo: Input location for the model descriptor.
- * @param data: Input location for the trace data.
- * @param n: Number of bins.
+/*
+ * Fill the model using only the summary of the pages of the trace data file.
+ * The bins get (approximate) number of entries, but no entries are mapped.
  */
-void ksmodel_fill(struct kshark_trace_histo *histo,
-		  struct kshark_entry **data, size_t n)
+static void ksmodel_fill_summary(struct kshark_trace_histo *histo)
+{
+	struct kshark_page_summary *page;
+	size_t i;
+	int bin;
+
+	histo->data = NULL;
+	histo->data_size = 0;
+	histo->tot_count = 0;
+	ksmodel_reset_bins(histo, 0, ALLB(histo));
+
+	for (i = 0; i < histo->chunks->n_pages; ++i) {
+		page = &histo->chunks->pages[i];
+		if (page->ts_first < histo->min) {
+			bin = LOB(histo);
+		} else if (page->ts_first >= histo->max) {
+			bin = UOB(histo);
+		} else {
+			bin = (page->ts_first - histo->min) / histo->bin_size;
+			histo->tot_count += page->count;
+		}
+
+		histo->bin_count[bin] += page->count;
+	}
+}
+
+static void ksmodel_fill_data(struct kshark_trace_histo *histo,
+			      struct kshark_entry **data, size_t n)
 {
 	size_t last_row = 0;
 	int bin;
@@ -420,6 +458,95 @@ void ksmodel_fill(struct kshark_trace_histo *histo,
 	ksmodel_set_bin_counts(histo);
 }
 
+static void ksmodel_fill_chunks(struct kshark_trace_histo *histo)
+{
+	struct kshark_entry **data;
+	ssize_t n;
+
+	/*
+	 * If the time-window is too big to be loaded in memory, use the
+	 * summary of the pages.
+	 */
+	if (kshark_chunk_cache_span(histo->chunks, histo->min, histo->max) >
+	    histo->chunks->max_loaded) {
+		ksmodel_fill_summary(histo);
+		return;
+	}
+
+	n = kshark_chunk_cache_get(histo->chunks, histo->min, histo->max,
+				   &data);
+	if (n <= 0) {
+		histo->data = NULL;
+		histo->data_size = 0;
+		histo->tot_count = 0;
+		ksmodel_reset_bins(histo, 0, ALLB(histo));
+		return;
+	}
+
+	ksmodel_fill_data(histo, data, n);
+}
+
+/**
+ * @brief Provide the Visualization model with data. Calculate the current
+ *	  state of the model. In out-of-core mode the data is taken from the
+ *	  cache of data chunks and the arguments "data" and "n" are ignored.
+ *
+ * @param histo: Input location for the model descriptor.
+ * @param data: Input location for the trace data.
+ * @param n: Number of bins.
+ */
+void ksmodel_fill(struct kshark_trace_histo *histo,
+		  struct kshark_entry **data, size_t n)
+{
+	if (histo->chunks && histo->n_bins && histo->bin_size)
+		ksmodel_fill_chunks(histo);
+	else
+		ksmodel_fill_data(histo, data, n);
+}
+
+/**
+ * @brief Switch the Visualization model to out-of-core mode. In this mode
+ *	  only the entries inside the time-window of the model (and around
+ *	  it) are loaded in memory. Note that ksmodel_clear() resets the
+ *	  model to the normal mode.
+ *
+ * @param histo: Input location for the model descriptor.
+ * @param cache: Input location for the cache of data chunks. Use NULL to
+ *		 switch back to the normal mode.
+ */
+void ksmodel_set_chunk_cache(struct kshark_trace_histo *histo,
+			     struct kshark_chunk_cache *cache)
+{
+	histo->chunks = cache;
+	histo->data = NULL;
+	histo->data_size = 0;
+}
+
+/* In out-of-core mode the model is always recalculated from scratch. */
+static void ksmodel_shift_chunks(struct kshark_trace_histo *histo,
+				 size_t n, bool forward)
+{
+	uint64_t delta = n * histo->bin_size;
+
+	if (forward) {
+		if (histo->max >= ksmodel_data_max(histo))
+			return;
+
+		histo->min += delta;
+		histo->max += delta;
+	} else {
+		if (histo->min <= ksmodel_data_min(histo) ||
+		    histo->min < delta)
+			return;
+
+		histo->min -= delta;
+		histo->max -= delta;
+	}
+
+	ksmodel_set_bining(histo, histo->n_bins, histo->min, histo->max);
+	ksmodel_fill(histo, NULL, 0);
+}
+
 /**
  * @brief Get the total number of entries in a given bin.
  *
@@ -442,6 +569,19 @@ size_t ksmodel_bin_count(struct kshark_trace_histo *histo, int bin)
 	return 0;
 }
 
+/* Get the number of entries in a given bin, which are loaded in memory. */
+static size_t ksmodel_bin_loaded(struct kshark_trace_histo *histo, int bin)
+{
+	/*
+	 * If the model is filled by using the summary of the pages, the bins
+	 * count entries which are not loaded.
+	 */
+	if (!histo->data)
+		return 0;
+
+	return ksmodel_bin_count(histo, bin);
+}
+
 /**
  * @brief Shift the time-window of the model forward. Recalculate the current
  *	  state of the model.
@@ -454,6 +594,11 @@ void ksmodel_shift_forward(struct kshark_trace_histo *histo, size_t n)
 	size_t last_row = 0;
 	int bin;
 
+	if (histo->chunks) {
+		ksmodel_shift_chunks(histo, n, true);
+		return;
+	}
+
 	if (!histo->data_size)
 		return;
 
@@ -532,6 +677,11 @@ void ksmodel_shift_backward(struct kshark_trace_histo *histo, size_t n)
 	size_t last_row = 0;
 	int bin;
 
+	if (histo->chunks) {
+		ksmodel_shift_chunks(histo, n, false);
+		return;
+	}
+
 	if (!histo->data_size)
 		return;
 
@@ -615,10 +765,10 @@ void ksmodel_jump_to(struct kshark_trace_histo *histo, uint64_t ts)
 	min = ts - histo->n_bins * histo->bin_size / 2;
 
 	/* Make sure that the range does not go outside of the dataset. */
-	if (min < histo->data[0]->ts) {
-		min = histo->data[0]->ts;
+	if (min < ksmodel_data_min(histo)) {
+		min = ksmodel_data_min(histo);
 	} else {
-		range_min = histo->data[histo->data_size - 1]->ts -
+		range_min = ksmodel_data_max(histo) -
 			    histo->n_bins * histo->bin_size;
 
 		if (min > range_min)
@@ -638,7 +788,7 @@ static void ksmodel_zoom(struct kshark_trace_histo *histo,
 	size_t range, min, max, delta_min;
 	double delta_tot;
 
-	if (!histo->data_size)
+	if (!histo->data_size && !histo->chunks)
 		return;
 
 	/*
@@ -683,11 +833,11 @@ static void ksmodel_zoom(struct kshark_trace_histo *histo,
 
 
 	/* Make sure the new range doesn't go outside of the dataset. */
-	if (min < histo->data[0]->ts)
-		min = histo->data[0]->ts;
+	if (min < ksmodel_data_min(histo))
+		min = ksmodel_data_min(histo);
 
-	if (max > histo->data[histo->data_size - 1]->ts)
-		max = histo->data[histo->data_size - 1]->ts;
+	if (max > ksmodel_data_max(histo))
+		max = ksmodel_data_max(histo);
 
 	/*
 	 * Use the new range to recalculate all bins from scratch. Enforce
@@ -787,7 +937,7 @@ ksmodel_entry_front_request_alloc(struct kshark_trace_histo *histo,
 	size_t first, n;
 
 	/* Get the number of entries in this bin. */
-	n = ksmodel_bin_count(histo, bin);
+	n = ksmodel_bin_loaded(histo, bin);
 	if (!n)
 		return NULL;
 
@@ -806,7 +956,7 @@ ksmodel_entry_back_request_alloc(struct kshark_trace_histo *histo,
 	size_t first, n;
 
 	/* Get the number of entries in this bin. */
-	n = ksmodel_bin_count(histo, bin);
+	n = ksmodel_bin_loaded(histo, bin);
 	if (!n)
 		return NULL;
 
@@ -817,6 +967,25 @@ ksmodel_entry_back_request_alloc(struct kshark_trace_histo *histo,
 					  vis_only, KS_GRAPH_VIEW_FILTER_MASK);
 }
 
+static ssize_t first_index_in_list(struct kshark_trace_histo *histo,
+				   const struct kshark_posting_list *list,
+				   size_t first, size_t n)
+{
+	ssize_t not_found = KS_EMPTY_BIN;
+	size_t pos, row;
+
+	for (pos = kshark_posting_list_find(list, first);
+	     pos < list->count && (row = list->rows[pos]) < first + n;
+	     ++pos) {
+		if (ksmodel_is_visible(histo->data[row]))
+			return row;
+
+		not_found = KS_FILTERED_BIN;
+	}
+
+	return not_found;
+}
+
 /**
  * @brief Get the index of the first entry from a given Cpu in a given bin.
  *
@@ -829,14 +998,22 @@ ksmodel_entry_back_request_alloc(struct kshark_trace_histo *histo,
 ssize_t ksmodel_first_index_at_cpu(struct kshark_trace_histo *histo,
 				   int bin, int cpu)
 {
+	const struct kshark_posting_list *list;
+	struct kshark_context *kshark_ctx = NULL;
 	size_t i, n, first, not_found = KS_EMPTY_BIN;
 
-	n = ksmodel_bin_count(histo, bin);
+	n = ksmodel_bin_loaded(histo, bin);
 	if (!n)
 		return not_found;
 
 	first = ksmodel_first_index_at_bin(histo, bin);
 
+	kshark_instance(&kshark_ctx);
+	list = kshark_index_lookup(kshark_ctx, histo->data,
+				   kshark_match_cpu, cpu);
+	if (list)
+		return first_index_in_list(histo, list, first, n);
+
 	for (i = first; i < first + n; ++i) {
 		if (histo->data[i]->cpu == cpu) {
 			if (ksmodel_is_visible(histo->data[i]))
@@ -861,14 +1038,22 @@ ssize_t ksmodel_first_index_at_cpu(struct kshark_trace_histo *histo,
 ssize_t ksmodel_first_index_at_pid(struct kshark_trace_histo *histo,
 				   int bin, int pid)
 {
+	const struct kshark_posting_list *list;
+	struct kshark_context *kshark_ctx = NULL;
 	size_t i, n, first, not_found = KS_EMPTY_BIN;
 
-	n = ksmodel_bin_count(histo, bin);
+	n = ksmodel_bin_loaded(histo, bin);
 	if (!n)
 		return not_found;
 
 	first = ksmodel_first_index_at_bin(histo, bin);
 
+	kshark_instance(&kshark_ctx);
+	list = kshark_index_lookup(kshark_ctx, histo->data,
+				   kshark_match_pid, pid);
+	if (list)
+		return first_index_in_list(histo, list, first, n);
+
 	for (i = first; i < first + n; ++i) {
 		if (histo->data[i]->pid == pid) {
 			if (ksmodel_is_visible(histo->data[i]))
@@ -71,6 +71,12 @@ struct kshark_trace_histo {
 
 	/** Number of bins. */
 	int			n_bins;
+
+	/**
+	 * Cache of data chunks. If set, the model works in out-of-core mode
+	 * and the data is taken from the cache.
+	 */
+	struct kshark_chunk_cache	*chunks;
 };
 
 void ksmodel_init(struct kshark_trace_histo *histo);
@@ -83,6 +89,9 @@ void ksmodel_set_bining(struct kshark_trace_histo *histo,
 void ksmodel_fill(struct kshark_trace_histo *histo,
 		  struct kshark_entry **data, size_t n);
 
+void ksmodel_set_chunk_cache(struct kshark_trace_histo *histo,
+			     struct kshark_chunk_cache *cache);
+
 size_t ksmodel_bin_count(struct kshark_trace_histo *histo, int bin);
 
 void ksmodel_shift_forward(struct kshark_trace_histo *histo, size_t n);
@@ -9,13 +9,100 @@
   *  @brief   Basic tools for OpenGL plotting.
   */
 
+// C
+#include <stdlib.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
 // OpenGL
+/** Use the prototypes of the Vertex Buffer Object functions. */
+#define GL_GLEXT_PROTOTYPES
 #include <GL/freeglut.h>
 #include <GL/gl.h>
 
 // KernelShark
 #include "libkshark-plot.h"
 
+/** Vertex of a batched primitive. */
+struct ksplot_vertex {
+	/** The coordinates of the vertex in pixels. */
+	GLint	x, y;
+};
+
+/**
+ * Group of batched primitives of the same type, size and color, drawn with
+ * a single call.
+ */
+struct ksplot_batch_run {
+	/** OpenGL primitive type (GL_POINTS, GL_LINES or GL_TRIANGLES). */
+	GLenum	mode;
+
+	/** The size of the points or the width of the lines. */
+	float	size;
+
+	/** The RGB color of the primitives. */
+	GLubyte	color[3];
+
+	/** The index of the first vertex of the run, once sorted. */
+	GLint	first;
+
+	/** Number of vertices in the run. */
+	GLsizei	count;
+};
+
+/**
+ * The batch of primitives, collected between ksplot_batch_begin() and
+ * ksplot_batch_flush(). The primitives are grouped by type, size and color.
+ * The groups are drawn in the order of their first primitive, and the
+ * primitives of a group in the order they have been added.
+ */
+static struct {
+	/** True if the primitives are collected instead of being drawn. */
+	bool			active;
+
+	/** True if Vertex Buffer Objects are supported by the context. */
+	bool			use_vbo;
+
+	/** Vertex Buffer Object, used to upload the vertices. */
+	GLuint			vbo;
+
+	/** Array of the collected vertices, in the order they were added. */
+	struct ksplot_vertex	*vertices;
+
+	/** The index of the run of each collected vertex. */
+	uint32_t		*vertex_runs;
+
+	/** The vertices, sorted by run, as uploaded for drawing. */
+	struct ksplot_vertex	*sorted;
+
+	/** Number of collected vertices. */
+	size_t			n_vertices;
+
+	/** The size of the arrays of vertices. */
+	size_t			vertices_size;
+
+	/** Array of runs of primitives. */
+	struct ksplot_batch_run	*runs;
+
+	/** Number of runs. */
+	size_t			n_runs;
+
+	/** The size of the array of runs. */
+	size_t			runs_size;
+
+	/**
+	 * Open addressing hash table of the indexes of the runs (plus one),
+	 * keyed by type, size and color.
+	 */
+	uint32_t		*run_table;
+
+	/** The size of the hash table of runs (a power of two). */
+	size_t			run_table_size;
+} batch;
+
 /**
  * @brief Create an empty scene for drawing.
  *
@@ -58,6 +145,9 @@ void ksplot_make_scene(int width, int height)
  */
 void ksplot_init_opengl(int dpr)
 {
+	const char *version;
+	int major = 0, minor = 0;
+
 	glDisable(GL_TEXTURE_2D);
 	glDisable(GL_DEPTH_TEST);
 	glDisable(GL_COLOR_MATERIAL);
@@ -67,6 +157,21 @@ void ksplot_init_opengl(int dpr)
 	glLineWidth(1.5 * dpr);
 	glPointSize(2.5 * dpr);
 	glClearColor(1, 1, 1, 1);
+
+	/*
+	 * Vertex Buffer Objects are core since OpenGL 1.5. On older contexts
+	 * the batch is drawn from client-side vertex arrays.
+	 */
+	version = (const char *) glGetString(GL_VERSION);
+	if (version)
+		sscanf(version, "%d.%d", &major, &minor);
+
+	batch.use_vbo = major > 1 || (major == 1 && minor >= 5);
+	if (batch.use_vbo && !batch.vbo)
+		glGenBuffers(1, &batch.vbo);
+
+	if (!batch.vbo)
+		batch.use_vbo = false;
 }
 
 /**
@@ -91,6 +196,253 @@ void ksplot_resize_opengl(int width, int height)
 	glLoadIdentity();
 }
 
+/**
+ * @brief Start collecting primitives. Until ksplot_batch_flush() is called,
+ *	  all ksplot_draw_* functions only add their primitives to a batch.
+ *	  All primitives of the same type, size and color are drawn together
+ *	  by a single call. Hence a primitive may be drawn before primitives
+ *	  added earlier. Flush the batch and begin a new one, if the
+ *	  primitives that follow have to be drawn on top.
+ */
+void ksplot_batch_begin(void)
+{
+	batch.n_vertices = batch.n_runs = 0;
+	if (batch.run_table)
+		memset(batch.run_table, 0,
+		       batch.run_table_size * sizeof(*batch.run_table));
+
+	batch.active = true;
+}
+
+/**
+ * @brief Draw all primitives collected since ksplot_batch_begin() and stop
+ *	  collecting.
+ */
+void ksplot_batch_flush(void)
+{
+	struct ksplot_batch_run *run;
+	const char *base = NULL;
+	GLint first = 0;
+	size_t i;
+
+	batch.active = false;
+	if (!batch.n_runs)
+		return;
+
+	/* Sort the vertices by run. The order inside a run is kept. */
+	for (i = 0; i < batch.n_runs; ++i) {
+		batch.runs[i].first = first;
+		first += batch.runs[i].count;
+		batch.runs[i].count = 0;
+	}
+
+	for (i = 0; i < batch.n_vertices; ++i) {
+		run = &batch.runs[batch.vertex_runs[i]];
+		batch.sorted[run->first + run->count++] = batch.vertices[i];
+	}
+
+	if (batch.use_vbo) {
+		glBindBuffer(GL_ARRAY_BUFFER, batch.vbo);
+		glBufferData(GL_ARRAY_BUFFER,
+			     batch.n_vertices * sizeof(*batch.sorted),
+			     batch.sorted, GL_STREAM_DRAW);
+	} else {
+		base = (const char *) batch.sorted;
+	}
+
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glVertexPointer(2, GL_INT, sizeof(*batch.sorted),
+			base + offsetof(struct ksplot_vertex, x));
+
+	for (i = 0; i < batch.n_runs; ++i) {
+		run = &batch.runs[i];
+		if (run->mode == GL_POINTS)
+			glPointSize(run->size);
+		else if (run->mode == GL_LINES)
+			glLineWidth(run->size);
+
+		glColor3ub(run->color[0], run->color[1], run->color[2]);
+		glDrawArrays(run->mode, run->first, run->count);
+	}
+
+	glDisableClientState(GL_VERTEX_ARRAY);
+
+	if (batch.use_vbo)
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	batch.n_vertices = batch.n_runs = 0;
+	if (batch.run_table)
+		memset(batch.run_table, 0,
+		       batch.run_table_size * sizeof(*batch.run_table));
+}
+
+static size_t batch_run_hash(GLenum mode, float size,
+			     const struct ksplot_color *col)
+{
+	uint32_t bits;
+	uint64_t key;
+
+	memcpy(&bits, &size, sizeof(bits));
+	key = (uint64_t) bits << 32 | (uint64_t) mode << 24 |
+	      col->red << 16 | col->green << 8 | col->blue;
+
+	return (key * 0x9E3779B97F4A7C15ULL) >> 32;
+}
+
+static bool batch_run_match(const struct ksplot_batch_run *run, GLenum mode,
+			    float size, const struct ksplot_color *col)
+{
+	return run->mode == mode && run->size == size &&
+	       run->color[0] == col->red &&
+	       run->color[1] == col->green &&
+	       run->color[2] == col->blue;
+}
+
+/* Get the slot of the run in the hash table, or the empty slot for it. */
+static uint32_t *batch_run_slot(GLenum mode, float size,
+				const struct ksplot_color *col)
+{
+	size_t mask = batch.run_table_size - 1;
+	size_t i;
+
+	for (i = batch_run_hash(mode, size, col) & mask;
+	     batch.run_table[i];
+	     i = (i + 1) & mask) {
+		if (batch_run_match(&batch.runs[batch.run_table[i] - 1],
+				    mode, size, col))
+			break;
+	}
+
+	return &batch.run_table[i];
+}
+
+static bool batch_grow_run_table(void)
+{
+	struct ksplot_batch_run *run;
+	struct ksplot_color col;
+	uint32_t *table;
+	size_t i, size;
+
+	size = batch.run_table_size ? batch.run_table_size * 2 : 256;
+	table = calloc(size, sizeof(*table));
+	if (!table)
+		return false;
+
+	free(batch.run_table);
+	batch.run_table = table;
+	batch.run_table_size = size;
+
+	for (i = 0; i < batch.n_runs; ++i) {
+		run = &batch.runs[i];
+		col.red = run->color[0];
+		col.green = run->color[1];
+		col.blue = run->color[2];
+		*batch_run_slot(run->mode, run->size, &col) = i + 1;
+	}
+
+	return true;
+}
+
+static bool batch_grow_vertices(size_t n)
+{
+	struct ksplot_vertex *vertices, *sorted;
+	uint32_t *vertex_runs;
+	size_t size;
+
+	size = batch.vertices_size ? batch.vertices_size * 2 : 4096;
+	while (size < n)
+		size *= 2;
+
+	vertices = realloc(batch.vertices, size * sizeof(*vertices));
+	if (!vertices)
+		return false;
+
+	batch.vertices = vertices;
+
+	sorted = realloc(batch.sorted, size * sizeof(*sorted));
+	if (!sorted)
+		return false;
+
+	batch.sorted = sorted;
+
+	vertex_runs = realloc(batch.vertex_runs, size * sizeof(*vertex_runs));
+	if (!vertex_runs)
+		return false;
+
+	batch.vertex_runs = vertex_runs;
+	batch.vertices_size = size;
+
+	return true;
+}
+
+/*
+ * Get space for "n" new vertices of a given primitive type and color.
+ * Returns NULL if the primitive has to be drawn immediately.
+ */
+static struct ksplot_vertex *batch_add(GLenum mode, float size,
+				       const struct ksplot_color *col,
+				       size_t n)
+{
+	struct ksplot_batch_run *run, *runs;
+	uint32_t *slot, run_id;
+	size_t i, new_size;
+
+	if (!batch.active)
+		return NULL;
+
+	if (batch.n_vertices + n > batch.vertices_size &&
+	    !batch_grow_vertices(batch.n_vertices + n))
+		goto fail;
+
+	/* Keep the load factor of the hash table of runs below 1/2. */
+	if ((batch.n_runs + 1) * 2 > batch.run_table_size &&
+	    !batch_grow_run_table())
+		goto fail;
+
+	slot = batch_run_slot(mode, size, col);
+	if (!*slot) {
+		if (batch.n_runs == batch.runs_size) {
+			new_size = batch.runs_size ? batch.runs_size * 2 : 64;
+			runs = realloc(batch.runs, new_size * sizeof(*runs));
+			if (!runs)
+				goto fail;
+
+			batch.runs = runs;
+			batch.runs_size = new_size;
+		}
+
+		run = &batch.runs[batch.n_runs++];
+		run->mode = mode;
+		run->size = size;
+		run->color[0] = col->red;
+		run->color[1] = col->green;
+		run->color[2] = col->blue;
+		run->count = 0;
+		*slot = batch.n_runs;
+	}
+
+	run_id = *slot - 1;
+	batch.runs[run_id].count += n;
+	for (i = 0; i < n; ++i)
+		batch.vertex_runs[batch.n_vertices + i] = run_id;
+
+	batch.n_vertices += n;
+
+	return &batch.vertices[batch.n_vertices - n];
+
+ fail:
+	/* Draw everything collected so far and continue without batching. */
+	fprintf(stderr, "Failed to allocate memory for the plot batch.\n");
+	ksplot_batch_flush();
+	return NULL;
+}
+
+static void set_vertex(struct ksplot_vertex *v, const struct ksplot_point *p)
+{
+	v->x = p->x;
+	v->y = p->y;
+}
+
 /**
  * @brief Draw a point.
  *
@@ -102,9 +454,17 @@ void ksplot_draw_point(const struct ksplot_point *p,
 		       const struct ksplot_color *col,
 		       float size)
 {
+	struct ksplot_vertex *v;
+
 	if (!p || !col || size < .5f)
 		return;
 
+	v = batch_add(GL_POINTS, size, col, 1);
+	if (v) {
+		set_vertex(v, p);
+		return;
+	}
+
 	glPointSize(size);
 	glBegin(GL_POINTS);
 	glColor3ub(col->red, col->green, col->blue);
@@ -125,9 +485,18 @@ void ksplot_draw_line(const struct ksplot_point *a,
 		      const struct ksplot_color *col,
 		      float size)
 {
+	struct ksplot_vertex *v;
+
 	if (!a || !b || !col || size < .5f)
 		return;
 
+	v = batch_add(GL_LINES, size, col, 2);
+	if (v) {
+		set_vertex(&v[0], a);
+		set_vertex(&v[1], b);
+		return;
+	}
+
 	glLineWidth(size);
 	glBegin(GL_LINES);
 	glColor3ub(col->red, col->green, col->blue);
@@ -149,6 +518,10 @@ void ksplot_draw_polygon(const struct ksplot_point *points,
 			 const struct ksplot_color *col,
 			 float size)
 {
+	struct ksplot_point in_point;
+	struct ksplot_vertex *v;
+	size_t i;
+
 	if (!points || !n_points || !col || size < .5f)
 		return;
 
@@ -163,10 +536,24 @@ void ksplot_draw_polygon(const struct ksplot_point *points,
 	}
 
 	/* Obtain a point inside the surface of the polygon. */
-	struct ksplot_point in_point;
 	in_point.x = (points[0].x + points[2].x) / 2;
 	in_point.y = (points[0].y + points[2].y) / 2;
 
+	/*
+	 * When batching, split the Triangle Fan into separate triangles, so
+	 * that all polygons can be drawn with a single call.
+	 */
+	v = batch_add(GL_TRIANGLES, 0, col, 3 * n_points);
+	if (v) {
+		for (i = 0; i < n_points; ++i) {
+			set_vertex(v++, &in_point);
+			set_vertex(v++, &points[i]);
+			set_vertex(v++, &points[(i + 1) % n_points]);
+		}
+
+		return;
+	}
+
 	/*
 	 * Draw a Triangle Fan using the internal point as a central
 	 * vertex.
@@ -174,7 +561,7 @@ void ksplot_draw_polygon(const struct ksplot_point *points,
 	glBegin(GL_TRIANGLE_FAN);
 	glColor3ub(col->red, col->green, col->blue);
 	glVertex2i(in_point.x, in_point.y);
-	for (size_t i = 0; i < n_points; ++i)
+	for (i = 0; i < n_points; ++i)
 		glVertex2i(points[i].x, points[i].y);
 
 	glVertex2i(points[0].x, points[0].y);
@@ -43,6 +43,10 @@ void ksplot_init_opengl(int dpr);
 
 void ksplot_resize_opengl(int width, int height);
 
+void ksplot_batch_begin(void);
+
+void ksplot_batch_flush(void);
+
 void ksplot_draw_point(const struct ksplot_point *p,
 		       const struct ksplot_color *col,
 		       float size);
@@ -0,0 +1,358 @@
+// SPDX-License-Identifier: LGPL-2.1
+
+/*
+ * Copyright (C) 2019 VMware Inc, Yordan Karadzhov <y.karadz@gmail.com>
+ */
+
+ /**
+  *  @file    libkshark-search.c
+  *  @brief   Full-text index of the info strings of the trace data.
+  */
+
+// C
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+// KernelShark
+#include "libkshark.h"
+
+/** Compressed list of blocks of one hash bucket, used during the building. */
+struct info_bucket {
+	/** The compressed list. */
+	uint8_t		*data;
+
+	/** The size of the list in bytes. */
+	size_t		size;
+
+	/** The size of the allocated memory in bytes. */
+	size_t		alloc;
+
+	/** The last block added to the list plus one. Zero if empty. */
+	uint64_t	last;
+};
+
+static inline uint32_t info_lower(uint8_t c)
+{
+	return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+}
+
+static inline uint32_t trigram_bucket(const char *s)
+{
+	const uint8_t *c = (const uint8_t *) s;
+	uint32_t t;
+
+	t = info_lower(c[0]) << 16 | info_lower(c[1]) << 8 | info_lower(c[2]);
+
+	/* Multiplicative hashing. Use the high bits of the product. */
+	return ((t * 2654435761U) >> 16) & (KS_INFO_INDEX_BUCKETS - 1);
+}
+
+static bool bucket_append(struct info_bucket *bucket, uint64_t block)
+{
+	uint64_t delta = block + 1 - bucket->last;
+	uint8_t *data;
+	size_t alloc;
+
+	/* A 64-bit value takes at most 10 bytes. */
+	if (bucket->size + 10 > bucket->alloc) {
+		alloc = bucket->alloc ? bucket->alloc * 2 : 16;
+		data = realloc(bucket->data, alloc);
+		if (!data)
+			return false;
+
+		bucket->data = data;
+		bucket->alloc = alloc;
+	}
+
+	do {
+		bucket->data[bucket->size] = delta & 0x7f;
+		delta >>= 7;
+		if (delta)
+			bucket->data[bucket->size] |= 0x80;
+
+		bucket->size++;
+	} while (delta);
+
+	bucket->last = block + 1;
+
+	return true;
+}
+
+static const uint8_t *decode_delta(const uint8_t *p, const uint8_t *end,
+				   uint64_t *delta)
+{
+	int shift = 0;
+
+	*delta = 0;
+	while (p < end) {
+		*delta |= (uint64_t) (*p & 0x7f) << shift;
+		shift += 7;
+		if (!(*p++ & 0x80))
+			break;
+	}
+
+	return p;
+}
+
+static size_t bucket_decode(const struct kshark_info_index *index,
+			    uint32_t bucket, uint64_t *blocks)
+{
+	const uint8_t *p = index->data + index->offsets[bucket];
+	const uint8_t *end = index->data + index->offsets[bucket + 1];
+	uint64_t delta, val = 0;
+	size_t n = 0;
+
+	while (p < end) {
+		p = decode_delta(p, end, &delta);
+		val += delta;
+		blocks[n++] = val - 1;
+	}
+
+	return n;
+}
+
+/* Keep only the blocks, which are also in the list of the given bucket. */
+static size_t bucket_intersect(const struct kshark_info_index *index,
+			       uint32_t bucket, uint64_t *blocks, size_t n)
+{
+	const uint8_t *p = index->data + index->offsets[bucket];
+	const uint8_t *end = index->data + index->offsets[bucket + 1];
+	uint64_t delta, val = 0;
+	size_t i = 0, n_out = 0;
+
+	while (p < end && i < n) {
+		p = decode_delta(p, end, &delta);
+		val += delta;
+
+		while (i < n && blocks[i] < val - 1)
+			++i;
+
+		if (i < n && blocks[i] == val - 1)
+			blocks[n_out++] = blocks[i++];
+	}
+
+	return n_out;
+}
+
+static size_t bucket_size(const struct kshark_info_index *index,
+			  uint32_t bucket)
+{
+	return index->offsets[bucket + 1] - index->offsets[bucket];
+}
+
+static int compare_buckets(const void *a, const void *b)
+{
+	uint32_t ba = *(const uint32_t *) a;
+	uint32_t bb = *(const uint32_t *) b;
+
+	return (ba > bb) - (ba < bb);
+}
+
+/**
+ * @brief Build a full-text index of the info strings of the trace data. The
+ *	  info strings are read by an additional reader of the trace data
+ *	  file, hence the session can be used while the index is being built.
+ *	  Use kshark_info_index_free() to free the index.
+ *
+ * @param kshark_ctx: Input location for the session context pointer.
+ * @param data_rows: Input location for the trace data.
+ * @param n_rows: The size of the inputted data.
+ * @param cancel: Optional input location for a flag. If the flag gets set
+ *		  (possibly by another thread), the building is aborted.
+ *
+ * @returns The index on success, or NULL on failure.
+ */
+struct kshark_info_index *
+kshark_info_index_build(struct kshark_context *kshark_ctx,
+			struct kshark_entry **data_rows, size_t n_rows,
+			const int *cancel)
+{
+	struct kshark_info_index *index = NULL;
+	struct info_bucket *buckets, *b;
+	struct kshark_reader *reader;
+	size_t row, i, len, total;
+	uint64_t block;
+	const char *info;
+
+	reader = kshark_reader_open(kshark_ctx);
+	if (!reader)
+		return NULL;
+
+	buckets = calloc(KS_INFO_INDEX_BUCKETS, sizeof(*buckets));
+	if (!buckets)
+		goto out;
+
+	for (row = 0; row < n_rows; ++row) {
+		if (cancel && __atomic_load_n(cancel, __ATOMIC_RELAXED))
+			goto out;
+
+		info = kshark_reader_get_info(reader, data_rows[row]);
+		if (!info)
+			continue;
+
+		block = row / KS_INFO_INDEX_BLOCK;
+		len = strlen(info);
+		for (i = 0; i + 2 < len; ++i) {
+			b = &buckets[trigram_bucket(info + i)];
+			if (b->last != block + 1 && !bucket_append(b, block))
+				goto fail;
+		}
+	}
+
+	/* Pack all lists into one array. */
+	index = calloc(1, sizeof(*index));
+	if (!index)
+		goto fail;
+
+	for (total = 0, i = 0; i < KS_INFO_INDEX_BUCKETS; ++i)
+		total += buckets[i].size;
+
+	index->n_rows = n_rows;
+	index->offsets = malloc((KS_INFO_INDEX_BUCKETS + 1) *
+				sizeof(*index->offsets));
+	index->data = malloc(total ? total : 1);
+	if (!index->offsets || !index->data)
+		goto fail;
+
+	for (total = 0, i = 0; i < KS_INFO_INDEX_BUCKETS; ++i) {
+		index->offsets[i] = total;
+		if (buckets[i].size)
+			memcpy(index->data + total, buckets[i].data,
+			       buckets[i].size);
+
+		total += buckets[i].size;
+	}
+
+	index->offsets[KS_INFO_INDEX_BUCKETS] = total;
+	goto out;
+
+ fail:
+	fprintf(stderr, "Failed to allocate memory for the info index.\n");
+
+	kshark_info_index_free(index);
+	index = NULL;
+
+ out:
+	if (buckets) {
+		for (i = 0; i < KS_INFO_INDEX_BUCKETS; ++i)
+			free(buckets[i].data);
+
+		free(buckets);
+	}
+
+	kshark_reader_close(reader);
+
+	return index;
+}
+
+/**
+ * @brief Free a full-text index of the info strings.
+ *
+ * @param index: Input location for the index.
+ */
+void kshark_info_index_free(struct kshark_info_index *index)
+{
+	if (!index)
+		return;
+
+	free(index->offsets);
+	free(index->data);
+	free(index);
+}
+
+/**
+ * @brief Find all rows, which may have an info string containing a given
+ *	  text (ignoring the case). The outputted rows are a superset of the
+ *	  rows containing the text, hence the caller has to check the info
+ *	  strings of these rows. All rows not outputted do not contain the
+ *	  text.
+ *
+ * @param index: Input location for the index.
+ * @param text: The text to search for.
+ * @param rows: Output location for the sorted array of rows. The user is
+ *		responsible for freeing the array.
+ *
+ * @returns The number of outputted rows on success. -EINVAL is returned if
+ *	    the index cannot be used for this text (the text is shorter than
+ *	    three characters or it contains non-ASCII characters). -ENOMEM
+ *	    is returned on failure.
+ */
+ssize_t kshark_info_index_find(const struct kshark_info_index *index,
+			       const char *text, size_t **rows)
+{
+	size_t i, n_buckets, n_blocks, n, count, row, last;
+	uint32_t *buckets;
+	uint64_t *blocks;
+	size_t len = strlen(text);
+
+	if (len < 3)
+		return -EINVAL;
+
+	for (i = 0; i < len; ++i)
+		if ((uint8_t) text[i] & 0x80)
+			return -EINVAL;
+
+	buckets = malloc((len - 2) * sizeof(*buckets));
+	n_blocks = (index->n_rows + KS_INFO_INDEX_BLOCK - 1) /
+		   KS_INFO_INDEX_BLOCK;
+	blocks = malloc((n_blocks ? n_blocks : 1) * sizeof(*blocks));
+	if (!buckets || !blocks)
+		goto fail;
+
+	for (i = 0; i < len - 2; ++i)
+		buckets[i] = trigram_bucket(text + i);
+
+	qsort(buckets, len - 2, sizeof(*buckets), compare_buckets);
+	for (n_buckets = 1, i = 1; i < len - 2; ++i)
+		if (buckets[i] != buckets[n_buckets - 1])
+			buckets[n_buckets++] = buckets[i];
+
+	/* Start from the shortest list. */
+	for (i = 1; i < n_buckets; ++i) {
+		if (bucket_size(index, buckets[i]) <
+		    bucket_size(index, buckets[0])) {
+			uint32_t tmp = buckets[0];
+
+			buckets[0] = buckets[i];
+			buckets[i] = tmp;
+		}
+	}
+
+	n = bucket_decode(index, buckets[0], blocks);
+	for (i = 1; i < n_buckets && n; ++i)
+		n = bucket_intersect(index, buckets[i], blocks, n);
+
+	for (count = 0, i = 0; i < n; ++i) {
+		last = (blocks[i] + 1) * KS_INFO_INDEX_BLOCK;
+		if (last > index->n_rows)
+			last = index->n_rows;
+
+		count += last - blocks[i] * KS_INFO_INDEX_BLOCK;
+	}
+
+	*rows = malloc((count ? count : 1) * sizeof(**rows));
+	if (!*rows)
+		goto fail;
+
+	for (count = 0, i = 0; i < n; ++i) {
+		last = (blocks[i] + 1) * KS_INFO_INDEX_BLOCK;
+		if (last > index->n_rows)
+			last = index->n_rows;
+
+		for (row = blocks[i] * KS_INFO_INDEX_BLOCK; row < last; ++row)
+			(*rows)[count++] = row;
+	}
+
+	free(buckets);
+	free(blocks);
+
+	return count;
+
+ fail:
+	free(buckets);
+	free(blocks);
+
+	return -ENOMEM;
+}
@@ -15,7 +15,9 @@
 // C
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <assert.h>
+#include <sys/mman.h>
 
 // KernelShark
 #include "libkshark.h"
@@ -24,6 +26,23 @@ static __thread struct trace_seq seq;
 
 static struct kshark_context *kshark_context_handler = NULL;
 
+/*
+ * The parser of the event formats (libtraceevent) is not thread-safe. Use a
+ * mutex to protect the opening of trace data files.
+ */
+static pthread_mutex_t open_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static struct tracecmd_input *open_trace_file(const char *file)
+{
+	struct tracecmd_input *handle;
+
+	pthread_mutex_lock(&open_mutex);
+	handle = tracecmd_open(file);
+	pthread_mutex_unlock(&open_mutex);
+
+	return handle;
+}
+
 static bool kshark_default_context(struct kshark_context **context)
 {
 	struct kshark_context *kshark_ctx;
@@ -141,7 +160,7 @@ bool kshark_open(struct kshark_context *kshark_ctx, const char *file)
 
 	kshark_free_task_list(kshark_ctx);
 
-	handle = tracecmd_open(file);
+	handle = open_trace_file(file);
 	if (!handle)
 		return false;
 
@@ -150,6 +169,8 @@ bool kshark_open(struct kshark_context *kshark_ctx, const char *file)
 		return false;
 	}
 
+	free(kshark_ctx->file);
+	kshark_ctx->file = strdup(file);
 	kshark_ctx->handle = handle;
 	kshark_ctx->pevent = tracecmd_get_pevent(handle);
 
@@ -193,6 +214,8 @@ void kshark_close(struct kshark_context *kshark_ctx)
 		kshark_ctx->advanced_event_filter = NULL;
 	}
 
+	kshark_filter_field_clear(kshark_ctx);
+
 	/*
 	 * All data collections are file specific. Make sure that collections
 	 * from this file are not going to be used with another file.
@@ -200,10 +223,16 @@ void kshark_close(struct kshark_context *kshark_ctx)
 	kshark_free_collection_list(kshark_ctx->collections);
 	kshark_ctx->collections = NULL;
 
+	kshark_index_clear(kshark_ctx);
+	kshark_clear_field_columns(kshark_ctx);
+
 	tracecmd_close(kshark_ctx->handle);
 	kshark_ctx->handle = NULL;
 	kshark_ctx->pevent = NULL;
 
+	free(kshark_ctx->file);
+	kshark_ctx->file = NULL;
+
 	pthread_mutex_destroy(&kshark_ctx->input_mutex);
 }
 
@@ -235,6 +264,8 @@ void kshark_free(struct kshark_context *kshark_ctx)
 	tracecmd_filter_id_hash_free(kshark_ctx->show_cpu_filter);
 	tracecmd_filter_id_hash_free(kshark_ctx->hide_cpu_filter);
 
+	kshark_filter_field_clear(kshark_ctx);
+
 	if (kshark_ctx->plugins) {
 		kshark_handle_plugins(kshark_ctx, KSHARK_PLUGIN_CLOSE);
 		kshark_free_plugin_list(kshark_ctx->plugins);
@@ -242,6 +273,11 @@ void kshark_free(struct kshark_context *kshark_ctx)
 	}
 
 	kshark_free_task_list(kshark_ctx);
+	kshark_index_clear(kshark_ctx);
+	kshark_clear_field_columns(kshark_ctx);
+
+	if (kshark_ctx->entry_cache)
+		munmap(kshark_ctx->entry_cache, kshark_ctx->entry_cache_size);
 
 	if (seq.buffer)
 		trace_seq_destroy(&seq);
@@ -249,6 +285,7 @@ void kshark_free(struct kshark_context *kshark_ctx)
 	if (kshark_ctx == kshark_context_handler)
 		kshark_context_handler = NULL;
 
+	free(kshark_ctx->file);
 	free(kshark_ctx);
 }
 
@@ -265,7 +302,16 @@ kshark_find_task(struct kshark_context *kshark_ctx, uint32_t key, int pid)
 	return NULL;
 }
 
-static struct kshark_task_list *
+/**
+ * @brief Add a task to the hash table of tasks of the session.
+ *
+ * @param kshark_ctx: Input location for the session context pointer.
+ * @param pid: Process Id of the task.
+ *
+ * @returns The task, if it was found or added successfully, or NULL on
+ *	    failure.
+ */
+struct kshark_task_list *
 kshark_add_task(struct kshark_context *kshark_ctx, int pid)
 {
 	struct kshark_task_list *list;
@@ -290,7 +336,8 @@ kshark_add_task(struct kshark_context *kshark_ctx, int pid)
 
 /**
  * @brief Get an array containing the Process Ids of all tasks presented in
- *	  the loaded trace data file.
+ *	  the loaded trace data file. If the loaded data is indexed, the
+ *	  Pids are taken (sorted) from the per-task posting lists.
  *
  * @param kshark_ctx: Input location for context pointer.
  * @param pids: Output location for the Pids of the tasks. The user is
@@ -305,6 +352,17 @@ ssize_t kshark_get_task_pids(struct kshark_context *kshark_ctx, int **pids)
 	struct kshark_task_list *list;
 	int *temp_pids;
 
+	if (kshark_ctx->pid_index) {
+		*pids = malloc(kshark_ctx->n_pid_index * sizeof(int));
+		if (!*pids)
+			goto fail;
+
+		for (i = 0; i < kshark_ctx->n_pid_index; ++i)
+			(*pids)[i] = kshark_ctx->pid_index[i].key;
+
+		return kshark_ctx->n_pid_index;
+	}
+
 	*pids = calloc(pid_size, sizeof(int));
 	if (!*pids)
 		goto fail;
@@ -450,6 +508,73 @@ static bool filter_is_set(struct tracecmd_filter_id *filter)
 	return filter && filter->count;
 }
 
+/**
+ * @brief Add a filter of the values of a numeric event field. Only the
+ *	  entries of the event, having a value of the field inside the range
+ *	  will be visible. The entries of all other events are not affected.
+ *	  If a filter for this field exists already, its range is replaced.
+ *	  The filter is applied by kshark_filter_entries() and when the data
+ *	  is loaded.
+ *
+ * @param kshark_ctx: Input location for the session context pointer.
+ * @param event_id: The Id of the event.
+ * @param field: The name of the field.
+ * @param min: The lower bound of the range (included).
+ * @param max: The upper bound of the range (included). For unsigned
+ *	       fields both bounds are interpreted as unsigned values.
+ *
+ * @returns True on success, or false on failure.
+ */
+bool kshark_filter_field_add(struct kshark_context *kshark_ctx,
+			     int event_id, const char *field,
+			     int64_t min, int64_t max)
+{
+	struct kshark_field_filter *filter;
+
+	for (filter = kshark_ctx->field_filters; filter; filter = filter->next)
+		if (filter->event_id == event_id &&
+		    strcmp(filter->field, field) == 0)
+			break;
+
+	if (!filter) {
+		filter = calloc(1, sizeof(*filter));
+		if (!filter)
+			return false;
+
+		filter->field = strdup(field);
+		if (!filter->field) {
+			free(filter);
+			return false;
+		}
+
+		filter->event_id = event_id;
+		filter->next = kshark_ctx->field_filters;
+		kshark_ctx->field_filters = filter;
+	}
+
+	filter->min = min;
+	filter->max = max;
+
+	return true;
+}
+
+/**
+ * @brief Remove all filters of the values of numeric event fields.
+ *
+ * @param kshark_ctx: Input location for the session context pointer.
+ */
+void kshark_filter_field_clear(struct kshark_context *kshark_ctx)
+{
+	struct kshark_field_filter *filter;
+
+	while (kshark_ctx->field_filters) {
+		filter = kshark_ctx->field_filters;
+		kshark_ctx->field_filters = filter->next;
+		free(filter->field);
+		free(filter);
+	}
+}
+
 /**
  * @brief Check if an Id filter is set.
  *
@@ -464,7 +589,8 @@ bool kshark_filter_is_set(struct kshark_context *kshark_ctx)
 	       filter_is_set(kshark_ctx->show_cpu_filter) ||
 	       filter_is_set(kshark_ctx->hide_cpu_filter) ||
 	       filter_is_set(kshark_ctx->show_event_filter) ||
-	       filter_is_set(kshark_ctx->hide_event_filter);
+	       filter_is_set(kshark_ctx->hide_event_filter) ||
+	       kshark_ctx->field_filters;
 }
 
 static inline void unset_event_filter_flag(struct kshark_context *kshark_ctx,
@@ -482,6 +608,27 @@ static inline void unset_event_filter_flag(struct kshark_context *kshark_ctx,
 	e->visible &= ~event_mask;
 }
 
+static void filter_fields(struct kshark_context *kshark_ctx,
+			  struct kshark_entry **data,
+			  size_t n_entries)
+{
+	const struct kshark_field_column *col;
+	struct kshark_field_filter *filter;
+
+	for (filter = kshark_ctx->field_filters; filter; filter = filter->next) {
+		col = kshark_get_field_column(kshark_ctx, data, n_entries,
+					      filter->event_id, filter->field);
+		if (!col) {
+			fprintf(stderr, "Failed to filter field %s.\n",
+				filter->field);
+			continue;
+		}
+
+		kshark_filter_field_range(kshark_ctx, col, data,
+					  filter->min, filter->max);
+	}
+}
+
 /**
  * @brief This function loops over the array of entries specified by "data"
  *	  and "n_entries" and sets the "visible" fields of each entry
@@ -532,6 +679,55 @@ void kshark_filter_entries(struct kshark_context *kshark_ctx,
 		if (!kshark_show_task(kshark_ctx, data[i]->pid))
 			data[i]->visible &= ~kshark_ctx->filter_mask;
 	}
+
+	/* Apply the filters of the values of the event fields. */
+	filter_fields(kshark_ctx, data, n_entries);
+}
+
+/**
+ * @brief Filter the entries of one event by the value of one of its numeric
+ *	  fields. The entries of the event, having a value of the field
+ *	  outside of a given range, are filtered-out in the same way as the
+ *	  entries filtered-out by the event filters. The entries of all other
+ *	  events are not touched. Use this function after applying the other
+ *	  filters.
+ *
+ * @param kshark_ctx: Input location for the session context pointer.
+ * @param col: Input location for the column of the field, obtained by using
+ *	       kshark_get_field_column().
+ * @param data: Input location for the trace data to be filtered. This must
+ *		be the data, the column has been extracted from.
+ * @param min: The lower bound of the range (included).
+ * @param max: The upper bound of the range (included). If the field is
+ *	       unsigned, both bounds are interpreted as unsigned values.
+ *
+ * @returns The number of entries filtered-out.
+ */
+size_t kshark_filter_field_range(struct kshark_context *kshark_ctx,
+				 const struct kshark_field_column *col,
+				 struct kshark_entry **data,
+				 int64_t min, int64_t max)
+{
+	size_t i, count = 0;
+	bool out;
+
+	for (i = 0; i < col->n_rows; ++i) {
+		if (!col->valid[i])
+			continue;
+
+		if (col->is_signed)
+			out = col->values[i] < min || col->values[i] > max;
+		else
+			out = (uint64_t) col->values[i] < (uint64_t) min ||
+			      (uint64_t) col->values[i] > (uint64_t) max;
+
+		if (out) {
+			unset_event_filter_flag(kshark_ctx, data[i]);
+			++count;
+		}
+	}
+
+	return count;
 }
 
 /**
@@ -625,6 +821,70 @@ static const char* missed_events_dump(struct kshark_context *kshark_ctx,
 	return NULL;
 }
 
+/*
+ * Compare the entries field by field. The structure has padding, hence
+ * memcmp() cannot be used.
+ */
+static bool entry_changed(const struct kshark_entry *a,
+			  const struct kshark_entry *b)
+{
+	return a->next != b->next ||
+	       a->visible != b->visible ||
+	       a->cpu != b->cpu ||
+	       a->pid != b->pid ||
+	       a->event_id != b->event_id ||
+	       a->offset != b->offset ||
+	       a->ts != b->ts;
+}
+
+static void load_entry(struct kshark_context *kshark_ctx,
+		       struct tep_record *rec,
+		       struct kshark_entry *entry)
+{
+	struct tep_event_filter *adv_filter = kshark_ctx->advanced_event_filter;
+	struct kshark_event_handler *evt_handler;
+	struct kshark_entry orig;
+	int ret;
+
+	kshark_set_entry_values(kshark_ctx, rec, entry);
+
+	/* Execute all plugin-provided actions (if any). */
+	evt_handler = kshark_ctx->event_handlers;
+	while ((evt_handler = kshark_find_event_handler(evt_handler,
+							entry->event_id))) {
+		orig = *entry;
+		evt_handler->event_func(kshark_ctx, rec, entry);
+		evt_handler = evt_handler->next;
+
+		/*
+		 * Actions which only collect information from the record
+		 * leave the entry untouched.
+		 */
+		if (entry_changed(&orig, entry))
+			entry->visible &= ~KS_PLUGIN_UNTOUCHED_MASK;
+	}
+
+	/* Apply event filtering. */
+	ret = FILTER_MATCH;
+	if (adv_filter->filters)
+		ret = tep_filter_match(adv_filter, rec);
+
+	if (!kshark_show_event(kshark_ctx, entry->event_id) ||
+	    ret != FILTER_MATCH) {
+		unset_event_filter_flag(kshark_ctx, entry);
+	}
+
+	/* Apply CPU filtering. */
+	if (!kshark_show_cpu(kshark_ctx, entry->pid)) {
+		entry->visible &= ~kshark_ctx->filter_mask;
+	}
+
+	/* Apply task filtering. */
+	if (!kshark_show_task(kshark_ctx, entry->pid)) {
+		entry->visible &= ~kshark_ctx->filter_mask;
+	}
+}
+
 /**
  * rec_list is used to pass the data to the load functions.
  * The rec_list will contain the list of entries from the source,
@@ -670,17 +930,126 @@ static void free_rec_list(struct rec_list **rec_list, int n_cpus,
 	free(rec_list);
 }
 
+/**
+ * @brief Register a callback function, reporting the progress of the loading
+ *	  of the trace data. The loading can be aborted from any thread, by
+ *	  using kshark_cancel_loading().
+ *
+ * @param kshark_ctx: Input location for the session context pointer.
+ * @param func: Callback function. Use NULL to unregister the callback.
+ * @param data: User data, passed to the callback.
+ */
+void kshark_set_load_progress(struct kshark_context *kshark_ctx,
+			      kshark_load_progress_func func, void *data)
+{
+	kshark_ctx->load_progress_func = func;
+	kshark_ctx->load_progress_data = data;
+}
+
+/**
+ * @brief Abort the ongoing loading of the trace data. The loading function
+ *	  returns -ECANCELED. This function is safe to be called from any
+ *	  thread.
+ *
+ * @param kshark_ctx: Input location for the session context pointer.
+ */
+void kshark_cancel_loading(struct kshark_context *kshark_ctx)
+{
+	__atomic_store_n(&kshark_ctx->load_cancel, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Check if the ongoing loading of the trace data is aborted.
+ *
+ * @param kshark_ctx: Input location for the session context pointer.
+ */
+bool kshark_loading_canceled(struct kshark_context *kshark_ctx)
+{
+	return __atomic_load_n(&kshark_ctx->load_cancel, __ATOMIC_RELAXED);
+}
+
+/* Report the progress of the loading once per this number of entries. */
+#define KS_LOAD_PROGRESS_STEP	(1 << 16)
+
+static bool load_progress_init(struct kshark_context *kshark_ctx,
+			       struct kshark_load_progress *progress)
+{
+	int cpu;
+
+	memset(progress, 0, sizeof(*progress));
+	__atomic_store_n(&kshark_ctx->load_cancel, 0, __ATOMIC_RELAXED);
+
+	progress->n_cpus = tracecmd_cpus(kshark_ctx->handle);
+	progress->cpu_done = calloc(progress->n_cpus,
+				    sizeof(*progress->cpu_done));
+	progress->cpu_total = calloc(progress->n_cpus,
+				     sizeof(*progress->cpu_total));
+	if (!progress->cpu_done || !progress->cpu_total)
+		return false;
+
+	for (cpu = 0; cpu < progress->n_cpus; ++cpu) {
+		progress->cpu_total[cpu] =
+			tracecmd_cpu_data_size(kshark_ctx->handle, cpu);
+		progress->total += progress->cpu_total[cpu];
+	}
+
+	progress->phase = KS_LOAD_DECODE;
+
+	return true;
+}
+
+static void load_progress_free(struct kshark_load_progress *progress)
+{
+	free(progress->cpu_done);
+	free(progress->cpu_total);
+}
+
+/*
+ * Report the progress to the user. Returns false if the loading has to be
+ * aborted.
+ */
+static bool load_progress_report(struct kshark_context *kshark_ctx,
+				 struct kshark_load_progress *progress,
+				 enum kshark_load_phase phase,
+				 uint64_t done, uint64_t total)
+{
+	progress->phase = phase;
+	progress->done = done;
+	progress->total = total;
+
+	if (kshark_ctx->load_progress_func)
+		kshark_ctx->load_progress_func(kshark_ctx, progress,
+					       kshark_ctx->load_progress_data);
+
+	return !kshark_loading_canceled(kshark_ctx);
+}
+
+/* Report the number of bytes of trace data, decoded for a given CPU. */
+static bool load_progress_decode(struct kshark_context *kshark_ctx,
+				 struct kshark_load_progress *progress,
+				 int cpu, uint64_t bytes)
+{
+	uint64_t done = progress->done + bytes - progress->cpu_done[cpu];
+
+	progress->cpu_done[cpu] = bytes;
+
+	return load_progress_report(kshark_ctx, progress, KS_LOAD_DECODE,
+				    done, progress->total);
+}
+
 static ssize_t get_records(struct kshark_context *kshark_ctx,
-			   struct rec_list ***rec_list, enum rec_type type)
+			   struct rec_list ***rec_list, enum rec_type type,
+			   struct kshark_load_progress *progress)
 {
-	struct kshark_event_handler *evt_handler;
-	struct tep_event_filter *adv_filter;
+	unsigned long long cpu_offset;
 	struct kshark_task_list *task;
 	struct tep_record *rec;
 	struct rec_list **temp_next;
 	struct rec_list **cpu_list;
 	struct rec_list *temp_rec;
 	size_t count, total = 0;
+	uint64_t bytes;
+	int page_size;
 	int n_cpus;
 	int pid;
 	int cpu;
@@ -690,17 +1059,27 @@ static ssize_t get_records(struct kshark_context *kshark_ctx,
 	if (!cpu_list)
 		return -ENOMEM;
 
-	/* Just to shorten the name */
-	if (type == REC_ENTRY)
-		adv_filter = kshark_ctx->advanced_event_filter;
+	page_size = tracecmd_page_size(kshark_ctx->handle);
 
 	for (cpu = 0; cpu < n_cpus; ++cpu) {
 		count = 0;
 		cpu_list[cpu] = NULL;
 		temp_next = &cpu_list[cpu];
+		cpu_offset = tracecmd_cpu_data_offset(kshark_ctx->handle, cpu);
 
 		rec = tracecmd_read_cpu_first(kshark_ctx->handle, cpu);
 		while (rec) {
+			/* Report the progress once per page of data. */
+			bytes = rec->offset - cpu_offset;
+			if (bytes >= progress->cpu_done[cpu] + page_size) {
+				progress->n_entries = total + count;
+				if (!load_progress_decode(kshark_ctx, progress,
+							  cpu, bytes)) {
+					free_record(rec);
+					goto cancel;
+				}
+			}
+
 			*temp_next = temp_rec = calloc(1, sizeof(*temp_rec));
 			if (!temp_rec)
 				goto fail;
@@ -714,7 +1093,6 @@ static ssize_t get_records(struct kshark_context *kshark_ctx,
 				break;
 			case REC_ENTRY: {
 				struct kshark_entry *entry;
-				int ret;
 
 				if (rec->missed_events) {
 					/*
@@ -732,37 +1110,8 @@ static ssize_t get_records(struct kshark_context *kshark_ctx,
 				}
 
 				entry = &temp_rec->entry;
-				kshark_set_entry_values(kshark_ctx, rec, entry);
-
-				/* Execute all plugin-provided actions (if any). */
-				evt_handler = kshark_ctx->event_handlers;
-				while ((evt_handler = kshark_find_event_handler(evt_handler,
-										entry->event_id))) {
-					evt_handler->event_func(kshark_ctx, rec, entry);
-					evt_handler = evt_handler->next;
-					entry->visible &= ~KS_PLUGIN_UNTOUCHED_MASK;
-				}
-
+				load_entry(kshark_ctx, rec, entry);
 				pid = entry->pid;
-				/* Apply event filtering. */
-				ret = FILTER_MATCH;
-				if (adv_filter->filters)
-					ret = tep_filter_match(adv_filter, rec);
-
-				if (!kshark_show_event(kshark_ctx, entry->event_id) ||
-				    ret != FILTER_MATCH) {
-					unset_event_filter_flag(kshark_ctx, entry);
-				}
-
-				/* Apply CPU filtering. */
-				if (!kshark_show_cpu(kshark_ctx, entry->pid)) {
-					entry->visible &= ~kshark_ctx->filter_mask;
-				}
-
-				/* Apply task filtering. */
-				if (!kshark_show_task(kshark_ctx, entry->pid)) {
-					entry->visible &= ~kshark_ctx->filter_mask;
-				}
 				free_record(rec);
 				break;
 			} /* REC_ENTRY */
@@ -781,6 +1130,11 @@ static ssize_t get_records(struct kshark_context *kshark_ctx,
 		}
 
 		total += count;
+
+		progress->n_entries = total;
+		if (!load_progress_decode(kshark_ctx, progress, cpu,
+					  progress->cpu_total[cpu]))
+			goto cancel;
 	}
 
 	*rec_list = cpu_list;
@@ -789,6 +1143,10 @@ static ssize_t get_records(struct kshark_context *kshark_ctx,
  fail:
 	free_rec_list(cpu_list, n_cpus, type);
 	return -ENOMEM;
+
+ cancel:
+	free_rec_list(cpu_list, n_cpus, type);
+	return -ECANCELED;
 }
 
 static int pick_next_cpu(struct rec_list **rec_list, int n_cpus,
@@ -843,16 +1201,27 @@ static int pick_next_cpu(struct rec_list **rec_list, int n_cpus,
 ssize_t kshark_load_data_entries(struct kshark_context *kshark_ctx,
 				 struct kshark_entry ***data_rows)
 {
+	struct kshark_load_progress progress;
 	struct kshark_entry **rows;
 	struct rec_list **rec_list;
 	enum rec_type type = REC_ENTRY;
 	ssize_t count, total = 0;
 	int n_cpus;
 
-	if (*data_rows)
+	if (*data_rows) {
+		if (*data_rows == kshark_ctx->index_data)
+			kshark_index_clear(kshark_ctx);
+
+		if (*data_rows == kshark_ctx->field_data)
+			kshark_clear_field_columns(kshark_ctx);
+
 		free(*data_rows);
+	}
+
+	if (!load_progress_init(kshark_ctx, &progress))
+		goto fail;
 
-	total = get_records(kshark_ctx, &rec_list, type);
+	total = get_records(kshark_ctx, &rec_list, type, &progress);
 	if (total < 0)
 		goto fail;
 
@@ -865,6 +1234,18 @@ ssize_t kshark_load_data_entries(struct kshark_context *kshark_ctx,
 	for (count = 0; count < total; count++) {
 		int next_cpu;
 
+		if (count % KS_LOAD_PROGRESS_STEP == 0 &&
+		    !load_progress_report(kshark_ctx, &progress,
+					  KS_LOAD_MERGE, count, total)) {
+			/* The merged entries are no longer in rec_list. */
+			while (count)
+				free(rows[--count]);
+
+			free(rows);
+			total = -ECANCELED;
+			goto fail_free;
+		}
+
 		next_cpu = pick_next_cpu(rec_list, n_cpus, type);
 
 		if (next_cpu >= 0) {
@@ -875,12 +1256,30 @@ ssize_t kshark_load_data_entries(struct kshark_context *kshark_ctx,
 
 	free_rec_list(rec_list, n_cpus, type);
 	*data_rows = rows;
+
+	/* The index is an optimization. The data is usable without it. */
+	load_progress_report(kshark_ctx, &progress, KS_LOAD_INDEX, 0, total);
+	kshark_index_entries(kshark_ctx, rows, total);
+
+	/*
+	 * The field filters need the values of the fields of all entries,
+	 * hence they cannot be applied while the entries are loaded.
+	 */
+	filter_fields(kshark_ctx, rows, total);
+
+	load_progress_report(kshark_ctx, &progress, KS_LOAD_DONE, total, total);
+	load_progress_free(&progress);
+
 	return total;
 
  fail_free:
 	free_rec_list(rec_list, n_cpus, type);
 
  fail:
+	load_progress_free(&progress);
+	if (total == -ECANCELED)
+		return -ECANCELED;
+
 	fprintf(stderr, "Failed to allocate memory during data loading.\n");
 	return -ENOMEM;
 }
@@ -900,6 +1299,7 @@ ssize_t kshark_load_data_entries(struct kshark_context *kshark_ctx,
 ssize_t kshark_load_data_records(struct kshark_context *kshark_ctx,
 				 struct tep_record ***data_rows)
 {
+	struct kshark_load_progress progress;
 	struct tep_record **rows;
 	struct tep_record *rec;
 	struct rec_list **rec_list;
@@ -908,7 +1308,10 @@ ssize_t kshark_load_data_records(struct kshark_context *kshark_ctx,
 	ssize_t count, total = 0;
 	int n_cpus;
 
-	total = get_records(kshark_ctx, &rec_list, type);
+	if (!load_progress_init(kshark_ctx, &progress))
+		goto fail;
+
+	total = get_records(kshark_ctx, &rec_list, type, &progress);
 	if (total < 0)
 		goto fail;
 
@@ -921,6 +1324,18 @@ ssize_t kshark_load_data_records(struct kshark_context *kshark_ctx,
 	for (count = 0; count < total; count++) {
 		int next_cpu;
 
+		if (count % KS_LOAD_PROGRESS_STEP == 0 &&
+		    !load_progress_report(kshark_ctx, &progress,
+					  KS_LOAD_MERGE, count, total)) {
+			/* The merged records are no longer in rec_list. */
+			while (count)
+				free_record(rows[--count]);
+
+			free(rows);
+			total = -ECANCELED;
+			goto fail_free;
+		}
+
 		next_cpu = pick_next_cpu(rec_list, n_cpus, type);
 
 		if (next_cpu >= 0) {
@@ -937,12 +1352,20 @@ ssize_t kshark_load_data_records(struct kshark_context *kshark_ctx,
 	/* There should be no records left in rec_list */
 	free_rec_list(rec_list, n_cpus, type);
 	*data_rows = rows;
+
+	load_progress_report(kshark_ctx, &progress, KS_LOAD_DONE, total, total);
+	load_progress_free(&progress);
+
 	return total;
 
  fail_free:
 	free_rec_list(rec_list, n_cpus, type);
 
  fail:
+	load_progress_free(&progress);
+	if (total == -ECANCELED)
+		return -ECANCELED;
+
 	fprintf(stderr, "Failed to allocate memory during data loading.\n");
 	return -ENOMEM;
 }
@@ -1026,13 +1449,17 @@ size_t kshark_load_data_matrix(struct kshark_context *kshark_ctx,
 			       uint16_t **pid_array,
 			       int **event_array)
 {
+	struct kshark_load_progress progress;
 	enum rec_type type = REC_ENTRY;
 	struct rec_list **rec_list;
 	ssize_t count, total = 0;
 	bool status;
 	int n_cpus;
 
-	total = get_records(kshark_ctx, &rec_list, type);
+	if (!load_progress_init(kshark_ctx, &progress))
+		goto fail;
+
+	total = get_records(kshark_ctx, &rec_list, type, &progress);
 	if (total < 0)
 		goto fail;
 
@@ -1076,16 +1503,559 @@ size_t kshark_load_data_matrix(struct kshark_context *kshark_ctx,
 
 	/* There should be no entries left in rec_list. */
 	free_rec_list(rec_list, n_cpus, type);
+
+	load_progress_report(kshark_ctx, &progress, KS_LOAD_DONE, total, total);
+	load_progress_free(&progress);
+
 	return total;
 
  fail_free:
 	free_rec_list(rec_list, n_cpus, type);
 
  fail:
+	load_progress_free(&progress);
+	if (total == -ECANCELED)
+		return -ECANCELED;
+
+	fprintf(stderr, "Failed to allocate memory during data loading.\n");
+	return -ENOMEM;
+}
+
+/**
+ * @brief Get a summary of all pages of the trace data file. The summary is
+ *	  collected without allocating a kshark_entry per record. As a side
+ *	  effect, all tasks found in the file are registered. The progress is
+ *	  reported in the same way as for kshark_load_data_entries().
+ *
+ * @param kshark_ctx: Input location for the session context pointer.
+ * @param pages: Output location for the summary. The user is responsible
+ *		 for freeing the outputted array.
+ *
+ * @returns The number of pages in the case of success, or a negative error
+ *	    code on failure.
+ */
+ssize_t kshark_get_page_summary(struct kshark_context *kshark_ctx,
+				struct kshark_page_summary **pages)
+{
+	struct kshark_page_summary *summary = NULL, *tmp;
+	struct kshark_load_progress progress;
+	size_t size = 0, n_pages = 0;
+	uint64_t page_mask, page, cpu_offset;
+	struct tep_record *rec;
+	int n_cpus, cpu;
+
+	if (!load_progress_init(kshark_ctx, &progress))
+		goto fail;
+
+	n_cpus = tracecmd_cpus(kshark_ctx->handle);
+	page_mask = ~((uint64_t) tracecmd_page_size(kshark_ctx->handle) - 1);
+
+	for (cpu = 0; cpu < n_cpus; ++cpu) {
+		cpu_offset = tracecmd_cpu_data_offset(kshark_ctx->handle, cpu);
+		rec = tracecmd_read_cpu_first(kshark_ctx->handle, cpu);
+		while (rec) {
+			page = rec->offset & page_mask;
+			if (!n_pages ||
+			    summary[n_pages - 1].cpu != cpu ||
+			    summary[n_pages - 1].offset != page) {
+				/* Report the progress once per page of data. */
+				if (!load_progress_decode(kshark_ctx, &progress,
+							  cpu,
+							  rec->offset - cpu_offset)) {
+					free_record(rec);
+					goto cancel;
+				}
+
+				if (n_pages == size) {
+					size = size ? size * 2 : 1024;
+					tmp = realloc(summary, size * sizeof(*summary));
+					if (!tmp) {
+						free_record(rec);
+						goto fail;
+					}
+
+					summary = tmp;
+				}
+
+				summary[n_pages].ts_first = rec->ts;
+				summary[n_pages].offset = page;
+				summary[n_pages].count = 0;
+				summary[n_pages].cpu = cpu;
+				++n_pages;
+			}
+
+			summary[n_pages - 1].ts_last = rec->ts;
+			summary[n_pages - 1].count++;
+
+			/* Account for the "missed_events" entry. */
+			if (rec->missed_events)
+				summary[n_pages - 1].count++;
+
+			if (!kshark_add_task(kshark_ctx,
+					     tep_data_pid(kshark_ctx->pevent, rec))) {
+				free_record(rec);
+				goto fail;
+			}
+
+			free_record(rec);
+			rec = tracecmd_read_data(kshark_ctx->handle, cpu);
+		}
+	}
+
+	load_progress_report(kshark_ctx, &progress, KS_LOAD_DONE,
+			     n_pages, n_pages);
+	load_progress_free(&progress);
+
+	*pages = summary;
+	return n_pages;
+
+ fail:
+	load_progress_free(&progress);
+	free(summary);
+	fprintf(stderr, "Failed to allocate memory during data loading.\n");
+	return -ENOMEM;
+
+ cancel:
+	load_progress_free(&progress);
+	free(summary);
+	return -ECANCELED;
+}
+
+static int compare_page_ts(const void *a, const void *b)
+{
+	const struct kshark_page_summary *pa = a, *pb = b;
+
+	if (pa->ts_first != pb->ts_first)
+		return pa->ts_first < pb->ts_first ? -1 : 1;
+
+	return pa->cpu - pb->cpu;
+}
+
+static int compare_entry_ts(const void *a, const void *b)
+{
+	const struct kshark_entry *ea = a, *eb = b;
+
+	if (ea->ts != eb->ts)
+		return ea->ts < eb->ts ? -1 : 1;
+
+	if (ea->cpu != eb->cpu)
+		return ea->cpu - eb->cpu;
+
+	return ea->offset < eb->offset ? -1 : ea->offset > eb->offset;
+}
+
+/**
+ * @brief Create a cache of data chunks, used to visualize trace data files
+ *	  which are too big to be loaded in memory at once (out-of-core
+ *	  mode). The trace data is split into chunks (time intervals) of
+ *	  approximately "chunk_size" entries, using a summary of the pages
+ *	  of the file. Only the chunks which are requested get decoded. The
+ *	  least recently used chunks are released once more than
+ *	  "max_chunks" chunks are loaded.
+ *
+ * @param kshark_ctx: Input location for the session context pointer.
+ * @param chunk_size: Approximate number of entries in one chunk.
+ * @param max_chunks: Maximum number of chunks kept in memory.
+ *
+ * @returns Pointer to the cache on success, or NULL on failure or if the
+ *	    loading has been canceled. Use kshark_chunk_cache_free() to free
+ *	    the cache.
+ */
+struct kshark_chunk_cache *
+kshark_chunk_cache_alloc(struct kshark_context *kshark_ctx,
+			 size_t chunk_size, size_t max_chunks)
+{
+	struct kshark_chunk_cache *cache;
+	size_t i, count = 0, n_chunks = 0;
+	ssize_t n_pages;
+
+	if (!kshark_ctx || !kshark_ctx->handle ||
+	    chunk_size == 0 || max_chunks == 0)
+		return NULL;
+
+	cache = calloc(1, sizeof(*cache));
+	if (!cache)
+		goto fail;
+
+	n_pages = kshark_get_page_summary(kshark_ctx, &cache->pages);
+	if (n_pages < 0) {
+		/* Failed or canceled. The error is reported already. */
+		free(cache);
+		return NULL;
+	}
+
+	cache->kshark_ctx = kshark_ctx;
+	cache->n_pages = n_pages;
+	cache->chunk_size = chunk_size;
+	cache->max_loaded = max_chunks;
+	qsort(cache->pages, n_pages, sizeof(*cache->pages), compare_page_ts);
+
+	/* There is one more bound than chunks. */
+	cache->bounds = calloc(n_pages + 2, sizeof(*cache->bounds));
+	if (!cache->bounds)
+		goto fail;
+
+	cache->bounds[0] = 0;
+	cache->ts_min = UINT64_MAX;
+	cache->ts_max = 0;
+	for (i = 0; i < n_pages; ++i) {
+		if (count >= chunk_size &&
+		    cache->pages[i].ts_first > cache->bounds[n_chunks]) {
+			cache->bounds[++n_chunks] = cache->pages[i].ts_first;
+			count = 0;
+		}
+
+		count += cache->pages[i].count;
+		cache->n_entries += cache->pages[i].count;
+
+		if (cache->pages[i].ts_first < cache->ts_min)
+			cache->ts_min = cache->pages[i].ts_first;
+
+		if (cache->pages[i].ts_last > cache->ts_max)
+			cache->ts_max = cache->pages[i].ts_last;
+	}
+
+	cache->n_chunks = n_chunks + 1;
+	cache->bounds[cache->n_chunks] = UINT64_MAX;
+
+	cache->chunks = calloc(cache->n_chunks, sizeof(*cache->chunks));
+	if (!cache->chunks)
+		goto fail;
+
+	return cache;
+
+ fail:
+	fprintf(stderr, "Failed to allocate memory for a chunk cache.\n");
+	kshark_chunk_cache_free(cache);
+	return NULL;
+}
+
+static void chunk_release(struct kshark_chunk_cache *cache, size_t i)
+{
+	if (!cache->chunks[i].last_used)
+		return;
+
+	free(cache->chunks[i].entries);
+	cache->chunks[i].entries = NULL;
+	cache->chunks[i].size = 0;
+	cache->chunks[i].last_used = 0;
+	--cache->n_loaded;
+}
+
+/**
+ * @brief Release all loaded data chunks. The chunks will be decoded again
+ *	  (applying the current filters and plugins) when requested. Note
+ *	  that the entries, outputted by kshark_chunk_cache_get(), are no
+ *	  longer valid after calling this function.
+ *
+ * @param cache: Input location for the cache.
+ */
+void kshark_chunk_cache_reset(struct kshark_chunk_cache *cache)
+{
+	size_t i;
+
+	if (!cache)
+		return;
+
+	for (i = 0; i < cache->n_chunks; ++i)
+		chunk_release(cache, i);
+
+	free(cache->rows);
+	free(cache->prev_rows);
+	cache->rows = cache->prev_rows = NULL;
+	cache->n_rows = 0;
+}
+
+/**
+ * @brief Free a cache of data chunks.
+ *
+ * @param cache: Input location for the cache.
+ */
+void kshark_chunk_cache_free(struct kshark_chunk_cache *cache)
+{
+	if (!cache)
+		return;
+
+	if (cache->chunks)
+		kshark_chunk_cache_reset(cache);
+
+	free(cache->chunks);
+	free(cache->bounds);
+	free(cache->pages);
+	free(cache);
+}
+
+static size_t chunk_find(struct kshark_chunk_cache *cache, uint64_t ts)
+{
+	size_t l = 0, h = cache->n_chunks, mid;
+
+	/* Find the last chunk, having a lower bound <= ts. */
+	BSEARCH(h, l, cache->bounds[mid] <= ts);
+
+	return l;
+}
+
+static int chunk_load(struct kshark_chunk_cache *cache, size_t i)
+{
+	struct kshark_context *kshark_ctx = cache->kshark_ctx;
+	struct kshark_data_chunk *chunk = &cache->chunks[i];
+	uint64_t lower = cache->bounds[i], upper = cache->bounds[i + 1];
+	struct kshark_entry *entries = NULL, *tmp, **last = NULL;
+	size_t size = 0, n = 0, j;
+	struct tep_record *rec;
+	int n_cpus, cpu;
+
+	n_cpus = tracecmd_cpus(kshark_ctx->handle);
+	if (n_cpus <= 0)
+		return -EINVAL;
+
+	pthread_mutex_lock(&kshark_ctx->input_mutex);
+
+	for (cpu = 0; cpu < n_cpus; ++cpu) {
+		if (tracecmd_set_cpu_to_timestamp(kshark_ctx->handle,
+						  cpu, lower) < 0)
+			continue;
+
+		while ((rec = tracecmd_read_data(kshark_ctx->handle, cpu))) {
+			if (rec->ts >= upper) {
+				free_record(rec);
+				break;
+			}
+
+			if (rec->ts < lower) {
+				free_record(rec);
+				continue;
+			}
+
+			/* Make room for a possible "missed_events" entry. */
+			if (n + 2 > size) {
+				size = size ? size * 2 : cache->chunk_size + 2;
+				tmp = realloc(entries, size * sizeof(*entries));
+				if (!tmp) {
+					free_record(rec);
+					goto fail;
+				}
+
+				entries = tmp;
+			}
+
+			if (rec->missed_events)
+				missed_events_action(kshark_ctx, rec, &entries[n++]);
+
+			load_entry(kshark_ctx, rec, &entries[n++]);
+			free_record(rec);
+		}
+	}
+
+	pthread_mutex_unlock(&kshark_ctx->input_mutex);
+
+	qsort(entries, n, sizeof(*entries), compare_entry_ts);
+
+	/*
+	 * Link the entries of each CPU. The entries of different chunks are
+	 * not linked.
+	 */
+	last = calloc(n_cpus, sizeof(*last));
+	if (!last)
+		goto fail_free;
+
+	for (j = n; j-- > 0;) {
+		cpu = entries[j].cpu;
+		entries[j].next = NULL;
+		if (cpu >= 0 && cpu < n_cpus) {
+			entries[j].next = last[cpu];
+			last[cpu] = &entries[j];
+		}
+	}
+
+	free(last);
+
+	chunk->entries = entries;
+	chunk->size = n;
+	chunk->last_used = ++cache->clock;
+	++cache->n_loaded;
+
+	return 0;
+
+ fail:
+	pthread_mutex_unlock(&kshark_ctx->input_mutex);
+
+ fail_free:
+	free(entries);
 	fprintf(stderr, "Failed to allocate memory during data loading.\n");
 	return -ENOMEM;
 }
 
+/**
+ * @brief Get the number of data chunks, needed in order to provide the
+ *	  entries inside a given time-window.
+ *
+ * @param cache: Input location for the cache.
+ * @param min: Lower edge of the time-window.
+ * @param max: Upper edge of the time-window.
+ *
+ * @returns The number of data chunks.
+ */
+size_t kshark_chunk_cache_span(struct kshark_chunk_cache *cache,
+			       uint64_t min, uint64_t max)
+{
+	size_t first, last;
+
+	first = chunk_find(cache, min);
+	last = chunk_find(cache, max);
+
+	/* The neighbouring chunks are included as well. */
+	if (first > 0)
+		--first;
+
+	if (last < cache->n_chunks - 1)
+		++last;
+
+	return last - first + 1;
+}
+
+static ssize_t chunk_cache_get_range(struct kshark_chunk_cache *cache,
+				     size_t first, size_t last,
+				     struct kshark_entry ***data_rows)
+{
+	size_t i, j, n_missing = 0, lru, total = 0;
+	struct kshark_entry **rows;
+
+	if (cache->rows && first == cache->first && last == cache->last) {
+		/* Same data chunks as in the previous call. */
+		for (i = first; i <= last; ++i)
+			cache->chunks[i].last_used = ++cache->clock;
+
+		*data_rows = cache->rows;
+		return cache->n_rows;
+	}
+
+	for (i = first; i <= last; ++i)
+		if (!cache->chunks[i].last_used)
+			++n_missing;
+
+	/*
+	 * Release the least recently used chunks outside of the requested
+	 * window and outside of the window of the previous call. If these
+	 * need more chunks than the capacity of the cache, the capacity is
+	 * temporarily exceeded.
+	 */
+	while (n_missing && cache->n_loaded + n_missing > cache->max_loaded) {
+		lru = cache->n_chunks;
+		for (i = 0; i < cache->n_chunks; ++i) {
+			if (!cache->chunks[i].last_used ||
+			    (i >= first && i <= last) ||
+			    (cache->rows &&
+			     i >= cache->first && i <= cache->last))
+				continue;
+
+			if (lru == cache->n_chunks ||
+			    cache->chunks[i].last_used <
+			    cache->chunks[lru].last_used)
+				lru = i;
+		}
+
+		if (lru == cache->n_chunks)
+			break;
+
+		chunk_release(cache, lru);
+	}
+
+	for (i = first; i <= last; ++i) {
+		if (!cache->chunks[i].last_used &&
+		    chunk_load(cache, i) < 0)
+			return -ENOMEM;
+
+		cache->chunks[i].last_used = ++cache->clock;
+		total += cache->chunks[i].size;
+	}
+
+	rows = malloc((total ? total : 1) * sizeof(*rows));
+	if (!rows)
+		return -ENOMEM;
+
+	for (total = 0, i = first; i <= last; ++i)
+		for (j = 0; j < cache->chunks[i].size; ++j)
+			rows[total++] = &cache->chunks[i].entries[j];
+
+	free(cache->prev_rows);
+	cache->prev_rows = cache->rows;
+
+	cache->rows = rows;
+	cache->n_rows = total;
+	cache->first = first;
+	cache->last = last;
+
+	*data_rows = rows;
+	return total;
+}
+
+/**
+ * @brief Get the entries inside a given time-window. All data chunks
+ *	  overlapping with the time-window, plus one chunk before and one
+ *	  chunk after the time-window, get loaded (if not loaded already).
+ *
+ * @param cache: Input location for the cache.
+ * @param min: Lower edge of the time-window.
+ * @param max: Upper edge of the time-window.
+ * @param data_rows: Output location for the trace data. The array and the
+ *		     entries are owned by the cache. They stay valid during
+ *		     the next call of this function and get released by the
+ *		     call after it. This way the user can switch to the new
+ *		     data before the old data is gone.
+ *
+ * @returns The size of the outputted data in the case of success, or a
+ *	    negative error code on failure.
+ */
+ssize_t kshark_chunk_cache_get(struct kshark_chunk_cache *cache,
+			       uint64_t min, uint64_t max,
+			       struct kshark_entry ***data_rows)
+{
+	size_t first, last;
+
+	if (!cache || min > max)
+		return -EINVAL;
+
+	first = chunk_find(cache, min);
+	last = chunk_find(cache, max);
+	if (first > 0)
+		--first;
+
+	if (last < cache->n_chunks - 1)
+		++last;
+
+	return chunk_cache_get_range(cache, first, last, data_rows);
+}
+
+/**
+ * @brief Decode again the data chunks of the entries, outputted by the last
+ *	  call of kshark_chunk_cache_get(). All other chunks are released.
+ *	  Use this function when the plugins or the filters have changed.
+ *	  Note that all entries, outputted before, are no longer valid after
+ *	  calling this function.
+ *
+ * @param cache: Input location for the cache.
+ * @param data_rows: Output location for the trace data. Same as for
+ *		     kshark_chunk_cache_get().
+ *
+ * @returns The size of the outputted data in the case of success, or a
+ *	    negative error code on failure.
+ */
+ssize_t kshark_chunk_cache_reload(struct kshark_chunk_cache *cache,
+				  struct kshark_entry ***data_rows)
+{
+	size_t first, last;
+
+	if (!cache || !cache->rows)
+		return -EINVAL;
+
+	first = cache->first;
+	last = cache->last;
+	kshark_chunk_cache_reset(cache);
+
+	return chunk_cache_get_range(cache, first, last, data_rows);
+}
+
 static const char *kshark_get_latency(struct tep_handle *pe,
 				      struct tep_record *record)
 {
@@ -1374,6 +2344,126 @@ const char *kshark_get_info_easy(struct kshark_entry *entry)
 	return info;
 }
 
+/**
+ * @brief Open an additional reader of the trace data file, opened by the
+ *	  session. A reader must not be used by more than one thread at the
+ *	  same time. Use kshark_reader_close() to free the reader.
+ *
+ * @param kshark_ctx: Input location for the session context pointer.
+ *
+ * @returns The reader on success, or NULL on failure.
+ */
+struct kshark_reader *kshark_reader_open(struct kshark_context *kshark_ctx)
+{
+	struct kshark_reader *reader;
+
+	if (!kshark_ctx->file)
+		return NULL;
+
+	reader = calloc(1, sizeof(*reader));
+	if (!reader)
+		return NULL;
+
+	reader->handle = open_trace_file(kshark_ctx->file);
+	if (!reader->handle) {
+		free(reader);
+		return NULL;
+	}
+
+	reader->pevent = tracecmd_get_pevent(reader->handle);
+
+	return reader;
+}
+
+/**
+ * @brief Close an additional reader of the trace data file.
+ *
+ * @param reader: Input location for the reader.
+ */
+void kshark_reader_close(struct kshark_reader *reader)
+{
+	if (!reader)
+		return;
+
+	tracecmd_close(reader->handle);
+	free(reader);
+}
+
+/**
+ * @brief Get the latency information of an entry, by using an additional
+ *	  reader of the trace data file. Unlike kshark_get_latency_easy(),
+ *	  this function does not lock the input mutex of the session.
+ *
+ * @param reader: Input location for the reader.
+ * @param entry: Input location for the KernelShark entry.
+ *
+ * @returns A string showing the latency information on success, otherwise
+ *	    NULL. The string is valid until the next call of a kshark_reader
+ *	    function in the same thread.
+ */
+const char *kshark_reader_get_latency(struct kshark_reader *reader,
+				      const struct kshark_entry *entry)
+{
+	struct tep_record *data;
+	const char *lat;
+
+	if (entry->event_id < 0 || !init_thread_seq())
+		return NULL;
+
+	data = tracecmd_read_at(reader->handle, entry->offset, NULL);
+	lat = kshark_get_latency(reader->pevent, data);
+	free_record(data);
+
+	return lat;
+}
+
+/**
+ * @brief Get the info string of an entry, by using an additional reader of
+ *	  the trace data file. Unlike kshark_get_info_easy(), this function
+ *	  does not lock the input mutex of the session.
+ *
+ * @param reader: Input location for the reader.
+ * @param entry: Input location for the KernelShark entry.
+ *
+ * @returns A string showing the data output of the trace event on success,
+ *	    otherwise NULL. The string is valid until the next call of a
+ *	    kshark_reader function in the same thread.
+ */
+const char *kshark_reader_get_info(struct kshark_reader *reader,
+				   const struct kshark_entry *entry)
+{
+	struct tep_event *event;
+	struct tep_record *data;
+	const char *info = NULL;
+
+	if (!init_thread_seq())
+		return NULL;
+
+	if (entry->event_id < 0) {
+		if (entry->event_id != KS_EVENT_OVERFLOW)
+			return NULL;
+
+		trace_seq_reset(&seq);
+		trace_seq_printf(&seq, "missed_events=%i", (int) entry->offset);
+		trace_seq_terminate(&seq);
+
+		return seq.buffer;
+	}
+
+	data = tracecmd_read_at(reader->handle, entry->offset, NULL);
+	if (!data)
+		return NULL;
+
+	event = tep_find_event(reader->pevent,
+			       tep_data_type(reader->pevent, data));
+	if (event)
+		info = kshark_get_info(reader->pevent, data, event);
+
+	free_record(data);
+
+	return info;
+}
+
 /**
  * @brief Convert the timestamp of the trace record (nanosecond precision) into
  *	  seconds and microseconds.
@@ -1675,11 +2765,45 @@ const struct kshark_entry dummy_entry = {
 	.ts		= 0
 };
 
+static const struct kshark_entry *
+get_indexed_entry(const struct kshark_entry_request *req,
+		  struct kshark_entry **data,
+		  const struct kshark_posting_list *list,
+		  ssize_t *i, ssize_t start, ssize_t end, int inc)
+{
+	const struct kshark_entry *e = NULL;
+	ssize_t pos;
+
+	/*
+	 * Walk only the entries of the posting list, which are inside the
+	 * requested range.
+	 */
+	pos = kshark_posting_list_find(list, start + (inc < 0));
+	if (inc < 0)
+		--pos;
+
+	for (; pos >= 0 && pos < (ssize_t) list->count; pos += inc) {
+		*i = list->rows[pos];
+		if ((inc > 0 && *i >= end) || (inc < 0 && *i <= end))
+			break;
+
+		if (req->vis_only && !(data[*i]->visible & req->vis_mask)) {
+			/* This data entry has been filtered. */
+			e = &dummy_entry;
+		} else {
+			return data[*i];
+		}
+	}
+
+	return e;
+}
+
 static const struct kshark_entry *
 get_entry(const struct kshark_entry_request *req,
           struct kshark_entry **data,
           ssize_t *index, ssize_t start, ssize_t end, int inc)
 {
+	const struct kshark_posting_list *list;
 	struct kshark_context *kshark_ctx = NULL;
 	const struct kshark_entry *e = NULL;
 	ssize_t i;
@@ -1695,6 +2819,13 @@ get_entry(const struct kshark_entry_request *req,
 	 * loops.
 	 */
 	assert((inc > 0 && start < end) || (inc < 0 && start > end));
+
+	list = kshark_index_lookup(kshark_ctx, data, req->cond, req->val);
+	if (list) {
+		e = get_indexed_entry(req, data, list, &i, start, end, inc);
+		goto out;
+	}
+
 	for (i = start; i != end; i += inc) {
 		if (req->cond(kshark_ctx, data[i], req->val)) {
 			/*
@@ -1711,6 +2842,7 @@ get_entry(const struct kshark_entry_request *req,
 		}
 	}
 
+ out:
 	if (index) {
 		if (e)
 			*index = (e->cpu != KS_FILTERED_BIN)? i : KS_FILTERED_BIN;
@@ -84,6 +84,81 @@ struct kshark_task_list {
 	int			 pid;
 };
 
+/**
+ * Posting list of entries. The list holds the (sorted) indexes inside the
+ * array of trace data of all entries sharing the same key (Pid or CPU).
+ */
+struct kshark_posting_list {
+	/** The key (Pid or CPU) of the entries in the list. */
+	int	key;
+
+	/** Number of entries in the list. */
+	size_t	count;
+
+	/** Sorted array of entry indexes. */
+	size_t	*rows;
+};
+
+/** Phases of the loading of the trace data. */
+enum kshark_load_phase {
+	/** Loading the entries from the cache file of the trace data file. */
+	KS_LOAD_CACHE,
+
+	/** Reading and decoding the per-CPU trace data. */
+	KS_LOAD_DECODE,
+
+	/** Merging the per-CPU data into one array, sorted in time. */
+	KS_LOAD_MERGE,
+
+	/** Building the per-task and per-CPU indexes of the data. */
+	KS_LOAD_INDEX,
+
+	/** The loading is completed. */
+	KS_LOAD_DONE,
+};
+
+/** Progress of the loading of the trace data. */
+struct kshark_load_progress {
+	/** The current phase of the loading. */
+	enum kshark_load_phase	phase;
+
+	/**
+	 * The work done in the current phase. This is the number of bytes
+	 * of trace data decoded in the KS_LOAD_DECODE phase and the number
+	 * of processed entries in all other phases.
+	 */
+	uint64_t		done;
+
+	/** The total amount of work in the current phase. */
+	uint64_t		total;
+
+	/**
+	 * Number of CPUs in the trace data file. Zero if the data is loaded
+	 * from the cache file, in which case the per-CPU arrays are NULL.
+	 */
+	int			n_cpus;
+
+	/** Array of the number of bytes decoded so far for each CPU. */
+	uint64_t		*cpu_done;
+
+	/** Array of the size of the trace data of each CPU in bytes. */
+	uint64_t		*cpu_total;
+
+	/** Number of entries loaded so far. */
+	size_t			n_entries;
+};
+
+struct kshark_context;
+
+/**
+ * Callback reporting the progress of the loading of the trace data. The
+ * callback is called by the thread doing the loading. The progress
+ * descriptor is valid only during the call.
+ */
+typedef void (*kshark_load_progress_func) (struct kshark_context *,
+					   const struct kshark_load_progress *,
+					   void *);
+
 /** Structure representing a kshark session. */
 struct kshark_context {
 	/** Input handle for the trace data file. */
@@ -95,6 +170,9 @@ struct kshark_context {
 	/** Hash table of task PIDs. */
 	struct kshark_task_list	*tasks[KS_TASK_HASH_SIZE];
 
+	/** The name of the trace data file. */
+	char			*file;
+
 	/** A mutex, used to protect the access to the input file. */
 	pthread_mutex_t		input_mutex;
 
@@ -129,6 +207,9 @@ struct kshark_context {
 	 */
 	struct tep_event_filter		*advanced_event_filter;
 
+	/** List of filters of the values of numeric event fields. */
+	struct kshark_field_filter	*field_filters;
+
 	/** List of Data collections. */
 	struct kshark_entry_collection *collections;
 
@@ -137,6 +218,54 @@ struct kshark_context {
 
 	/** List of Plugin Event handlers. */
 	struct kshark_event_handler	*event_handlers;
+
+	/** Memory mapping of the entry cache file (if used). */
+	void				*entry_cache;
+
+	/** The size of the memory mapping of the entry cache file. */
+	size_t				entry_cache_size;
+
+	/**
+	 * Hash of the data collections, when the data was loaded from the
+	 * entry cache file.
+	 */
+	uint64_t			entry_cache_hash;
+
+	/** The array of trace data, indexed by the posting lists. */
+	struct kshark_entry		**index_data;
+
+	/** The size of the indexed array of trace data. */
+	size_t				index_size;
+
+	/** Posting lists of the entries of each task, sorted by Pid. */
+	struct kshark_posting_list	*pid_index;
+
+	/** Number of posting lists in "pid_index". */
+	size_t				n_pid_index;
+
+	/** Posting lists of the entries of each CPU, indexed by CPU Id. */
+	struct kshark_posting_list	*cpu_index;
+
+	/** Number of posting lists in "cpu_index". */
+	int				n_cpu_index;
+
+	/** The array of trace data, the cached field columns belong to. */
+	struct kshark_entry		**field_data;
+
+	/** List of the cached field columns of "field_data". */
+	struct kshark_field_column	*field_columns;
+
+	/** Callback reporting the progress of the loading of the data. */
+	kshark_load_progress_func	load_progress_func;
+
+	/** User data, passed to the progress callback. */
+	void				*load_progress_data;
+
+	/**
+	 * If set, the ongoing loading of the data is aborted. Use
+	 * kshark_cancel_loading() to set this flag.
+	 */
+	int				load_cancel;
 };
 
 bool kshark_instance(struct kshark_context **kshark_ctx);
@@ -149,6 +278,13 @@ ssize_t kshark_load_data_entries(struct kshark_context *kshark_ctx,
 ssize_t kshark_load_data_records(struct kshark_context *kshark_ctx,
 				 struct tep_record ***data_rows);
 
+void kshark_set_load_progress(struct kshark_context *kshark_ctx,
+			      kshark_load_progress_func func, void *data);
+
+void kshark_cancel_loading(struct kshark_context *kshark_ctx);
+
+bool kshark_loading_canceled(struct kshark_context *kshark_ctx);
+
 size_t kshark_load_data_matrix(struct kshark_context *kshark_ctx,
 			       uint64_t **offset_array,
 			       uint16_t **cpu_array,
@@ -156,6 +292,159 @@ size_t kshark_load_data_matrix(struct kshark_context *kshark_ctx,
 			       uint16_t **pid_array,
 			       int **event_array);
 
+/** Summary of one page of the trace data file. */
+struct kshark_page_summary {
+	/** The timestamp of the first record in the page. */
+	uint64_t	ts_first;
+
+	/** The timestamp of the last record in the page. */
+	uint64_t	ts_last;
+
+	/** The offset of the page into the trace file. */
+	uint64_t	offset;
+
+	/** Number of entries in the page. */
+	uint32_t	count;
+
+	/** The CPU core of the page. */
+	int16_t		cpu;
+};
+
+ssize_t kshark_get_page_summary(struct kshark_context *kshark_ctx,
+				struct kshark_page_summary **pages);
+
+/** Chunk of trace data (time interval), loaded in memory. */
+struct kshark_data_chunk {
+	/** Array of entries, sorted in time. */
+	struct kshark_entry	*entries;
+
+	/** The size of the array of entries. */
+	size_t			size;
+
+	/**
+	 * Value of the clock of the cache, when the chunk was used for the
+	 * last time. Zero means that the chunk is not loaded.
+	 */
+	uint64_t		last_used;
+};
+
+/**
+ * Cache of data chunks, used to visualize trace data files which are too big
+ * to be loaded in memory at once (out-of-core mode).
+ */
+struct kshark_chunk_cache {
+	/** Session context pointer. */
+	struct kshark_context		*kshark_ctx;
+
+	/** Summary of all pages of the trace data file, sorted in time. */
+	struct kshark_page_summary	*pages;
+
+	/** Number of pages. */
+	size_t				n_pages;
+
+	/** Total number of entries in the trace data file. */
+	size_t				n_entries;
+
+	/** Timestamp of the first entry in the trace data file. */
+	uint64_t			ts_min;
+
+	/** Timestamp of the last entry in the trace data file. */
+	uint64_t			ts_max;
+
+	/**
+	 * Lower edges (in time) of the chunks. The array has "n_chunks + 1"
+	 * elements and the last element is the upper edge of the last chunk.
+	 */
+	uint64_t			*bounds;
+
+	/** Array of data chunks. */
+	struct kshark_data_chunk	*chunks;
+
+	/** Number of data chunks. */
+	size_t				n_chunks;
+
+	/** Approximate number of entries in one chunk. */
+	size_t				chunk_size;
+
+	/** Maximum number of chunks kept in memory. */
+	size_t				max_loaded;
+
+	/** Number of chunks loaded in memory. */
+	size_t				n_loaded;
+
+	/** Clock of the cache, used to find the least recently used chunk. */
+	uint64_t			clock;
+
+	/** The array of entries, outputted by kshark_chunk_cache_get(). */
+	struct kshark_entry		**rows;
+
+	/** The size of the array of entries "rows". */
+	size_t				n_rows;
+
+	/** The first data chunk of "rows". */
+	size_t				first;
+
+	/** The last data chunk of "rows". */
+	size_t				last;
+
+	/**
+	 * The array of entries, outputted by the previous call of
+	 * kshark_chunk_cache_get(). The array and its data chunks are kept,
+	 * because the user may still be working on them.
+	 */
+	struct kshark_entry		**prev_rows;
+};
+
+struct kshark_chunk_cache *
+kshark_chunk_cache_alloc(struct kshark_context *kshark_ctx,
+			 size_t chunk_size, size_t max_chunks);
+
+void kshark_chunk_cache_reset(struct kshark_chunk_cache *cache);
+
+void kshark_chunk_cache_free(struct kshark_chunk_cache *cache);
+
+size_t kshark_chunk_cache_span(struct kshark_chunk_cache *cache,
+			       uint64_t min, uint64_t max);
+
+ssize_t kshark_chunk_cache_get(struct kshark_chunk_cache *cache,
+			       uint64_t min, uint64_t max,
+			       struct kshark_entry ***data_rows);
+
+ssize_t kshark_chunk_cache_reload(struct kshark_chunk_cache *cache,
+				  struct kshark_entry ***data_rows);
+
+ssize_t kshark_load_data_entries_cached(struct kshark_context *kshark_ctx,
+					const char *file,
+					struct kshark_entry ***data_rows);
+
+ssize_t kshark_load_entry_cache(struct kshark_context *kshark_ctx,
+				const char *file,
+				struct kshark_entry ***data_rows);
+
+bool kshark_save_entry_cache(struct kshark_context *kshark_ctx,
+			     const char *file,
+			     struct kshark_entry **data_rows,
+			     size_t n_rows);
+
+void kshark_free_data_entries(struct kshark_context *kshark_ctx,
+			      struct kshark_entry **data_rows,
+			      size_t n_rows);
+
+bool kshark_entry_cache_outdated(struct kshark_context *kshark_ctx);
+
+struct kshark_cache_image;
+
+struct kshark_cache_image *
+kshark_entry_cache_detach(struct kshark_context *kshark_ctx, const char *file,
+			  struct kshark_entry **data_rows, size_t n_rows);
+
+bool kshark_entry_cache_image_save(struct kshark_cache_image *image);
+
+void kshark_entry_cache_image_free(struct kshark_cache_image *image);
+
+struct kshark_task_list *
+kshark_add_task(struct kshark_context *kshark_ctx, int pid);
+
 ssize_t kshark_get_task_pids(struct kshark_context *kshark_ctx, int **pids);
 
 void kshark_close(struct kshark_context *kshark_ctx);
@@ -174,6 +463,29 @@ const char *kshark_get_event_name_easy(struct kshark_entry *entry);
 
 const char *kshark_get_info_easy(struct kshark_entry *entry);
 
+/**
+ * Additional reader of the trace data file. The reader has its own input
+ * handle, hence it can read the data in parallel with the session and with
+ * the other readers.
+ */
+struct kshark_reader {
+	/** Input handle for the trace data file. */
+	struct tracecmd_input	*handle;
+
+	/** Page event used to parse the page. */
+	struct tep_handle	*pevent;
+};
+
+struct kshark_reader *kshark_reader_open(struct kshark_context *kshark_ctx);
+
+void kshark_reader_close(struct kshark_reader *reader);
+
+const char *kshark_reader_get_latency(struct kshark_reader *reader,
+				      const struct kshark_entry *entry);
+
+const char *kshark_reader_get_info(struct kshark_reader *reader,
+				   const struct kshark_entry *entry);
+
 void kshark_convert_nano(uint64_t time, uint64_t *sec, uint64_t *usec);
 
 char* kshark_dump_entry(const struct kshark_entry *entry);
@@ -260,6 +572,36 @@ void kshark_filter_add_id(struct kshark_context *kshark_ctx,
 
 void kshark_filter_clear(struct kshark_context *kshark_ctx, int filter_id);
 
+/**
+ * Filter of the entries of one trace event by the value of one of its numeric
+ * fields. Only the entries having a value inside the range are shown.
+ */
+struct kshark_field_filter {
+	/** Pointer to the next field filter. */
+	struct kshark_field_filter	*next;
+
+	/** The Id of the trace event. */
+	int		event_id;
+
+	/** The name of the field. */
+	char		*field;
+
+	/**
+	 * The lower bound of the range (included). For unsigned fields the
+	 * bits of the value are interpreted as unsigned.
+	 */
+	int64_t		min;
+
+	/** The upper bound of the range (included). */
+	int64_t		max;
+};
+
+bool kshark_filter_field_add(struct kshark_context *kshark_ctx,
+			     int event_id, const char *field,
+			     int64_t min, int64_t max);
+
+void kshark_filter_field_clear(struct kshark_context *kshark_ctx);
+
 bool kshark_filter_is_set(struct kshark_context *kshark_ctx);
 
 void kshark_filter_entries(struct kshark_context *kshark_ctx,
@@ -375,6 +717,121 @@ kshark_get_entry_back(const struct kshark_entry_request *req,
 		      struct kshark_entry **data,
 		      ssize_t *index);
 
+int kshark_index_entries(struct kshark_context *kshark_ctx,
+			 struct kshark_entry **data,
+			 size_t n_rows);
+
+void kshark_index_clear(struct kshark_context *kshark_ctx);
+
+const struct kshark_posting_list *
+kshark_index_lookup(struct kshark_context *kshark_ctx,
+		    struct kshark_entry **data,
+		    matching_condition_func cond, int val);
+
+size_t kshark_posting_list_find(const struct kshark_posting_list *list,
+				size_t row);
+
+int kshark_index_update_pids(struct kshark_context *kshark_ctx,
+			     struct kshark_entry **entries,
+			     const int *old_pids, size_t n);
+
+/** Number of consecutive rows, sharing one position in the info index. */
+#define KS_INFO_INDEX_BLOCK	16
+
+/** Number of hash buckets of the trigrams in the info index. */
+#define KS_INFO_INDEX_BUCKETS	(1 << 16)
+
+/**
+ * Full-text index of the info strings of the trace data. The index maps the
+ * (case-insensitive) trigrams of the info strings into hash buckets. For each
+ * bucket, the index holds the list of the blocks of KS_INFO_INDEX_BLOCK rows
+ * containing at least one trigram from the bucket. The lists are sorted and
+ * compressed, by storing the differences between consecutive blocks as
+ * variable-length integers.
+ */
+struct kshark_info_index {
+	/** Number of indexed rows. */
+	size_t		n_rows;
+
+	/**
+	 * Array of (KS_INFO_INDEX_BUCKETS + 1) offsets. The list of bucket
+	 * "i" starts at data[offsets[i]] and ends at data[offsets[i + 1]].
+	 */
+	uint64_t	*offsets;
+
+	/** The compressed lists of all buckets. */
+	uint8_t		*data;
+};
+
+struct kshark_info_index *
+kshark_info_index_build(struct kshark_context *kshark_ctx,
+			struct kshark_entry **data_rows, size_t n_rows,
+			const int *cancel);
+
+void kshark_info_index_free(struct kshark_info_index *index);
+
+ssize_t kshark_info_index_find(const struct kshark_info_index *index,
+			       const char *text, size_t **rows);
+
+bool kshark_save_info_index(struct kshark_context *kshark_ctx,
+			    const char *file, const char *dir,
+			    const struct kshark_info_index *index);
+
+struct kshark_info_index *
+kshark_load_info_index(struct kshark_context *kshark_ctx,
+		       const char *file, const char *dir, size_t n_rows);
+
+/**
+ * Column of the values of one numeric field of one trace event. The values
+ * of the field for all entries of the trace data are decoded in a single
+ * pass and stored in a plain array, having one element per entry.
+ */
+struct kshark_field_column {
+	/** Pointer to the next column in the cache of the session. */
+	struct kshark_field_column	*next;
+
+	/** The Id of the trace event. */
+	int		event_id;
+
+	/** The name of the field. */
+	char		*field;
+
+	/** True if the field is a signed integer. */
+	bool		is_signed;
+
+	/** The number of rows (entries) in the column. */
+	size_t		n_rows;
+
+	/**
+	 * The value of the field for each row. The value is zero for the
+	 * rows of the other events.
+	 */
+	int64_t		*values;
+
+	/** Non-zero for the rows, having a valid value of the field. */
+	uint8_t		*valid;
+
+	/** The number of rows, having a valid value of the field. */
+	size_t		n_valid;
+};
+
+int kshark_load_field_columns(struct kshark_context *kshark_ctx,
+			      struct kshark_entry **data, size_t n_rows,
+			      const int *event_ids, const char * const *fields,
+			      int n_columns);
+
+const struct kshark_field_column *
+kshark_get_field_column(struct kshark_context *kshark_ctx,
+			struct kshark_entry **data, size_t n_rows,
+			int event_id, const char *field);
+
+void kshark_clear_field_columns(struct kshark_context *kshark_ctx);
+
+size_t kshark_filter_field_range(struct kshark_context *kshark_ctx,
+				 const struct kshark_field_column *col,
+				 struct kshark_entry **data,
+				 int64_t min, int64_t max);
+
 /**
  * Data collections are used to optimize the search for an entry having an
  * abstract property, defined by a Matching condition function and a value.
@@ -416,6 +873,9 @@ struct kshark_entry_collection {
 	size_t size;
 };
 
+bool kshark_collection_points_alloc(struct kshark_entry_collection *col,
+				    size_t size);
+
 struct kshark_entry_collection *
 kshark_add_collection_to_list(struct kshark_context *kshark_ctx,
 			      struct kshark_entry_collection **col_list,
@@ -431,6 +891,13 @@ kshark_register_data_collection(struct kshark_context *kshark_ctx,
 				matching_condition_func cond, int val,
 				size_t margin);
 
+ssize_t kshark_register_data_collections(struct kshark_context *kshark_ctx,
+					 struct kshark_entry **data,
+					 size_t n_rows,
+					 matching_condition_func cond,
+					 const int *vals, size_t n_vals,
+					 size_t margin);
+
 void kshark_unregister_data_collection(struct kshark_entry_collection **col,
 				       matching_condition_func cond,
 				       int val);
@@ -517,6 +984,12 @@ enum kshark_config_formats {
  */
 #define KS_ADV_EVENT_FILTER_NAME	"adv event filter"
 
+/**
+ * Field name for the Configuration document describing the filters of the
+ * values of numeric event fields.
+ */
+#define KS_FIELD_FILTER_NAME		"field filter"
+
 /**
  * Field name for the Configuration document describing user-specified filter
  * mask.
@@ -583,6 +1056,12 @@ bool kshark_export_adv_filters(struct kshark_context *kshark_ctx,
 bool kshark_import_adv_filters(struct kshark_context *kshark_ctx,
 			       struct kshark_config_doc *conf);
 
+bool kshark_export_field_filters(struct kshark_context *kshark_ctx,
+				 struct kshark_config_doc **conf);
+
+bool kshark_import_field_filters(struct kshark_context *kshark_ctx,
+				 struct kshark_config_doc *conf);
+
 bool kshark_export_event_filter(struct tep_handle *pevent,
 				struct tracecmd_filter_id *filter,
 				const char *filter_name,
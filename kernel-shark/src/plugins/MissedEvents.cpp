@@ -20,62 +20,6 @@
 
 using namespace KsPlot;
 
-/**
- * This class represents the graphical element of the KernelShark marker for
- * Missed events.
- */
-class MissedEventsMark : public PlotObject {
-public:
-	/** Create a default Missed events marker. */
-	MissedEventsMark() : _base(0, 0), _height(0)
-	{
-		_color = {0, 0, 255};
-		_size = 2;
-	}
-
-	/**
-	 * @brief Create and position a Missed events marker.
-	 *
-	 * @param p: Base point of the marker.
-	 * @param h: vertical size (height) of the marker.
-	 */
-	MissedEventsMark(const Point &p, int h)
-	: _base(p.x(), p.y()), _height(h)
-	{
-		_color = {0, 0, 255};
-		_size = 2;
-	}
-
-	/** Set the Base point of the marker. */
-	void setBase(const Point &p) {_base.set(p.x(), p.y());}
-
-	/** Set the vertical size (height) point of the marker. */
-	void setHeight(int h) {_height = h;}
-
-private:
-	/** Base point of the Mark's line. */
-	Point	_base;
-
-	/** The vertical size (height) of the Mark. */
-	int	_height;
-
-	void _draw(const Color &col, float size = 1.) const override;
-};
-
-void MissedEventsMark::_draw(const Color &col, float size) const
-{
-	Point p(_base.x(), _base.y() - _height);
-	drawLine(_base, p, col, size);
-
-	Rectangle rec;
-	rec.setPoint(0, p.x(), p.y());
-	rec.setPoint(1, p.x() - _height / 4, p.y());
-	rec.setPoint(2, p.x() - _height / 4, p.y() + _height / 4);
-	rec.setPoint(3, p.x(), p.y() + _height / 4);
-	rec._color = col;
-	rec.draw();
-}
-
 //! @cond Doxygen_Suppress
 
 #define PLUGIN_MAX_ENTRIES		10000
@@ -90,8 +34,9 @@ static void pluginDraw(kshark_context *kshark_ctx,
 {
 	int height = argvCpp->_graph->getHeight();
 	const kshark_entry *entry(nullptr);
-	MissedEventsMark *mark;
+	KsPlot::Color col(0, 0, 255);
 	ssize_t index;
+	int x, y;
 
 	int nBins = argvCpp->_graph->size();
 	for (int bin = 0; bin < nBins; ++bin) {
@@ -107,10 +52,17 @@ static void pluginDraw(kshark_context *kshark_ctx,
 							      &index);
 
 		if (entry) {
-			mark = new MissedEventsMark(argvCpp->_graph->getBin(bin)._base,
-						    height);
-
-			argvCpp->_shapes->push_front(mark);
+			/*
+			 * The marker is a vertical line, having a small
+			 * filled square (flag) on the top.
+			 */
+			x = argvCpp->_graph->getBin(bin)._base.x();
+			y = argvCpp->_graph->getBin(bin)._base.y();
+			argvCpp->_shapeBuffer->addLine(x, y, x, y - height, col);
+			argvCpp->_shapeBuffer->addRectangle(x, y - height,
+							    x - height / 4,
+							    y - height + height / 4,
+							    col, true);
 		}
 	}
 }
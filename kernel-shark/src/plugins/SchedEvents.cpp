@@ -17,6 +17,7 @@
 // C++ 11
 #include<functional>
 #include<unordered_set>
+#include<vector>
 
 // KernelShark
 #include "libkshark.h"
@@ -50,55 +51,48 @@ static void pluginDraw(plugin_sched_context *plugin_ctx,
 		       SchedEvent e,
 		       int pid,
 		       KsPlot::Graph *graph,
-		       KsPlot::PlotObjList *shapes)
+		       KsPlot::ShapeBuffer *shapes)
 {
 	const kshark_entry *entryClose, *entryOpen, *entryME;
 	ssize_t indexClose(0), indexOpen(0), indexME(0);
 	std::function<void(int)> ifSchedBack;
-	KsPlot::Rectangle *rec = nullptr;
 	int height = graph->getHeight() * .3;
+	KsPlot::Color boxColor;
+	bool boxIsOpen(false);
+	int boxX(0);
 
 	auto openBox = [&] (const KsPlot::Point &p)
 	{
 		/*
-		 * First check if we already have an open box. If we don't
-		 * have, open a new one.
+		 * Opening a box only records its left side. The box gets
+		 * added to the buffer of shapes when it is closed.
 		 */
-		if (!rec)
-			rec = new KsPlot::Rectangle;
-
 		if (e == SchedEvent::Switch) {
 			/* Red box. */
-			rec->_color = KsPlot::Color(255, 0, 0);
+			boxColor = KsPlot::Color(255, 0, 0);
 		} else {
 			/* Green box. */
-			rec->_color = KsPlot::Color(0, 255, 0);
+			boxColor = KsPlot::Color(0, 255, 0);
 		}
 
-		rec->setFill(false);
-
-		rec->setPoint(0, p.x() - 1, p.y() - height);
-		rec->setPoint(1, p.x() - 1, p.y() - 1);
+		boxX = p.x() - 1;
+		boxIsOpen = true;
 	};
 
 	auto closeBox = [&] (const KsPlot::Point &p)
 	{
-		if (rec == nullptr)
+		if (!boxIsOpen)
 			return;
 
-		int boxSize = p.x() - rec->getPoint(0)->x;
-		if (boxSize < PLUGIN_MIN_BOX_SIZE) {
+		boxIsOpen = false;
+		if (p.x() - boxX < PLUGIN_MIN_BOX_SIZE) {
 			/* This box is too small. Don't try to plot it. */
-			delete rec;
-			rec = nullptr;
 			return;
 		}
 
-		rec->setPoint(3, p.x() - 1, p.y() - height);
-		rec->setPoint(2, p.x() - 1, p.y() - 1);
-
-		shapes->push_front(rec);
-		rec = nullptr;
+		shapes->addRectangle(boxX, p.y() - height,
+				     p.x() - 1, p.y() - 1,
+				     boxColor, false);
 	};
 
 	for (int bin = 0; bin < graph->size(); ++bin) {
@@ -156,7 +150,7 @@ static void pluginDraw(plugin_sched_context *plugin_ctx,
 			}
 		}
 
-		if (rec) {
+		if (boxIsOpen) {
 			if (entryME || entryClose) {
 				/* Close the box in this bin. */
 				closeBox(graph->getBin(bin)._base);
@@ -180,11 +174,6 @@ static void pluginDraw(plugin_sched_context *plugin_ctx,
 			}
 		}
 	}
-
-	if (rec)
-		delete rec;
-
-	return;
 }
 
 /*
@@ -206,11 +195,16 @@ static void secondPass(kshark_entry **data,
 	if (!col)
 		return;
 
+	kshark_context *kshark_ctx(nullptr);
+	std::vector<kshark_entry *> edited;
+	std::vector<int> oldPids;
 	const kshark_entry *e;
 	kshark_entry *last;
 	int first, n;
 	ssize_t index;
 
+	kshark_instance(&kshark_ctx);
+
 	/* Loop over the intervals of the data collection. */
 	for (size_t i = 0; i < col->size; ++i) {
 		first = col->break_points[i];
@@ -240,12 +234,18 @@ static void secondPass(kshark_entry **data,
 				 * sched_switch event and leave a sign that you
 				 * edited this entry.
 				 */
+				edited.push_back(last);
+				oldPids.push_back(last->pid);
 				last->pid = data[index]->pid;
 				last->visible &= ~KS_PLUGIN_UNTOUCHED_MASK;
 				break;
 			}
 		}
 	}
+
+	/* Update the index of the data once, for all edited entries. */
+	kshark_index_update_pids(kshark_ctx, edited.data(), oldPids.data(),
+				 edited.size());
 }
 
 /**
@@ -270,6 +270,17 @@ void plugin_draw(kshark_cpp_argv *argv_c, int pid, int draw_action)
 
 	KsCppArgV *argvCpp = KS_ARGV_TO_CPP(argv_c);
 
+	if (plugin_ctx->collections_data != argvCpp->_histo->data) {
+		/*
+		 * The data has been replaced. The collections and the second
+		 * pass have to be redone.
+		 */
+		kshark_free_collection_list(plugin_ctx->collections);
+		plugin_ctx->collections = NULL;
+		tracecmd_filter_id_clear(plugin_ctx->second_pass_hash);
+		plugin_ctx->collections_data = argvCpp->_histo->data;
+	}
+
 	/*
 	 * Try to find a collections for this task. It is OK if
 	 * coll = NULL.
@@ -301,12 +312,12 @@ void plugin_draw(kshark_cpp_argv *argv_c, int pid, int draw_action)
 		pluginDraw(plugin_ctx, kshark_ctx,
 			   argvCpp->_histo, col,
 			   SchedEvent::Wakeup, pid,
-			   argvCpp->_graph, argvCpp->_shapes);
+			   argvCpp->_graph, argvCpp->_shapeBuffer);
 
 		pluginDraw(plugin_ctx, kshark_ctx,
 			   argvCpp->_histo, col,
 			   SchedEvent::Switch, pid,
-			   argvCpp->_graph, argvCpp->_shapes);
+			   argvCpp->_graph, argvCpp->_shapeBuffer);
 	} catch (const std::exception &exc) {
 		std::cerr << "Exception in SchedEvents\n" << exc.what();
 	}
@@ -46,6 +46,7 @@ static void plugin_free_context(struct plugin_sched_context *plugin_ctx)
 
 	tracecmd_filter_id_hash_free(plugin_ctx->second_pass_hash);
 	kshark_free_collection_list(plugin_ctx->collections);
+	free(plugin_ctx->pid_table);
 
 	free(plugin_ctx);
 }
@@ -148,30 +149,88 @@ static void plugin_register_command(struct kshark_context *kshark_ctx,
 			tep_register_comm(kshark_ctx->pevent, comm, pid);
 }
 
-static int find_wakeup_pid(struct kshark_context *kshark_ctx, struct kshark_entry *e,
-		    struct tep_event *wakeup_event, struct tep_format_field *pid_field)
+static size_t pid_table_hash(uint64_t offset, size_t size)
 {
-	struct tep_record *record;
-	unsigned long long val;
-	int ret;
+	return ((offset * 0x9E3779B97F4A7C15ULL) >> 32) & (size - 1);
+}
 
-	if (!wakeup_event || e->event_id != wakeup_event->id)
-		return -1;
+static struct plugin_sched_pid_item *
+pid_table_slot(struct plugin_sched_pid_item *table, size_t size,
+	       uint64_t offset)
+{
+	size_t i;
 
-	record = tracecmd_read_at(kshark_ctx->handle, e->offset, NULL);
-	ret = tep_read_number_field(pid_field, record->data, &val);
-	free_record(record);
+	for (i = pid_table_hash(offset, size);
+	     table[i].offset && table[i].offset != offset;
+	     i = (i + 1) & (size - 1))
+		;
 
-	if (ret)
-		return -1;
+	return &table[i];
+}
 
-	return val;
+static const struct plugin_sched_pid_item *
+pid_table_find(struct plugin_sched_context *plugin_ctx, uint64_t offset)
+{
+	struct plugin_sched_pid_item *item;
+
+	if (!plugin_ctx->pid_table)
+		return NULL;
+
+	item = pid_table_slot(plugin_ctx->pid_table,
+			      plugin_ctx->pid_table_size, offset);
+
+	return item->offset ? item : NULL;
 }
 
-static bool wakeup_match_rec_pid(struct plugin_sched_context *plugin_ctx,
-				 struct kshark_context *kshark_ctx,
-				 struct kshark_entry *e,
-				 int pid)
+static bool pid_table_grow(struct plugin_sched_context *plugin_ctx)
+{
+	struct plugin_sched_pid_item *table, *old = plugin_ctx->pid_table;
+	size_t i, size;
+
+	size = plugin_ctx->pid_table_size ? plugin_ctx->pid_table_size * 2 :
+					    1024;
+
+	table = calloc(size, sizeof(*table));
+	if (!table) {
+		fprintf(stderr,
+			"Failed to allocate memory for the Pid table.\n");
+		return false;
+	}
+
+	for (i = 0; i < plugin_ctx->pid_table_size; ++i)
+		if (old[i].offset)
+			*pid_table_slot(table, size, old[i].offset) = old[i];
+
+	free(old);
+	plugin_ctx->pid_table = table;
+	plugin_ctx->pid_table_size = size;
+
+	return true;
+}
+
+static void pid_table_add(struct plugin_sched_context *plugin_ctx,
+			  uint64_t offset, int pid, int prev_state)
+{
+	struct plugin_sched_pid_item *item;
+
+	/* Keep the load factor of the table below 1/2. */
+	if ((plugin_ctx->pid_table_count + 1) * 2 >
+	    plugin_ctx->pid_table_size &&
+	    !pid_table_grow(plugin_ctx))
+		return;
+
+	item = pid_table_slot(plugin_ctx->pid_table,
+			      plugin_ctx->pid_table_size, offset);
+	if (!item->offset)
+		++plugin_ctx->pid_table_count;
+
+	item->offset = offset;
+	item->pid = pid;
+	item->prev_state = prev_state;
+}
+
+static int get_wakeup_pid(struct plugin_sched_context *plugin_ctx,
+			  struct tep_record *record, int event_id)
 {
 	struct tep_event *wakeup_events[] = {
 		plugin_ctx->sched_waking_event,
@@ -183,15 +242,83 @@ static bool wakeup_match_rec_pid(struct plugin_sched_context *plugin_ctx,
 		plugin_ctx->sched_wakeup_pid_field,
 		plugin_ctx->sched_wakeup_new_pid_field,
 	};
-	int i, wakeup_pid = -1;
+	unsigned long long val;
+	int i;
 
 	for (i = 0; i < sizeof(wakeup_events) / sizeof(wakeup_events[0]); i++) {
-		wakeup_pid = find_wakeup_pid(kshark_ctx, e, wakeup_events[i], wakeup_fields[i]);
-		if (wakeup_pid >= 0)
-			break;
+		if (!wakeup_events[i] || event_id != wakeup_events[i]->id)
+			continue;
+
+		if (tep_read_number_field(wakeup_fields[i], record->data, &val))
+			return -1;
+
+		return val;
 	}
 
-	if (wakeup_pid >= 0 && wakeup_pid == pid)
+	return -1;
+}
+
+static bool is_wakeup_event(struct plugin_sched_context *plugin_ctx,
+			    int event_id)
+{
+	return (plugin_ctx->sched_waking_event &&
+		event_id == plugin_ctx->sched_waking_event->id) ||
+	       (plugin_ctx->sched_wakeup_event &&
+		event_id == plugin_ctx->sched_wakeup_event->id) ||
+	       (plugin_ctx->sched_wakeup_new_event &&
+		event_id == plugin_ctx->sched_wakeup_new_event->id);
+}
+
+static bool is_switch_event(struct plugin_sched_context *plugin_ctx,
+			    int event_id)
+{
+	return plugin_ctx->sched_switch_event &&
+	       event_id == plugin_ctx->sched_switch_event->id;
+}
+
+static void capture_switch(struct plugin_sched_context *plugin_ctx,
+			   struct tep_record *record)
+{
+	unsigned long long val = 0;
+	int pid = -1;
+
+	if (tep_read_number_field(plugin_ctx->sched_switch_prev_state_field,
+				  record->data, &val) == 0)
+		pid = tep_data_pid(plugin_ctx->pevent, record);
+
+	pid_table_add(plugin_ctx, record->offset, pid, val);
+}
+
+static void capture_wakeup(struct plugin_sched_context *plugin_ctx,
+			   struct tep_record *record, int event_id)
+{
+	pid_table_add(plugin_ctx, record->offset,
+		      get_wakeup_pid(plugin_ctx, record, event_id), 0);
+}
+
+/*
+ * Get the information, captured while loading the data. The table is filled
+ * by the actions of the plugin, also for the entries restored from the entry
+ * cache, and is only read afterwards. Hence no locking is needed here.
+ */
+static const struct plugin_sched_pid_item *
+get_pid_item(struct plugin_sched_context *plugin_ctx, struct kshark_entry *e)
+{
+	return pid_table_find(plugin_ctx, e->offset);
+}
+
+static bool wakeup_match_rec_pid(struct plugin_sched_context *plugin_ctx,
+				 struct kshark_context *kshark_ctx,
+				 struct kshark_entry *e,
+				 int pid)
+{
+	const struct plugin_sched_pid_item *item;
+
+	if (!is_wakeup_event(plugin_ctx, e->event_id))
+		return false;
+
+	item = get_pid_item(plugin_ctx, e);
+	if (item && item->pid >= 0 && item->pid == pid)
 		return true;
 
 	return false;
@@ -235,27 +362,17 @@ bool plugin_switch_match_rec_pid(struct kshark_context *kshark_ctx,
 				 struct kshark_entry *e,
 				 int pid)
 {
+	const struct plugin_sched_pid_item *item;
 	struct plugin_sched_context *plugin_ctx;
-	unsigned long long val;
-	int ret, switch_pid = -1;
 
 	plugin_ctx = plugin_sched_context_handler;
 
-	if (plugin_ctx->sched_switch_event &&
-	    e->event_id == plugin_ctx->sched_switch_event->id) {
-		struct tep_record *record;
-
-		record = tracecmd_read_at(kshark_ctx->handle, e->offset, NULL);
-		ret = tep_read_number_field(plugin_ctx->sched_switch_prev_state_field,
-					    record->data, &val);
-
-		if (ret == 0 && !(val & 0x7f))
-			switch_pid = tep_data_pid(plugin_ctx->pevent, record);
-
-		free_record(record);
-	}
+	if (!is_switch_event(plugin_ctx, e->event_id))
+		return false;
 
-	if (switch_pid >= 0 && switch_pid == pid)
+	item = get_pid_item(plugin_ctx, e);
+	if (item && item->pid >= 0 && !(item->prev_state & 0x7f) &&
+	    item->pid == pid)
 		return true;
 
 	return false;
@@ -310,13 +427,46 @@ static void plugin_sched_action(struct kshark_context *kshark_ctx,
 				struct tep_record *rec,
 				struct kshark_entry *entry)
 {
+	struct plugin_sched_context *plugin_ctx = plugin_sched_context_handler;
 	int pid = plugin_get_next_pid(rec);
+
+	capture_switch(plugin_ctx, rec);
+
 	if (pid >= 0) {
 		entry->pid = pid;
 		plugin_register_command(kshark_ctx, rec, entry->pid);
 	}
 }
 
+static void plugin_wakeup_action(struct kshark_context *kshark_ctx,
+				 struct tep_record *rec,
+				 struct kshark_entry *entry)
+{
+	struct plugin_sched_context *plugin_ctx = plugin_sched_context_handler;
+
+	capture_wakeup(plugin_ctx, rec, entry->event_id);
+}
+
+static void register_wakeup_handler(struct kshark_context *kshark_ctx,
+				    struct tep_event *event)
+{
+	if (event)
+		kshark_register_event_handler(&kshark_ctx->event_handlers,
+					      event->id,
+					      plugin_wakeup_action,
+					      NULL);
+}
+
+static void unregister_wakeup_handler(struct kshark_context *kshark_ctx,
+				      struct tep_event *event)
+{
+	if (event)
+		kshark_unregister_event_handler(&kshark_ctx->event_handlers,
+						event->id,
+						plugin_wakeup_action,
+						NULL);
+}
+
 static int plugin_sched_init(struct kshark_context *kshark_ctx)
 {
 	struct plugin_sched_context *plugin_ctx;
@@ -331,6 +481,10 @@ static int plugin_sched_init(struct kshark_context *kshark_ctx)
 				      plugin_sched_action,
 				      plugin_draw);
 
+	register_wakeup_handler(kshark_ctx, plugin_ctx->sched_waking_event);
+	register_wakeup_handler(kshark_ctx, plugin_ctx->sched_wakeup_event);
+	register_wakeup_handler(kshark_ctx, plugin_ctx->sched_wakeup_new_event);
+
 	return 1;
 }
 
@@ -348,6 +502,11 @@ static int plugin_sched_close(struct kshark_context *kshark_ctx)
 					plugin_sched_action,
 					plugin_draw);
 
+	unregister_wakeup_handler(kshark_ctx, plugin_ctx->sched_waking_event);
+	unregister_wakeup_handler(kshark_ctx, plugin_ctx->sched_wakeup_event);
+	unregister_wakeup_handler(kshark_ctx,
+				  plugin_ctx->sched_wakeup_new_event);
+
 	plugin_free_context(plugin_ctx);
 	plugin_sched_context_handler = NULL;
 
@@ -19,6 +19,29 @@
 extern "C" {
 #endif
 
+/**
+ * Item of the Pid table of the plugin. The table holds information, captured
+ * from the sched_switch and sched_wakeup records while loading the data, such
+ * that the matching functions never have to read the trace file again.
+ */
+struct plugin_sched_pid_item {
+	/**
+	 * The offset into the trace file of the record, used as a key.
+	 * Zero means that the item is empty.
+	 */
+	uint64_t	offset;
+
+	/**
+	 * For sched_switch: the Pid of the previous task.
+	 * For sched_wakeup: the Pid of the task being woken up.
+	 * -1 if the Pid is not available.
+	 */
+	int32_t		pid;
+
+	/** For sched_switch: the state of the previous task. */
+	int32_t		prev_state;
+};
+
 /** Structure representing a plugin-specific context. */
 struct plugin_sched_context {
 	/** Input handle for the trace data file. */
@@ -60,8 +83,28 @@ struct plugin_sched_context {
 	/** List of Data collections used by this plugin. */
 	struct kshark_entry_collection	*collections;
 
+	/**
+	 * The array of trace data, the Data collections and the second pass
+	 * belong to. In out-of-core mode the array changes together with the
+	 * time-window of the model.
+	 */
+	struct kshark_entry		**collections_data;
+
 	/** Hash of the tasks for which the second pass is already done. */
 	struct tracecmd_filter_id	*second_pass_hash;
+
+	/**
+	 * Pid table (open addressing hash table, keyed by offset). It is
+	 * filled while loading the data and is read-only afterwards, when
+	 * the matching functions use it from several threads.
+	 */
+	struct plugin_sched_pid_item	*pid_table;
+
+	/** The size of the Pid table (a power of two). */
+	size_t				pid_table_size;
+
+	/** Number of items in the Pid table. */
+	size_t				pid_table_count;
 };
 
 int plugin_get_next_pid(struct tep_record *record);
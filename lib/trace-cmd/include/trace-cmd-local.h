@@ -50,4 +50,21 @@ __do_write_check(int fd, const void *data, size_t size)
 	return 0;
 }
 
+/* Local for trace-util.c and trace-output.c */
+
+/* The format file of an event of the tracing directory */
+struct event_format_file {
+	char		*system;
+	char		*event;
+	char		*path;
+	char		*buf;
+	int		len;	/* -1 if the file could not be read */
+};
+
+void tracecmd_read_format_files(struct event_format_file *files, int nr);
+bool tracecmd_format_cache_enabled(void);
+struct event_format_file *
+tracecmd_local_format_files(const char *tracing_dir, int *nr);
+void tracecmd_free_format_files(struct event_format_file *files, int nr);
+
 #endif /* _TRACE_CMD_LOCAL_H */
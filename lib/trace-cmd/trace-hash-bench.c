@@ -0,0 +1,199 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Benchmark of trace_hash, using it the way trace-cmd profile does.
+ *
+ * Build with "make trace-hash-bench" and run:
+ *
+ *   lib/trace-cmd/trace-hash-bench [nr_items]
+ *
+ * Before the timings, it checks that items with the same key are still
+ * found newest first while the hash is resized. The profiler matches the
+ * end of nested calls with their start that way.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "trace-hash.h"
+#include "trace-hash-local.h"
+
+#define DEFAULT_ITEMS	1000000
+#define NR_LOOKUPS	4
+
+struct bench_item {
+	struct trace_hash_item	hash;
+	unsigned long long	val;
+	int			seq;
+};
+
+static struct bench_item *item_from_hash(struct trace_hash_item *item)
+{
+	return (struct bench_item *)item;
+}
+
+static int match_val(struct trace_hash_item *item, void *data)
+{
+	return item_from_hash(item)->val == *(unsigned long long *)data;
+}
+
+static struct bench_item *
+find_item(struct trace_hash *hash, unsigned long long val)
+{
+	struct trace_hash_item *item;
+
+	item = trace_hash_find(hash, trace_hash(val), match_val, &val);
+	if (!item)
+		return NULL;
+
+	return item_from_hash(item);
+}
+
+static void add_item(struct trace_hash *hash, struct bench_item *item,
+		     unsigned long long val, int seq)
+{
+	item->val = val;
+	item->seq = seq;
+	item->hash.key = trace_hash(val);
+	trace_hash_add(hash, &item->hash);
+}
+
+/*
+ * Like a function that calls itself, push several starts with the same
+ * key while other items make the hash grow. Every lookup must return the
+ * last start, and deleting it must uncover the one before.
+ */
+static int check_duplicate_order(void)
+{
+	const int nr_dups = 64, nr_fill = 100;
+	const unsigned long long dup_val = 0xffffffff81000000ULL;
+	struct bench_item *items, *item;
+	struct trace_hash hash;
+	int i, j, n = 0;
+	int ret = 0;
+
+	items = calloc(nr_dups * (nr_fill + 1), sizeof(*items));
+	if (!items || trace_hash_init(&hash, 16) < 0) {
+		fprintf(stderr, "Failed to allocate the hash\n");
+		free(items);
+		return -1;
+	}
+
+	for (i = 0; i < nr_dups; i++) {
+		add_item(&hash, &items[n++], dup_val, i);
+		for (j = 0; j < nr_fill; j++) {
+			add_item(&hash, &items[n], n, n);
+			n++;
+
+			item = find_item(&hash, dup_val);
+			if (!item || item->seq != i) {
+				fprintf(stderr, "Found start %d instead of %d\n",
+					item ? item->seq : -1, i);
+				ret = -1;
+				goto out;
+			}
+		}
+	}
+
+	for (i = nr_dups - 1; i >= 0; i--) {
+		item = find_item(&hash, dup_val);
+		if (!item || item->seq != i) {
+			fprintf(stderr, "Found start %d instead of %d\n",
+				item ? item->seq : -1, i);
+			ret = -1;
+			goto out;
+		}
+		trace_hash_del(&item->hash);
+	}
+
+	if (find_item(&hash, dup_val)) {
+		fprintf(stderr, "Found a deleted start\n");
+		ret = -1;
+	}
+ out:
+	trace_hash_free(&hash);
+	free(items);
+	return ret;
+}
+
+static double elapsed(struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) +
+		(now.tv_nsec - start->tv_nsec) / 1000000000.0;
+}
+
+/*
+ * As the profiler does for tasks and events: look the value up first,
+ * and add it only if it is not there yet. Then look up all of them a
+ * few times, as each event of the trace does.
+ */
+static int bench(const char *name, int nr_items, unsigned long long base,
+		 unsigned long long step)
+{
+	struct bench_item *items;
+	struct trace_hash hash;
+	struct timespec start;
+	double insert, lookup;
+	int i, j;
+
+	items = calloc(nr_items, sizeof(*items));
+	if (!items || trace_hash_init(&hash, 1024) < 0) {
+		fprintf(stderr, "Failed to allocate the hash\n");
+		free(items);
+		return -1;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < nr_items; i++) {
+		if (!find_item(&hash, base + i * step))
+			add_item(&hash, &items[i], base + i * step, i);
+	}
+	insert = elapsed(&start);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (j = 0; j < NR_LOOKUPS; j++) {
+		for (i = 0; i < nr_items; i++) {
+			if (!find_item(&hash, base + i * step)) {
+				fprintf(stderr, "%s: item %d not found\n",
+					name, i);
+				break;
+			}
+		}
+	}
+	lookup = elapsed(&start);
+
+	printf("%-24s %10d  insert %8.3fs  lookup %8.3fs  buckets %d\n",
+	       name, nr_items, insert, lookup, hash.nr_buckets);
+
+	trace_hash_free(&hash);
+	free(items);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int nr_items = DEFAULT_ITEMS;
+
+	if (argc > 1)
+		nr_items = atoi(argv[1]);
+
+	if (nr_items <= 0) {
+		fprintf(stderr, "usage: %s [nr_items]\n", argv[0]);
+		return 1;
+	}
+
+	if (check_duplicate_order() < 0)
+		return 1;
+
+	printf("duplicate key order       ok\n");
+
+	if (bench("sequential", nr_items, 1, 1) < 0 ||
+	    bench("64-byte aligned (stack)", nr_items,
+		  0xffff888000000000ULL, 64) < 0)
+		return 1;
+
+	return 0;
+}
@@ -11,18 +11,69 @@
 
 #include "trace-hash.h"
 
+/* Number of old buckets moved to the new buckets by each addition */
+#define TRACE_HASH_MIGRATE	4
+
+/*
+ * Multiplicative hashing: the top bits of the product depend on all
+ * the bits of the key, so keys that only differ in their high bits
+ * (like pointers or shifted values) still spread over all buckets.
+ */
+static inline int hash_bucket(unsigned long long key, int bits)
+{
+	if (!bits)
+		return 0;
+
+	return (key * 0x9e3779b97f4a7c15ULL) >> (64 - bits);
+}
+
+static void bucket_add(struct trace_hash_item **bucket,
+		       struct trace_hash_item *item)
+{
+	struct trace_hash_item *next = *bucket;
+
+	if (next)
+		next->prev = item;
+
+	item->next = next;
+	item->prev = (struct trace_hash_item *)bucket;
+
+	*bucket = item;
+}
+
+/*
+ * Items with the same key are found newest first. The items of an old
+ * bucket are older than the items already in the new bucket, hence they
+ * are moved to the end of it, in their current order.
+ */
+static void bucket_append(struct trace_hash_item **bucket,
+			  struct trace_hash_item *item)
+{
+	struct trace_hash_item *prev = (struct trace_hash_item *)bucket;
+
+	while (prev->next)
+		prev = prev->next;
+
+	item->next = NULL;
+	item->prev = prev;
+	prev->next = item;
+}
+
 int trace_hash_init(struct trace_hash *hash, int buckets)
 {
+	int bits = 0;
+
 	memset(hash, 0, sizeof(*hash));
 
-	hash->buckets = calloc(sizeof(*hash->buckets), buckets);
+	/* Round up to a power of two */
+	while ((1 << bits) < buckets)
+		bits++;
+
+	hash->buckets = calloc(sizeof(*hash->buckets), 1 << bits);
 	if (!hash->buckets)
 		return -ENOMEM;
-	hash->nr_buckets = buckets;
-
-	/* If a power of two then we can shortcut */
-	if (!(buckets & (buckets - 1)))
-		hash->power = buckets - 1;
+	hash->nr_buckets = 1 << bits;
+	hash->bits = bits;
 
 	return 0;
 }
@@ -30,47 +81,83 @@ int trace_hash_init(struct trace_hash *hash, int buckets)
 void trace_hash_free(struct trace_hash *hash)
 {
 	free(hash->buckets);
+	free(hash->old_buckets);
+	hash->buckets = NULL;
+	hash->old_buckets = NULL;
 }
 
 int trace_hash_empty(struct trace_hash *hash)
+{
+	return !hash->nr_items;
+}
+
+static void migrate_buckets(struct trace_hash *hash, int nr)
 {
 	struct trace_hash_item **bucket;
+	struct trace_hash_item *item;
 
-	trace_hash_for_each_bucket(bucket, hash)
-		if (*bucket)
-			return 0;
-	return 1;
+	while (nr-- && hash->migrate < hash->nr_old_buckets) {
+		bucket = &hash->old_buckets[hash->migrate++];
+		while ((item = *bucket)) {
+			*bucket = item->next;
+			bucket_append(&hash->buckets[hash_bucket(item->key,
+								 hash->bits)],
+				      item);
+		}
+	}
+
+	if (hash->migrate < hash->nr_old_buckets)
+		return;
+
+	free(hash->old_buckets);
+	hash->old_buckets = NULL;
+	hash->nr_old_buckets = 0;
+	hash->migrate = 0;
 }
 
-int trace_hash_add(struct trace_hash *hash, struct trace_hash_item *item)
+static void grow_hash(struct trace_hash *hash)
 {
-	struct trace_hash_item *next;
-	int bucket = hash->power ? item->key & hash->power :
-		item->key % hash->nr_buckets;
+	struct trace_hash_item **buckets;
 
-	if (hash->buckets[bucket]) {
-		next = hash->buckets[bucket];
-		next->prev = item;
-	} else
-		next = NULL;
+	/* Finish the previous resize first */
+	if (hash->old_buckets)
+		migrate_buckets(hash, hash->nr_old_buckets);
 
-	item->next = next;
-	item->prev = (struct trace_hash_item *)&hash->buckets[bucket];
+	buckets = calloc(sizeof(*buckets), hash->nr_buckets * 2);
+	if (!buckets)
+		return; /* Keep using the current buckets */
 
-	hash->buckets[bucket] = item;
+	hash->old_buckets = hash->buckets;
+	hash->nr_old_buckets = hash->nr_buckets;
+	hash->old_bits = hash->bits;
+	hash->migrate = 0;
 
-	return 1;
+	hash->buckets = buckets;
+	hash->nr_buckets *= 2;
+	hash->bits++;
 }
 
-struct trace_hash_item *
-trace_hash_find(struct trace_hash *hash, unsigned long long key,
-		trace_hash_func match, void *data)
+int trace_hash_add(struct trace_hash *hash, struct trace_hash_item *item)
 {
-	struct trace_hash_item *item;
-	int bucket = hash->power ? key & hash->power :
-		key % hash->nr_buckets;
+	if (hash->nr_items >= (unsigned long long)hash->nr_buckets &&
+	    hash->nr_buckets < (1 << 30))
+		grow_hash(hash);
+
+	if (hash->old_buckets)
+		migrate_buckets(hash, TRACE_HASH_MIGRATE);
+
+	bucket_add(&hash->buckets[hash_bucket(item->key, hash->bits)], item);
+	item->hash = hash;
+	hash->nr_items++;
+
+	return 1;
+}
 
-	for (item = hash->buckets[bucket]; item; item = item->next) {
+static struct trace_hash_item *
+find_in_bucket(struct trace_hash_item *item, unsigned long long key,
+	       trace_hash_func match, void *data)
+{
+	for (; item; item = item->next) {
 		if (item->key == key) {
 			if (!match)
 				return item;
@@ -81,3 +168,27 @@ trace_hash_find(struct trace_hash *hash, unsigned long long key,
 
 	return NULL;
 }
+
+/*
+ * Note, this does not modify the hash, so it is safe to look up items
+ * from several threads, as long as no items are added or removed.
+ */
+struct trace_hash_item *
+trace_hash_find(struct trace_hash *hash, unsigned long long key,
+		trace_hash_func match, void *data)
+{
+	struct trace_hash_item *item;
+	int bucket;
+
+	item = find_in_bucket(hash->buckets[hash_bucket(key, hash->bits)],
+			      key, match, data);
+	if (item || !hash->old_buckets)
+		return item;
+
+	/* The item may not have been moved yet */
+	bucket = hash_bucket(key, hash->old_bits);
+	if (bucket < hash->migrate)
+		return NULL;
+
+	return find_in_bucket(hash->old_buckets[bucket], key, match, data);
+}
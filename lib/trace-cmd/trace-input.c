@@ -450,7 +450,8 @@ static int read_event_file(struct tracecmd_input *handle,
 			printf("%.*s\n", (int)size, buf);
 		}
 	} else {
-		if (tep_parse_event(pevent, buf, size, system))
+		/* Most of the events are usually not in the data */
+		if (tep_parse_event_lazy(pevent, buf, size, system))
 			handle->parsing_failures++;
 	}
 	free(buf);
@@ -716,9 +717,17 @@ static int read_and_parse_cmdlines(struct tracecmd_input *handle);
  */
 int tracecmd_get_parsing_failures(struct tracecmd_input *handle)
 {
-	if (handle)
-		return handle->parsing_failures;
-	return 0;
+	if (!handle)
+		return 0;
+
+	/*
+	 * The formats of the events are parsed on their first use. Parse
+	 * the rest now, to print their warnings. As with tep_parse_event(),
+	 * a print format that fails to parse does not count as a failure.
+	 */
+	tep_parse_lazy_events(handle->pevent);
+
+	return handle->parsing_failures;
 }
 
 /**
@@ -2062,7 +2071,8 @@ static int init_cpu(struct tracecmd_input *handle, int cpu)
 	list_head_init(&cpu_data->page_maps);
 
 	if (!cpu_data->size) {
-		printf("CPU %d is empty\n", cpu);
+		if (!(handle->flags & TRACECMD_FL_QUIET))
+			printf("CPU %d is empty\n", cpu);
 		return 0;
 	}
 
@@ -2400,7 +2410,8 @@ static int handle_options(struct tracecmd_input *handle)
 				trace_pid_map_load(handle, buf);
 			break;
 		default:
-			warning("unknown option %d", option);
+			if (!(handle->flags & TRACECMD_FL_QUIET))
+				warning("unknown option %d", option);
 			break;
 		}
 
@@ -3462,6 +3473,38 @@ int tracecmd_cpus(struct tracecmd_input *handle)
 	return handle->cpus;
 }
 
+/**
+ * tracecmd_cpu_data_offset - return the file offset of the data of a CPU
+ * @handle: input handle for the trace.dat file
+ * @cpu: the CPU
+ *
+ * Returns 0 if @cpu has no data.
+ */
+unsigned long long tracecmd_cpu_data_offset(struct tracecmd_input *handle,
+					    int cpu)
+{
+	if (!handle->cpu_data || cpu < 0 || cpu >= handle->cpus)
+		return 0;
+
+	return handle->cpu_data[cpu].file_offset;
+}
+
+/**
+ * tracecmd_cpu_data_size - return the size of the data recorded for a CPU
+ * @handle: input handle for the trace.dat file
+ * @cpu: the CPU
+ *
+ * Returns 0 if @cpu has no data.
+ */
+unsigned long long tracecmd_cpu_data_size(struct tracecmd_input *handle,
+					  int cpu)
+{
+	if (!handle->cpu_data || cpu < 0 || cpu >= handle->cpus)
+		return 0;
+
+	return handle->cpu_data[cpu].file_size;
+}
+
 /**
  * tracecmd_get_pevent - return the pevent handle
  * @handle: input handle for the trace.dat file
@@ -19,6 +19,7 @@
 #include <ctype.h>
 #include <errno.h>
 #include <glob.h>
+#include <fnmatch.h>
 
 #include "trace-cmd-local.h"
 #include "list.h"
@@ -56,12 +57,15 @@ struct tracecmd_output {
 	bool			quiet;
 	struct list_head 	options;
 	struct tracecmd_msg_handle *msg_handle;
+	struct event_format_file *formats;
+	int			nr_formats;
 };
 
 struct list_event {
 	struct list_event		*next;
 	char				*name;
 	char				*file;
+	struct event_format_file	*format;
 };
 
 struct list_event_system {
@@ -137,6 +141,8 @@ void tracecmd_output_free(struct tracecmd_output *handle)
 	if (handle->tracing_dir)
 		free(handle->tracing_dir);
 
+	tracecmd_free_format_files(handle->formats, handle->nr_formats);
+
 	if (handle->pevent)
 		tep_unref(handle->pevent);
 
@@ -377,13 +383,11 @@ static int read_header_files(struct tracecmd_output *handle)
 static int copy_event_system(struct tracecmd_output *handle,
 			     struct list_event_system *slist)
 {
+	struct event_format_file *format;
 	struct list_event *elist;
-	unsigned long long size, check_size, endian8;
-	struct stat st;
-	char *format;
+	unsigned long long size, endian8;
 	int endian4;
 	int count = 0;
-	int ret;
 
 	for (elist = slist->events; elist; elist = elist->next)
 		count++;
@@ -393,21 +397,18 @@ static int copy_event_system(struct tracecmd_output *handle,
 		return -1;
 
 	for (elist = slist->events; elist; elist = elist->next) {
-		format = elist->file;
-		ret = stat(format, &st);
-
-		if (ret >= 0) {
-			/* unfortunately, you can not stat debugfs files for size */
-			size = get_size(format);
-			endian8 = convert_endian_8(handle, size);
-			if (do_write_check(handle, &endian8, 8))
-				return -1;
-			check_size = copy_file(handle, format);
-			if (size != check_size) {
-				warning("error in size of file '%s'", format);
-				return -1;
-			}
-		}
+		format = elist->format;
+		size = 0;
+		if (format->len < 0)
+			warning("Can't read '%s'", elist->file);
+		else
+			size = format->len;
+
+		endian8 = convert_endian_8(handle, size);
+		if (do_write_check(handle, &endian8, 8))
+			return -1;
+		if (size && do_write_check(handle, format->buf, size))
+			return -1;
 	}
 
 	return 0;
@@ -416,7 +417,8 @@ static int copy_event_system(struct tracecmd_output *handle,
 static void add_list_event_system(struct list_event_system **systems,
 				  const char *system,
 				  const char *event,
-				  const char *path)
+				  const char *path,
+				  struct event_format_file *format)
 {
 	struct list_event_system *slist;
 	struct list_event *elist;
@@ -449,6 +451,7 @@ static void add_list_event_system(struct list_event_system **systems,
 			goto err_mem;
 		elist->name = strdup(event);
 		elist->file = strdup(path);
+		elist->format = format;
 		if (!elist->name || !elist->file) {
 			free(elist->name);
 			free(elist->file);
@@ -483,17 +486,63 @@ static void free_list_events(struct list_event_system *list)
 	}
 }
 
+static void add_event_file(struct list_event_system **systems,
+			   const char *file, int events_len, int do_ftrace,
+			   struct event_format_file *format)
+{
+	char *system;
+	char *event;
+	char *ptr;
+
+	system = strdup(file + events_len + 1);
+	system = strtok_r(system, "/", &ptr);
+	if (!ptr) {
+		/* ?? should we warn? */
+		free(system);
+		return;
+	}
+
+	if (!do_ftrace && strcmp(system, "ftrace") == 0) {
+		free(system);
+		return;
+	}
+
+	event = strtok_r(NULL, "/", &ptr);
+	if (!ptr) {
+		/* ?? should we warn? */
+		free(system);
+		return;
+	}
+
+	add_list_event_system(systems, system, event, file, format);
+	free(system);
+}
+
+/* Returns the format files of all events, if they are cached */
+static struct event_format_file *
+get_cached_formats(struct tracecmd_output *handle)
+{
+	const char *tracing;
+
+	if (handle->formats || !tracecmd_format_cache_enabled())
+		return handle->formats;
+
+	tracing = find_tracing_dir(handle);
+	if (tracing)
+		handle->formats = tracecmd_local_format_files(tracing,
+							      &handle->nr_formats);
+
+	return handle->formats;
+}
+
 static void glob_events(struct tracecmd_output *handle,
 			struct list_event_system **systems,
 			const char *str)
 {
+	struct event_format_file *formats;
 	glob_t globbuf;
 	char *events_path;
-	char *system;
-	char *event;
 	char *path;
-	char *file;
-	char *ptr;
 	int do_ftrace = 0;
 	int events_len;
 	int ret;
@@ -516,37 +565,29 @@ static void glob_events(struct tracecmd_output *handle,
 	strcat(path, "/format");
 	put_tracing_file(events_path);
 
+	/* The cached files are sorted the same way as glob() sorts them */
+	formats = get_cached_formats(handle);
+	if (formats) {
+		for (i = 0; i < handle->nr_formats; i++) {
+			if (fnmatch(path, formats[i].path,
+				    FNM_PATHNAME | FNM_PERIOD) == 0)
+				add_event_file(systems, formats[i].path,
+					       events_len, do_ftrace,
+					       &formats[i]);
+		}
+		free(path);
+		return;
+	}
+
 	globbuf.gl_offs = 0;
 	ret = glob(path, 0, NULL, &globbuf);
 	free(path);
 	if (ret < 0)
 		return;
 
-	for (i = 0; i < globbuf.gl_pathc; i++) {
-		file = globbuf.gl_pathv[i];
-		system = strdup(file + events_len + 1);
-		system = strtok_r(system, "/", &ptr);
-		if (!ptr) {
-			/* ?? should we warn? */
-			free(system);
-			continue;
-		}
-
-		if (!do_ftrace && strcmp(system, "ftrace") == 0) {
-			free(system);
-			continue;
-		}
-
-		event = strtok_r(NULL, "/", &ptr);
-		if (!ptr) {
-			/* ?? should we warn? */
-			free(system);
-			continue;
-		}
-
-		add_list_event_system(systems, system, event, file);
-		free(system);
-	}
+	for (i = 0; i < globbuf.gl_pathc; i++)
+		add_event_file(systems, globbuf.gl_pathv[i], events_len,
+			       do_ftrace, NULL);
 	globfree(&globbuf);
 }
 
@@ -597,16 +638,60 @@ create_event_list_item(struct tracecmd_output *handle,
 	warning("Insufficient memory");
 }
 
+/*
+ * Read the format files of the listed events, which are not cached,
+ * all at once. Returns the array of the read files.
+ */
+static struct event_format_file *
+read_list_formats(struct list_event_system *systems, int *nr)
+{
+	struct event_format_file *files;
+	struct list_event_system *slist;
+	struct list_event *elist;
+	int i = 0;
+
+	*nr = 0;
+	for (slist = systems; slist; slist = slist->next)
+		for (elist = slist->events; elist; elist = elist->next)
+			if (!elist->format)
+				(*nr)++;
+
+	files = calloc(*nr ? *nr : 1, sizeof(*files));
+	if (!files)
+		return NULL;
+
+	for (slist = systems; slist; slist = slist->next) {
+		for (elist = slist->events; elist; elist = elist->next) {
+			if (elist->format)
+				continue;
+			files[i].path = strdup(elist->file);
+			if (!files[i].path) {
+				tracecmd_free_format_files(files, *nr);
+				return NULL;
+			}
+			elist->format = &files[i++];
+		}
+	}
+
+	tracecmd_read_format_files(files, *nr);
+
+	return files;
+}
+
 static int read_ftrace_files(struct tracecmd_output *handle)
 {
 	struct list_event_system *systems = NULL;
 	struct tracecmd_event_list list = { .glob = "ftrace/*" };
+	struct event_format_file *files;
 	int ret;
+	int nr;
 
 	create_event_list_item(handle, &systems, &list);
 
-	ret = copy_event_system(handle, systems);
+	files = read_list_formats(systems, &nr);
+	ret = files ? copy_event_system(handle, systems) : -1;
 
+	tracecmd_free_format_files(files, nr);
 	free_list_events(systems);
 
 	return ret;
@@ -632,9 +717,11 @@ static int read_event_files(struct tracecmd_output *handle,
 	struct list_event_system *slist;
 	struct tracecmd_event_list *list;
 	struct tracecmd_event_list all_events = { .glob = "*/*" };
+	struct event_format_file *files;
 	int count = 0;
 	int endian4;
 	int ret;
+	int nr;
 
 	/*
 	 * If any of the list is the special keyword "all" then
@@ -650,10 +737,14 @@ static int read_event_files(struct tracecmd_output *handle,
 
 	systems = create_event_list(handle, event_list);
 
+	ret = -1;
+	files = read_list_formats(systems, &nr);
+	if (!files)
+		goto out_free;
+
 	for (slist = systems; slist; slist = slist->next)
 		count++;
 
-	ret = -1;
 	endian4 = convert_endian_4(handle, count);
 	if (do_write_check(handle, &endian4, 4))
 		goto out_free;
@@ -669,8 +760,13 @@ static int read_event_files(struct tracecmd_output *handle,
 	}
 
  out_free:
+	tracecmd_free_format_files(files, nr);
 	free_list_events(systems);
 
+	/* The cached formats are not needed after the events are written */
+	tracecmd_free_format_files(handle->formats, handle->nr_formats);
+	handle->formats = NULL;
+
 	return ret;
 }
 
@@ -18,9 +18,10 @@
 #include <sys/mount.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/utsname.h>
+#include <pthread.h>
 
-#include "trace-cmd.h"
-#include "event-utils.h"
+#include "trace-cmd-local.h"
 
 #define LOCAL_PLUGIN_DIR ".trace-cmd/plugins"
 #define TRACEFS_PATH "/sys/kernel/tracing"
@@ -73,48 +74,84 @@ void tracecmd_parse_cmdlines(struct tep_handle *pevent,
 	}
 }
 
-void tracecmd_parse_proc_kallsyms(struct tep_handle *pevent,
-			 char *file, unsigned int size __maybe_unused)
+static int hex_val(char ch)
 {
-	unsigned long long addr;
+	if (ch >= '0' && ch <= '9')
+		return ch - '0';
+	ch |= 0x20;
+	if (ch >= 'a' && ch <= 'f')
+		return ch - 'a' + 10;
+	return -1;
+}
+
+/*
+ * The lines of kallsyms are "<addr> <type> <func>[\t[<mod>]]". As there
+ * can be a lot of them, they are split by hand, in place.
+ */
+static void parse_kallsyms_line(struct tep_handle *pevent, char *line)
+{
+	unsigned long long addr = 0;
 	char *func;
-	char *line;
-	char *next = NULL;
-	char *addr_str;
 	char *mod;
+	char *p;
+	int val;
 	char ch;
 
-	line = strtok_r(file, "\n", &next);
-	while (line) {
-		mod = NULL;
-		errno = 0;
-		sscanf(line, "%ms %c %ms\t[%ms",
-			     &addr_str, &ch, &func, &mod);
-		if (errno) {
-			free(addr_str);
-			free(func);
-			free(mod);
-			perror("sscanf");
-			return;
+	for (p = line; (val = hex_val(*p)) >= 0; p++)
+		addr = (addr << 4) | val;
+
+	if (p == line || p[0] != ' ' || !p[1] || p[2] != ' ')
+		return;
+
+	ch = p[1];
+	func = p + 3;
+
+	mod = strchr(func, '\t');
+	if (mod) {
+		*mod++ = 0;
+		if (*mod == '[') {
+			mod++;
+			/* truncate the extra ']' */
+			p = strchr(mod, ']');
+			if (p)
+				*p = 0;
+		} else {
+			mod = NULL;
 		}
-		addr = strtoull(addr_str, NULL, 16);
-		free(addr_str);
-
-		/* truncate the extra ']' */
-		if (mod)
-			mod[strlen(mod) - 1] = 0;
-
-		/*
-		 * Hacks for
-		 *  - arm arch that adds a lot of bogus '$a' functions
-		 *  - x86-64 that reports per-cpu variable offsets as absolute
-		 */
-		if (func[0] != '$' && ch != 'A' && ch != 'a')
-			tep_register_function(pevent, func, addr, mod);
-		free(func);
-		free(mod);
+	}
 
-		line = strtok_r(NULL, "\n", &next);
+	/*
+	 * Hacks for
+	 *  - arm arch that adds a lot of bogus '$a' functions
+	 *  - x86-64 that reports per-cpu variable offsets as absolute
+	 */
+	if (func[0] && func[0] != '$' && ch != 'A' && ch != 'a')
+		tep_register_function(pevent, func, addr, mod);
+}
+
+void tracecmd_parse_proc_kallsyms(struct tep_handle *pevent,
+			 char *file, unsigned int size)
+{
+	char *end = file + size;
+	char *line;
+	char *next;
+
+	/* The callers check errno after the parsing */
+	errno = 0;
+
+	for (line = file; line < end; line = next + 1) {
+		next = memchr(line, '\n', end - line);
+		if (!next) {
+			/* Do not write past @size for the last line */
+			line = strndup(line, end - line);
+			if (line)
+				parse_kallsyms_line(pevent, line);
+			free(line);
+			break;
+		}
+
+		*next = 0;
+		parse_kallsyms_line(pevent, line);
 	}
 }
 
@@ -122,7 +159,6 @@ void tracecmd_parse_ftrace_printk(struct tep_handle *pevent,
 			 char *file, unsigned int size __maybe_unused)
 {
 	unsigned long long addr;
-	char *printk;
 	char *line;
 	char *next = NULL;
 	char *addr_str;
@@ -136,11 +172,9 @@ void tracecmd_parse_ftrace_printk(struct tep_handle *pevent,
 			break;
 		}
 		addr = strtoull(addr_str, NULL, 16);
-		/* fmt still has a space, skip it */
-		printk = strdup(fmt+1);
+		/* fmt still has a space, skip it, it is duplicated */
+		tep_register_print_string(pevent, fmt + 1, addr);
 		line = strtok_r(NULL, "\n", &next);
-		tep_register_print_string(pevent, printk, addr);
-		free(printk);
 	}
 }
 
@@ -530,59 +564,616 @@ static int read_file(const char *file, char **buffer)
 	return len;
 }
 
-static int load_events(struct tep_handle *pevent, const char *system,
-			const char *sys_dir)
+static int read_whole_file(const char *file, char **buffer)
 {
-	struct dirent *dent;
 	struct stat st;
+	char *buf;
+	int len = -1;
+	int fd;
+
+	fd = open(file, O_RDONLY);
+	if (fd < 0)
+		return -1;
+
+	if (fstat(fd, &st) < 0 || st.st_size > INT_MAX - 1)
+		goto out;
+
+	buf = malloc(st.st_size + 1);
+	if (!buf)
+		goto out;
+
+	if (read(fd, buf, st.st_size) != st.st_size) {
+		free(buf);
+		goto out;
+	}
+
+	len = st.st_size;
+	buf[len] = 0;
+	*buffer = buf;
+ out:
+	close(fd);
+
+	return len;
+}
+
+/* Minimum number of format files, read by one thread */
+#define FORMATS_PER_THREAD	64
+#define MAX_FORMAT_THREADS	16
+
+struct format_reader {
+	struct event_format_file	*files;
+	int				nr;
+	int				next;
+};
+
+static void *read_formats_thread(void *data)
+{
+	struct format_reader *reader = data;
+	struct event_format_file *file;
+	int i;
+
+	while ((i = __atomic_fetch_add(&reader->next, 1,
+				       __ATOMIC_RELAXED)) < reader->nr) {
+		file = &reader->files[i];
+		file->len = read_file(file->path, &file->buf);
+		if (file->len < 0)
+			file->buf = NULL;
+	}
+
+	return NULL;
+}
+
+/**
+ * tracecmd_read_format_files - read the format files of events
+ * @files: The files to read
+ * @nr: The number of files
+ *
+ * Reading the files of the tracing directory is slow, hence the files
+ * are read by a pool of threads. The content of each file is stored
+ * in its @buf and the size in its @len (-1 if it could not be read).
+ */
+void tracecmd_read_format_files(struct event_format_file *files, int nr)
+{
+	struct format_reader reader = { files, nr, 0 };
+	pthread_t threads[MAX_FORMAT_THREADS];
+	int nr_threads;
+	long cpus;
+	int i;
+
+	nr_threads = nr / FORMATS_PER_THREAD;
+	cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (cpus > 0 && nr_threads > cpus)
+		nr_threads = cpus;
+	if (nr_threads > MAX_FORMAT_THREADS)
+		nr_threads = MAX_FORMAT_THREADS;
+
+	/* The calling thread is one of the readers */
+	for (i = 0; i < nr_threads - 1; i++) {
+		if (pthread_create(&threads[i], NULL,
+				   read_formats_thread, &reader))
+			break;
+	}
+	nr_threads = i;
+
+	read_formats_thread(&reader);
+
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(threads[i], NULL);
+}
+
+/**
+ * tracecmd_free_format_files - free the format files of events
+ * @files: The files to free
+ * @nr: The number of files
+ */
+void tracecmd_free_format_files(struct event_format_file *files, int nr)
+{
+	int i;
+
+	if (!files)
+		return;
+
+	for (i = 0; i < nr; i++) {
+		free(files[i].system);
+		free(files[i].event);
+		free(files[i].path);
+		free(files[i].buf);
+	}
+	free(files);
+}
+
+static int add_format_file(struct event_format_file **files, int *nr,
+			   const char *events_dir, const char *system,
+			   const char *event)
+{
+	struct event_format_file *file;
+	int ret;
+
+	/* Grow the array each time its size is a power of two */
+	if (*nr >= 64 && !(*nr & (*nr - 1))) {
+		file = realloc(*files, *nr * 2 * sizeof(*file));
+		if (!file)
+			return -1;
+		*files = file;
+	}
+
+	file = &(*files)[*nr];
+	memset(file, 0, sizeof(*file));
+	file->len = -1;
+	(*nr)++;
+
+	file->system = strdup(system);
+	file->event = strdup(event);
+	if (!file->system || !file->event)
+		return -1;
+
+	ret = asprintf(&file->path, "%s/%s/%s/format",
+		       events_dir, system, file->event);
+	if (ret < 0) {
+		file->path = NULL;
+		return -1;
+	}
+
+	return 0;
+}
+
+static bool is_dir(const char *path, struct dirent *dent)
+{
+	struct stat st;
+
+	if (dent->d_type != DT_UNKNOWN)
+		return dent->d_type == DT_DIR;
+
+	return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+static struct event_format_file *
+list_format_files(const char *events_dir, int *nr)
+{
+	struct event_format_file *files;
+	struct dirent *dent;
+	struct dirent *edent;
+	DIR *sys_dir;
 	DIR *dir;
-	int len = 0;
-	int ret = 0, failure = 0;
+	char *event;
+	char *sys;
+	int ret = 0;
 
-	ret = stat(sys_dir, &st);
-	if (ret < 0 || !S_ISDIR(st.st_mode))
-		return EINVAL;
+	*nr = 0;
+	files = malloc(64 * sizeof(*files));
+	if (!files)
+		return NULL;
 
-	dir = opendir(sys_dir);
+	dir = opendir(events_dir);
 	if (!dir)
-		return errno;
+		return files;
 
-	while ((dent = readdir(dir))) {
+	while (!ret && (dent = readdir(dir))) {
 		const char *name = dent->d_name;
-		char *event;
-		char *format;
-		char *buf;
 
 		if (strcmp(name, ".") == 0 ||
 		    strcmp(name, "..") == 0)
 			continue;
 
-		event = append_file(sys_dir, name);
-		ret = stat(event, &st);
-		if (ret < 0 || !S_ISDIR(st.st_mode))
-			goto free_event;
+		sys = append_file(events_dir, name);
+		if (!sys) {
+			ret = -1;
+			break;
+		}
 
-		format = append_file(event, "format");
-		ret = stat(format, &st);
-		if (ret < 0)
-			goto free_format;
+		sys_dir = is_dir(sys, dent) ? opendir(sys) : NULL;
+		while (!ret && sys_dir && (edent = readdir(sys_dir))) {
+			if (strcmp(edent->d_name, ".") == 0 ||
+			    strcmp(edent->d_name, "..") == 0)
+				continue;
 
-		len = read_file(format, &buf);
-		if (len < 0)
-			goto free_format;
+			event = append_file(sys, edent->d_name);
+			if (!event) {
+				ret = -1;
+				break;
+			}
+			if (is_dir(event, edent))
+				ret = add_format_file(&files, nr, events_dir,
+						      name, edent->d_name);
+			free(event);
+		}
 
-		ret = tep_parse_event(pevent, buf, len, system);
-		free(buf);
- free_format:
-		free(format);
- free_event:
-		free(event);
-		if (ret)
-			failure = ret;
+		if (sys_dir)
+			closedir(sys_dir);
+		free(sys);
 	}
 
 	closedir(dir);
-	return failure;
+
+	if (ret) {
+		tracecmd_free_format_files(files, *nr);
+		return NULL;
+	}
+
+	return files;
+}
+
+/* Compare "a/" with "b/", as glob() sorts the paths of the files */
+static int compare_path_names(const char *a, const char *b)
+{
+	unsigned char ca, cb;
+
+	while (*a && *a == *b) {
+		a++;
+		b++;
+	}
+
+	ca = *a ? *a : '/';
+	cb = *b ? *b : '/';
+
+	return ca - cb;
+}
+
+static int compare_format_files(const void *a, const void *b)
+{
+	const struct event_format_file *fa = a;
+	const struct event_format_file *fb = b;
+	int ret;
+
+	ret = compare_path_names(fa->system, fb->system);
+	if (ret)
+		return ret;
+
+	return compare_path_names(fa->event, fb->event);
+}
+
+/*
+ * The format files can be cached in the directory given by the
+ * TRACECMD_EVENT_CACHE environment variable. The cache is a copy of
+ * the format files of all events, valid as long as the kernel, its
+ * modules and the set of the events do not change.
+ */
+#define FORMAT_CACHE_ENV	"TRACECMD_EVENT_CACHE"
+#define FORMAT_CACHE_MAGIC	"trace-cmd formats 1"
+
+struct format_cache_header {
+	char			magic[sizeof(FORMAT_CACHE_MAGIC)];
+	unsigned long long	key;
+	unsigned int		nr;
+};
+
+/* The lengths of the system, the event and the format of each file */
+struct format_cache_entry {
+	unsigned int		system;
+	unsigned int		event;
+	unsigned int		format;
+};
+
+/**
+ * tracecmd_format_cache_enabled - test if the format files are cached
+ *
+ * Returns true if the format files of the events are cached on the
+ * disk, i.e. the TRACECMD_EVENT_CACHE environment variable is set.
+ */
+bool tracecmd_format_cache_enabled(void)
+{
+	const char *dir = getenv(FORMAT_CACHE_ENV);
+
+	return dir && *dir;
+}
+
+static unsigned long long hash_buf(unsigned long long hash,
+				   const void *data, size_t size)
+{
+	const unsigned char *p = data;
+	size_t i;
+
+	/* FNV-1a */
+	for (i = 0; i < size; i++) {
+		hash ^= p[i];
+		hash *= 0x100000001b3ULL;
+	}
+
+	return hash;
+}
+
+static unsigned long long hash_str(unsigned long long hash, const char *str)
+{
+	return hash_buf(hash, str, strlen(str) + 1);
+}
+
+static unsigned long long hash_file(unsigned long long hash, const char *file)
+{
+	char *buf;
+	int len;
+
+	len = read_file(file, &buf);
+	hash = hash_buf(hash, &len, sizeof(len));
+	if (len < 0)
+		return hash;
+
+	hash = hash_buf(hash, buf, len);
+	free(buf);
+
+	return hash;
+}
+
+static unsigned long long hash_modules(unsigned long long hash)
+{
+	char *line, *next, *end;
+	char *buf;
+	int len;
+
+	len = read_file("/proc/modules", &buf);
+	if (len < 0)
+		return hash;
+
+	/* Only the name and the size of a module do not change over time */
+	for (line = buf; *line; line = next) {
+		next = strchr(line, '\n');
+		next = next ? next + 1 : line + strlen(line);
+
+		end = memchr(line, ' ', next - line);
+		if (end)
+			end = memchr(end + 1, ' ', next - end - 1);
+		if (!end)
+			end = next;
+
+		hash = hash_buf(hash, line, end - line);
+	}
+	free(buf);
+
+	return hash;
+}
+
+static unsigned long long format_cache_key(const char *tracing_dir)
+{
+	static const char * const files[] = {
+		"available_events",
+		"dynamic_events",
+		"kprobe_events",
+		"uprobe_events",
+	};
+	unsigned long long hash = 0xcbf29ce484222325ULL;
+	struct utsname uts;
+	char *file;
+	int i;
+
+	hash = hash_str(hash, tracing_dir);
+
+	if (uname(&uts) == 0) {
+		hash = hash_str(hash, uts.sysname);
+		hash = hash_str(hash, uts.release);
+		hash = hash_str(hash, uts.version);
+		hash = hash_str(hash, uts.machine);
+	}
+
+	/* The notes of the kernel contain its build-id */
+	hash = hash_file(hash, "/sys/kernel/notes");
+
+	/* Loading modules and adding dynamic events change the events */
+	for (i = 0; i < ARRAY_SIZE(files); i++) {
+		file = append_file(tracing_dir, files[i]);
+		if (!file)
+			continue;
+		hash = hash_file(hash, file);
+		free(file);
+	}
+
+	return hash_modules(hash);
+}
+
+static char *format_cache_file(void)
+{
+	struct utsname uts;
+	char *file;
+	int ret;
+
+	if (uname(&uts) < 0)
+		return NULL;
+
+	ret = asprintf(&file, "%s/formats-%s",
+		       getenv(FORMAT_CACHE_ENV), uts.release);
+
+	return ret < 0 ? NULL : file;
+}
+
+static struct event_format_file *
+load_format_cache(const char *cache, const char *events_dir,
+		  unsigned long long key, int *nr)
+{
+	struct format_cache_header header;
+	struct format_cache_entry entry;
+	struct event_format_file *files;
+	struct event_format_file *file;
+	char *buf;
+	char *end;
+	char *p;
+	int len;
+	int ret;
+
+	len = read_whole_file(cache, &buf);
+	if (len < 0)
+		return NULL;
+
+	files = NULL;
+	*nr = 0;
+
+	if (len < sizeof(header))
+		goto out;
+
+	memcpy(&header, buf, sizeof(header));
+	if (memcmp(header.magic, FORMAT_CACHE_MAGIC, sizeof(header.magic)) ||
+	    header.key != key || header.nr > len / sizeof(entry))
+		goto out;
+
+	files = calloc(header.nr ? header.nr : 1, sizeof(*files));
+	if (!files)
+		goto out;
+
+	p = buf + sizeof(header);
+	end = buf + len;
+	for (; *nr < header.nr; (*nr)++) {
+		file = &files[*nr];
+		file->len = -1;
+
+		if (end - p < sizeof(entry))
+			goto fail;
+		memcpy(&entry, p, sizeof(entry));
+		p += sizeof(entry);
+
+		if (entry.system > end - p ||
+		    entry.event > end - p - entry.system ||
+		    entry.format > end - p - entry.system - entry.event)
+			goto fail;
+
+		file->system = strndup(p, entry.system);
+		p += entry.system;
+		file->event = strndup(p, entry.event);
+		p += entry.event;
+		file->buf = malloc(entry.format + 1);
+		if (!file->system || !file->event || !file->buf)
+			goto fail;
+
+		memcpy(file->buf, p, entry.format);
+		file->buf[entry.format] = 0;
+		file->len = entry.format;
+		p += entry.format;
+
+		ret = asprintf(&file->path, "%s/%s/%s/format",
+			       events_dir, file->system, file->event);
+		if (ret < 0) {
+			file->path = NULL;
+			goto fail;
+		}
+	}
+
+	if (p != end)
+		goto fail;
+ out:
+	free(buf);
+	return files;
+
+ fail:
+	tracecmd_free_format_files(files, header.nr);
+	files = NULL;
+	goto out;
+}
+
+static void store_format_cache(const char *cache, unsigned long long key,
+			       struct event_format_file *files, int nr)
+{
+	struct format_cache_header header;
+	struct format_cache_entry entry;
+	size_t size = sizeof(header);
+	char *tmp = NULL;
+	char *buf;
+	char *p;
+	int fd = -1;
+	int i;
+
+	for (i = 0; i < nr; i++) {
+		/* Do not cache the files which failed to be read */
+		if (files[i].len < 0)
+			return;
+		size += sizeof(entry) + strlen(files[i].system) +
+			strlen(files[i].event) + files[i].len;
+	}
+
+	buf = malloc(size);
+	if (!buf)
+		return;
+
+	memset(&header, 0, sizeof(header));
+	strcpy(header.magic, FORMAT_CACHE_MAGIC);
+	header.key = key;
+	header.nr = nr;
+	memcpy(buf, &header, sizeof(header));
+	p = buf + sizeof(header);
+	for (i = 0; i < nr; i++) {
+		entry.system = strlen(files[i].system);
+		entry.event = strlen(files[i].event);
+		entry.format = files[i].len;
+		memcpy(p, &entry, sizeof(entry));
+		p += sizeof(entry);
+		memcpy(p, files[i].system, entry.system);
+		p += entry.system;
+		memcpy(p, files[i].event, entry.event);
+		p += entry.event;
+		memcpy(p, files[i].buf, entry.format);
+		p += entry.format;
+	}
+
+	if (mkdir(getenv(FORMAT_CACHE_ENV), 0755) < 0 && errno != EEXIST)
+		goto out;
+
+	/* Replace the cache at once, other trace-cmd may be reading it */
+	if (asprintf(&tmp, "%s.XXXXXX", cache) < 0) {
+		tmp = NULL;
+		goto out;
+	}
+
+	fd = mkstemp(tmp);
+	if (fd < 0)
+		goto out;
+
+	if (__do_write_check(fd, buf, size) || rename(tmp, cache) < 0)
+		unlink(tmp);
+ out:
+	if (fd >= 0)
+		close(fd);
+	free(tmp);
+	free(buf);
+
+	/*
+	 * The cache is optional. Do not leave its errors (or EEXIST of the
+	 * directory) to be reported by the next warning().
+	 */
+	errno = 0;
+}
+
+/**
+ * tracecmd_local_format_files - read the format files of all events
+ * @tracing_dir: The directory that contains the events.
+ * @nr: Returns the number of the files
+ *
+ * Returns the array of the format files of all events of the system,
+ * sorted as the paths of the files are sorted by glob(). If caching is
+ * enabled (see tracecmd_format_cache_enabled()) and the events did not
+ * change since they were cached, the files are read from the cache.
+ * The array must be freed with tracecmd_free_format_files().
+ */
+struct event_format_file *
+tracecmd_local_format_files(const char *tracing_dir, int *nr)
+{
+	struct event_format_file *files = NULL;
+	unsigned long long key = 0;
+	char *events_dir;
+	char *cache = NULL;
+
+	events_dir = append_file(tracing_dir, "events");
+	if (!events_dir)
+		return NULL;
+
+	if (tracecmd_format_cache_enabled()) {
+		cache = format_cache_file();
+		key = format_cache_key(tracing_dir);
+	}
+
+	if (cache)
+		files = load_format_cache(cache, events_dir, key, nr);
+
+	if (!files) {
+		files = list_format_files(events_dir, nr);
+		if (!files)
+			goto out;
+
+		tracecmd_read_format_files(files, *nr);
+		qsort(files, *nr, sizeof(*files), compare_format_files);
+
+		if (cache)
+			store_format_cache(cache, key, files, *nr);
+	}
+ out:
+	free(events_dir);
+	free(cache);
+
+	return files;
 }
 
 static int read_header(struct tep_handle *pevent, const char *events_dir)
@@ -647,11 +1238,13 @@ struct tep_handle *tracecmd_local_events(const char *tracing_dir)
 int tracecmd_fill_local_events(const char *tracing_dir,
 			       struct tep_handle *pevent, int *parsing_failures)
 {
-	struct dirent *dent;
+	struct event_format_file *files;
 	char *events_dir;
 	struct stat st;
-	DIR *dir;
+	int failure;
 	int ret;
+	int nr;
+	int i, j;
 
 	if (!tracing_dir)
 		return -1;
@@ -668,42 +1261,35 @@ int tracecmd_fill_local_events(const char *tracing_dir,
 		goto out_free;
 	}
 
-	dir = opendir(events_dir);
-	if (!dir) {
+	ret = read_header(pevent, events_dir);
+	if (ret < 0) {
 		ret = -1;
 		goto out_free;
 	}
 
-	ret = read_header(pevent, events_dir);
-	if (ret < 0) {
+	files = tracecmd_local_format_files(tracing_dir, &nr);
+	if (!files) {
 		ret = -1;
 		goto out_free;
 	}
 
-	while ((dent = readdir(dir))) {
-		const char *name = dent->d_name;
-		char *sys;
-
-		if (strcmp(name, ".") == 0 ||
-		    strcmp(name, "..") == 0)
-			continue;
-
-		sys = append_file(events_dir, name);
-		ret = stat(sys, &st);
-		if (ret < 0 || !S_ISDIR(st.st_mode)) {
-			free(sys);
-			continue;
+	/* The files of a system are next to each other */
+	for (i = 0; i < nr; i = j) {
+		failure = 0;
+		for (j = i; j < nr; j++) {
+			if (strcmp(files[j].system, files[i].system) != 0)
+				break;
+			if (files[j].len < 0 ||
+			    tep_parse_event(pevent, files[j].buf, files[j].len,
+					    files[j].system))
+				failure = 1;
 		}
 
-		ret = load_events(pevent, name, sys);
-
-		free(sys);
-
-		if (ret && parsing_failures)
+		if (failure && parsing_failures)
 			(*parsing_failures)++;
 	}
 
-	closedir(dir);
+	tracecmd_free_format_files(files, nr);
 	/* always succeed because parsing failures are not critical */
 	ret = 0;
 
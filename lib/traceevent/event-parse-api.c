@@ -19,7 +19,7 @@
 struct tep_event *tep_get_event(struct tep_handle *tep, int index)
 {
 	if (tep && tep->events && index < tep->nr_events)
-		return tep->events[index];
+		return tep_parse_lazy_event(tep->events[index]);
 
 	return NULL;
 }
@@ -7,10 +7,13 @@
 #ifndef _PARSE_EVENTS_INT_H
 #define _PARSE_EVENTS_INT_H
 
+#include <pthread.h>
+
 struct tep_cmdline;
-struct cmdline_list;
+struct cmdline_table;
 struct func_map;
-struct func_list;
+struct printk_map;
+struct str_pool;
 struct event_handler;
 struct func_resolver;
 
@@ -34,18 +37,29 @@ struct tep_handle {
 	int long_size;
 	int page_size;
 
+	struct cmdline_table *cmdline_table;
 	struct tep_cmdline *cmdlines;
-	struct cmdline_list *cmdlist;
 	int cmdline_count;
+	/* Serializes adding the command lines */
+	pthread_mutex_t cmdline_lock;
 
+	/* Sorted by address once func_index is built */
 	struct func_map *func_map;
+	unsigned long long *func_index;
+	unsigned int *func_ranks;
 	struct func_resolver *func_resolver;
-	struct func_list *funclist;
 	unsigned int func_count;
+	unsigned int func_alloc;
 
 	struct printk_map *printk_map;
-	struct printk_list *printklist;
 	unsigned int printk_count;
+	unsigned int printk_alloc;
+	bool printk_sorted;
+	/* Serializes building the function index and sorting printk_map */
+	pthread_mutex_t lookup_lock;
+
+	/* The strings of the functions and printk formats */
+	struct str_pool *str_pool;
 
 
 	struct tep_event **events;
@@ -84,6 +98,7 @@ struct tep_handle {
 };
 
 void tep_free_event(struct tep_event *event);
+struct tep_event *tep_parse_lazy_event(struct tep_event *event);
 void tep_free_format_field(struct tep_format_field *field);
 
 unsigned short tep_data2host2(struct tep_handle *tep, unsigned short data);
@@ -27,14 +27,21 @@
 #include "event-utils.h"
 #include "trace-seq.h"
 
-static const char *input_buf;
-static unsigned long long input_buf_ptr;
-static unsigned long long input_buf_siz;
+/*
+ * The state of the parser is kept per thread, as the events added by
+ * tep_parse_event_lazy() are parsed by the thread that looks them up.
+ */
+static __thread const char *input_buf;
+static __thread unsigned long long input_buf_ptr;
+static __thread unsigned long long input_buf_siz;
+
+static __thread int is_flag_field;
+static __thread int is_symbolic_field;
 
-static int is_flag_field;
-static int is_symbolic_field;
+static __thread int show_warning = 1;
 
-static int show_warning = 1;
+/* Serializes parsing the rest of the lazy events */
+static pthread_mutex_t lazy_lock = PTHREAD_MUTEX_INITIALIZER;
 
 #define do_warning(fmt, ...)				\
 	do {						\
@@ -54,6 +61,25 @@ static int show_warning = 1;
 			warning(fmt, ##__VA_ARGS__);		\
 	} while (0)
 
+/*
+ * Disable the warnings of the calling thread if @tep is quiet. Returns
+ * the previous state, to be passed to restore_warnings().
+ */
+static int silence_warnings(struct tep_handle *tep)
+{
+	int save = show_warning;
+
+	if (tep && (tep->flags & TEP_QUIET))
+		show_warning = 0;
+
+	return save;
+}
+
+static void restore_warnings(int save)
+{
+	show_warning = save;
+}
+
 static void init_input_buf(const char *buf, unsigned long long size)
 {
 	input_buf = buf;
@@ -124,96 +150,269 @@ struct tep_print_arg *alloc_arg(void)
 	return calloc(1, sizeof(struct tep_print_arg));
 }
 
+/*
+ * The command lines are registered in a list until the first lookup,
+ * that may have several entries for a pid. The first lookup resolves
+ * them, and moves the command lines into a hash table of the pids. The
+ * table can be read by several threads while a command line is being
+ * added. Its entries are never removed or moved, and when the table
+ * grows, the old table is kept until the handle is freed. The other
+ * command lines of a pid are kept as its history, hence the returned
+ * strings stay valid too.
+ */
+struct cmdline_comm {
+	struct cmdline_comm	*prev;
+	char			comm[];
+};
+
 struct tep_cmdline {
-	char *comm;
-	int pid;
+	/* All command lines, the newest first */
+	struct tep_cmdline	*next;
+	struct cmdline_comm	*comm;
+	int			pid;
 };
 
-static int cmdline_cmp(const void *a, const void *b)
+struct cmdline_table {
+	struct cmdline_table	*old;
+	unsigned int		bits;
+	struct tep_cmdline	*slots[];
+};
+
+#define CMDLINE_TABLE_BITS	10
+
+static inline unsigned int cmdline_hash(int pid, unsigned int bits)
 {
-	const struct tep_cmdline *ca = a;
-	const struct tep_cmdline *cb = b;
+	/* Multiplicative hashing. Use the high bits of the product. */
+	return ((unsigned int)pid * 2654435761U) >> (32 - bits);
+}
 
-	if (ca->pid < cb->pid)
-		return -1;
-	if (ca->pid > cb->pid)
-		return 1;
+static void insert_cmdline(struct cmdline_table *table,
+			   struct tep_cmdline *cmdline)
+{
+	unsigned int mask = (1U << table->bits) - 1;
+	unsigned int i;
 
-	return 0;
+	i = cmdline_hash(cmdline->pid, table->bits);
+	while (table->slots[i])
+		i = (i + 1) & mask;
+
+	__atomic_store_n(&table->slots[i], cmdline, __ATOMIC_RELEASE);
 }
 
-/* Looking for where to place the key */
-static int cmdline_slot_cmp(const void *a, const void *b)
+/* Must be called with the cmdline_lock held */
+static int grow_cmdline_table(struct tep_handle *tep, int count)
 {
-	const struct tep_cmdline *ca = a;
-	const struct tep_cmdline *cb = b;
-	const struct tep_cmdline *cb1 = cb + 1;
+	struct cmdline_table *old = tep->cmdline_table;
+	struct cmdline_table *table;
+	unsigned int bits = CMDLINE_TABLE_BITS;
+	unsigned int i;
 
-	if (ca->pid < cb->pid)
+	if (old)
+		bits = old->bits;
+
+	/* Keep the table at most half full */
+	while (count * 2 > (1 << bits))
+		bits++;
+
+	if (old && bits == old->bits)
+		return 0;
+
+	table = calloc(1, sizeof(*table) + sizeof(*table->slots) * (1 << bits));
+	if (!table)
 		return -1;
 
-	if (ca->pid > cb->pid) {
-		if (ca->pid <= cb1->pid)
-			return 0;
-		return 1;
+	table->bits = bits;
+	table->old = old;
+
+	if (old) {
+		for (i = 0; i < (1U << old->bits); i++) {
+			if (old->slots[i])
+				insert_cmdline(table, old->slots[i]);
+		}
 	}
 
+	/* Readers that still use the old table will find what it has */
+	__atomic_store_n(&tep->cmdline_table, table, __ATOMIC_RELEASE);
+
 	return 0;
 }
 
-struct cmdline_list {
-	struct cmdline_list	*next;
-	char			*comm;
+static struct cmdline_comm *alloc_cmdline_comm(const char *comm,
+					       struct cmdline_comm *prev)
+{
+	struct cmdline_comm *item;
+	size_t len = strlen(comm) + 1;
+
+	item = malloc(sizeof(*item) + len);
+	if (!item)
+		return NULL;
+
+	item->prev = prev;
+	memcpy(item->comm, comm, len);
+
+	return item;
+}
+
+/*
+ * Return where to add @comm to the end of the history of @cmdline, or
+ * NULL if the pid already had it.
+ */
+static struct cmdline_comm **history_end(struct tep_cmdline *cmdline,
+					 const char *comm)
+{
+	struct cmdline_comm **last = &cmdline->comm;
+
+	while (*last) {
+		if (strcmp((*last)->comm, comm) == 0)
+			return NULL;
+		last = &(*last)->prev;
+	}
+
+	return last;
+}
+
+struct cmdline_sort {
+	struct tep_cmdline	*cmdline;
 	int			pid;
 };
 
+static int cmdline_cmp(const void *a, const void *b)
+{
+	const struct cmdline_sort *ca = a;
+	const struct cmdline_sort *cb = b;
+
+	if (ca->pid < cb->pid)
+		return -1;
+	if (ca->pid > cb->pid)
+		return 1;
+
+	return 0;
+}
+
+/*
+ * Resolve the command lines registered before the first lookup, and
+ * move them into the hash table. If a pid was registered several times,
+ * the command line returned for it is the one found by a binary search
+ * of the entries sorted by pid, as it has always been. The others are
+ * kept as its history. Must be called with the cmdline_lock held.
+ */
 static int cmdline_init(struct tep_handle *tep)
 {
-	struct cmdline_list *cmdlist = tep->cmdlist;
-	struct cmdline_list *item;
-	struct tep_cmdline *cmdlines;
-	int i;
+	struct tep_cmdline *cmdline, *winner, *list = NULL;
+	struct cmdline_sort *sorted, *found;
+	struct cmdline_comm **last;
+	int i, j, n = tep->cmdline_count;
+	int count = 0;
 
-	cmdlines = malloc(sizeof(*cmdlines) * tep->cmdline_count);
-	if (!cmdlines)
+	sorted = malloc(sizeof(*sorted) * (n ? n : 1));
+	if (!sorted)
 		return -1;
 
-	i = 0;
-	while (cmdlist) {
-		cmdlines[i].pid = cmdlist->pid;
-		cmdlines[i].comm = cmdlist->comm;
-		i++;
-		item = cmdlist;
-		cmdlist = cmdlist->next;
-		free(item);
+	for (i = 0, cmdline = tep->cmdlines; cmdline; cmdline = cmdline->next) {
+		sorted[i].cmdline = cmdline;
+		sorted[i++].pid = cmdline->pid;
 	}
 
-	qsort(cmdlines, tep->cmdline_count, sizeof(*cmdlines), cmdline_cmp);
+	qsort(sorted, n, sizeof(*sorted), cmdline_cmp);
+
+	for (i = 0; i < n; i = j) {
+		for (j = i + 1; j < n && sorted[j].pid == sorted[i].pid; j++)
+			;
+
+		found = bsearch(&sorted[i], sorted, n, sizeof(*sorted),
+				cmdline_cmp);
+		winner = found->cmdline;
+
+		for (; i < j; i++) {
+			cmdline = sorted[i].cmdline;
+			if (cmdline == winner)
+				continue;
 
-	tep->cmdlines = cmdlines;
-	tep->cmdlist = NULL;
+			last = history_end(winner, cmdline->comm->comm);
+			if (last)
+				__atomic_store_n(last, cmdline->comm,
+						 __ATOMIC_RELEASE);
+			else
+				free(cmdline->comm);
+			free(cmdline);
+		}
+
+		winner->next = list;
+		list = winner;
+		count++;
+	}
+
+	free(sorted);
+
+	tep->cmdlines = list;
+	tep->cmdline_count = count;
+
+	if (grow_cmdline_table(tep, count))
+		return -1;
+
+	for (cmdline = list; cmdline; cmdline = cmdline->next)
+		insert_cmdline(tep->cmdline_table, cmdline);
 
 	return 0;
 }
 
+static struct cmdline_table *get_cmdline_table(struct tep_handle *tep)
+{
+	struct cmdline_table *table;
+
+	table = __atomic_load_n(&tep->cmdline_table, __ATOMIC_ACQUIRE);
+	if (table)
+		return table;
+
+	pthread_mutex_lock(&tep->cmdline_lock);
+	if (!tep->cmdline_table)
+		cmdline_init(tep);
+	table = tep->cmdline_table;
+	pthread_mutex_unlock(&tep->cmdline_lock);
+
+	return table;
+}
+
+static struct tep_cmdline *find_cmdline_entry(struct tep_handle *tep, int pid)
+{
+	struct cmdline_table *table;
+	struct tep_cmdline *cmdline;
+	unsigned int mask;
+	unsigned int i;
+
+	table = get_cmdline_table(tep);
+	if (!table)
+		return NULL;
+
+	mask = (1U << table->bits) - 1;
+	i = cmdline_hash(pid, table->bits);
+	while ((cmdline = __atomic_load_n(&table->slots[i], __ATOMIC_ACQUIRE))) {
+		if (cmdline->pid == pid)
+			return cmdline;
+		i = (i + 1) & mask;
+	}
+
+	return NULL;
+}
+
+static const char *cmdline_comm(struct tep_cmdline *cmdline)
+{
+	return __atomic_load_n(&cmdline->comm, __ATOMIC_ACQUIRE)->comm;
+}
+
 static const char *find_cmdline(struct tep_handle *tep, int pid)
 {
-	const struct tep_cmdline *comm;
-	struct tep_cmdline key;
+	struct tep_cmdline *cmdline;
 
 	if (!pid)
 		return "<idle>";
 
-	if (!tep->cmdlines && cmdline_init(tep))
+	if (!get_cmdline_table(tep))
 		return "<not enough memory for cmdlines!>";
 
-	key.pid = pid;
-
-	comm = bsearch(&key, tep->cmdlines, tep->cmdline_count,
-		       sizeof(*tep->cmdlines), cmdline_cmp);
-
-	if (comm)
-		return comm->comm;
+	cmdline = find_cmdline_entry(tep, pid);
+	if (cmdline)
+		return cmdline_comm(cmdline);
 	return "<...>";
 }
 
@@ -227,104 +426,75 @@ static const char *find_cmdline(struct tep_handle *tep, int pid)
  */
 bool tep_is_pid_registered(struct tep_handle *tep, int pid)
 {
-	const struct tep_cmdline *comm;
-	struct tep_cmdline key;
-
 	if (!pid)
 		return true;
 
-	if (!tep->cmdlines && cmdline_init(tep))
-		return false;
-
-	key.pid = pid;
-
-	comm = bsearch(&key, tep->cmdlines, tep->cmdline_count,
-		       sizeof(*tep->cmdlines), cmdline_cmp);
-
-	if (comm)
-		return true;
-	return false;
+	return find_cmdline_entry(tep, pid) != NULL;
 }
 
-/*
- * If the command lines have been converted to an array, then
- * we must add this pid. This is much slower than when cmdlines
- * are added before the array is initialized.
- */
+/* Must be called with the cmdline_lock held */
 static int add_new_comm(struct tep_handle *tep,
 			const char *comm, int pid, bool override)
 {
-	struct tep_cmdline *cmdlines = tep->cmdlines;
+	struct cmdline_comm **last;
 	struct tep_cmdline *cmdline;
-	struct tep_cmdline key;
-	char *new_comm;
-	int cnt;
+	struct cmdline_comm *item;
 
-	if (!pid)
-		return 0;
-
-	/* avoid duplicates */
-	key.pid = pid;
-
-	cmdline = bsearch(&key, tep->cmdlines, tep->cmdline_count,
-			  sizeof(*tep->cmdlines), cmdline_cmp);
+	cmdline = find_cmdline_entry(tep, pid);
 	if (cmdline) {
-		if (!override) {
+		if (strcmp(cmdline_comm(cmdline), comm) == 0) {
+			if (override)
+				return 0;
 			errno = EEXIST;
 			return -1;
 		}
-		new_comm = strdup(comm);
-		if (!new_comm) {
-			errno = ENOMEM;
-			return -1;
+
+		if (override) {
+			item = alloc_cmdline_comm(comm, cmdline->comm);
+			if (!item) {
+				errno = ENOMEM;
+				return -1;
+			}
+
+			/* The previous command lines are kept behind it */
+			__atomic_store_n(&cmdline->comm, item, __ATOMIC_RELEASE);
+			return 0;
 		}
-		free(cmdline->comm);
-		cmdline->comm = new_comm;
 
-		return 0;
-	}
+		/* The pid keeps its command line, remember the other one */
+		last = history_end(cmdline, comm);
+		if (last) {
+			item = alloc_cmdline_comm(comm, NULL);
+			if (item)
+				__atomic_store_n(last, item, __ATOMIC_RELEASE);
+		}
 
-	cmdlines = realloc(cmdlines, sizeof(*cmdlines) * (tep->cmdline_count + 1));
-	if (!cmdlines) {
-		errno = ENOMEM;
+		errno = EEXIST;
 		return -1;
 	}
-	tep->cmdlines = cmdlines;
 
-	key.comm = strdup(comm);
-	if (!key.comm) {
+	if (grow_cmdline_table(tep, tep->cmdline_count + 1)) {
 		errno = ENOMEM;
 		return -1;
 	}
 
-	if (!tep->cmdline_count) {
-		/* no entries yet */
-		tep->cmdlines[0] = key;
-		tep->cmdline_count++;
-		return 0;
+	cmdline = malloc(sizeof(*cmdline));
+	if (!cmdline) {
+		errno = ENOMEM;
+		return -1;
 	}
 
-	/* Now find where we want to store the new cmdline */
-	cmdline = bsearch(&key, tep->cmdlines, tep->cmdline_count - 1,
-			  sizeof(*tep->cmdlines), cmdline_slot_cmp);
-
-	cnt = tep->cmdline_count;
-	if (cmdline) {
-		/* cmdline points to the one before the spot we want */
-		cmdline++;
-		cnt -= cmdline - tep->cmdlines;
-
-	} else {
-		/* The new entry is either before or after the list */
-		if (key.pid > tep->cmdlines[tep->cmdline_count - 1].pid) {
-			tep->cmdlines[tep->cmdline_count++] = key;
-			return 0;
-		}
-		cmdline = &tep->cmdlines[0];
+	cmdline->comm = alloc_cmdline_comm(comm, NULL);
+	if (!cmdline->comm) {
+		free(cmdline);
+		errno = ENOMEM;
+		return -1;
 	}
-	memmove(cmdline + 1, cmdline, (cnt * sizeof(*cmdline)));
-	*cmdline = key;
+	cmdline->pid = pid;
+	cmdline->next = tep->cmdlines;
 
+	insert_cmdline(tep->cmdline_table, cmdline);
+	__atomic_store_n(&tep->cmdlines, cmdline, __ATOMIC_RELEASE);
 	tep->cmdline_count++;
 
 	return 0;
@@ -333,30 +503,50 @@ static int add_new_comm(struct tep_handle *tep,
 static int _tep_register_comm(struct tep_handle *tep,
 			      const char *comm, int pid, bool override)
 {
-	struct cmdline_list *item;
+	struct tep_cmdline *cmdline;
+	int ret = -1;
 
-	if (tep->cmdlines)
-		return add_new_comm(tep, comm, pid, override);
+	if (!pid)
+		return 0;
 
-	item = malloc(sizeof(*item));
-	if (!item)
-		return -1;
+	if (!comm)
+		comm = "<...>";
 
-	if (comm)
-		item->comm = strdup(comm);
-	else
-		item->comm = strdup("<...>");
-	if (!item->comm) {
-		free(item);
-		return -1;
+	pthread_mutex_lock(&tep->cmdline_lock);
+
+	if (tep->cmdline_table || override) {
+		if (!tep->cmdline_table && cmdline_init(tep)) {
+			errno = ENOMEM;
+			goto out;
+		}
+		ret = add_new_comm(tep, comm, pid, override);
+		goto out;
 	}
-	item->pid = pid;
-	item->next = tep->cmdlist;
 
-	tep->cmdlist = item;
+	/* No lookup yet, the pid is resolved by the first one */
+	cmdline = malloc(sizeof(*cmdline));
+	if (!cmdline) {
+		errno = ENOMEM;
+		goto out;
+	}
+
+	cmdline->comm = alloc_cmdline_comm(comm, NULL);
+	if (!cmdline->comm) {
+		free(cmdline);
+		errno = ENOMEM;
+		goto out;
+	}
+	cmdline->pid = pid;
+	cmdline->next = tep->cmdlines;
+
+	__atomic_store_n(&tep->cmdlines, cmdline, __ATOMIC_RELEASE);
 	tep->cmdline_count++;
+	ret = 0;
 
-	return 0;
+ out:
+	pthread_mutex_unlock(&tep->cmdline_lock);
+
+	return ret;
 }
 
 /**
@@ -367,7 +557,11 @@ static int _tep_register_comm(struct tep_handle *tep,
  *
  * This adds a mapping to search for command line names with
  * a given pid. The comm is duplicated. If a command with the same pid
- * already exist, -1 is returned and errno is set to EEXIST
+ * already exist, -1 is returned and errno is set to EEXIST. The new
+ * command line is still kept in the history of the pid, see
+ * tep_data_comm_history(). A pid registered several times before the
+ * first lookup of a command line gets one of them, the others go to
+ * its history.
  */
 int tep_register_comm(struct tep_handle *tep, const char *comm, int pid)
 {
@@ -382,30 +576,104 @@ int tep_register_comm(struct tep_handle *tep, const char *comm, int pid)
  *
  * This adds a mapping to search for command line names with
  * a given pid. The comm is duplicated. If a command with the same pid
- * already exist, the command string is udapted with the new one
+ * already exist, the command string is udapted with the new one. The
+ * previous command strings of the pid are kept, see
+ * tep_data_comm_history().
  */
 int tep_override_comm(struct tep_handle *tep, const char *comm, int pid)
 {
-	if (!tep->cmdlines && cmdline_init(tep)) {
-		errno = ENOMEM;
-		return -1;
-	}
 	return _tep_register_comm(tep, comm, pid, true);
 }
 
+static void free_cmdlines(struct tep_handle *tep)
+{
+	struct cmdline_table *table = tep->cmdline_table;
+	struct cmdline_table *old;
+	struct tep_cmdline *cmdline;
+	struct cmdline_comm *item;
+
+	while (tep->cmdlines) {
+		cmdline = tep->cmdlines;
+		tep->cmdlines = cmdline->next;
+		while (cmdline->comm) {
+			item = cmdline->comm;
+			cmdline->comm = item->prev;
+			free(item);
+		}
+		free(cmdline);
+	}
+
+	while (table) {
+		old = table->old;
+		free(table);
+		table = old;
+	}
+	tep->cmdline_table = NULL;
+	tep->cmdline_count = 0;
+}
+
+/*
+ * The names of the functions and the printk formats are copied into a
+ * pool of large chunks, instead of being allocated one by one.
+ */
+struct str_pool {
+	struct str_pool		*next;
+	size_t			size;
+	size_t			used;
+	char			data[];
+};
+
+#define STR_POOL_SIZE		(64 * 1024)
+
+static char *pool_strdup(struct tep_handle *tep, const char *str)
+{
+	struct str_pool *pool = tep->str_pool;
+	size_t len = strlen(str) + 1;
+	size_t size;
+	char *copy;
+
+	if (!pool || pool->used + len > pool->size) {
+		size = len > STR_POOL_SIZE ? len : STR_POOL_SIZE;
+		pool = malloc(sizeof(*pool) + size);
+		if (!pool)
+			return NULL;
+		pool->size = size;
+		pool->used = 0;
+
+		/* Keep filling the current chunk if this one is for a long string */
+		if (len > STR_POOL_SIZE && tep->str_pool) {
+			pool->next = tep->str_pool->next;
+			tep->str_pool->next = pool;
+		} else {
+			pool->next = tep->str_pool;
+			tep->str_pool = pool;
+		}
+	}
+
+	copy = pool->data + pool->used;
+	memcpy(copy, str, len);
+	pool->used += len;
+
+	return copy;
+}
+
+static void free_str_pool(struct tep_handle *tep)
+{
+	struct str_pool *pool;
+
+	while (tep->str_pool) {
+		pool = tep->str_pool;
+		tep->str_pool = pool->next;
+		free(pool);
+	}
+}
+
 struct func_map {
 	unsigned long long		addr;
 	char				*func;
 	char				*mod;
 };
 
-struct func_list {
-	struct func_list	*next;
-	unsigned long long	addr;
-	char			*func;
-	char			*mod;
-};
-
 static int func_cmp(const void *a, const void *b)
 {
 	const struct func_map *fa = a;
@@ -420,80 +688,111 @@ static int func_cmp(const void *a, const void *b)
 }
 
 /*
- * We are searching for a record in between, not an exact
- * match.
+ * The addresses of the sorted functions are laid out in Eytzinger (BFS)
+ * order: the children of the node k are 2k and 2k + 1. The first levels
+ * of the search then share a few cache lines. @func_ranks maps a node
+ * back to the position of its function in @func_map.
  */
-static int func_bcmp(const void *a, const void *b)
+static unsigned int build_func_index(struct tep_handle *tep,
+				     unsigned long long *index,
+				     unsigned int i, unsigned int k)
 {
-	const struct func_map *fa = a;
-	const struct func_map *fb = b;
-
-	if ((fa->addr == fb->addr) ||
-
-	    (fa->addr > fb->addr &&
-	     fa->addr < (fb+1)->addr))
-		return 0;
+	if (k <= tep->func_count) {
+		i = build_func_index(tep, index, i, 2 * k);
+		index[k] = tep->func_map[i].addr;
+		tep->func_ranks[k] = i++;
+		i = build_func_index(tep, index, i, 2 * k + 1);
+	}
 
-	if (fa->addr < fb->addr)
-		return -1;
+	return i;
+}
 
-	return 1;
+static void free_func_index(struct tep_handle *tep)
+{
+	free(tep->func_index);
+	free(tep->func_ranks);
+	tep->func_index = NULL;
+	tep->func_ranks = NULL;
 }
 
+/*
+ * The index is built on the first lookup, which may be done by several
+ * threads at once. It is published only when it is complete, so that the
+ * threads which find it built do not need to take the lock.
+ */
 static int func_map_init(struct tep_handle *tep)
 {
-	struct func_list *funclist;
-	struct func_list *item;
-	struct func_map *func_map;
-	int i;
+	unsigned long long *index;
+	unsigned int i;
+	int ret = 0;
 
-	func_map = malloc(sizeof(*func_map) * (tep->func_count + 1));
-	if (!func_map)
-		return -1;
+	if (__atomic_load_n(&tep->func_index, __ATOMIC_ACQUIRE))
+		return 0;
 
-	funclist = tep->funclist;
+	pthread_mutex_lock(&tep->lookup_lock);
+	if (tep->func_index)
+		goto out;
 
-	i = 0;
-	while (funclist) {
-		func_map[i].func = funclist->func;
-		func_map[i].addr = funclist->addr;
-		func_map[i].mod = funclist->mod;
-		i++;
-		item = funclist;
-		funclist = funclist->next;
-		free(item);
+	/* kallsyms is mostly sorted already */
+	for (i = 1; i < tep->func_count; i++) {
+		if (tep->func_map[i - 1].addr > tep->func_map[i].addr) {
+			qsort(tep->func_map, tep->func_count,
+			      sizeof(*tep->func_map), func_cmp);
+			break;
+		}
 	}
 
-	qsort(func_map, tep->func_count, sizeof(*func_map), func_cmp);
-
-	/*
-	 * Add a special record at the end.
-	 */
-	func_map[tep->func_count].func = NULL;
-	func_map[tep->func_count].addr = 0;
-	func_map[tep->func_count].mod = NULL;
+	index = malloc(sizeof(*index) * (tep->func_count + 1));
+	tep->func_ranks = malloc(sizeof(*tep->func_ranks) *
+				 (tep->func_count + 1));
+	if (!index || !tep->func_ranks) {
+		free(index);
+		free_func_index(tep);
+		ret = -1;
+		goto out;
+	}
 
-	tep->func_map = func_map;
-	tep->funclist = NULL;
+	build_func_index(tep, index, 0, 1);
+	__atomic_store_n(&tep->func_index, index, __ATOMIC_RELEASE);
+ out:
+	pthread_mutex_unlock(&tep->lookup_lock);
 
-	return 0;
+	return ret;
 }
 
+/*
+ * We are searching for the function that contains @addr, not an
+ * exact match.
+ */
 static struct func_map *
 __find_func(struct tep_handle *tep, unsigned long long addr)
 {
-	struct func_map *func;
-	struct func_map key;
+	unsigned int n = tep->func_count;
+	unsigned int k = 1;
+	unsigned int i;
 
-	if (!tep->func_map)
-		func_map_init(tep);
+	if (func_map_init(tep))
+		return NULL;
 
-	key.addr = addr;
+	/* Find the first function that starts after @addr */
+	while (k <= n)
+		k = 2 * k + (tep->func_index[k] <= addr);
+	k >>= __builtin_ffs(~k);
 
-	func = bsearch(&key, tep->func_map, tep->func_count,
-		       sizeof(*tep->func_map), func_bcmp);
+	i = k ? tep->func_ranks[k] : n;
+	if (!i)
+		return NULL;
+	i--;
 
-	return func;
+	/* Nothing is known to end the last function */
+	if (i == n - 1 && tep->func_map[i].addr != addr)
+		return NULL;
+
+	/* Of the aliases of a function, the first one registered wins */
+	while (i && tep->func_map[i - 1].addr == tep->func_map[i].addr)
+		i--;
+
+	return &tep->func_map[i];
 }
 
 struct func_resolver {
@@ -509,7 +808,7 @@ struct func_resolver {
  * @priv: resolver function private state.
  *
  * Some tools may have already a way to resolve kernel functions, allow them to
- * keep using it instead of duplicating all the entries inside tep->funclist.
+ * keep using it instead of duplicating all the entries inside tep->func_map.
  */
 int tep_set_function_resolver(struct tep_handle *tep,
 			      tep_func_resolver_t *func, void *priv)
@@ -568,6 +867,9 @@ find_func(struct tep_handle *tep, unsigned long long addr)
  * Returns a pointer to the function stored that has the given
  * address. Note, the address does not have to be exact, it
  * will select the function that would contain the address.
+ *
+ * Several threads may look up functions at once, but not while
+ * functions are registered (see tep_init_lookup_maps()).
  */
 const char *tep_find_function(struct tep_handle *tep, unsigned long long addr)
 {
@@ -587,7 +889,8 @@ const char *tep_find_function(struct tep_handle *tep, unsigned long long addr)
  *
  * Returns the address the function starts at. This can be used in
  * conjunction with tep_find_function to print both the function
- * name and the function offset.
+ * name and the function offset. The same rules as for
+ * tep_find_function() apply to calling it from several threads.
  */
 unsigned long long
 tep_find_function_address(struct tep_handle *tep, unsigned long long addr)
@@ -614,34 +917,43 @@ tep_find_function_address(struct tep_handle *tep, unsigned long long addr)
 int tep_register_function(struct tep_handle *tep, char *func,
 			  unsigned long long addr, char *mod)
 {
-	struct func_list *item = malloc(sizeof(*item));
+	struct func_map *map;
+	unsigned int alloc;
 
-	if (!item)
-		return -1;
+	if (tep->func_count == tep->func_alloc) {
+		alloc = tep->func_alloc ? tep->func_alloc * 2 : 1024;
+		map = realloc(tep->func_map, sizeof(*map) * alloc);
+		if (!map)
+			goto out_err;
+		tep->func_map = map;
+		tep->func_alloc = alloc;
+	}
 
-	item->next = tep->funclist;
-	item->func = strdup(func);
-	if (!item->func)
-		goto out_free;
+	map = &tep->func_map[tep->func_count];
+	map->addr = addr;
+	map->func = pool_strdup(tep, func);
+	if (!map->func)
+		goto out_err;
 
+	map->mod = NULL;
 	if (mod) {
-		item->mod = strdup(mod);
-		if (!item->mod)
-			goto out_free_func;
-	} else
-		item->mod = NULL;
-	item->addr = addr;
+		/* The functions of a module come one after the other */
+		if (tep->func_count && map[-1].mod && strcmp(map[-1].mod, mod) == 0)
+			map->mod = map[-1].mod;
+		else
+			map->mod = pool_strdup(tep, mod);
+		if (!map->mod)
+			goto out_err;
+	}
 
-	tep->funclist = item;
 	tep->func_count++;
 
+	/* The index is built again on the next lookup */
+	free_func_index(tep);
+
 	return 0;
 
-out_free_func:
-	free(item->func);
-	item->func = NULL;
-out_free:
-	free(item);
+out_err:
 	errno = ENOMEM;
 	return -1;
 }
@@ -656,8 +968,8 @@ void tep_print_funcs(struct tep_handle *tep)
 {
 	int i;
 
-	if (!tep->func_map)
-		func_map_init(tep);
+	if (func_map_init(tep))
+		return;
 
 	for (i = 0; i < (int)tep->func_count; i++) {
 		printf("%016llx %s",
@@ -675,12 +987,6 @@ struct printk_map {
 	char				*printk;
 };
 
-struct printk_list {
-	struct printk_list	*next;
-	unsigned long long	addr;
-	char			*printk;
-};
-
 static int printk_cmp(const void *a, const void *b)
 {
 	const struct printk_map *pa = a;
@@ -694,35 +1000,19 @@ static int printk_cmp(const void *a, const void *b)
 	return 0;
 }
 
-static int printk_map_init(struct tep_handle *tep)
+/* Sort the strings on the first lookup, see func_map_init() */
+static void printk_map_init(struct tep_handle *tep)
 {
-	struct printk_list *printklist;
-	struct printk_list *item;
-	struct printk_map *printk_map;
-	int i;
-
-	printk_map = malloc(sizeof(*printk_map) * (tep->printk_count + 1));
-	if (!printk_map)
-		return -1;
-
-	printklist = tep->printklist;
+	if (__atomic_load_n(&tep->printk_sorted, __ATOMIC_ACQUIRE))
+		return;
 
-	i = 0;
-	while (printklist) {
-		printk_map[i].printk = printklist->printk;
-		printk_map[i].addr = printklist->addr;
-		i++;
-		item = printklist;
-		printklist = printklist->next;
-		free(item);
+	pthread_mutex_lock(&tep->lookup_lock);
+	if (!tep->printk_sorted) {
+		qsort(tep->printk_map, tep->printk_count,
+		      sizeof(*tep->printk_map), printk_cmp);
+		__atomic_store_n(&tep->printk_sorted, true, __ATOMIC_RELEASE);
 	}
-
-	qsort(printk_map, tep->printk_count, sizeof(*printk_map), printk_cmp);
-
-	tep->printk_map = printk_map;
-	tep->printklist = NULL;
-
-	return 0;
+	pthread_mutex_unlock(&tep->lookup_lock);
 }
 
 static struct printk_map *
@@ -731,8 +1021,7 @@ find_printk(struct tep_handle *tep, unsigned long long addr)
 	struct printk_map *printk;
 	struct printk_map key;
 
-	if (!tep->printk_map && printk_map_init(tep))
-		return NULL;
+	printk_map_init(tep);
 
 	key.addr = addr;
 
@@ -754,39 +1043,70 @@ find_printk(struct tep_handle *tep, unsigned long long addr)
 int tep_register_print_string(struct tep_handle *tep, const char *fmt,
 			      unsigned long long addr)
 {
-	struct printk_list *item = malloc(sizeof(*item));
+	struct printk_map *item;
+	unsigned int alloc;
 	char *p;
 
-	if (!item)
-		return -1;
+	if (tep->printk_count == tep->printk_alloc) {
+		alloc = tep->printk_alloc ? tep->printk_alloc * 2 : 256;
+		item = realloc(tep->printk_map, sizeof(*item) * alloc);
+		if (!item)
+			goto out_err;
+		tep->printk_map = item;
+		tep->printk_alloc = alloc;
+	}
 
-	item->next = tep->printklist;
+	item = &tep->printk_map[tep->printk_count];
 	item->addr = addr;
 
 	/* Strip off quotes and '\n' from the end */
 	if (fmt[0] == '"')
 		fmt++;
-	item->printk = strdup(fmt);
+	item->printk = pool_strdup(tep, fmt);
 	if (!item->printk)
-		goto out_free;
+		goto out_err;
 
+	/* The strings of the pool are next to each other, stay in this one */
 	p = item->printk + strlen(item->printk) - 1;
-	if (*p == '"')
+	if (p >= item->printk && *p == '"')
 		*p = 0;
 
 	p -= 2;
-	if (strcmp(p, "\\n") == 0)
+	if (p >= item->printk && strcmp(p, "\\n") == 0)
 		*p = 0;
 
-	tep->printklist = item;
 	tep->printk_count++;
+	tep->printk_sorted = false;
+
+	return 0;
+
+out_err:
+	errno = ENOMEM;
+	return -1;
+}
 
+/**
+ * tep_init_lookup_maps - build the lookup tables of the handle
+ * @tep: a handle to the trace event parser context
+ *
+ * The tables used to look up the functions, printk formats and comms
+ * are built on the first lookup, which may be done by several threads at
+ * once. This builds them up front, so that the first events printed do
+ * not wait for it. Adding functions or printk formats must still be
+ * serialized with the printing, while comms (which event handlers may
+ * add) can be added at any time. An alternative function resolver is not
+ * covered.
+ *
+ * Returns 0 on success, -1 on failure to allocate memory.
+ */
+int tep_init_lookup_maps(struct tep_handle *tep)
+{
+	if (func_map_init(tep))
+		return -1;
+	printk_map_init(tep);
+	if (!get_cmdline_table(tep))
+		return -1;
 	return 0;
-
-out_free:
-	free(item);
-	errno = ENOMEM;
-	return -1;
 }
 
 /**
@@ -799,8 +1119,7 @@ void tep_print_printk(struct tep_handle *tep)
 {
 	int i;
 
-	if (!tep->printk_map)
-		printk_map_init(tep);
+	printk_map_init(tep);
 
 	for (i = 0; i < (int)tep->printk_count; i++) {
 		printf("%016llx %s\n",
@@ -1712,6 +2031,86 @@ fail_expect:
 	return -1;
 }
 
+static unsigned int field_name_hash(const char *name)
+{
+	unsigned int hash = 2166136261U;
+
+	/* FNV-1a */
+	while (*name) {
+		hash ^= (unsigned char)*name++;
+		hash *= 16777619U;
+	}
+
+	return hash;
+}
+
+/*
+ * Build an open addressing hash table of the fields of a list. The table
+ * is at least twice the size of the list, hence the probing sequences
+ * stay short. If the allocation fails, the lookups walk the list.
+ */
+static void build_field_hash(struct tep_field_hash *hash,
+			     struct tep_format_field *list, int nr)
+{
+	struct tep_format_field *field;
+	unsigned int size = 4;
+	unsigned int i;
+
+	while (size < 2 * (unsigned int)nr)
+		size <<= 1;
+
+	hash->fields = calloc(size, sizeof(*hash->fields));
+	if (!hash->fields)
+		return;
+
+	hash->mask = size - 1;
+
+	for (field = list; field; field = field->next) {
+		i = field_name_hash(field->name) & hash->mask;
+		while (hash->fields[i]) {
+			/* Keep the first field, as the list walk does. */
+			if (strcmp(hash->fields[i]->name, field->name) == 0)
+				break;
+			i = (i + 1) & hash->mask;
+		}
+
+		if (!hash->fields[i])
+			hash->fields[i] = field;
+	}
+}
+
+static struct tep_format_field *
+find_field_hash(const struct tep_field_hash *hash,
+		struct tep_format_field *list, const char *name)
+{
+	struct tep_format_field *field;
+	unsigned int i;
+
+	if (!hash->fields) {
+		for (field = list; field; field = field->next) {
+			if (strcmp(field->name, name) == 0)
+				break;
+		}
+		return field;
+	}
+
+	i = field_name_hash(name) & hash->mask;
+	while ((field = hash->fields[i])) {
+		if (strcmp(field->name, name) == 0)
+			break;
+		i = (i + 1) & hash->mask;
+	}
+
+	return field;
+}
+
+static void free_field_hash(struct tep_field_hash *hash)
+{
+	free(hash->fields);
+	hash->fields = NULL;
+	hash->mask = 0;
+}
+
 static int event_read_format(struct tep_event *event)
 {
 	char *token;
@@ -1737,6 +2136,11 @@ static int event_read_format(struct tep_event *event)
 		return ret;
 	event->format.nr_fields = ret;
 
+	build_field_hash(&event->format.common_hash,
+			 event->format.common_fields, event->format.nr_common);
+	build_field_hash(&event->format.fields_hash,
+			 event->format.fields, event->format.nr_fields);
+
 	return 0;
 
  fail:
@@ -3333,15 +3737,8 @@ static int event_read_print(struct tep_event *event)
 struct tep_format_field *
 tep_find_common_field(struct tep_event *event, const char *name)
 {
-	struct tep_format_field *format;
-
-	for (format = event->format.common_fields;
-	     format; format = format->next) {
-		if (strcmp(format->name, name) == 0)
-			break;
-	}
-
-	return format;
+	return find_field_hash(&event->format.common_hash,
+			       event->format.common_fields, name);
 }
 
 /**
@@ -3351,19 +3748,17 @@ tep_find_common_field(struct tep_event *event, const char *name)
  *
  * Returns a non-common field by the given @name.
  * This does not search common fields.
+ *
+ * The lookup uses a hash of the field names of the event. Still, callers
+ * that read the same field of many records should look it up once. The
+ * returned field stays valid for the lifetime of the event and can be
+ * passed directly to tep_read_number_field().
  */
 struct tep_format_field *
 tep_find_field(struct tep_event *event, const char *name)
 {
-	struct tep_format_field *format;
-
-	for (format = event->format.fields;
-	     format; format = format->next) {
-		if (strcmp(format->name, name) == 0)
-			break;
-	}
-
-	return format;
+	return find_field_hash(&event->format.fields_hash,
+			       event->format.fields, name);
 }
 
 /**
@@ -3460,7 +3855,7 @@ static int get_common_info(struct tep_handle *tep,
 		return -1;
 	}
 
-	event = tep->events[0];
+	event = tep_parse_lazy_event(tep->events[0]);
 	field = tep_find_common_field(event, type);
 	if (!field)
 		return -1;
@@ -3538,12 +3933,17 @@ static int events_id_cmp(const void *a, const void *b);
 struct tep_event *tep_find_event(struct tep_handle *tep, int id)
 {
 	struct tep_event **eventptr;
+	struct tep_event *event;
 	struct tep_event key;
 	struct tep_event *pkey = &key;
 
-	/* Check cache first */
-	if (tep->last_event && tep->last_event->id == id)
-		return tep->last_event;
+	/*
+	 * Check cache first. The cache may be updated while the events
+	 * are printed by other threads.
+	 */
+	event = __atomic_load_n(&tep->last_event, __ATOMIC_RELAXED);
+	if (event && event->id == id)
+		return event;
 
 	key.id = id;
 
@@ -3551,8 +3951,9 @@ struct tep_event *tep_find_event(struct tep_handle *tep, int id)
 			   sizeof(*tep->events), events_id_cmp);
 
 	if (eventptr) {
-		tep->last_event = *eventptr;
-		return *eventptr;
+		event = tep_parse_lazy_event(*eventptr);
+		__atomic_store_n(&tep->last_event, event, __ATOMIC_RELAXED);
+		return event;
 	}
 
 	return NULL;
@@ -3571,13 +3972,14 @@ struct tep_event *
 tep_find_event_by_name(struct tep_handle *tep,
 		       const char *sys, const char *name)
 {
-	struct tep_event *event = NULL;
+	struct tep_event *event;
 	int i;
 
-	if (tep->last_event &&
-	    strcmp(tep->last_event->name, name) == 0 &&
-	    (!sys || strcmp(tep->last_event->system, sys) == 0))
-		return tep->last_event;
+	event = __atomic_load_n(&tep->last_event, __ATOMIC_RELAXED);
+	if (event &&
+	    strcmp(event->name, name) == 0 &&
+	    (!sys || strcmp(event->system, sys) == 0))
+		return event;
 
 	for (i = 0; i < tep->nr_events; i++) {
 		event = tep->events[i];
@@ -3591,10 +3993,46 @@ tep_find_event_by_name(struct tep_handle *tep,
 	if (i == tep->nr_events)
 		event = NULL;
 
-	tep->last_event = event;
+	event = tep_parse_lazy_event(event);
+	__atomic_store_n(&tep->last_event, event, __ATOMIC_RELAXED);
 	return event;
 }
 
+/*
+ * The fields of the print arguments are looked up on their first use.
+ * Events may be printed by several threads at once, hence the cached
+ * values are accessed atomically (all threads find the same values).
+ */
+static struct tep_format_field *
+arg_field(struct tep_event *event, struct tep_print_arg *arg)
+{
+	struct tep_format_field *field;
+
+	field = __atomic_load_n(&arg->field.field, __ATOMIC_RELAXED);
+	if (!field) {
+		field = tep_find_any_field(event, arg->field.name);
+		__atomic_store_n(&arg->field.field, field, __ATOMIC_RELAXED);
+	}
+
+	return field;
+}
+
+static int arg_field_offset(struct tep_event *event, int *offset,
+			    const char *name)
+{
+	struct tep_format_field *field;
+	int val;
+
+	val = __atomic_load_n(offset, __ATOMIC_RELAXED);
+	if (val == -1) {
+		field = tep_find_any_field(event, name);
+		val = field->offset;
+		__atomic_store_n(offset, val, __ATOMIC_RELAXED);
+	}
+
+	return val;
+}
+
 static unsigned long long
 eval_num_arg(void *data, int size, struct tep_event *event, struct tep_print_arg *arg)
 {
@@ -3602,6 +4040,7 @@ eval_num_arg(void *data, int size, struct tep_event *event, struct tep_print_arg
 	unsigned long long val = 0;
 	unsigned long long left, right;
 	struct tep_print_arg *typearg = NULL;
+	struct tep_format_field *field;
 	struct tep_print_arg *larg;
 	unsigned long offset;
 	unsigned int field_size;
@@ -3613,15 +4052,12 @@ eval_num_arg(void *data, int size, struct tep_event *event, struct tep_print_arg
 	case TEP_PRINT_ATOM:
 		return strtoull(arg->atom.atom, NULL, 0);
 	case TEP_PRINT_FIELD:
-		if (!arg->field.field) {
-			arg->field.field = tep_find_any_field(event, arg->field.name);
-			if (!arg->field.field)
-				goto out_warning_field;
-			
-		}
+		field = arg_field(event, arg);
+		if (!field)
+			goto out_warning_field;
+
 		/* must be a number */
-		val = tep_read_number(tep, data + arg->field.field->offset,
-				      arg->field.field->size);
+		val = tep_read_number(tep, data + field->offset, field->size);
 		break;
 	case TEP_PRINT_FLAGS:
 	case TEP_PRINT_SYMBOL:
@@ -3678,17 +4114,14 @@ eval_num_arg(void *data, int size, struct tep_event *event, struct tep_print_arg
 				offset += right;
 				break;
 			case TEP_PRINT_FIELD:
-				if (!larg->field.field) {
-					larg->field.field =
-						tep_find_any_field(event, larg->field.name);
-					if (!larg->field.field) {
-						arg = larg;
-						goto out_warning_field;
-					}
+				field = arg_field(event, larg);
+				if (!field) {
+					arg = larg;
+					goto out_warning_field;
 				}
-				field_size = larg->field.field->elementsize;
-				offset = larg->field.field->offset +
-					right * larg->field.field->elementsize;
+				field_size = field->elementsize;
+				offset = field->offset +
+					right * field->elementsize;
 				break;
 			default:
 				goto default_op; /* oops, all bets off */
@@ -3958,14 +4391,10 @@ static void print_str_arg(struct trace_seq *s, void *data, int size,
 		print_str_to_seq(s, format, len_arg, arg->atom.atom);
 		return;
 	case TEP_PRINT_FIELD:
-		field = arg->field.field;
+		field = arg_field(event, arg);
 		if (!field) {
-			field = tep_find_any_field(event, arg->field.name);
-			if (!field) {
-				str = arg->field.name;
-				goto out_warning_field;
-			}
-			arg->field.field = field;
+			str = arg->field.name;
+			goto out_warning_field;
 		}
 		/* Zero sized fields, mean the rest of the data */
 		len = field->size ? : size - field->offset;
@@ -4058,13 +4487,10 @@ static void print_str_arg(struct trace_seq *s, void *data, int size,
 				arg->hex.field->dynarray.field->size);
 			hex = data + (offset & 0xffff);
 		} else {
-			field = arg->hex.field->field.field;
+			field = arg_field(event, arg->hex.field);
 			if (!field) {
 				str = arg->hex.field->field.name;
-				field = tep_find_any_field(event, str);
-				if (!field)
-					goto out_warning_field;
-				arg->hex.field->field.field = field;
+				goto out_warning_field;
 			}
 			hex = data + field->offset;
 		}
@@ -4089,13 +4515,10 @@ static void print_str_arg(struct trace_seq *s, void *data, int size,
 						 field->size);
 			num = data + (offset & 0xffff);
 		} else {
-			field = arg->int_array.field->field.field;
+			field = arg_field(event, arg->int_array.field);
 			if (!field) {
 				str = arg->int_array.field->field.name;
-				field = tep_find_any_field(event, str);
-				if (!field)
-					goto out_warning_field;
-				arg->int_array.field->field.field = field;
+				goto out_warning_field;
 			}
 			num = data + field->offset;
 		}
@@ -4129,13 +4552,9 @@ static void print_str_arg(struct trace_seq *s, void *data, int size,
 	case TEP_PRINT_STRING: {
 		int str_offset;
 
-		if (arg->string.offset == -1) {
-			struct tep_format_field *f;
-
-			f = tep_find_any_field(event, arg->string.string);
-			arg->string.offset = f->offset;
-		}
-		str_offset = tep_data2host4(tep, *(unsigned int *)(data + arg->string.offset));
+		str_offset = arg_field_offset(event, &arg->string.offset,
+					      arg->string.string);
+		str_offset = tep_data2host4(tep, *(unsigned int *)(data + str_offset));
 		str_offset &= 0xffff;
 		print_str_to_seq(s, format, len_arg, ((char *)data) + str_offset);
 		break;
@@ -4147,13 +4566,9 @@ static void print_str_arg(struct trace_seq *s, void *data, int size,
 		int bitmask_offset;
 		int bitmask_size;
 
-		if (arg->bitmask.offset == -1) {
-			struct tep_format_field *f;
-
-			f = tep_find_any_field(event, arg->bitmask.bitmask);
-			arg->bitmask.offset = f->offset;
-		}
-		bitmask_offset = tep_data2host4(tep, *(unsigned int *)(data + arg->bitmask.offset));
+		bitmask_offset = arg_field_offset(event, &arg->bitmask.offset,
+						  arg->bitmask.bitmask);
+		bitmask_offset = tep_data2host4(tep, *(unsigned int *)(data + bitmask_offset));
 		bitmask_size = bitmask_offset >> 16;
 		bitmask_offset &= 0xffff;
 		print_bitmask_to_seq(tep, s, format, len_arg,
@@ -5356,20 +5771,32 @@ const char *tep_data_comm_from_pid(struct tep_handle *tep, int pid)
 	return comm;
 }
 
-static struct tep_cmdline *
-pid_from_cmdlist(struct tep_handle *tep, const char *comm, struct tep_cmdline *next)
+/**
+ * tep_data_comm_history - return a command line that a PID had
+ * @tep: a handle to the trace event parser context
+ * @pid: the PID of the task to search for
+ * @idx: 0 for the current command line, 1 for the previous one, etc.
+ *
+ * The command lines of a PID are replaced by tep_override_comm(). The
+ * other command lines it was registered with, that did not replace the
+ * current one, are kept after the ones it replaced.
+ * Returns NULL if @pid does not have that many command lines. The
+ * strings stay valid until the handle is freed.
+ */
+const char *tep_data_comm_history(struct tep_handle *tep, int pid, int idx)
 {
-	struct cmdline_list *cmdlist = (struct cmdline_list *)next;
+	struct tep_cmdline *cmdline;
+	struct cmdline_comm *item;
 
-	if (cmdlist)
-		cmdlist = cmdlist->next;
-	else
-		cmdlist = tep->cmdlist;
+	cmdline = find_cmdline_entry(tep, pid);
+	if (!cmdline)
+		return NULL;
 
-	while (cmdlist && strcmp(cmdlist->comm, comm) != 0)
-		cmdlist = cmdlist->next;
+	item = __atomic_load_n(&cmdline->comm, __ATOMIC_ACQUIRE);
+	while (item && idx--)
+		item = item->prev;
 
-	return (struct tep_cmdline *)cmdlist;
+	return item ? item->comm : NULL;
 }
 
 /**
@@ -5390,32 +5817,15 @@ struct tep_cmdline *tep_data_pid_from_comm(struct tep_handle *tep, const char *c
 {
 	struct tep_cmdline *cmdline;
 
-	/*
-	 * If the cmdlines have not been converted yet, then use
-	 * the list.
-	 */
-	if (!tep->cmdlines)
-		return pid_from_cmdlist(tep, comm, next);
-
-	if (next) {
-		/*
-		 * The next pointer could have been still from
-		 * a previous call before cmdlines were created
-		 */
-		if (next < tep->cmdlines ||
-		    next >= tep->cmdlines + tep->cmdline_count)
-			next = NULL;
-		else
-			cmdline  = next++;
-	}
-
-	if (!next)
-		cmdline = tep->cmdlines;
+	if (next)
+		cmdline = next->next;
+	else
+		cmdline = __atomic_load_n(&tep->cmdlines, __ATOMIC_ACQUIRE);
 
-	while (cmdline < tep->cmdlines + tep->cmdline_count) {
-		if (strcmp(cmdline->comm, comm) == 0)
+	while (cmdline) {
+		if (strcmp(cmdline_comm(cmdline), comm) == 0)
 			return cmdline;
-		cmdline++;
+		cmdline = cmdline->next;
 	}
 	return NULL;
 }
@@ -5430,20 +5840,9 @@ struct tep_cmdline *tep_data_pid_from_comm(struct tep_handle *tep, const char *c
  */
 int tep_cmdline_pid(struct tep_handle *tep, struct tep_cmdline *cmdline)
 {
-	struct cmdline_list *cmdlist = (struct cmdline_list *)cmdline;
-
 	if (!cmdline)
 		return -1;
 
-	/*
-	 * If cmdlines have not been created yet, or cmdline is
-	 * not part of the array, then treat it as a cmdlist instead.
-	 */
-	if (!tep->cmdlines ||
-	    cmdline < tep->cmdlines ||
-	    cmdline >= tep->cmdlines + tep->cmdline_count)
-		return cmdlist->pid;
-
 	return cmdline->pid;
 }
 
@@ -5792,6 +6191,9 @@ struct tep_event **tep_list_events(struct tep_handle *tep,
 	if (!tep)
 		return NULL;
 
+	/* The events are returned to be used */
+	tep_parse_lazy_events(tep);
+
 	events = tep->sort_events;
 	if (events && tep->last_type == sort_type)
 		return events;
@@ -5834,6 +6236,9 @@ struct tep_event **tep_list_events_copy(struct tep_handle *tep,
 	if (!tep)
 		return NULL;
 
+	/* The events are returned to be used */
+	tep_parse_lazy_events(tep);
+
 	events = list_events_copy(tep);
 	if (!events)
 		return NULL;
@@ -6115,6 +6520,7 @@ int tep_parse_header_page(struct tep_handle *tep, char *buf, unsigned long size,
 			  int long_size)
 {
 	int ignore;
+	int save;
 
 	if (!size) {
 		/*
@@ -6129,6 +6535,8 @@ int tep_parse_header_page(struct tep_handle *tep, char *buf, unsigned long size,
 	}
 	init_input_buf(buf, size);
 
+	save = silence_warnings(tep);
+
 	parse_header_field("timestamp", &tep->header_page_ts_offset,
 			   &tep->header_page_ts_size, 1);
 	parse_header_field("commit", &tep->header_page_size_offset,
@@ -6138,6 +6546,8 @@ int tep_parse_header_page(struct tep_handle *tep, char *buf, unsigned long size,
 	parse_header_field("data", &tep->header_page_data_offset,
 			   &tep->header_page_data_size, 1);
 
+	restore_warnings(save);
+
 	return 0;
 }
 
@@ -6192,22 +6602,14 @@ static int find_event_handle(struct tep_handle *tep, struct tep_event *event)
 	return 1;
 }
 
-/**
- * __tep_parse_format - parse the event format
- * @buf: the buffer storing the event format string
- * @size: the size of @buf
- * @sys: the system the event belongs to
- *
- * This parses the event format and creates an event structure
- * to quickly parse raw data for a given event.
- *
- * These files currently come from:
- *
- * /sys/kernel/debug/tracing/events/.../.../format
+/*
+ * Read the name and the id of the event, from the start of its format.
+ * input_buf_ptr is left at the rest of the format.
  */
-enum tep_errno __tep_parse_format(struct tep_event **eventp,
-				  struct tep_handle *tep, const char *buf,
-				  unsigned long size, const char *sys)
+static enum tep_errno parse_event_header(struct tep_event **eventp,
+					 struct tep_handle *tep,
+					 const char *buf, unsigned long size,
+					 const char *sys)
 {
 	struct tep_event *event;
 	int ret;
@@ -6251,21 +6653,38 @@ enum tep_errno __tep_parse_format(struct tep_event **eventp,
 	/* Add tep to event so that it can be referenced */
 	event->tep = tep;
 
+	return 0;
+
+ event_alloc_failed:
+	free(event->system);
+	free(event->name);
+	free(event);
+	*eventp = NULL;
+	return ret;
+}
+
+/*
+ * Parse the fields and the print format of the event, from the input
+ * buffer. If @quiet is set, don't print warnings if the print format
+ * fails to parse.
+ */
+static enum tep_errno parse_event_body(struct tep_event *event, bool quiet)
+{
+	int save;
+	int ret;
+
 	ret = event_read_format(event);
 	if (ret < 0) {
 		ret = TEP_ERRNO__READ_FORMAT_FAILED;
 		goto event_parse_failed;
 	}
 
-	/*
-	 * If the event has an override, don't print warnings if the event
-	 * print format fails to parse.
-	 */
-	if (tep && find_event_handle(tep, event))
+	save = show_warning;
+	if (quiet)
 		show_warning = 0;
 
 	ret = event_read_print(event);
-	show_warning = 1;
+	show_warning = save;
 
 	if (ret < 0) {
 		ret = TEP_ERRNO__READ_PRINT_FAILED;
@@ -6303,12 +6722,42 @@ enum tep_errno __tep_parse_format(struct tep_event **eventp,
  event_parse_failed:
 	event->flags |= TEP_EVENT_FL_FAILED;
 	return ret;
+}
+
+/**
+ * __tep_parse_format - parse the event format
+ * @buf: the buffer storing the event format string
+ * @size: the size of @buf
+ * @sys: the system the event belongs to
+ *
+ * This parses the event format and creates an event structure
+ * to quickly parse raw data for a given event.
+ *
+ * These files currently come from:
+ *
+ * /sys/kernel/debug/tracing/events/.../.../format
+ */
+enum tep_errno __tep_parse_format(struct tep_event **eventp,
+				  struct tep_handle *tep, const char *buf,
+				  unsigned long size, const char *sys)
+{
+	int save;
+	int ret;
+
+	save = silence_warnings(tep);
+
+	ret = parse_event_header(eventp, tep, buf, size, sys);
+	if (*eventp) {
+		/*
+		 * If the event has an override, don't print warnings if the
+		 * event print format fails to parse.
+		 */
+		ret = parse_event_body(*eventp,
+				       tep && find_event_handle(tep, *eventp));
+	}
+
+	restore_warnings(save);
 
- event_alloc_failed:
-	free(event->system);
-	free(event->name);
-	free(event);
-	*eventp = NULL;
 	return ret;
 }
 
@@ -6384,6 +6833,120 @@ enum tep_errno tep_parse_event(struct tep_handle *tep, const char *buf,
 	return __parse_event(tep, &event, buf, size, sys);
 }
 
+/**
+ * tep_parse_event_lazy - add an event, parse its format later
+ * @tep: a handle to the trace event parser context
+ * @buf: the buffer storing the event format string
+ * @size: the size of @buf
+ * @sys: the system the event belongs to
+ *
+ * Like tep_parse_event(), but only the name and the id of the event are
+ * read now. The rest of the format is kept, and parsed the first time the
+ * event is returned by tep_find_event(), tep_find_event_by_name(),
+ * tep_get_event(), tep_list_events() or tep_list_events_copy(). The name,
+ * id, system, flags and handler of the event can be used before.
+ *
+ * Warnings about the rest of the format are only printed when it is
+ * parsed, see tep_parse_lazy_events().
+ */
+enum tep_errno tep_parse_event_lazy(struct tep_handle *tep, const char *buf,
+				    unsigned long size, const char *sys)
+{
+	struct tep_event *event;
+	unsigned long start;
+	int save;
+	int ret;
+
+	save = silence_warnings(tep);
+	ret = parse_event_header(&event, tep, buf, size, sys);
+	restore_warnings(save);
+	if (!event)
+		return ret;
+
+	start = input_buf_ptr;
+	event->lazy_format = malloc(size - start + 1);
+	if (event->lazy_format) {
+		memcpy(event->lazy_format, buf + start, size - start);
+		event->lazy_size = size - start;
+		/* Bind the handler registered for the event, if any */
+		find_event_handle(tep, event);
+	} else {
+		/* Parse it now then */
+		save = silence_warnings(tep);
+		parse_event_body(event, find_event_handle(tep, event));
+		restore_warnings(save);
+	}
+
+	if (add_event(tep, event)) {
+		tep_free_event(event);
+		return TEP_ERRNO__MEM_ALLOC_FAILED;
+	}
+
+	return 0;
+}
+
+static void parse_lazy_event(struct tep_event *event)
+{
+	const char *save_input_buf;
+	unsigned long long save_input_buf_ptr;
+	unsigned long long save_input_buf_siz;
+	char *buf;
+	int save;
+
+	pthread_mutex_lock(&lazy_lock);
+
+	buf = event->lazy_format;
+	if (buf) {
+		/* The lookup may be done while parsing something else */
+		save_input_buf = input_buf;
+		save_input_buf_ptr = input_buf_ptr;
+		save_input_buf_siz = input_buf_siz;
+
+		init_input_buf(buf, event->lazy_size);
+		save = silence_warnings(event->tep);
+		parse_event_body(event, event->handler != NULL);
+		restore_warnings(save);
+
+		input_buf = save_input_buf;
+		input_buf_ptr = save_input_buf_ptr;
+		input_buf_siz = save_input_buf_siz;
+
+		__atomic_store_n(&event->lazy_format, NULL, __ATOMIC_RELEASE);
+		free(buf);
+	}
+
+	pthread_mutex_unlock(&lazy_lock);
+}
+
+/*
+ * Make sure that the format of @event is parsed, if it was added by
+ * tep_parse_event_lazy(). Returns @event.
+ */
+struct tep_event *tep_parse_lazy_event(struct tep_event *event)
+{
+	if (event && __atomic_load_n(&event->lazy_format, __ATOMIC_ACQUIRE))
+		parse_lazy_event(event);
+
+	return event;
+}
+
+/**
+ * tep_parse_lazy_events - parse the formats of all lazy events
+ * @tep: a handle to the trace event parser context
+ *
+ * Parses the rest of the formats of the events added by
+ * tep_parse_event_lazy(), that have not been looked up yet. As with
+ * tep_parse_event(), an event that fails to parse is kept and marked
+ * with TEP_EVENT_FL_FAILED.
+ */
+void tep_parse_lazy_events(struct tep_handle *tep)
+{
+	int i;
+
+	for (i = 0; i < tep->nr_events; i++)
+		tep_parse_lazy_event(tep->events[i]);
+}
+
 int get_field_val(struct trace_seq *s, struct tep_format_field *field,
 		  const char *name, struct tep_record *record,
 		  unsigned long long *val, int err)
@@ -6912,6 +7475,8 @@ struct tep_handle *tep_alloc(void)
 	if (tep) {
 		tep->ref_count = 1;
 		tep->host_bigendian = tep_is_bigendian();
+		pthread_mutex_init(&tep->cmdline_lock, NULL);
+		pthread_mutex_init(&tep->lookup_lock, NULL);
 	}
 
 	return tep;
@@ -6951,6 +7516,8 @@ static void free_format_fields(struct tep_format_field *field)
 
 static void free_formats(struct tep_format *format)
 {
+	free_field_hash(&format->common_hash);
+	free_field_hash(&format->fields_hash);
 	free_format_fields(format->common_fields);
 	free_format_fields(format->fields);
 }
@@ -6959,6 +7526,7 @@ void tep_free_event(struct tep_event *event)
 {
 	free(event->name);
 	free(event->system);
+	free(event->lazy_format);
 
 	free_formats(&event->format);
 
@@ -6974,9 +7542,6 @@ void tep_free_event(struct tep_event *event)
  */
 void tep_free(struct tep_handle *tep)
 {
-	struct cmdline_list *cmdlist, *cmdnext;
-	struct func_list *funclist, *funcnext;
-	struct printk_list *printklist, *printknext;
 	struct tep_function_handler *func_handler;
 	struct event_handler *handle;
 	int i;
@@ -6984,42 +7549,16 @@ void tep_free(struct tep_handle *tep)
 	if (!tep)
 		return;
 
-	cmdlist = tep->cmdlist;
-	funclist = tep->funclist;
-	printklist = tep->printklist;
-
 	tep->ref_count--;
 	if (tep->ref_count)
 		return;
 
-	if (tep->cmdlines) {
-		for (i = 0; i < tep->cmdline_count; i++)
-			free(tep->cmdlines[i].comm);
-		free(tep->cmdlines);
-	}
-
-	while (cmdlist) {
-		cmdnext = cmdlist->next;
-		free(cmdlist->comm);
-		free(cmdlist);
-		cmdlist = cmdnext;
-	}
-
-	if (tep->func_map) {
-		for (i = 0; i < (int)tep->func_count; i++) {
-			free(tep->func_map[i].func);
-			free(tep->func_map[i].mod);
-		}
-		free(tep->func_map);
-	}
+	free_cmdlines(tep);
+	pthread_mutex_destroy(&tep->cmdline_lock);
+	pthread_mutex_destroy(&tep->lookup_lock);
 
-	while (funclist) {
-		funcnext = funclist->next;
-		free(funclist->func);
-		free(funclist->mod);
-		free(funclist);
-		funclist = funcnext;
-	}
+	free(tep->func_map);
+	free_func_index(tep);
 
 	while (tep->func_handlers) {
 		func_handler = tep->func_handlers;
@@ -7027,18 +7566,8 @@ void tep_free(struct tep_handle *tep)
 		free_func_handle(func_handler);
 	}
 
-	if (tep->printk_map) {
-		for (i = 0; i < (int)tep->printk_count; i++)
-			free(tep->printk_map[i].printk);
-		free(tep->printk_map);
-	}
-
-	while (printklist) {
-		printknext = printklist->next;
-		free(printklist->printk);
-		free(printklist);
-		printklist = printknext;
-	}
+	free(tep->printk_map);
+	free_str_pool(tep);
 
 	for (i = 0; i < tep->nr_events; i++)
 		tep_free_event(tep->events[i]);
@@ -303,6 +303,7 @@ find_event(struct tep_handle *tep, struct event_list **events,
 		event = tep->events[i];
 		if (event_match(event, sys_name ? &sreg : NULL, &ereg)) {
 			match = 1;
+			tep_parse_lazy_event(event);
 			if (add_event(events, event) < 0) {
 				fail = 1;
 				break;
@@ -90,6 +90,8 @@ struct hook_list;
 void trace_init_profile(struct tracecmd_input *handle, struct hook_list *hooks,
 			int global);
 int do_trace_profile(void);
+int trace_profile_read_parallel(struct tracecmd_input *handle,
+				struct tracecmd_input **inputs, int nr_inputs);
 void trace_profile_set_merge_like_comms(void);
 
 struct tracecmd_input *
@@ -12,6 +12,7 @@
 #include <string.h>
 #include <getopt.h>
 #include <signal.h>
+#include <pthread.h>
 
 #include "trace-hash-local.h"
 #include "trace-local.h"
@@ -130,7 +131,12 @@ struct chain {
 	struct chain		*sibling;
 	const char		*func;
 	struct chain		*parents;
+	/* The chain that has this one in its parents */
+	struct chain		*child;
 	struct pid_list		*pid_list;
+	/* The call chain and level that created a top level chain */
+	unsigned long		seq;
+	int			level;
 	int			nr_parents;
 	int			count;
 	int			total;
@@ -140,6 +146,21 @@ static struct chain *chains;
 static int nr_chains;
 static int total_counts;
 
+/*
+ * The parents of the chains are looked up by their child and their
+ * function, in an open-addressing table that doubles its size when it
+ * gets half full.
+ */
+struct chain_hash {
+	struct chain		**slots;
+	unsigned int		bits;
+	unsigned long		count;
+};
+
+#define CHAIN_HASH_BITS	12
+
+static struct chain_hash chain_hash;
+
 struct pid_list {
 	struct pid_list		*next;
 	struct chain		chain;
@@ -157,6 +178,76 @@ static void add_chain(struct chain *chain)
 	nr_chains++;
 }
 
+static void chain_hash_init(struct chain_hash *hash, unsigned int bits)
+{
+	hash->slots = calloc(1UL << bits, sizeof(*hash->slots));
+	if (!hash->slots)
+		die("malloc");
+	hash->bits = bits;
+	hash->count = 0;
+}
+
+static unsigned long
+chain_slot(struct chain_hash *hash, struct chain *child, const char *func)
+{
+	unsigned long long key;
+
+	key = (unsigned long)child ^
+		((unsigned long)func * 0x9e3779b97f4a7c15ULL);
+
+	return (key * 0x9e3779b97f4a7c15ULL) >> (64 - hash->bits);
+}
+
+static struct chain **
+chain_hash_lookup(struct chain_hash *hash, struct chain *child,
+		  const char *func)
+{
+	unsigned long mask = (1UL << hash->bits) - 1;
+	unsigned long i;
+
+	for (i = chain_slot(hash, child, func); hash->slots[i];
+	     i = (i + 1) & mask) {
+		if (hash->slots[i]->child == child &&
+		    hash->slots[i]->func == func)
+			break;
+	}
+
+	return &hash->slots[i];
+}
+
+static struct chain *
+find_parent(struct chain_hash *hash, struct chain *child, const char *func)
+{
+	if (!hash->slots)
+		return NULL;
+
+	return *chain_hash_lookup(hash, child, func);
+}
+
+static void add_parent(struct chain_hash *hash, struct chain *chain)
+{
+	struct chain **slots = hash->slots;
+	unsigned long size = 1UL << hash->bits;
+	unsigned long count = hash->count;
+	unsigned long i;
+
+	if (!slots) {
+		chain_hash_init(hash, CHAIN_HASH_BITS);
+	} else if ((count + 1) * 2 > size) {
+		chain_hash_init(hash, hash->bits + 1);
+		for (i = 0; i < size; i++) {
+			if (slots[i])
+				*chain_hash_lookup(hash, slots[i]->child,
+						   slots[i]->func) = slots[i];
+		}
+		hash->count = count;
+		free(slots);
+	}
+
+	*chain_hash_lookup(hash, chain->child, chain->func) = chain;
+	hash->count++;
+}
+
 static void
 insert_chain(struct pid_list *pid_list, struct chain *chain_list,
 	     const char **chain_str, int size, int event)
@@ -172,11 +263,10 @@ insert_chain(struct pid_list *pid_list, struct chain *chain_list,
 	if (!size--)
 		return;
 
-	for (chain = chain_list->parents; chain; chain = chain->sibling) {
-		if (chain->func == chain_str[size]) {
-			insert_chain(pid_list, chain, chain_str, size, 0);
-			return;
-		}
+	chain = find_parent(&chain_hash, chain_list, chain_str[size]);
+	if (chain) {
+		insert_chain(pid_list, chain, chain_str, size, 0);
+		return;
 	}
 
 	chain_list->nr_parents++;
@@ -185,9 +275,11 @@ insert_chain(struct pid_list *pid_list, struct chain *chain_list,
 		die("malloc");
 	chain->sibling = chain_list->parents;
 	chain_list->parents = chain;
+	chain->child = chain_list;
 	chain->func = chain_str[size];
 	chain->pid_list = pid_list;
 	chain->event = event;
+	add_parent(&chain_hash, chain);
 
 	/* NULL func means this is the top level of the chain. Store it */
 	if (!chain_list->func)
@@ -196,6 +288,12 @@ insert_chain(struct pid_list *pid_list, struct chain *chain_list,
 	insert_chain(pid_list, chain, chain_str, size, 0);
 }
 
+struct hist_parallel;
+static struct hist_parallel *hist_parallel;
+
+static void queue_call_chain(struct hist_parallel *hp, struct pid_list *pid_list,
+			     const char **chain, int size, int event);
+
 static void save_call_chain(int pid, const char **chain, int size, int event)
 {
 	static struct pid_list *pid_list;
@@ -217,7 +315,10 @@ static void save_call_chain(int pid, const char **chain, int size, int event)
 			list_pids = pid_list;
 		}
 	}
-	insert_chain(pid_list, &pid_list->chain, chain, size, event);
+	if (hist_parallel)
+		queue_call_chain(hist_parallel, pid_list, chain, size, event);
+	else
+		insert_chain(pid_list, &pid_list->chain, chain, size, event);
 }
 
 static void save_stored_stacks(void)
@@ -252,14 +353,12 @@ static void pop_stack_func(void)
 }
 
 static void
-process_function(struct tep_handle *pevent, struct tep_record *record)
+read_function(struct tep_handle *pevent, struct tep_record *record,
+	      int *pid, const char **func, const char **parent)
 {
 	unsigned long long parent_ip;
 	unsigned long long ip;
 	unsigned long long val;
-	const char *parent;
-	const char *func;
-	int pid;
 	int ret;
 
 	ret = tep_read_number_field(common_pid_field, record->data, &val);
@@ -274,11 +373,14 @@ process_function(struct tep_handle *pevent, struct tep_record *record)
 	if (ret < 0)
 		die("no parent ip field for function?");
 
-	pid = val;
+	*pid = val;
 
-	func = tep_find_function(pevent, ip);
-	parent = tep_find_function(pevent, parent_ip);
+	*func = tep_find_function(pevent, ip);
+	*parent = tep_find_function(pevent, parent_ip);
+}
 
+static void do_function(int pid, const char *func, const char *parent)
+{
 	if (current_pid >= 0 && pid != current_pid) {
 		save_stack();
 		restore_stack(pid);
@@ -309,13 +411,22 @@ process_function(struct tep_handle *pevent, struct tep_record *record)
 }
 
 static void
-process_function_graph_entry(struct tep_handle *pevent, struct tep_record *record)
+process_function(struct tep_handle *pevent, struct tep_record *record)
 {
-	unsigned long long depth;
-	unsigned long long ip;
-	unsigned long long val;
+	const char *parent;
 	const char *func;
 	int pid;
+
+	read_function(pevent, record, &pid, &func, &parent);
+	do_function(pid, func, parent);
+}
+
+static void
+read_function_graph_entry(struct tep_handle *pevent, struct tep_record *record,
+			  int *pid, const char **func, unsigned long long *depth)
+{
+	unsigned long long ip;
+	unsigned long long val;
 	int ret;
 
 	ret = tep_read_number_field(common_pid_field, record->data, &val);
@@ -328,14 +439,18 @@ process_function_graph_entry(struct tep_handle *pevent, struct tep_record *recor
 		die("no ip field for function graph entry?");
 
 	ret = tep_read_number_field(function_graph_entry_depth_field,
-				    record->data, &depth);
+				    record->data, depth);
 	if (ret < 0)
 		die("no parent ip field for function entry?");
 
-	pid = val;
+	*pid = val;
 
-	func = tep_find_function(pevent, ip);
+	*func = tep_find_function(pevent, ip);
+}
 
+static void
+do_function_graph_entry(int pid, const char *func, unsigned long long depth)
+{
 	if (current_pid >= 0 && pid != current_pid) {
 		save_stack();
 		restore_stack(pid);
@@ -355,11 +470,21 @@ process_function_graph_entry(struct tep_handle *pevent, struct tep_record *recor
 }
 
 static void
-process_function_graph_exit(struct tep_handle *pevent, struct tep_record *record)
+process_function_graph_entry(struct tep_handle *pevent, struct tep_record *record)
 {
 	unsigned long long depth;
-	unsigned long long val;
+	const char *func;
 	int pid;
+
+	read_function_graph_entry(pevent, record, &pid, &func, &depth);
+	do_function_graph_entry(pid, func, depth);
+}
+
+static void
+read_function_graph_exit(struct tep_record *record, int *pid,
+			 unsigned long long *depth)
+{
+	unsigned long long val;
 	int ret;
 
 	ret = tep_read_number_field(common_pid_field, record->data, &val);
@@ -367,12 +492,15 @@ process_function_graph_exit(struct tep_handle *pevent, struct tep_record *record
 		die("no pid field for function graph exit?");
 
 	ret = tep_read_number_field(function_graph_exit_depth_field,
-				    record->data, &depth);
+				    record->data, depth);
 	if (ret < 0)
 		die("no parent ip field for function?");
 
-	pid = val;
+	*pid = val;
+}
 
+static void do_function_graph_exit(int pid, unsigned long long depth)
+{
 	if (current_pid >= 0 && pid != current_pid) {
 		save_stack();
 		restore_stack(pid);
@@ -389,6 +517,16 @@ process_function_graph_exit(struct tep_handle *pevent, struct tep_record *record
 	func_depth = depth - 1;
 }
 
+static void
+process_function_graph_exit(struct tep_handle *pevent, struct tep_record *record)
+{
+	unsigned long long depth;
+	int pid;
+
+	read_function_graph_exit(record, &pid, &depth);
+	do_function_graph_exit(pid, depth);
+}
+
 static int pending_pid = -1;
 static const char **pending_ips;
 static int pending_ips_idx;
@@ -695,6 +833,644 @@ static void update_kernel_stack(struct tep_handle *pevent)
 	kernel_stack_caller_field = tep_find_field(event, "caller");
 }
 
+/*
+ * Parallel mode.
+ *
+ * The data of the CPUs is split into segments of pages, that are decoded
+ * by a pool of threads: the function records get their functions looked
+ * up, and the other records are copied. The calling thread goes through
+ * the segments in the same order as the serial case does, and keeps the
+ * stacks of the tasks. This part can not be split per CPU, as the stacks
+ * of the tasks carry over from one CPU to the next.
+ *
+ * The call chains that it saves are handed over to a second pool of
+ * threads, each building the tries of its share of the top functions.
+ * At the end, the top level chains of all the tries are merged in the
+ * order they were created in, which is the order of the serial case.
+ */
+#define HIST_SEGMENT_PAGES	256
+#define HIST_BATCH_REQUESTS	4096
+#define HIST_BATCH_FUNCS	(HIST_BATCH_REQUESTS * 16)
+#define HIST_MAX_BATCHES	8
+
+enum {
+	HIST_RECORD,
+	HIST_FUNCTION,
+	HIST_GRAPH_ENTRY,
+	HIST_GRAPH_EXIT,
+};
+
+struct hist_entry {
+	/* Copy of the record, for HIST_RECORD */
+	struct tep_record	*record;
+	const char		*func;
+	const char		*parent;
+	unsigned long long	depth;
+	int			type;
+	int			pid;
+	int			missed;
+};
+
+struct hist_segment {
+	int			cpu;
+	unsigned long long	start;
+	unsigned long long	end;
+};
+
+struct hist_chunk {
+	struct hist_entry	*entries;
+	int			nr_entries;
+	int			alloc_entries;
+	bool			decoded;
+};
+
+struct hist_request {
+	struct pid_list		*pid_list;
+	unsigned long		seq;
+	int			size;
+	int			event;
+	/* Index of the first function of the chain in the batch */
+	int			funcs;
+};
+
+struct hist_batch {
+	struct hist_batch	*next;
+	struct hist_request	requests[HIST_BATCH_REQUESTS];
+	int			nr_requests;
+	const char		**funcs;
+	int			nr_funcs;
+	int			alloc_funcs;
+};
+
+struct hist_decoder {
+	struct hist_parallel	*hp;
+	struct tracecmd_input	*handle;
+	pthread_t		thread;
+};
+
+struct hist_shard {
+	struct hist_parallel	*hp;
+	pthread_t		thread;
+	struct chain_hash	hash;
+
+	/* Batches waiting to be inserted */
+	struct hist_batch	*head;
+	struct hist_batch	*tail;
+	int			nr_batches;
+
+	/* The batch being filled by the calling thread */
+	struct hist_batch	*curr;
+
+	/* Top level chains, the newest first */
+	struct chain		*chains;
+	int			nr_chains;
+	int			total_counts;
+};
+
+struct hist_parallel {
+	struct tep_handle	*pevent;
+
+	struct hist_segment	*segments;
+	int			nr_segments;
+	struct hist_chunk	*chunks;
+	int			nr_chunks;
+	int			taken;
+	int			consumed;
+	struct hist_decoder	*decoders;
+	int			nr_decoders;
+
+	struct hist_shard	*shards;
+	int			nr_shards;
+	unsigned long		seq;
+	bool			done;
+
+	pthread_mutex_t		lock;
+	pthread_cond_t		cond;
+	pthread_cond_t		data_cond;
+	pthread_cond_t		space_cond;
+};
+
+static struct tep_record *copy_record(struct tep_record *record)
+{
+	struct tep_record *copy;
+
+	copy = malloc(sizeof(*copy) + record->size);
+	if (!copy)
+		die("malloc");
+	memset(copy, 0, sizeof(*copy));
+
+	copy->ts = record->ts;
+	copy->offset = record->offset;
+	copy->missed_events = record->missed_events;
+	copy->record_size = record->record_size;
+	copy->size = record->size;
+	copy->cpu = record->cpu;
+	copy->data = copy + 1;
+	memcpy(copy->data, record->data, record->size);
+	copy->ref_count = 1;
+
+	return copy;
+}
+
+static void decode_record(struct tep_handle *pevent, struct tep_record *record,
+			  struct hist_entry *entry)
+{
+	unsigned long long val;
+	int type;
+
+	memset(entry, 0, sizeof(*entry));
+	entry->missed = record->missed_events != 0;
+
+	tep_read_number_field(common_type_field, record->data, &val);
+	type = val;
+
+	/* Same as process_record() */
+	if (type == function_type) {
+		entry->type = HIST_FUNCTION;
+		read_function(pevent, record, &entry->pid,
+			      &entry->func, &entry->parent);
+	} else if (type == function_graph_entry_type) {
+		entry->type = HIST_GRAPH_ENTRY;
+		read_function_graph_entry(pevent, record, &entry->pid,
+					  &entry->func, &entry->depth);
+	} else if (type == function_graph_exit_type) {
+		entry->type = HIST_GRAPH_EXIT;
+		read_function_graph_exit(record, &entry->pid, &entry->depth);
+	} else {
+		entry->type = HIST_RECORD;
+		entry->record = copy_record(record);
+	}
+}
+
+static void decode_segment(struct hist_parallel *hp,
+			   struct tracecmd_input *handle,
+			   struct hist_segment *segment,
+			   struct hist_chunk *chunk)
+{
+	struct tep_record *record;
+	struct hist_entry *entries;
+	int cpu = segment->cpu;
+
+	if (tracecmd_set_cursor(handle, cpu, segment->start) < 0)
+		die("could not read CPU %d at offset %llu",
+		    cpu, segment->start);
+
+	for (;;) {
+		record = tracecmd_peek_data(handle, cpu);
+		if (!record || record->offset >= segment->end)
+			break;
+
+		record = tracecmd_read_data(handle, cpu);
+
+		if (chunk->nr_entries == chunk->alloc_entries) {
+			chunk->alloc_entries = chunk->alloc_entries ?
+				chunk->alloc_entries * 2 : 4096;
+			entries = realloc(chunk->entries, chunk->alloc_entries *
+					  sizeof(*entries));
+			if (!entries)
+				die("malloc");
+			chunk->entries = entries;
+		}
+
+		decode_record(hp->pevent, record,
+			      &chunk->entries[chunk->nr_entries++]);
+		free_record(record);
+	}
+}
+
+static void *hist_decoder(void *data)
+{
+	struct hist_decoder *decoder = data;
+	struct hist_parallel *hp = decoder->hp;
+	struct hist_chunk *chunk;
+	int i;
+
+	for (;;) {
+		pthread_mutex_lock(&hp->lock);
+		while (hp->taken < hp->nr_segments &&
+		       hp->taken >= hp->consumed + hp->nr_chunks)
+			pthread_cond_wait(&hp->cond, &hp->lock);
+		if (hp->taken == hp->nr_segments) {
+			pthread_mutex_unlock(&hp->lock);
+			break;
+		}
+		i = hp->taken++;
+		pthread_mutex_unlock(&hp->lock);
+
+		chunk = &hp->chunks[i % hp->nr_chunks];
+		decode_segment(hp, decoder->handle, &hp->segments[i], chunk);
+
+		pthread_mutex_lock(&hp->lock);
+		chunk->decoded = true;
+		pthread_cond_broadcast(&hp->cond);
+		pthread_mutex_unlock(&hp->lock);
+	}
+
+	return NULL;
+}
+
+static bool newer_chain(struct chain *a, struct chain *b)
+{
+	return a->seq > b->seq || (a->seq == b->seq && a->level > b->level);
+}
+
+/* Same as insert_chain(), after the pid_list chain was accounted */
+static void shard_insert_chain(struct hist_shard *shard,
+			       struct hist_request *req, const char **chain_str)
+{
+	struct chain *chain_list = &req->pid_list->chain;
+	struct chain *chain;
+	int event = req->event;
+	int size = req->size;
+	int level = 0;
+
+	while (size--) {
+		chain = find_parent(&shard->hash, chain_list, chain_str[size]);
+		if (!chain) {
+			chain = zalloc(sizeof(*chain));
+			if (!chain)
+				die("malloc");
+			chain->child = chain_list;
+			chain->func = chain_str[size];
+			chain->pid_list = req->pid_list;
+			chain->event = event;
+			add_parent(&shard->hash, chain);
+
+			/* The pid_list chain is shared by the shards */
+			if (chain_list != &req->pid_list->chain) {
+				chain_list->nr_parents++;
+				chain->sibling = chain_list->parents;
+				chain_list->parents = chain;
+			}
+
+			if (!chain_list->func) {
+				chain->seq = req->seq;
+				chain->level = level;
+				chain->next = shard->chains;
+				shard->chains = chain;
+				shard->nr_chains++;
+			}
+		}
+
+		if (!chain->func)
+			shard->total_counts++;
+		chain->count++;
+
+		chain_list = chain;
+		event = 0;
+		level++;
+	}
+}
+
+static void *hist_shard(void *data)
+{
+	struct hist_shard *shard = data;
+	struct hist_parallel *hp = shard->hp;
+	struct hist_request *req;
+	struct hist_batch *batch;
+	int i;
+
+	for (;;) {
+		pthread_mutex_lock(&hp->lock);
+		while (!shard->head && !hp->done)
+			pthread_cond_wait(&hp->data_cond, &hp->lock);
+		batch = shard->head;
+		if (batch) {
+			shard->head = batch->next;
+			if (!shard->head)
+				shard->tail = NULL;
+			shard->nr_batches--;
+			pthread_cond_broadcast(&hp->space_cond);
+		}
+		pthread_mutex_unlock(&hp->lock);
+
+		if (!batch)
+			break;
+
+		for (i = 0; i < batch->nr_requests; i++) {
+			req = &batch->requests[i];
+			shard_insert_chain(shard, req, batch->funcs + req->funcs);
+		}
+
+		free(batch->funcs);
+		free(batch);
+	}
+
+	return NULL;
+}
+
+static void send_batch(struct hist_parallel *hp, struct hist_shard *shard)
+{
+	struct hist_batch *batch = shard->curr;
+
+	if (!batch)
+		return;
+
+	pthread_mutex_lock(&hp->lock);
+	while (shard->nr_batches >= HIST_MAX_BATCHES)
+		pthread_cond_wait(&hp->space_cond, &hp->lock);
+	if (shard->tail)
+		shard->tail->next = batch;
+	else
+		shard->head = batch;
+	shard->tail = batch;
+	shard->nr_batches++;
+	pthread_cond_broadcast(&hp->data_cond);
+	pthread_mutex_unlock(&hp->lock);
+
+	shard->curr = NULL;
+}
+
+static struct hist_batch *alloc_batch(int size)
+{
+	struct hist_batch *batch;
+
+	batch = malloc(sizeof(*batch));
+	if (!batch)
+		die("malloc");
+
+	batch->next = NULL;
+	batch->nr_requests = 0;
+	batch->nr_funcs = 0;
+	batch->alloc_funcs = size > HIST_BATCH_FUNCS ? size : HIST_BATCH_FUNCS;
+	batch->funcs = malloc(batch->alloc_funcs * sizeof(*batch->funcs));
+	if (!batch->funcs)
+		die("malloc");
+
+	return batch;
+}
+
+static void queue_call_chain(struct hist_parallel *hp, struct pid_list *pid_list,
+			     const char **chain, int size, int event)
+{
+	struct hist_request *req;
+	struct hist_batch *batch;
+	struct hist_shard *shard;
+	unsigned long long key;
+
+	/* What insert_chain() does with the pid_list chain */
+	total_counts++;
+	pid_list->chain.count++;
+
+	if (!size)
+		return;
+
+	/* The chains with the same top function go to the same shard */
+	key = (unsigned long)pid_list ^
+		((unsigned long)chain[size - 1] * 0x9e3779b97f4a7c15ULL);
+	key *= 0x9e3779b97f4a7c15ULL;
+	shard = &hp->shards[(key >> 32) % hp->nr_shards];
+
+	batch = shard->curr;
+	if (batch && (batch->nr_requests == HIST_BATCH_REQUESTS ||
+		      batch->nr_funcs + size > batch->alloc_funcs)) {
+		send_batch(hp, shard);
+		batch = NULL;
+	}
+	if (!batch)
+		batch = shard->curr = alloc_batch(size);
+
+	req = &batch->requests[batch->nr_requests++];
+	req->pid_list = pid_list;
+	req->seq = hp->seq++;
+	req->size = size;
+	req->event = event;
+	req->funcs = batch->nr_funcs;
+
+	memcpy(batch->funcs + batch->nr_funcs, chain, size * sizeof(*chain));
+	batch->nr_funcs += size;
+}
+
+static void replay_hist_entry(struct tep_handle *pevent,
+			      struct hist_entry *entry)
+{
+	/* If we missed events, just flush out the current stack */
+	if (entry->missed)
+		flush_stack();
+
+	switch (entry->type) {
+	case HIST_FUNCTION:
+		do_function(entry->pid, entry->func, entry->parent);
+		break;
+	case HIST_GRAPH_ENTRY:
+		do_function_graph_entry(entry->pid, entry->func, entry->depth);
+		break;
+	case HIST_GRAPH_EXIT:
+		do_function_graph_exit(entry->pid, entry->depth);
+		break;
+	default:
+		process_record(pevent, entry->record);
+		free_record(entry->record);
+		break;
+	}
+}
+
+static void add_segments(struct hist_parallel *hp,
+			 struct tracecmd_input *handle, int cpu)
+{
+	unsigned long long offset = tracecmd_cpu_data_offset(handle, cpu);
+	unsigned long long size = tracecmd_cpu_data_size(handle, cpu);
+	unsigned long long length;
+	struct hist_segment *segments;
+	unsigned long long pos;
+	int nr;
+
+	length = (unsigned long long)HIST_SEGMENT_PAGES *
+		tracecmd_page_size(handle);
+	nr = (size + length - 1) / length;
+	if (!nr)
+		return;
+
+	segments = realloc(hp->segments,
+			   (hp->nr_segments + nr) * sizeof(*segments));
+	if (!segments)
+		die("malloc");
+	hp->segments = segments;
+
+	for (pos = 0; pos < size; pos += length) {
+		segments = &hp->segments[hp->nr_segments++];
+		segments->cpu = cpu;
+		segments->start = offset + pos;
+		segments->end = offset + (pos + length < size ?
+					  pos + length : size);
+	}
+}
+
+/*
+ * Start the threads, and read the data in the same order as the
+ * serial case. The call chains saved from now on go to the shards,
+ * until finish_hist_parallel() is called.
+ */
+static struct hist_parallel *
+read_hist_parallel(struct tracecmd_input *handle,
+		   struct tracecmd_input **inputs, int nr_inputs,
+		   int nr_threads)
+{
+	struct hist_parallel *hp;
+	struct hist_chunk *chunk;
+	int cpus = tracecmd_cpus(handle);
+	int cpu;
+	int i;
+	int j;
+
+	hp = zalloc(sizeof(*hp));
+	if (!hp)
+		die("malloc");
+
+	hp->pevent = tracecmd_get_pevent(handle);
+	pthread_mutex_init(&hp->lock, NULL);
+	pthread_cond_init(&hp->cond, NULL);
+	pthread_cond_init(&hp->data_cond, NULL);
+	pthread_cond_init(&hp->space_cond, NULL);
+
+	for (cpu = 0; cpu < cpus; cpu++)
+		add_segments(hp, handle, cpu);
+
+	hp->nr_decoders = nr_inputs;
+	hp->nr_chunks = nr_inputs * 2 + 2;
+	hp->nr_shards = nr_threads;
+	hp->chunks = calloc(hp->nr_chunks, sizeof(*hp->chunks));
+	hp->decoders = calloc(hp->nr_decoders, sizeof(*hp->decoders));
+	hp->shards = calloc(hp->nr_shards, sizeof(*hp->shards));
+	if (!hp->chunks || !hp->decoders || !hp->shards)
+		die("malloc");
+
+	for (i = 0; i < hp->nr_shards; i++) {
+		hp->shards[i].hp = hp;
+		if (pthread_create(&hp->shards[i].thread, NULL,
+				   hist_shard, &hp->shards[i]))
+			die("Could not create hist thread");
+	}
+
+	for (i = 0; i < hp->nr_decoders; i++) {
+		hp->decoders[i].hp = hp;
+		hp->decoders[i].handle = inputs[i];
+		if (pthread_create(&hp->decoders[i].thread, NULL,
+				   hist_decoder, &hp->decoders[i]))
+			die("Could not create hist thread");
+	}
+
+	hist_parallel = hp;
+
+	for (i = 0; i < hp->nr_segments; i++) {
+		chunk = &hp->chunks[i % hp->nr_chunks];
+
+		pthread_mutex_lock(&hp->lock);
+		while (!chunk->decoded)
+			pthread_cond_wait(&hp->cond, &hp->lock);
+		pthread_mutex_unlock(&hp->lock);
+
+		for (j = 0; j < chunk->nr_entries; j++)
+			replay_hist_entry(hp->pevent, &chunk->entries[j]);
+		chunk->nr_entries = 0;
+
+		pthread_mutex_lock(&hp->lock);
+		chunk->decoded = false;
+		hp->consumed++;
+		pthread_cond_broadcast(&hp->cond);
+		pthread_mutex_unlock(&hp->lock);
+	}
+
+	for (i = 0; i < hp->nr_decoders; i++)
+		pthread_join(hp->decoders[i].thread, NULL);
+
+	for (i = 0; i < hp->nr_chunks; i++)
+		free(hp->chunks[i].entries);
+	free(hp->chunks);
+	free(hp->decoders);
+	free(hp->segments);
+
+	return hp;
+}
+
+/* Wait for the shards, and merge their top level chains */
+static void finish_hist_parallel(struct hist_parallel *hp)
+{
+	struct chain **next = &chains;
+	struct hist_shard *shard;
+	struct hist_shard *newest;
+	int i;
+
+	hist_parallel = NULL;
+
+	for (i = 0; i < hp->nr_shards; i++)
+		send_batch(hp, &hp->shards[i]);
+
+	pthread_mutex_lock(&hp->lock);
+	hp->done = true;
+	pthread_cond_broadcast(&hp->data_cond);
+	pthread_mutex_unlock(&hp->lock);
+
+	for (i = 0; i < hp->nr_shards; i++)
+		pthread_join(hp->shards[i].thread, NULL);
+
+	for (i = 0; i < hp->nr_shards; i++) {
+		nr_chains += hp->shards[i].nr_chains;
+		total_counts += hp->shards[i].total_counts;
+	}
+
+	/* add_chain() adds the newest chain to the front */
+	for (;;) {
+		newest = NULL;
+		for (i = 0; i < hp->nr_shards; i++) {
+			shard = &hp->shards[i];
+			if (shard->chains &&
+			    (!newest || newer_chain(shard->chains, newest->chains)))
+				newest = shard;
+		}
+		if (!newest)
+			break;
+		*next = newest->chains;
+		newest->chains = newest->chains->next;
+		next = &(*next)->next;
+	}
+	*next = NULL;
+
+	for (i = 0; i < hp->nr_shards; i++)
+		free(hp->shards[i].hash.slots);
+
+	pthread_cond_destroy(&hp->space_cond);
+	pthread_cond_destroy(&hp->data_cond);
+	pthread_cond_destroy(&hp->cond);
+	pthread_mutex_destroy(&hp->lock);
+	free(hp->shards);
+	free(hp);
+}
+
+/*
+ * Open additional handles of the trace data, one for each thread that
+ * decodes the data. Returns the number of handles opened.
+ */
+static int open_hist_inputs(const char *file, struct tracecmd_input ***inputs,
+			    int nr_threads)
+{
+	struct tracecmd_input *handle;
+	int nr = 0;
+
+	*inputs = calloc(nr_threads, sizeof(**inputs));
+	if (!*inputs)
+		die("malloc");
+
+	while (nr < nr_threads) {
+		handle = tracecmd_alloc(file);
+		if (!handle)
+			break;
+
+		/* The main handle already warns about the event formats */
+		tracecmd_set_flag(handle, TRACECMD_FL_QUIET);
+		tep_set_flag(tracecmd_get_pevent(handle), TEP_QUIET);
+		if (tracecmd_read_headers(handle) ||
+		    tracecmd_init_data(handle)) {
+			tracecmd_close(handle);
+			break;
+		}
+
+		(*inputs)[nr++] = handle;
+	}
+
+	return nr;
+}
+
 enum field { NEXT_PTR, SIB_PTR };
 
 static struct chain *next_ptr(struct chain *chain, enum field field)
@@ -931,14 +1707,19 @@ static void print_chains(struct tep_handle *pevent)
 	}
 }
 
-static void do_trace_hist(struct tracecmd_input *handle)
+static void do_trace_hist(struct tracecmd_input *handle, const char *file,
+			  int nr_threads)
 {
 	struct tep_handle *pevent = tracecmd_get_pevent(handle);
+	struct tracecmd_input **inputs = NULL;
+	struct hist_parallel *hp = NULL;
 	struct tep_record *record;
 	struct tep_event *event;
+	int nr_inputs = 0;
 	int cpus;
 	int cpu;
 	int ret;
+	int i;
 
 	cpus = tracecmd_cpus(handle);
 
@@ -972,23 +1753,42 @@ static void do_trace_hist(struct tracecmd_input *handle)
 	update_function_graph_exit(pevent);
 	update_kernel_stack(pevent);
 
-	for (cpu = 0; cpu < cpus; cpu++) {
-		for (;;) {
-			struct tep_record *record;
+	/*
+	 * The threads look up the functions with the main handle, so that
+	 * the names of the functions can still be compared as pointers.
+	 * Looking up a function builds the function map, which is then only
+	 * read. The comms are only touched by this thread.
+	 */
+	if (nr_threads > 1) {
+		tep_find_function(pevent, 0);
+		nr_inputs = open_hist_inputs(file, &inputs, nr_threads);
+	}
 
-			record = tracecmd_read_data(handle, cpu);
-			if (!record)
-				break;
+	if (nr_inputs) {
+		hp = read_hist_parallel(handle, inputs, nr_inputs, nr_threads);
+	} else {
+		for (cpu = 0; cpu < cpus; cpu++) {
+			for (;;) {
+				struct tep_record *record;
 
-			/* If we missed events, just flush out the current stack */
-			if (record->missed_events)
-				flush_stack();
+				record = tracecmd_read_data(handle, cpu);
+				if (!record)
+					break;
+
+				/* If we missed events, just flush out the current stack */
+				if (record->missed_events)
+					flush_stack();
 
-			process_record(pevent, record);
-			free_record(record);
+				process_record(pevent, record);
+				free_record(record);
+			}
 		}
 	}
 
+	for (i = 0; i < nr_inputs; i++)
+		tracecmd_close(inputs[i]);
+	free(inputs);
+
 	if (current_pid >= 0)
 		save_call_chain(current_pid, ips, ips_idx, 0);
 	if (pending_pid >= 0)
@@ -996,21 +1796,36 @@ static void do_trace_hist(struct tracecmd_input *handle)
 
 	save_stored_stacks();
 
+	if (hp)
+		finish_hist_parallel(hp);
+
 	sort_chains();
 	print_chains(pevent);
 }
 
+enum {
+	OPT_threads	= 255,
+};
+
 void trace_hist(int argc, char **argv)
 {
 	struct tracecmd_input *handle;
 	const char *input_file = NULL;
+	int nr_threads = 0;
 	int instances;
 	int ret;
 
 	for (;;) {
 		int c;
-
-		c = getopt(argc-1, argv+1, "+hi:P");
+		int option_index = 0;
+		static struct option long_options[] = {
+			{"threads", required_argument, NULL, OPT_threads},
+			{"help", no_argument, NULL, '?'},
+			{NULL, 0, NULL, 0}
+		};
+
+		c = getopt_long (argc-1, argv+1, "+hi:P",
+			long_options, &option_index);
 		if (c == -1)
 			break;
 		switch (c) {
@@ -1025,6 +1840,9 @@ void trace_hist(int argc, char **argv)
 		case 'P':
 			compact = 1;
 			break;
+		case OPT_threads:
+			nr_threads = atoi(optarg);
+			break;
 		default:
 			usage(argv);
 		}
@@ -1065,11 +1883,12 @@ void trace_hist(int argc, char **argv)
 				warning("could not retrieve handle %d", i);
 				continue;
 			}
-			do_trace_hist(new_handle);
+			/* The instances share the chains, read them serially */
+			do_trace_hist(new_handle, NULL, 0);
 			tracecmd_close(new_handle);
 		}
 	} else {
-		do_trace_hist(handle);
+		do_trace_hist(handle, input_file, nr_threads);
 	}
 
 	tracecmd_close(handle);
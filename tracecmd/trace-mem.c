@@ -18,6 +18,7 @@
 #include <string.h>
 #include <getopt.h>
 #include <signal.h>
+#include <pthread.h>
 
 #include "trace-local.h"
 #include "trace-hash-local.h"
@@ -181,11 +182,35 @@ struct ptr_descr {
 #define HASH_MASK	(HASH_SIZE - 1);
 
 static struct func_descr *func_hash[HASH_SIZE];
-static struct ptr_descr *ptr_hash[HASH_SIZE];
 static struct func_descr **func_list;
 
 static unsigned func_count;
 
+/*
+ * The live pointers are kept in an open-addressing table with linear
+ * probing, that doubles its size when it gets half full. The descriptors
+ * are allocated from slabs, and the freed ones are kept on a free list
+ * (linked by their next field) for reuse.
+ */
+struct ptr_table {
+	struct ptr_descr	**slots;
+	unsigned int		bits;
+	unsigned long		count;
+};
+
+#define PTR_TABLE_BITS	12
+#define PTR_SLAB_SIZE	4096
+
+struct ptr_slab {
+	struct ptr_slab		*next;
+	struct ptr_descr	descrs[PTR_SLAB_SIZE];
+};
+
+static struct ptr_table ptr_table;
+static struct ptr_slab *ptr_slabs;
+static int ptr_slab_used = PTR_SLAB_SIZE;
+static struct ptr_descr *free_ptrs;
+
 static int make_key(const void *ptr, int size)
 {
 	int key = 0;
@@ -234,59 +259,136 @@ static struct func_descr *create_func(const char *func)
 	return funcd;
 }
 
-static struct ptr_descr *find_ptr(unsigned long long ptr)
+static void ptr_table_init(struct ptr_table *table, unsigned int bits)
 {
-	struct ptr_descr *ptrd;
-	int key = make_key(&ptr, sizeof(ptr)) & HASH_MASK;
+	table->slots = calloc(1UL << bits, sizeof(*table->slots));
+	if (!table->slots)
+		die("malloc");
+	table->bits = bits;
+	table->count = 0;
+}
 
-	for (ptrd = ptr_hash[key]; ptrd; ptrd = ptrd->next) {
-		if (ptrd->ptr == ptr)
-			return ptrd;
-	}
+static void ptr_table_clear(struct ptr_table *table)
+{
+	if (!table->count)
+		return;
+	memset(table->slots, 0, sizeof(*table->slots) << table->bits);
+	table->count = 0;
+}
 
-	return NULL;
+static unsigned long ptr_slot(struct ptr_table *table, unsigned long long ptr)
+{
+	/* The low bits of the pointers are mostly zero, use the high bits */
+	return (ptr * 0x9e3779b97f4a7c15ULL) >> (64 - table->bits);
 }
 
-static struct ptr_descr *create_ptr(unsigned long long ptr)
+/*
+ * Returns the slot that holds @ptr, or the empty slot where @ptr
+ * would be added.
+ */
+static unsigned long ptr_table_lookup(struct ptr_table *table,
+				      unsigned long long ptr)
 {
-	struct ptr_descr *ptrd;
-	int key = make_key(&ptr, sizeof(ptr)) & HASH_MASK;
+	unsigned long mask = (1UL << table->bits) - 1;
+	unsigned long i;
 
-	ptrd = zalloc(sizeof(*ptrd));
-	if (!ptrd)
-		die("malloc");
+	for (i = ptr_slot(table, ptr); table->slots[i]; i = (i + 1) & mask) {
+		if (table->slots[i]->ptr == ptr)
+			break;
+	}
 
-	ptrd->ptr = ptr;
-	ptrd->next = ptr_hash[key];
-	ptr_hash[key] = ptrd;
+	return i;
+}
 
-	return ptrd;
+/* Make room for one more pointer. Must be called before the lookup. */
+static void ptr_table_reserve(struct ptr_table *table)
+{
+	struct ptr_descr **slots = table->slots;
+	unsigned long size = 1UL << table->bits;
+	unsigned long count = table->count;
+	unsigned long i;
+
+	if ((table->count + 1) * 2 <= size)
+		return;
+
+	ptr_table_init(table, table->bits + 1);
+	for (i = 0; i < size; i++) {
+		if (slots[i])
+			table->slots[ptr_table_lookup(table, slots[i]->ptr)] = slots[i];
+	}
+	table->count = count;
+	free(slots);
 }
 
-static void remove_ptr(unsigned long long ptr)
+static void ptr_table_delete(struct ptr_table *table, unsigned long i)
 {
-	struct ptr_descr *ptrd, **last;
-	int key = make_key(&ptr, sizeof(ptr)) & HASH_MASK;
+	unsigned long mask = (1UL << table->bits) - 1;
+	unsigned long j = i;
+	unsigned long k;
 
-	last = &ptr_hash[key];
-	for (ptrd = ptr_hash[key]; ptrd; ptrd = ptrd->next) {
-		if (ptrd->ptr == ptr)
+	/* Move back the following entries that would not be found otherwise */
+	for (;;) {
+		j = (j + 1) & mask;
+		if (!table->slots[j])
 			break;
-		last = &ptrd->next;
+		k = ptr_slot(table, table->slots[j]->ptr);
+		if ((j > i && (k <= i || k > j)) ||
+		    (j < i && (k <= i && k > j))) {
+			table->slots[i] = table->slots[j];
+			i = j;
+		}
+	}
+	table->slots[i] = NULL;
+	table->count--;
+}
+
+static struct ptr_descr *alloc_ptr(void)
+{
+	struct ptr_descr *ptrd;
+	struct ptr_slab *slab;
+
+	if (free_ptrs) {
+		ptrd = free_ptrs;
+		free_ptrs = ptrd->next;
+	} else {
+		if (ptr_slab_used == PTR_SLAB_SIZE) {
+			slab = malloc(sizeof(*slab));
+			if (!slab)
+				die("malloc");
+			slab->next = ptr_slabs;
+			ptr_slabs = slab;
+			ptr_slab_used = 0;
+		}
+		ptrd = &ptr_slabs->descrs[ptr_slab_used++];
 	}
 
+	memset(ptrd, 0, sizeof(*ptrd));
+
+	return ptrd;
+}
+
+static void free_ptr(struct ptr_descr *ptrd)
+{
+	ptrd->next = free_ptrs;
+	free_ptrs = ptrd;
+}
+
+static void remove_ptr(unsigned long long ptr)
+{
+	unsigned long i = ptr_table_lookup(&ptr_table, ptr);
+	struct ptr_descr *ptrd = ptr_table.slots[i];
+
 	if (!ptrd)
 		return;
 
-	*last = ptrd->next;
-	free(ptrd);
+	ptr_table_delete(&ptr_table, i);
+	free_ptr(ptrd);
 }
 
-static void add_kmalloc(const char *func, unsigned long long ptr,
-			unsigned int req, int alloc)
+static struct func_descr *
+account_kmalloc(const char *func, unsigned int req, int alloc)
 {
 	struct func_descr *funcd;
-	struct ptr_descr *ptrd;
 
 	funcd = find_func(func);
 	if (!funcd)
@@ -301,9 +403,27 @@ static void add_kmalloc(const char *func, unsigned long long ptr,
 	if (funcd->current_req > funcd->max_req)
 		funcd->max_req = funcd->current_req;
 
-	ptrd = find_ptr(ptr);
-	if (!ptrd)
-		ptrd = create_ptr(ptr);
+	return funcd;
+}
+
+static void add_kmalloc(const char *func, unsigned long long ptr,
+			unsigned int req, int alloc)
+{
+	struct func_descr *funcd;
+	struct ptr_descr *ptrd;
+	unsigned long i;
+
+	funcd = account_kmalloc(func, req, alloc);
+
+	ptr_table_reserve(&ptr_table);
+	i = ptr_table_lookup(&ptr_table, ptr);
+	ptrd = ptr_table.slots[i];
+	if (!ptrd) {
+		ptrd = alloc_ptr();
+		ptrd->ptr = ptr;
+		ptr_table.slots[i] = ptrd;
+		ptr_table.count++;
+	}
 
 	ptrd->alloc = alloc;
 	ptrd->req = req;
@@ -314,8 +434,10 @@ static void remove_kmalloc(unsigned long long ptr)
 {
 	struct func_descr *funcd;
 	struct ptr_descr *ptrd;
+	unsigned long i;
 
-	ptrd = find_ptr(ptr);
+	i = ptr_table_lookup(&ptr_table, ptr);
+	ptrd = ptr_table.slots[i];
 	if (!ptrd)
 		return;
 
@@ -323,22 +445,39 @@ static void remove_kmalloc(unsigned long long ptr)
 	funcd->current_alloc -= ptrd->alloc;
 	funcd->current_req -= ptrd->req;
 
-	remove_ptr(ptr);
+	ptr_table_delete(&ptr_table, i);
+	free_ptr(ptrd);
 }
 
-static void
-process_kmalloc(struct tep_handle *pevent, struct tep_record *record,
-		struct tep_format_field *callsite_field,
-		struct tep_format_field *bytes_req_field,
-		struct tep_format_field *bytes_alloc_field,
-		struct tep_format_field *ptr_field)
+enum {
+	MEM_NOP,
+	MEM_ALLOC,
+	MEM_FREE,
+};
+
+struct mem_entry {
+	/* Must be first, the per CPU pair tables point to it */
+	struct ptr_descr	descr;
+	unsigned long long	ts;
+	const char		*func;
+	int			type;
+	/* Set on an alloc that is freed later in the same chunk */
+	int			paired;
+};
+
+static int
+read_kmalloc(struct tep_handle *pevent, struct tep_record *record,
+	     struct mem_entry *entry,
+	     struct tep_format_field *callsite_field,
+	     struct tep_format_field *bytes_req_field,
+	     struct tep_format_field *bytes_alloc_field,
+	     struct tep_format_field *ptr_field)
 {
 	unsigned long long callsite;
 	unsigned long long val;
 	unsigned long long ptr;
 	unsigned int req;
 	int alloc;
-	const char *func;
 
 	tep_read_number_field(callsite_field, record->data, &callsite);
 	tep_read_number_field(bytes_req_field, record->data, &val);
@@ -347,62 +486,469 @@ process_kmalloc(struct tep_handle *pevent, struct tep_record *record,
 	alloc = val;
 	tep_read_number_field(ptr_field, record->data, &ptr);
 
-	func = tep_find_function(pevent, callsite);
+	entry->func = tep_find_function(pevent, callsite);
+	entry->descr.ptr = ptr;
+	entry->descr.req = req;
+	entry->descr.alloc = alloc;
 
-	add_kmalloc(func, ptr, req, alloc);
+	return entry->type = MEM_ALLOC;
 }
 
-static void
-process_kfree(struct tep_handle *pevent, struct tep_record *record,
-	      struct tep_format_field *ptr_field)
+static int
+read_kfree(struct tep_record *record, struct mem_entry *entry,
+	   struct tep_format_field *ptr_field)
 {
 	unsigned long long ptr;
 
 	tep_read_number_field(ptr_field, record->data, &ptr);
 
-	remove_kmalloc(ptr);
+	entry->descr.ptr = ptr;
+
+	return entry->type = MEM_FREE;
 }
 
-static void
-process_record(struct tep_handle *pevent, struct tep_record *record)
+static int
+read_mem_record(struct tep_handle *pevent, struct tep_record *record,
+		struct mem_entry *entry)
 {
 	unsigned long long val;
 	int type;
 
+	memset(entry, 0, sizeof(*entry));
+	entry->ts = record->ts;
+
 	tep_read_number_field(common_type_field, record->data, &val);
 	type = val;
 
 	if (type == kmalloc_type)
-		return process_kmalloc(pevent, record,
-				       kmalloc_callsite_field,
-				       kmalloc_bytes_req_field,
-				       kmalloc_bytes_alloc_field,
-				       kmalloc_ptr_field);
+		return read_kmalloc(pevent, record, entry,
+				    kmalloc_callsite_field,
+				    kmalloc_bytes_req_field,
+				    kmalloc_bytes_alloc_field,
+				    kmalloc_ptr_field);
 	if (type == kmalloc_node_type)
-		return process_kmalloc(pevent, record,
-				       kmalloc_node_callsite_field,
-				       kmalloc_node_bytes_req_field,
-				       kmalloc_node_bytes_alloc_field,
-				       kmalloc_node_ptr_field);
+		return read_kmalloc(pevent, record, entry,
+				    kmalloc_node_callsite_field,
+				    kmalloc_node_bytes_req_field,
+				    kmalloc_node_bytes_alloc_field,
+				    kmalloc_node_ptr_field);
 	if (type == kfree_type)
-		return process_kfree(pevent, record, kfree_ptr_field);
+		return read_kfree(record, entry, kfree_ptr_field);
 
 	if (type == kmem_cache_alloc_type)
-		return process_kmalloc(pevent, record,
-				       kmem_cache_callsite_field,
-				       kmem_cache_bytes_req_field,
-				       kmem_cache_bytes_alloc_field,
-				       kmem_cache_ptr_field);
+		return read_kmalloc(pevent, record, entry,
+				    kmem_cache_callsite_field,
+				    kmem_cache_bytes_req_field,
+				    kmem_cache_bytes_alloc_field,
+				    kmem_cache_ptr_field);
 	if (type == kmem_cache_alloc_node_type)
-		return process_kmalloc(pevent, record,
-				       kmem_cache_node_callsite_field,
-				       kmem_cache_node_bytes_req_field,
-				       kmem_cache_node_bytes_alloc_field,
-				       kmem_cache_node_ptr_field);
+		return read_kmalloc(pevent, record, entry,
+				    kmem_cache_node_callsite_field,
+				    kmem_cache_node_bytes_req_field,
+				    kmem_cache_node_bytes_alloc_field,
+				    kmem_cache_node_ptr_field);
 	if (type == kmem_cache_free_type)
-		return process_kfree(pevent, record, kmem_cache_free_ptr_field);
+		return read_kfree(record, entry, kmem_cache_free_ptr_field);
+
+	return entry->type = MEM_NOP;
+}
+
+static void
+process_record(struct tep_handle *pevent, struct tep_record *record)
+{
+	struct mem_entry entry;
+
+	switch (read_mem_record(pevent, record, &entry)) {
+	case MEM_ALLOC:
+		add_kmalloc(entry.func, entry.descr.ptr,
+			    entry.descr.req, entry.descr.alloc);
+		break;
+	case MEM_FREE:
+		remove_kmalloc(entry.descr.ptr);
+		break;
+	}
+}
+
+/*
+ * Parallel pass.
+ *
+ * Each CPU of the trace is read by a worker thread, that decodes the
+ * records into chunks of entries. Within a chunk, an alloc of a pointer
+ * that is freed later on the same CPU is marked as paired. The main thread
+ * merges the chunks of the CPUs by timestamp, the same way
+ * tracecmd_read_next_data() does.
+ *
+ * The paired allocs are kept in a small table of pending pointers,
+ * that point to the entries of the chunks. Only the pointers that live
+ * longer than a chunk, or that are freed on another CPU, go through the
+ * global pointer table. A pointer is never in both tables, and the two
+ * together hold the same pointers as the global table of the serial case
+ * does, so the result is the same.
+ */
+#define MEM_CHUNK_ENTRIES	8192
+#define MEM_MAX_CHUNKS		8
+
+struct mem_chunk {
+	struct mem_chunk	*next;
+	int			nr;
+	int			pos;
+	struct mem_entry	entries[MEM_CHUNK_ENTRIES];
+};
+
+struct mem_cpu {
+	struct tracecmd_input	*handle;
+	int			cpu;
+	int			done;
+
+	/* Chunks ready to be merged by the main thread */
+	struct mem_chunk	*head;
+	struct mem_chunk	*tail;
+	int			nr_chunks;
+
+	/* The chunk being merged by the main thread */
+	struct mem_chunk	*curr;
+
+	/* The unpaired allocs of the chunk being read */
+	struct ptr_table	pairs;
+};
+
+struct mem_parallel;
+
+struct mem_worker {
+	struct mem_parallel	*mp;
+	pthread_t		thread;
+	int			id;
+};
+
+struct mem_parallel {
+	struct tep_handle	*pevent;
+	struct mem_cpu		*cpus;
+	int			nr_cpus;
+	int			nr_workers;
+	pthread_mutex_t		lock;
+	pthread_cond_t		data_cond;
+	pthread_cond_t		space_cond;
+};
+
+static void pair_mem_entry(struct mem_cpu *mc, struct mem_entry *entry)
+{
+	struct ptr_table *pairs = &mc->pairs;
+	struct mem_entry *alloc;
+	unsigned long i;
+
+	switch (entry->type) {
+	case MEM_ALLOC:
+		ptr_table_reserve(pairs);
+		i = ptr_table_lookup(pairs, entry->descr.ptr);
+		if (!pairs->slots[i])
+			pairs->count++;
+		pairs->slots[i] = &entry->descr;
+		break;
+	case MEM_FREE:
+		i = ptr_table_lookup(pairs, entry->descr.ptr);
+		if (!pairs->slots[i])
+			break;
+		alloc = (struct mem_entry *)pairs->slots[i];
+		alloc->paired = 1;
+		ptr_table_delete(pairs, i);
+		break;
+	}
+}
+
+static struct mem_chunk *
+read_mem_chunk(struct mem_parallel *mp, struct mem_cpu *mc, int *done)
+{
+	struct mem_chunk *chunk;
+	struct mem_entry *entry;
+	struct tep_record *record;
+	struct tep_record *next;
+
+	chunk = malloc(sizeof(*chunk));
+	if (!chunk)
+		die("malloc");
+	chunk->next = NULL;
+	chunk->nr = 0;
+	chunk->pos = 0;
+
+	*done = 0;
+
+	while (chunk->nr < MEM_CHUNK_ENTRIES) {
+		record = tracecmd_read_data(mc->handle, mc->cpu);
+		if (!record) {
+			*done = 1;
+			break;
+		}
+		next = tracecmd_peek_data(mc->handle, mc->cpu);
+
+		entry = &chunk->entries[chunk->nr];
+		read_mem_record(mp->pevent, record, entry);
+		pair_mem_entry(mc, entry);
+
+		/*
+		 * Other events are only kept if their timestamp goes back
+		 * in time, as that changes the order of the merge.
+		 */
+		if (entry->type != MEM_NOP || (next && next->ts < record->ts))
+			chunk->nr++;
+
+		free_record(record);
+	}
+
+	ptr_table_clear(&mc->pairs);
+
+	return chunk;
 }
 
+static struct mem_cpu *
+next_worker_cpu(struct mem_parallel *mp, int id, int *all_done)
+{
+	struct mem_cpu *mc = NULL;
+	struct mem_cpu *c;
+	int cpu;
+
+	*all_done = 1;
+
+	/* Fill the CPU that the main thread is most likely to wait on */
+	for (cpu = id; cpu < mp->nr_cpus; cpu += mp->nr_workers) {
+		c = &mp->cpus[cpu];
+		if (c->done)
+			continue;
+		*all_done = 0;
+		if (c->nr_chunks >= MEM_MAX_CHUNKS)
+			continue;
+		if (!mc || c->nr_chunks < mc->nr_chunks)
+			mc = c;
+	}
+
+	return mc;
+}
+
+static void *mem_worker(void *data)
+{
+	struct mem_worker *worker = data;
+	struct mem_parallel *mp = worker->mp;
+	struct mem_chunk *chunk;
+	struct mem_cpu *mc;
+	int all_done;
+	int done;
+
+	for (;;) {
+		pthread_mutex_lock(&mp->lock);
+		while (!(mc = next_worker_cpu(mp, worker->id, &all_done)) &&
+		       !all_done)
+			pthread_cond_wait(&mp->space_cond, &mp->lock);
+		pthread_mutex_unlock(&mp->lock);
+
+		if (!mc)
+			break;
+
+		chunk = read_mem_chunk(mp, mc, &done);
+
+		pthread_mutex_lock(&mp->lock);
+		if (chunk->nr) {
+			if (mc->tail)
+				mc->tail->next = chunk;
+			else
+				mc->head = chunk;
+			mc->tail = chunk;
+			mc->nr_chunks++;
+		} else {
+			free(chunk);
+		}
+		mc->done = done;
+		pthread_cond_broadcast(&mp->data_cond);
+		pthread_mutex_unlock(&mp->lock);
+	}
+
+	return NULL;
+}
+
+static struct mem_entry *
+peek_mem_entry(struct mem_parallel *mp, struct mem_cpu *mc)
+{
+	struct mem_chunk *chunk = mc->curr;
+
+	if (chunk && chunk->pos < chunk->nr)
+		return &chunk->entries[chunk->pos];
+
+	free(chunk);
+
+	pthread_mutex_lock(&mp->lock);
+	while (!mc->head && !mc->done)
+		pthread_cond_wait(&mp->data_cond, &mp->lock);
+
+	chunk = mc->head;
+	if (chunk) {
+		mc->head = chunk->next;
+		if (!mc->head)
+			mc->tail = NULL;
+		mc->nr_chunks--;
+		pthread_cond_broadcast(&mp->space_cond);
+	}
+	pthread_mutex_unlock(&mp->lock);
+
+	mc->curr = chunk;
+
+	return chunk ? &chunk->entries[0] : NULL;
+}
+
+static void replay_mem_entry(struct ptr_table *pending,
+			     struct mem_entry *entry)
+{
+	struct ptr_descr *ptrd;
+	unsigned long i;
+
+	i = ptr_table_lookup(pending, entry->descr.ptr);
+	ptrd = pending->slots[i];
+
+	switch (entry->type) {
+	case MEM_ALLOC:
+		if (!entry->paired) {
+			if (ptrd)
+				ptr_table_delete(pending, i);
+			add_kmalloc(entry->func, entry->descr.ptr,
+				    entry->descr.req, entry->descr.alloc);
+			break;
+		}
+
+		entry->descr.func = account_kmalloc(entry->func,
+						    entry->descr.req,
+						    entry->descr.alloc);
+		/* Replace the pointer, as add_kmalloc() would */
+		if (!ptrd) {
+			remove_ptr(entry->descr.ptr);
+			ptr_table_reserve(pending);
+			i = ptr_table_lookup(pending, entry->descr.ptr);
+			pending->count++;
+		}
+		pending->slots[i] = &entry->descr;
+		break;
+	case MEM_FREE:
+		if (!ptrd) {
+			remove_kmalloc(entry->descr.ptr);
+			break;
+		}
+		ptrd->func->current_alloc -= ptrd->alloc;
+		ptrd->func->current_req -= ptrd->req;
+		ptr_table_delete(pending, i);
+		break;
+	}
+}
+
+static void read_mem_parallel(struct tep_handle *pevent,
+			      struct tracecmd_input **inputs, int nr_inputs,
+			      int cpus)
+{
+	struct mem_worker *workers;
+	struct ptr_table pending;
+	struct mem_parallel mp;
+	struct mem_entry *entry;
+	struct mem_entry *next;
+	struct mem_cpu *mc;
+	int next_cpu = -1;
+	int cpu;
+	int i;
+
+	memset(&mp, 0, sizeof(mp));
+	mp.pevent = pevent;
+	mp.nr_cpus = cpus;
+	mp.nr_workers = nr_inputs;
+	pthread_mutex_init(&mp.lock, NULL);
+	pthread_cond_init(&mp.data_cond, NULL);
+	pthread_cond_init(&mp.space_cond, NULL);
+
+	mp.cpus = calloc(mp.nr_cpus, sizeof(*mp.cpus));
+	workers = calloc(mp.nr_workers, sizeof(*workers));
+	if (!mp.cpus || !workers)
+		die("malloc");
+
+	for (cpu = 0; cpu < mp.nr_cpus; cpu++) {
+		mc = &mp.cpus[cpu];
+		mc->cpu = cpu;
+		mc->handle = inputs[cpu % mp.nr_workers];
+		ptr_table_init(&mc->pairs, PTR_TABLE_BITS);
+	}
+
+	ptr_table_init(&pending, PTR_TABLE_BITS);
+
+	for (i = 0; i < mp.nr_workers; i++) {
+		workers[i].mp = &mp;
+		workers[i].id = i;
+		if (pthread_create(&workers[i].thread, NULL,
+				   mem_worker, &workers[i]))
+			die("Could not create mem thread");
+	}
+
+	for (;;) {
+		next = NULL;
+		for (cpu = 0; cpu < mp.nr_cpus; cpu++) {
+			entry = peek_mem_entry(&mp, &mp.cpus[cpu]);
+			if (entry && (!next || entry->ts < next->ts)) {
+				next = entry;
+				next_cpu = cpu;
+			}
+		}
+		if (!next)
+			break;
+
+		mc = &mp.cpus[next_cpu];
+		replay_mem_entry(&pending, next);
+		mc->curr->pos++;
+	}
+
+	for (i = 0; i < mp.nr_workers; i++)
+		pthread_join(workers[i].thread, NULL);
+
+	for (cpu = 0; cpu < mp.nr_cpus; cpu++)
+		free(mp.cpus[cpu].pairs.slots);
+	free(pending.slots);
+
+	pthread_cond_destroy(&mp.space_cond);
+	pthread_cond_destroy(&mp.data_cond);
+	pthread_mutex_destroy(&mp.lock);
+	free(workers);
+	free(mp.cpus);
+}
+
+/*
+ * Open additional handles of the trace data, one for each thread. There is
+ * no point in having more threads than CPUs in the trace. Returns the number
+ * of handles opened.
+ */
+static int open_mem_inputs(const char *file, struct tracecmd_input ***inputs,
+			   int nr_threads, int cpus)
+{
+	struct tracecmd_input *handle;
+	int nr = 0;
+
+	if (nr_threads > cpus)
+		nr_threads = cpus;
+
+	*inputs = calloc(nr_threads, sizeof(**inputs));
+	if (!*inputs)
+		die("malloc");
+
+	while (nr < nr_threads) {
+		handle = tracecmd_alloc(file);
+		if (!handle)
+			break;
+
+		/* The main handle already warns about the event formats */
+		tracecmd_set_flag(handle, TRACECMD_FL_QUIET);
+		tep_set_flag(tracecmd_get_pevent(handle), TEP_QUIET);
+		if (tracecmd_read_headers(handle) ||
+		    tracecmd_init_data(handle)) {
+			tracecmd_close(handle);
+			break;
+		}
+
+		(*inputs)[nr++] = handle;
+	}
+
+	return nr;
+}
+
+
 static int func_cmp(const void *a, const void *b)
 {
 	const struct func_descr *fa = *(const struct func_descr **)a;
@@ -459,15 +1005,19 @@ static void print_list(void)
 	}
 }
 
-static void do_trace_mem(struct tracecmd_input *handle)
+static void do_trace_mem(struct tracecmd_input *handle, const char *file,
+			 int nr_threads)
 {
 	struct tep_handle *pevent = tracecmd_get_pevent(handle);
+	struct tracecmd_input **inputs = NULL;
 	struct tep_record *record;
 	struct tep_event *event;
 	int missed_events = 0;
+	int nr_inputs = 0;
 	int cpus;
 	int cpu;
 	int ret;
+	int i;
 
 	ret = tracecmd_init_data(handle);
 	if (ret < 0)
@@ -501,30 +1051,59 @@ static void do_trace_mem(struct tracecmd_input *handle)
 	update_kmem_cache_alloc_node(pevent);
 	update_kmem_cache_free(pevent);
 
-	while ((record = tracecmd_read_next_data(handle, &cpu))) {
+	ptr_table_init(&ptr_table, PTR_TABLE_BITS);
 
-		/* record missed event */
-		if (!missed_events && record->missed_events)
-			missed_events = 1;
+	/*
+	 * The threads look up the functions with the main handle, so that
+	 * the names of the functions can still be compared as pointers.
+	 */
+	if (nr_threads > 1 && cpus > 1 && !tep_init_lookup_maps(pevent))
+		nr_inputs = open_mem_inputs(file, &inputs, nr_threads, cpus);
 
-		process_record(pevent, record);
-		free_record(record);
+	if (nr_inputs) {
+		read_mem_parallel(pevent, inputs, nr_inputs, cpus);
+	} else {
+		while ((record = tracecmd_read_next_data(handle, &cpu))) {
+
+			/* record missed event */
+			if (!missed_events && record->missed_events)
+				missed_events = 1;
+
+			process_record(pevent, record);
+			free_record(record);
+		}
 	}
 
+	for (i = 0; i < nr_inputs; i++)
+		tracecmd_close(inputs[i]);
+	free(inputs);
+
 	sort_list();
 	print_list();
 }
 
+enum {
+	OPT_threads	= 255,
+};
+
 void trace_mem(int argc, char **argv)
 {
 	struct tracecmd_input *handle;
 	const char *input_file = NULL;
+	int nr_threads = 0;
 	int ret;
 
 	for (;;) {
 		int c;
-
-		c = getopt(argc-1, argv+1, "+hi:");
+		int option_index = 0;
+		static struct option long_options[] = {
+			{"threads", required_argument, NULL, OPT_threads},
+			{"help", no_argument, NULL, '?'},
+			{NULL, 0, NULL, 0}
+		};
+
+		c = getopt_long (argc-1, argv+1, "+hi:",
+			long_options, &option_index);
 		if (c == -1)
 			break;
 		switch (c) {
@@ -536,6 +1115,9 @@ void trace_mem(int argc, char **argv)
 				die("Only one input for mem");
 			input_file = optarg;
 			break;
+		case OPT_threads:
+			nr_threads = atoi(optarg);
+			break;
 		default:
 			usage(argv);
 		}
@@ -558,7 +1140,7 @@ void trace_mem(int argc, char **argv)
 	if (ret)
 		return;
 
-	do_trace_mem(handle);
+	do_trace_mem(handle, input_file, nr_threads);
 
 	tracecmd_close(handle);
 }
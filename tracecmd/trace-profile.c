@@ -9,6 +9,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 #ifndef NO_AUDIT
 #include <libaudit.h>
 #endif
@@ -121,6 +122,22 @@ struct start_data {
 	struct stack_holder	stack;
 };
 
+/*
+ * Log-bucketed histogram of the times of an event. Values below
+ * HIST_SUB_BUCKETS have their own bucket. Every power of two above
+ * is split into HIST_SUB_BUCKETS buckets, which bounds the error of
+ * a percentile to 1/HIST_SUB_BUCKETS of its value. Only the range
+ * of buckets between the smallest and the largest value is allocated.
+ */
+#define HIST_SUB_BITS		4
+#define HIST_SUB_BUCKETS	(1 << HIST_SUB_BITS)
+
+struct latency_hist {
+	unsigned long long	*counts;
+	int			lo;
+	int			hi;
+};
+
 struct event_hash {
 	struct trace_hash_item	hash;
 	struct event_data	*event_data;
@@ -136,6 +153,7 @@ struct event_hash {
 	unsigned long long	time_std;
 	unsigned long long	last_time;
 
+	struct latency_hist	hist;
 	struct trace_hash	stacks;
 };
 
@@ -209,6 +227,143 @@ void trace_profile_set_merge_like_comms(void)
 	merge_like_comms = true;
 }
 
+static int hist_bucket(unsigned long long val)
+{
+	int bits;
+
+	if (val < HIST_SUB_BUCKETS)
+		return val;
+
+	bits = 63 - __builtin_clzll(val);
+
+	return ((bits - HIST_SUB_BITS + 1) << HIST_SUB_BITS) +
+		((val >> (bits - HIST_SUB_BITS)) & (HIST_SUB_BUCKETS - 1));
+}
+
+/* The smallest value of the bucket, and the size of the bucket */
+static unsigned long long hist_bucket_start(int bucket, unsigned long long *size)
+{
+	int shift;
+
+	if (bucket < HIST_SUB_BUCKETS) {
+		*size = 1;
+		return bucket;
+	}
+
+	shift = (bucket >> HIST_SUB_BITS) - 1;
+	*size = 1ULL << shift;
+
+	return (unsigned long long)(HIST_SUB_BUCKETS +
+				    (bucket & (HIST_SUB_BUCKETS - 1))) << shift;
+}
+
+static int hist_resize(struct latency_hist *hist, int lo, int hi)
+{
+	unsigned long long *counts;
+
+	if (hist->counts) {
+		if (lo > hist->lo)
+			lo = hist->lo;
+		if (hi < hist->hi)
+			hi = hist->hi;
+	}
+
+	counts = calloc(hi - lo + 1, sizeof(*counts));
+	if (!counts)
+		return -1;
+
+	if (hist->counts) {
+		memcpy(counts + hist->lo - lo, hist->counts,
+		       (hist->hi - hist->lo + 1) * sizeof(*counts));
+		free(hist->counts);
+	}
+
+	hist->counts = counts;
+	hist->lo = lo;
+	hist->hi = hi;
+
+	return 0;
+}
+
+static void hist_add(struct latency_hist *hist, unsigned long long val,
+		     unsigned long long count)
+{
+	int bucket = hist_bucket(val);
+
+	if (!hist->counts || bucket < hist->lo || bucket > hist->hi) {
+		if (hist_resize(hist, bucket, bucket) < 0) {
+			warning("Could not allocate histogram");
+			return;
+		}
+	}
+
+	hist->counts[bucket - hist->lo] += count;
+}
+
+static void hist_merge(struct latency_hist *hist, struct latency_hist *from)
+{
+	int i;
+
+	if (!from->counts)
+		return;
+
+	if (!hist->counts || from->lo < hist->lo || from->hi > hist->hi) {
+		if (hist_resize(hist, from->lo, from->hi) < 0) {
+			warning("Could not allocate histogram");
+			return;
+		}
+	}
+
+	for (i = from->lo; i <= from->hi; i++)
+		hist->counts[i - hist->lo] += from->counts[i - from->lo];
+}
+
+static void hist_free(struct latency_hist *hist)
+{
+	free(hist->counts);
+	hist->counts = NULL;
+}
+
+/*
+ * Return the value below which @percent percent of the values are.
+ * The middle of the bucket is used, limited by the known min and max.
+ */
+static unsigned long long
+hist_percentile(struct latency_hist *hist, double percent,
+		unsigned long long min, unsigned long long max)
+{
+	unsigned long long total = 0;
+	unsigned long long rank;
+	unsigned long long size;
+	unsigned long long val;
+	int i;
+
+	if (!hist->counts)
+		return 0;
+
+	for (i = 0; i <= hist->hi - hist->lo; i++)
+		total += hist->counts[i];
+
+	rank = (unsigned long long)(percent * total / 100.0 + 0.999999);
+	if (!rank)
+		rank = 1;
+
+	for (i = 0, total = 0; i < hist->hi - hist->lo; i++) {
+		total += hist->counts[i];
+		if (total >= rank)
+			break;
+	}
+
+	val = hist_bucket_start(i + hist->lo, &size);
+	val += size / 2;
+
+	if (val < min)
+		return min;
+	if (val > max)
+		return max;
+	return val;
+}
+
 static struct start_data *
 add_start(struct task_data *task,
 	  struct event_data *event_data, struct tep_record *record,
@@ -433,6 +588,8 @@ add_and_free_start(struct task_data *task, struct start_data *start,
 		event_hash->ts_min = ts;
 	}
 
+	hist_add(&event_hash->hist, delta, 1);
+
 	if (start->stack.record) {
 		unsigned long size;
 		void *caller;
@@ -1960,6 +2117,17 @@ static void output_event(struct event_hash *event_hash)
 	}
 	printf("\n");
 
+	if (event_hash->time_total && event_hash->count > 1)
+		printf("    Percentiles: p50: %lld p90: %lld p99: %lld p99.9: %lld\n",
+		       hist_percentile(&event_hash->hist, 50,
+				       event_hash->time_min, event_hash->time_max),
+		       hist_percentile(&event_hash->hist, 90,
+				       event_hash->time_min, event_hash->time_max),
+		       hist_percentile(&event_hash->hist, 99,
+				       event_hash->time_min, event_hash->time_max),
+		       hist_percentile(&event_hash->hist, 99.9,
+				       event_hash->time_min, event_hash->time_max));
+
 	output_stacks(pevent, &event_hash->stacks);
 }
 
@@ -2122,6 +2290,7 @@ static void free_event_hash(struct event_hash *event_hash)
 		}
 	}
 	trace_hash_free(&event_hash->stacks);
+	hist_free(&event_hash->hist);
 	free(event_hash);
 }
 
@@ -2331,37 +2500,22 @@ static void merge_stacks(struct event_hash *exist, struct event_hash *event)
 	}
 }
 
-static void merge_event_into_group(struct group_data *group,
-				   struct event_hash *event)
+static void merge_event_into_hash(struct trace_hash *hash,
+				  struct event_hash *event,
+				  unsigned long long key)
 {
 	struct event_hash *exist;
 	struct trace_hash_item *item;
 	struct event_data_match edata;
-	unsigned long long key;
-
-	if (event->event_data->type == EVENT_TYPE_WAKEUP) {
-		edata.event_data = event->event_data;
-		event->search_val = 0;
-		event->val = 0;
-		key = trace_hash((unsigned long)event->event_data);
-	} else if (event->event_data->type == EVENT_TYPE_SCHED_SWITCH) {
-		edata.event_data = event->event_data;
-		event->search_val = event->val;
-		key = (unsigned long)event->event_data +
-			((unsigned long)event->val * 2);
-		key = trace_hash(key);
-	} else {
-		key = event->hash.key;
-	}
 
 	edata.event_data = event->event_data;
 	edata.search_val = event->search_val;
 	edata.val = event->val;
 
-	item = trace_hash_find(&group->event_hash, key, match_event, &edata);
+	item = trace_hash_find(hash, key, match_event, &edata);
 	if (!item) {
 		event->hash.key = key;
-		trace_hash_add(&group->event_hash, &event->hash);
+		trace_hash_add(hash, &event->hash);
 		return;
 	}
 
@@ -2378,10 +2532,32 @@ static void merge_event_into_group(struct group_data *group,
 		exist->ts_min = event->ts_min;
 	}
 
+	hist_merge(&exist->hist, &event->hist);
 	merge_stacks(exist, event);
 	free_event_hash(event);
 }
 
+static void merge_event_into_group(struct group_data *group,
+				   struct event_hash *event)
+{
+	unsigned long long key;
+
+	if (event->event_data->type == EVENT_TYPE_WAKEUP) {
+		event->search_val = 0;
+		event->val = 0;
+		key = trace_hash((unsigned long)event->event_data);
+	} else if (event->event_data->type == EVENT_TYPE_SCHED_SWITCH) {
+		event->search_val = event->val;
+		key = (unsigned long)event->event_data +
+			((unsigned long)event->val * 2);
+		key = trace_hash(key);
+	} else {
+		key = event->hash.key;
+	}
+
+	merge_event_into_hash(&group->event_hash, event, key);
+}
+
 static void add_group(struct handle_data *h, struct task_data *task)
 {
 	unsigned long long key;
@@ -2453,3 +2629,503 @@ int do_trace_profile(void)
 
 	return 0;
 }
+
+/*
+ * Parallel processing of the trace data.
+ *
+ * The records of each CPU are read and decoded by worker threads, each
+ * one with its own input handle. Records of events that are neither part
+ * of a start/end pair nor have a special handler only add to a counter,
+ * hence they are counted locally for each CPU and the counts are merged
+ * at the end, in CPU order.
+ *
+ * Everything else is still done by the main thread, in time order. It
+ * merges the CPUs by timestamp the same way tracecmd_read_next_data()
+ * does. The other records are copied and fed to trace_profile_record(),
+ * so the start and end events are matched and the stacks are attached
+ * exactly as in the serial case, even across CPUs. For the counted
+ * events, the main thread only updates the state of the task that the
+ * next stack trace or start event depends on.
+ */
+#define PROFILE_CHUNK_ENTRIES	4096
+#define PROFILE_MAX_CHUNKS	8
+
+struct profile_entry {
+	unsigned long long	ts;
+	/* Copy of the record, if it must be processed by the main thread */
+	struct tep_record	*record;
+	/* Set if the event is counted on the CPU */
+	struct event_data	*event_data;
+	unsigned long long	pid;
+	unsigned long long	val;
+	int			missed;
+};
+
+struct profile_chunk {
+	struct profile_chunk	*next;
+	int			nr;
+	int			pos;
+	struct profile_entry	entries[PROFILE_CHUNK_ENTRIES];
+};
+
+struct profile_cpu {
+	struct tracecmd_input	*handle;
+	int			cpu;
+	int			done;
+	int			after_stack;
+
+	/* Chunks ready to be processed by the main thread */
+	struct profile_chunk	*head;
+	struct profile_chunk	*tail;
+	int			nr_chunks;
+
+	/* The chunk being processed by the main thread */
+	struct profile_chunk	*curr;
+
+	/* Tasks of the events accounted on this CPU */
+	struct trace_hash	task_hash;
+};
+
+struct profile_parallel;
+
+struct profile_worker {
+	struct profile_parallel	*pp;
+	pthread_t		thread;
+	int			id;
+};
+
+struct profile_parallel {
+	struct handle_data	*h;
+	struct profile_cpu	*cpus;
+	int			nr_cpus;
+	int			nr_workers;
+	pthread_mutex_t		lock;
+	pthread_cond_t		data_cond;
+	pthread_cond_t		space_cond;
+};
+
+static int is_local_event(struct event_data *event_data)
+{
+	return !event_data->handle_event && !event_data->start &&
+		!event_data->end && !event_data->pid_field;
+}
+
+static int is_stack_record(struct tep_handle *pevent, struct tep_record *record)
+{
+	return stacktrace_event &&
+		tep_data_type(pevent, record) == stacktrace_event->id;
+}
+
+static struct task_data *
+find_local_task(struct trace_hash *task_hash, int pid)
+{
+	unsigned long long key = trace_hash(pid);
+	struct trace_hash_item *item;
+	struct task_data *task;
+	unsigned long data = pid;
+
+	item = trace_hash_find(task_hash, key, match_task, &data);
+	if (item)
+		return task_from_item(item);
+
+	task = malloc(sizeof(*task));
+	if (!task)
+		die("Could not allocate task");
+	memset(task, 0, sizeof(*task));
+
+	task->pid = pid;
+	task->hash.key = key;
+	trace_hash_add(task_hash, &task->hash);
+
+	init_task(NULL, task);
+
+	return task;
+}
+
+static struct tep_record *copy_record(struct tep_record *record)
+{
+	struct tep_record *copy;
+
+	copy = malloc(sizeof(*copy) + record->size);
+	if (!copy)
+		die("Could not allocate record");
+	memset(copy, 0, sizeof(*copy));
+
+	copy->ts = record->ts;
+	copy->offset = record->offset;
+	copy->missed_events = record->missed_events;
+	copy->record_size = record->record_size;
+	copy->size = record->size;
+	copy->cpu = record->cpu;
+	copy->data = copy + 1;
+	memcpy(copy->data, record->data, record->size);
+	copy->ref_count = 1;
+
+	return copy;
+}
+
+/* Count an event without a start or an end on its CPU */
+static void
+account_local_event(struct handle_data *h, struct profile_cpu *pc,
+		    struct event_data *event_data, struct tep_record *record,
+		    unsigned long long *pid, unsigned long long *val)
+{
+	struct event_data_match edata;
+	struct event_hash *event_hash;
+	struct task_data *task;
+
+	tep_read_number_field(h->common_pid, record->data, pid);
+
+	*val = 0;
+	if (event_data->data_field)
+		tep_read_number_field(event_data->data_field,
+				      record->data, val);
+
+	task = find_local_task(&pc->task_hash, *pid);
+
+	edata.event_data = event_data;
+	edata.search_val = *val;
+	edata.val = *val;
+
+	event_hash = find_event_hash(task, &edata);
+	if (!event_hash)
+		die("failed to allocate event_hash");
+
+	event_hash->count++;
+}
+
+static struct profile_chunk *
+read_profile_chunk(struct profile_parallel *pp, struct profile_cpu *pc,
+		   int *done)
+{
+	struct tep_handle *pevent = tracecmd_get_pevent(pc->handle);
+	struct handle_data *h = pp->h;
+	struct profile_chunk *chunk;
+	struct profile_entry *entry;
+	struct event_data *event_data;
+	struct tep_record *record;
+	struct tep_record *next;
+	unsigned long long pid;
+	unsigned long long val;
+	int next_stack;
+	int local;
+
+	chunk = malloc(sizeof(*chunk));
+	if (!chunk)
+		die("Could not allocate profile chunk");
+	chunk->next = NULL;
+	chunk->nr = 0;
+	chunk->pos = 0;
+
+	*done = 0;
+
+	while (chunk->nr < PROFILE_CHUNK_ENTRIES) {
+		record = tracecmd_read_data(pc->handle, pc->cpu);
+		if (!record) {
+			*done = 1;
+			break;
+		}
+		next = tracecmd_peek_data(pc->handle, pc->cpu);
+		next_stack = next && is_stack_record(pevent, next);
+
+		event_data = find_event_data(h, tep_data_type(pevent, record));
+
+		/*
+		 * Stack traces are recorded right after the event they belong
+		 * to. The events around them must go through the main thread
+		 * to attach the stacks the same way as the serial case does.
+		 */
+		local = event_data && is_local_event(event_data) &&
+			!pc->after_stack && !next_stack;
+
+		entry = &chunk->entries[chunk->nr];
+		memset(entry, 0, sizeof(*entry));
+		entry->ts = record->ts;
+
+		if (local) {
+			account_local_event(h, pc, event_data, record,
+					    &pid, &val);
+			entry->event_data = event_data;
+			entry->pid = pid;
+			entry->val = val;
+		} else if (event_data) {
+			entry->record = copy_record(record);
+		}
+
+		entry->missed = record->missed_events != 0;
+
+		/*
+		 * The main thread only needs to see a record of an event that
+		 * is not profiled if it has missed events before it, or if its
+		 * timestamp goes back in time. The latter changes the order in
+		 * which the CPUs are merged by timestamp.
+		 */
+		if (entry->record || entry->event_data || entry->missed ||
+		    (next && next->ts < record->ts))
+			chunk->nr++;
+
+		pc->after_stack = event_data && event_data == stacktrace_event;
+
+		free_record(record);
+	}
+
+	return chunk;
+}
+
+static struct profile_cpu *
+next_worker_cpu(struct profile_parallel *pp, int id, int *all_done)
+{
+	struct profile_cpu *pc = NULL;
+	struct profile_cpu *c;
+	int cpu;
+
+	*all_done = 1;
+
+	/* Fill the CPU that the main thread is most likely to wait on */
+	for (cpu = id; cpu < pp->nr_cpus; cpu += pp->nr_workers) {
+		c = &pp->cpus[cpu];
+		if (c->done)
+			continue;
+		*all_done = 0;
+		if (c->nr_chunks >= PROFILE_MAX_CHUNKS)
+			continue;
+		if (!pc || c->nr_chunks < pc->nr_chunks)
+			pc = c;
+	}
+
+	return pc;
+}
+
+static void *profile_worker(void *data)
+{
+	struct profile_worker *worker = data;
+	struct profile_parallel *pp = worker->pp;
+	struct profile_chunk *chunk;
+	struct profile_cpu *pc;
+	int all_done;
+	int done;
+
+	for (;;) {
+		pthread_mutex_lock(&pp->lock);
+		while (!(pc = next_worker_cpu(pp, worker->id, &all_done)) &&
+		       !all_done)
+			pthread_cond_wait(&pp->space_cond, &pp->lock);
+		pthread_mutex_unlock(&pp->lock);
+
+		if (!pc)
+			break;
+
+		chunk = read_profile_chunk(pp, pc, &done);
+
+		pthread_mutex_lock(&pp->lock);
+		if (chunk->nr) {
+			if (pc->tail)
+				pc->tail->next = chunk;
+			else
+				pc->head = chunk;
+			pc->tail = chunk;
+			pc->nr_chunks++;
+		} else {
+			free(chunk);
+		}
+		pc->done = done;
+		pthread_cond_broadcast(&pp->data_cond);
+		pthread_mutex_unlock(&pp->lock);
+	}
+
+	return NULL;
+}
+
+static struct profile_entry *
+peek_profile_entry(struct profile_parallel *pp, struct profile_cpu *pc)
+{
+	struct profile_chunk *chunk = pc->curr;
+
+	if (chunk && chunk->pos < chunk->nr)
+		return &chunk->entries[chunk->pos];
+
+	free(chunk);
+
+	pthread_mutex_lock(&pp->lock);
+	while (!pc->head && !pc->done)
+		pthread_cond_wait(&pp->data_cond, &pp->lock);
+
+	chunk = pc->head;
+	if (chunk) {
+		pc->head = chunk->next;
+		if (!pc->head)
+			pc->tail = NULL;
+		pc->nr_chunks--;
+		pthread_cond_broadcast(&pp->space_cond);
+	}
+	pthread_mutex_unlock(&pp->lock);
+
+	pc->curr = chunk;
+
+	return chunk ? &chunk->entries[0] : NULL;
+}
+
+static void replay_profile_entry(struct handle_data *h,
+				 struct profile_entry *entry, int cpu)
+{
+	struct event_data_match edata;
+	struct task_data *task;
+
+	if (entry->record) {
+		trace_profile_record(h->handle, entry->record);
+		free_record(entry->record);
+		return;
+	}
+
+	if (entry->missed)
+		handle_missed_events(h, cpu);
+
+	if (!entry->event_data)
+		return;
+
+	/*
+	 * Do what trace_profile_record() and handle_event_data() do with
+	 * the task, in the same order. This also creates the task and its
+	 * event in the same order as the serial case. The counts are added
+	 * by merge_local_events().
+	 */
+	task = find_task(h, entry->pid);
+	if (!task)
+		return;
+
+	if (task->last_stack) {
+		free_record(task->last_stack);
+		task->last_stack = NULL;
+	}
+	task->proxy = NULL;
+	task->last_start = NULL;
+
+	edata.event_data = entry->event_data;
+	edata.search_val = entry->val;
+	edata.val = entry->val;
+	task->last_event = find_event_hash(task, &edata);
+}
+
+static void merge_local_events(struct handle_data *h, struct profile_cpu *pc)
+{
+	struct trace_hash_item **bucket;
+	struct trace_hash_item **ebucket;
+	struct trace_hash_item *item;
+	struct trace_hash_item *eitem;
+	struct event_hash *event_hash;
+	struct task_data *local;
+	struct task_data *task;
+
+	trace_hash_for_each_bucket(bucket, &pc->task_hash) {
+		trace_hash_while_item(item, bucket) {
+			local = task_from_item(item);
+			trace_hash_del(item);
+
+			task = find_task(h, local->pid);
+			trace_hash_for_each_bucket(ebucket, &local->event_hash) {
+				trace_hash_while_item(eitem, ebucket) {
+					event_hash = event_from_item(eitem);
+					trace_hash_del(eitem);
+					if (task)
+						merge_event_into_hash(&task->event_hash,
+								      event_hash,
+								      event_hash->hash.key);
+					else
+						free_event_hash(event_hash);
+				}
+			}
+			free_task(local);
+		}
+	}
+	trace_hash_free(&pc->task_hash);
+}
+
+/**
+ * trace_profile_read_parallel - profile the trace data with several threads
+ * @handle: The input handle, initialized with trace_init_profile()
+ * @inputs: Additional handles of the same trace data, one per thread
+ * @nr_inputs: The number of handles in @inputs
+ *
+ * Reads all the records of @handle and accounts them the same way as
+ * passing them to trace_show_data() in order would. The records of each
+ * CPU are read by using one of the @inputs handles.
+ *
+ * Returns 0 on success, or -1 if @handle is not being profiled.
+ */
+int trace_profile_read_parallel(struct tracecmd_input *handle,
+				struct tracecmd_input **inputs, int nr_inputs)
+{
+	struct profile_worker *workers;
+	struct profile_parallel pp;
+	struct profile_entry *entry;
+	struct profile_entry *next;
+	struct handle_data *h;
+	int next_cpu = -1;
+	int cpu;
+	int i;
+
+	for (h = handles; h; h = h->next) {
+		if (h->handle == handle)
+			break;
+	}
+	if (!h || nr_inputs < 1)
+		return -1;
+
+	memset(&pp, 0, sizeof(pp));
+	pp.h = h;
+	pp.nr_cpus = tracecmd_cpus(handle);
+	pp.nr_workers = nr_inputs < pp.nr_cpus ? nr_inputs : pp.nr_cpus;
+	pthread_mutex_init(&pp.lock, NULL);
+	pthread_cond_init(&pp.data_cond, NULL);
+	pthread_cond_init(&pp.space_cond, NULL);
+
+	pp.cpus = calloc(pp.nr_cpus, sizeof(*pp.cpus));
+	workers = calloc(pp.nr_workers, sizeof(*workers));
+	if (!pp.cpus || !workers)
+		die("Could not allocate profile threads");
+
+	for (cpu = 0; cpu < pp.nr_cpus; cpu++) {
+		pp.cpus[cpu].cpu = cpu;
+		pp.cpus[cpu].handle = inputs[cpu % pp.nr_workers];
+		trace_hash_init(&pp.cpus[cpu].task_hash, 1024);
+	}
+
+	for (i = 0; i < pp.nr_workers; i++) {
+		workers[i].pp = &pp;
+		workers[i].id = i;
+		if (pthread_create(&workers[i].thread, NULL,
+				   profile_worker, &workers[i]))
+			die("Could not create profile thread");
+	}
+
+	for (;;) {
+		next = NULL;
+		for (cpu = 0; cpu < pp.nr_cpus; cpu++) {
+			entry = peek_profile_entry(&pp, &pp.cpus[cpu]);
+			if (entry && (!next || entry->ts < next->ts)) {
+				next = entry;
+				next_cpu = cpu;
+			}
+		}
+		if (!next)
+			break;
+
+		replay_profile_entry(h, next, next_cpu);
+		pp.cpus[next_cpu].curr->pos++;
+	}
+
+	for (i = 0; i < pp.nr_workers; i++)
+		pthread_join(workers[i].thread, NULL);
+
+	/* Merge in CPU order, to keep the result deterministic */
+	for (cpu = 0; cpu < pp.nr_cpus; cpu++)
+		merge_local_events(h, &pp.cpus[cpu]);
+
+	pthread_cond_destroy(&pp.space_cond);
+	pthread_cond_destroy(&pp.data_cond);
+	pthread_mutex_destroy(&pp.lock);
+	free(workers);
+	free(pp.cpus);
+
+	return 0;
+}
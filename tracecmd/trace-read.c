@@ -19,6 +19,7 @@
 #include <unistd.h>
 #include <ctype.h>
 #include <errno.h>
+#include <pthread.h>
 
 #include "trace-local.h"
 #include "trace-hash.h"
@@ -49,6 +50,7 @@ struct handle_list {
 	const char		*file;
 	int			cpus;
 	int			done;
+	int			printed;
 	struct tep_record	*record;
 	struct filter		*event_filters;
 	struct filter		*event_filter_out;
@@ -92,6 +94,9 @@ static int sched_id;
 static int stacktrace_id;
 
 static int profile;
+static int nr_threads;
+static struct tracecmd_input **profile_inputs;
+static int nr_profile_inputs;
 
 static int buffer_breaks = 0;
 
@@ -778,14 +783,19 @@ static void finish_wakeup(void)
 	trace_hash_free(&wakeup_hash);
 }
 
-void trace_show_data(struct tracecmd_input *handle, struct tep_record *record)
+/*
+ * Format a record into @s, without the trailing new line. This does not
+ * change any state (unless the event has its own handler, or with the
+ * --ts-diff and --debug options), hence records of different CPUs can be
+ * formatted by different threads.
+ */
+static void show_data_seq(struct trace_seq *s, struct tracecmd_input *handle,
+			  struct tep_record *record)
 {
-	tracecmd_show_data_func func = tracecmd_get_show_data_func(handle);
 	const char *lfmt = latency_format ? "%8.8s-%-5d %3d" : "%16s-%-5d [%03d]";
 	const char *tfmt = tracecmd_get_flags(handle) & TRACECMD_FL_IN_USECS ? " %6.1000d:" : "%12d:";
 	struct tep_handle *pevent;
 	struct tep_event *event;
-	struct trace_seq s;
 	int cpu = record->cpu;
 	bool use_trace_clock;
 	static unsigned long long last_ts;
@@ -795,37 +805,29 @@ void trace_show_data(struct tracecmd_input *handle, struct tep_record *record)
 
 	page_size = tracecmd_page_size(handle);
 
-	test_save(record, cpu);
-
-	if (func) {
-		func(handle, record);
-		return;
-	}
-
 	pevent = tracecmd_get_pevent(handle);
 	event = tep_find_event_by_record(pevent, record);
 	use_trace_clock = tracecmd_get_use_trace_clock(handle);
 
-	trace_seq_init(&s);
 	if (record->missed_events > 0)
-		trace_seq_printf(&s, "CPU:%d [%lld EVENTS DROPPED]\n",
+		trace_seq_printf(s, "CPU:%d [%lld EVENTS DROPPED]\n",
 				 cpu, record->missed_events);
 	else if (record->missed_events < 0)
-		trace_seq_printf(&s, "CPU:%d [EVENTS DROPPED]\n", cpu);
+		trace_seq_printf(s, "CPU:%d [EVENTS DROPPED]\n", cpu);
 	if (buffer_breaks || tracecmd_get_debug()) {
 		if (tracecmd_record_at_buffer_start(handle, record)) {
-			trace_seq_printf(&s, "CPU:%d [SUBBUFFER START]", cpu);
+			trace_seq_printf(s, "CPU:%d [SUBBUFFER START]", cpu);
 			if (tracecmd_get_debug())
-				trace_seq_printf(&s, " [%lld:0x%llx]",
+				trace_seq_printf(s, " [%lld:0x%llx]",
 						 tracecmd_page_ts(handle, record),
 						 record->offset & ~(page_size - 1));
-			trace_seq_putc(&s, '\n');
+			trace_seq_putc(s, '\n');
 		}
 	}
 
-	tep_print_event(pevent, &s, record, lfmt, TEP_PRINT_COMM,
+	tep_print_event(pevent, s, record, lfmt, TEP_PRINT_COMM,
 			TEP_PRINT_PID, TEP_PRINT_CPU);
-	tep_print_event(pevent, &s, record, tfmt, TEP_PRINT_TIME);
+	tep_print_event(pevent, s, record, tfmt, TEP_PRINT_TIME);
 
 	if (tsdiff) {
 		unsigned long long rec_ts = record->ts;
@@ -839,21 +841,21 @@ void trace_show_data(struct tracecmd_input *handle, struct tep_record *record)
 			buf[49] = 0;
 		}
 		last_ts = rec_ts;
-		trace_seq_printf(&s, " %-8s", buf);
+		trace_seq_printf(s, " %-8s", buf);
 	}
 
-	print_event_name(&s, event);
-	tep_print_event(pevent, &s, record, "%s", format_type);
+	print_event_name(s, event);
+	tep_print_event(pevent, s, record, "%s", format_type);
 
-	if (s.len && *(s.buffer + s.len - 1) == '\n')
-		s.len--;
+	if (s->len && *(s->buffer + s->len - 1) == '\n')
+		s->len--;
 	if (tracecmd_get_debug()) {
 		struct kbuffer *kbuf;
 		struct kbuffer_raw_info info;
 		void *page;
 		void *offset;
 
-		trace_seq_printf(&s, " [%d:0x%llx:%d]",
+		trace_seq_printf(s, " [%d:0x%llx:%d]",
 				 tracecmd_record_ts_delta(handle, record),
 				 record->offset & (page_size - 1), record->size);
 		kbuf = tracecmd_record_kbuf(handle, record);
@@ -871,26 +873,41 @@ void trace_show_data(struct tracecmd_input *handle, struct tep_record *record)
 					break;
 				switch (pi->type) {
 				case KBUFFER_TYPE_PADDING:
-					trace_seq_printf(&s, "\n PADDING: ");
+					trace_seq_printf(s, "\n PADDING: ");
 					break;
 				case KBUFFER_TYPE_TIME_EXTEND:
-					trace_seq_printf(&s, "\n TIME EXTEND: ");
+					trace_seq_printf(s, "\n TIME EXTEND: ");
 					break;
 				case KBUFFER_TYPE_TIME_STAMP:
-					trace_seq_printf(&s, "\n TIME STAMP?: ");
+					trace_seq_printf(s, "\n TIME STAMP?: ");
 					break;
 				}
-				trace_seq_printf(&s, "delta:%lld length:%d",
+				trace_seq_printf(s, "delta:%lld length:%d",
 						 pi->delta,
 						 pi->length);
 			}
 		}
 	}
+}
+
+void trace_show_data(struct tracecmd_input *handle, struct tep_record *record)
+{
+	tracecmd_show_data_func func = tracecmd_get_show_data_func(handle);
+	struct trace_seq s;
+
+	test_save(record, record->cpu);
+
+	if (func) {
+		func(handle, record);
+		return;
+	}
 
+	trace_seq_init(&s);
+	show_data_seq(&s, handle, record);
 	trace_seq_do_printf(&s);
 	trace_seq_destroy(&s);
 
-	process_wakeup(pevent, record);
+	process_wakeup(tracecmd_get_pevent(handle), record);
 
 	printf("\n");
 }
@@ -1139,6 +1156,406 @@ static void free_filters(struct filter *event_filter)
 	}
 }
 
+/*
+ * Open additional handles of the trace data, used by the threads of
+ * trace_profile_read_parallel(). The headers are read later by
+ * init_profile_inputs(), once the number of CPUs is known.
+ */
+static void open_profile_inputs(const char *file, int no_date,
+				unsigned long long tsoffset,
+				unsigned long long ts2secs)
+{
+	struct tracecmd_input *handle;
+	int i;
+
+	profile_inputs = calloc(nr_threads, sizeof(*profile_inputs));
+	if (!profile_inputs)
+		die("Failed to allocate profile handles");
+
+	for (i = 0; i < nr_threads; i++) {
+		handle = tracecmd_alloc(file);
+		if (!handle)
+			break;
+
+		/* The main handle already warns about the event formats */
+		tracecmd_set_flag(handle, TRACECMD_FL_QUIET);
+		tep_set_flag(tracecmd_get_pevent(handle), TEP_QUIET);
+		if (no_date)
+			tracecmd_set_flag(handle, TRACECMD_FL_IGNORE_DATE);
+		if (tsoffset)
+			tracecmd_set_ts_offset(handle, tsoffset);
+		if (ts2secs)
+			tracecmd_set_ts2secs(handle, ts2secs);
+
+		profile_inputs[nr_profile_inputs++] = handle;
+	}
+}
+
+/* There is no point in having more threads than CPUs in the trace */
+static void init_profile_inputs(int cpus)
+{
+	int nr = 0;
+	int i;
+
+	for (i = 0; i < nr_profile_inputs; i++) {
+		if (nr < cpus &&
+		    !tracecmd_read_headers(profile_inputs[i]) &&
+		    !tracecmd_init_data(profile_inputs[i]))
+			profile_inputs[nr++] = profile_inputs[i];
+		else
+			tracecmd_close(profile_inputs[i]);
+	}
+	nr_profile_inputs = nr;
+}
+
+static void close_profile_inputs(void)
+{
+	int i;
+
+	for (i = 0; i < nr_profile_inputs; i++)
+		tracecmd_close(profile_inputs[i]);
+	free(profile_inputs);
+	profile_inputs = NULL;
+	nr_profile_inputs = 0;
+}
+
+/*
+ * The pipelined report: the calling thread merges and filters the
+ * records, as the serial report does, and hands them over in chunks to
+ * a pool of threads that format them. A writer thread writes out the
+ * formatted chunks in the order they were filled.
+ */
+#define REPORT_CHUNK_SIZE	1024
+
+enum report_chunk_state {
+	REPORT_CHUNK_FREE,
+	REPORT_CHUNK_FILLED,
+	REPORT_CHUNK_FORMATTED,
+};
+
+struct report_entry {
+	struct handle_list	*handles;
+	struct tep_record	*record;
+	/* Offset into the early text of the chunk, or -1 */
+	int			text;
+};
+
+struct report_chunk {
+	struct report_entry	entries[REPORT_CHUNK_SIZE];
+	int			nr_entries;
+	enum report_chunk_state	state;
+	/* Records that the merging thread had to format itself */
+	struct trace_seq	early;
+	struct trace_seq	out;
+};
+
+struct report_pipe {
+	pthread_mutex_t		lock;
+	pthread_cond_t		cond;
+	/* Held for write while an event handler formats a record */
+	pthread_rwlock_t	print_lock;
+	struct report_chunk	*chunks;
+	int			nr_chunks;
+	unsigned long		filled;
+	unsigned long		taken;
+	unsigned long		written;
+	bool			done;
+};
+
+static void seq_handle_file(struct trace_seq *s, struct handle_list *handles)
+{
+	/* Same as print_handle_file() */
+	if (!multi_inputs && !instances)
+		return;
+	if (handles->file)
+		trace_seq_printf(s, "%*s: ", max_file_size, handles->file);
+	else
+		trace_seq_printf(s, "%*s  ", max_file_size, "");
+}
+
+static void *report_worker(void *data)
+{
+	struct report_pipe *rp = data;
+	struct report_chunk *chunk;
+	struct report_entry *entry;
+	struct trace_seq s;
+	int i;
+
+	trace_seq_init(&s);
+
+	for (;;) {
+		pthread_mutex_lock(&rp->lock);
+		while (rp->taken == rp->filled && !rp->done)
+			pthread_cond_wait(&rp->cond, &rp->lock);
+		if (rp->taken == rp->filled) {
+			pthread_mutex_unlock(&rp->lock);
+			break;
+		}
+		chunk = &rp->chunks[rp->taken++ % rp->nr_chunks];
+		pthread_mutex_unlock(&rp->lock);
+
+		for (i = 0; i < chunk->nr_entries; i++) {
+			entry = &chunk->entries[i];
+			if (entry->text >= 0) {
+				trace_seq_puts(&chunk->out,
+					       chunk->early.buffer + entry->text);
+				continue;
+			}
+
+			seq_handle_file(&chunk->out, entry->handles);
+
+			trace_seq_reset(&s);
+			pthread_rwlock_rdlock(&rp->print_lock);
+			show_data_seq(&s, entry->handles->handle, entry->record);
+			pthread_rwlock_unlock(&rp->print_lock);
+
+			trace_seq_printf(&chunk->out, "%.*s\n", s.len, s.buffer);
+		}
+
+		pthread_mutex_lock(&rp->lock);
+		chunk->state = REPORT_CHUNK_FORMATTED;
+		pthread_cond_broadcast(&rp->cond);
+		pthread_mutex_unlock(&rp->lock);
+	}
+
+	trace_seq_destroy(&s);
+
+	return NULL;
+}
+
+static void *report_writer(void *data)
+{
+	struct report_pipe *rp = data;
+	struct report_chunk *chunk;
+
+	for (;;) {
+		pthread_mutex_lock(&rp->lock);
+		for (;;) {
+			chunk = &rp->chunks[rp->written % rp->nr_chunks];
+			if (rp->written < rp->filled &&
+			    chunk->state == REPORT_CHUNK_FORMATTED)
+				break;
+			if (rp->written == rp->filled && rp->done)
+				break;
+			pthread_cond_wait(&rp->cond, &rp->lock);
+		}
+		pthread_mutex_unlock(&rp->lock);
+
+		if (chunk->state != REPORT_CHUNK_FORMATTED)
+			break;
+
+		fwrite(chunk->out.buffer, 1, chunk->out.len, stdout);
+
+		pthread_mutex_lock(&rp->lock);
+		chunk->state = REPORT_CHUNK_FREE;
+		rp->written++;
+		pthread_cond_broadcast(&rp->cond);
+		pthread_mutex_unlock(&rp->lock);
+	}
+
+	return NULL;
+}
+
+static void free_chunk_records(struct report_chunk *chunk)
+{
+	int i;
+
+	for (i = 0; i < chunk->nr_entries; i++) {
+		if (chunk->entries[i].record)
+			free_record(chunk->entries[i].record);
+	}
+	chunk->nr_entries = 0;
+	trace_seq_reset(&chunk->early);
+	trace_seq_reset(&chunk->out);
+}
+
+/*
+ * Records of events with a handler are formatted right away, in the
+ * order of the trace: the handlers may keep state between records,
+ * register comms, or even read ahead in the trace data (the function
+ * graph handler does). The first record of each handle is formatted
+ * here as well, to settle what the first formatting looks up and caches.
+ */
+static bool report_early(struct handle_list *handles, struct tep_record *record)
+{
+	struct tep_handle *pevent = tracecmd_get_pevent(handles->handle);
+	struct tep_event *event;
+
+	if (!handles->printed) {
+		handles->printed = 1;
+		return true;
+	}
+
+	event = tep_find_event_by_record(pevent, record);
+
+	return !event ||
+		(event->handler && !(event->flags & TEP_EVENT_FL_NOHANDLE));
+}
+
+static void add_report_record(struct report_pipe *rp, struct trace_seq *s,
+			      struct report_chunk *chunk,
+			      struct handle_list *handles,
+			      struct tep_record *record)
+{
+	struct report_entry *entry = &chunk->entries[chunk->nr_entries];
+
+	test_save(record, record->cpu);
+
+	entry->handles = handles;
+	entry->record = record;
+	entry->text = -1;
+	chunk->nr_entries++;
+
+	if (report_early(handles, record)) {
+		trace_seq_reset(s);
+		pthread_rwlock_wrlock(&rp->print_lock);
+		show_data_seq(s, handles->handle, record);
+		pthread_rwlock_unlock(&rp->print_lock);
+
+		entry->text = chunk->early.len;
+		seq_handle_file(&chunk->early, handles);
+		trace_seq_printf(&chunk->early, "%.*s\n", s->len, s->buffer);
+		/* Terminate the text of this entry */
+		trace_seq_putc(&chunk->early, 0);
+	}
+}
+
+static bool can_report_parallel(struct list_head *handle_list)
+{
+	struct handle_list *handles;
+
+	/* The wakeup latencies are printed in between the records */
+	if (nr_threads < 2 || profile || show_wakeup || tsdiff ||
+	    buffer_breaks || tracecmd_get_debug())
+		return false;
+
+	list_for_each_entry(handles, handle_list, list) {
+		if (tracecmd_get_show_data_func(handles->handle))
+			return false;
+		if (tep_init_lookup_maps(tracecmd_get_pevent(handles->handle)))
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * Same as the loop in read_data_info(), but with the formatting of the
+ * records done by nr_threads threads. Returns -1 if the threads could
+ * not be started, in which case no record has been read.
+ */
+static int read_data_parallel(struct list_head *handle_list)
+{
+	struct report_pipe rp = {
+		.lock		= PTHREAD_MUTEX_INITIALIZER,
+		.cond		= PTHREAD_COND_INITIALIZER,
+		.print_lock	= PTHREAD_RWLOCK_INITIALIZER,
+	};
+	struct handle_list *handles;
+	struct handle_list *last_handle;
+	struct tep_record *record;
+	struct tep_record *last_record;
+	struct report_chunk *chunk;
+	pthread_t *threads;
+	struct trace_seq s;
+	int nr_started = 0;
+	int ret = -1;
+	int i;
+
+	rp.nr_chunks = nr_threads * 2 + 2;
+	rp.chunks = calloc(rp.nr_chunks, sizeof(*rp.chunks));
+	threads = calloc(nr_threads + 1, sizeof(*threads));
+	if (!rp.chunks || !threads)
+		goto out_free;
+
+	for (i = 0; i < rp.nr_chunks; i++) {
+		trace_seq_init(&rp.chunks[i].early);
+		trace_seq_init(&rp.chunks[i].out);
+	}
+
+	if (pthread_create(&threads[0], NULL, report_writer, &rp))
+		goto out_free;
+	for (nr_started = 1; nr_started <= nr_threads; nr_started++) {
+		if (pthread_create(&threads[nr_started], NULL,
+				   report_worker, &rp))
+			break;
+	}
+	if (nr_started == 1) {
+		/* Nothing was read yet, let the writer exit */
+		rp.done = true;
+		pthread_join(threads[0], NULL);
+		goto out_free;
+	}
+
+	/* Flush what was printed before, the writer uses stdout as well */
+	fflush(stdout);
+
+	trace_seq_init(&s);
+	chunk = &rp.chunks[0];
+
+	do {
+		last_handle = NULL;
+		last_record = NULL;
+
+		list_for_each_entry(handles, handle_list, list) {
+			record = get_next_record(handles);
+			if (!last_record ||
+			    (record && record->ts < last_record->ts)) {
+				last_record = record;
+				last_handle = handles;
+			}
+		}
+		if (last_record) {
+			add_report_record(&rp, &s, chunk, last_handle,
+					  last_record);
+			/* The chunk owns the record now */
+			last_handle->record = NULL;
+		}
+
+		if (chunk->nr_entries == REPORT_CHUNK_SIZE ||
+		    (!last_record && chunk->nr_entries)) {
+			pthread_mutex_lock(&rp.lock);
+			chunk->state = REPORT_CHUNK_FILLED;
+			rp.filled++;
+			pthread_cond_broadcast(&rp.cond);
+
+			/* Wait for the next chunk to be written out */
+			while (rp.filled - rp.written >= rp.nr_chunks)
+				pthread_cond_wait(&rp.cond, &rp.lock);
+			pthread_mutex_unlock(&rp.lock);
+
+			chunk = &rp.chunks[rp.filled % rp.nr_chunks];
+			free_chunk_records(chunk);
+		}
+	} while (last_record);
+
+	pthread_mutex_lock(&rp.lock);
+	rp.done = true;
+	pthread_cond_broadcast(&rp.cond);
+	pthread_mutex_unlock(&rp.lock);
+
+	trace_seq_destroy(&s);
+	ret = 0;
+
+	for (i = 0; i < nr_started; i++)
+		pthread_join(threads[i], NULL);
+
+	fflush(stdout);
+
+ out_free:
+	if (rp.chunks) {
+		for (i = 0; i < rp.nr_chunks; i++) {
+			free_chunk_records(&rp.chunks[i]);
+			trace_seq_destroy(&rp.chunks[i].early);
+			trace_seq_destroy(&rp.chunks[i].out);
+		}
+	}
+	free(rp.chunks);
+	free(threads);
+
+	return ret;
+}
+
 enum output_type {
 	OUTPUT_NORMAL,
 	OUTPUT_STAT_ONLY,
@@ -1237,6 +1654,24 @@ static void read_data_info(struct list_head *handle_list, enum output_type otype
 	if (otype != OUTPUT_NORMAL)
 		return;
 
+	/*
+	 * Without filters, a single trace can be profiled by several
+	 * threads, each reading its own handle of the file.
+	 */
+	handles = container_of(handle_list->next, struct handle_list, list);
+	if (nr_profile_inputs)
+		init_profile_inputs(handles->cpus);
+	if (profile && nr_profile_inputs > 1 && !multi_inputs && !instances &&
+	    !filter_cpus && !handles->event_filters &&
+	    !handles->event_filter_out &&
+	    !trace_profile_read_parallel(handles->handle, profile_inputs,
+					 nr_profile_inputs))
+		goto profile;
+
+	if (can_report_parallel(handle_list) &&
+	    !read_data_parallel(handle_list))
+		goto profile;
+
 	do {
 		last_handle = NULL;
 		last_record = NULL;
@@ -1256,6 +1691,7 @@ static void read_data_info(struct list_head *handle_list, enum output_type otype
 		}
 	} while (last_record);
 
+ profile:
 	if (profile)
 		do_trace_profile();
 
@@ -1349,10 +1785,11 @@ static void add_functions(struct tep_handle *pevent, const char *file)
 	if (ret < 0)
 		die("Can't stat file %s", file);
 
-	buf = malloc(st.st_size);
+	buf = malloc(st.st_size + 1);
 	if (!buf)
 		die("Failed to allocate for function buffer");
 	read_file_fd(fd, buf, st.st_size);
+	buf[st.st_size] = 0;
 	close(fd);
 	tracecmd_parse_proc_kallsyms(pevent, buf, st.st_size);
 	free(buf);
@@ -1420,6 +1857,7 @@ static void add_hook(const char *arg)
 }
 
 enum {
+	OPT_threads	= 237,
 	OPT_version	= 238,
 	OPT_tsdiff	= 239,
 	OPT_ts2secs	= 240,
@@ -1502,6 +1940,7 @@ void trace_report (int argc, char **argv)
 			{"boundary", no_argument, NULL, OPT_boundary},
 			{"debug", no_argument, NULL, OPT_debug},
 			{"profile", no_argument, NULL, OPT_profile},
+			{"threads", required_argument, NULL, OPT_threads},
 			{"uname", no_argument, NULL, OPT_uname},
 			{"version", no_argument, NULL, OPT_version},
 			{"by-comm", no_argument, NULL, OPT_bycomm},
@@ -1651,6 +2090,9 @@ void trace_report (int argc, char **argv)
 		case OPT_profile:
 			profile = 1;
 			break;
+		case OPT_threads:
+			nr_threads = atoi(optarg);
+			break;
 		case OPT_uname:
 			show_uname = 1;
 			break;
@@ -1726,6 +2168,10 @@ void trace_report (int argc, char **argv)
 		else if (ts2secs)
 			tracecmd_set_ts2secs(handle, ts2secs);
 
+		if (profile && nr_threads > 1 && !multi_inputs)
+			open_profile_inputs(inputs->file, no_date, inputs->tsoffset,
+					    inputs->ts2secs ? : ts2secs);
+
 		pevent = tracecmd_get_pevent(handle);
 
 		if (nanosec)
@@ -1811,6 +2257,7 @@ void trace_report (int argc, char **argv)
 	list_for_each_entry(handles, &handle_list, list) {
 		tracecmd_close(handles->handle);
 	}
+	close_profile_inputs();
 	free_handles();
 	free_inputs();
 
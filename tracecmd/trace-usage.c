@@ -174,6 +174,7 @@ static struct usage_help usage_help[] = {
 		"          -H Allows users to hook two events together for timings\n"
 		"             (used with --profile)\n"
 		"          --by-comm used with --profile, merge events for related comms\n"
+		"          --threads number of threads to format the data (or to read it, with --profile)\n"
 		"          --ts-offset will add amount to timestamp of all events of the\n"
 		"                     previous data file.\n"
 		"          --ts2secs HZ, pass in the timestamp frequency (per second)\n"
@@ -201,6 +202,7 @@ static struct usage_help usage_help[] = {
 		"show a histogram of the trace.dat information",
 		" %s hist [-i file][-P] [file]"
 		"          -P ignore pids (compact all functions)\n"
+		"          --threads number of threads to read the data\n"
 	},
 	{
 		"stat",